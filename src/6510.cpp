@@ -2,37 +2,149 @@
 #include "struse/struse.h"
 #include "6510.h"
 #include "Files.h"
+#include "MemSync.h"
 #include <malloc.h>
+#include <atomic>
 
-// for now support 1 CPU
+// main CPU, drive CPUs and other banks of main memory, all but the main CPU
+// are created when the UI thread first asks for them. slot 0 is the main CPU,
+// 1-4 the drives and the banks follow. The connection thread only looks up
+// CPUs that exist, a slot is set once its CPU is ready.
 
-static CPU6510* sp6510 = nullptr;
+enum { kNumMemSpaces = (int)VICEMemSpaces::Drive11 + 1, kFirstBankSlot = kNumMemSpaces - 1 };
 
+static std::atomic<CPU6510*> saCPUs[kNumCPUSlots];
 
-CPU6510::CPU6510() : space(VICEMemSpaces::MainMemory), memoryChanged(false)
+
+CPU6510::CPU6510() : space(VICEMemSpaces::MainMemory), bank(0), viewFrame(1), syncGeneration(0),
+	syncInFlight(0), regsFresh(true), receivedGeneration(0), publishedGeneration(0), receivedRegsNew(false),
+	memoryChanged(false)
 {
 	IBMutexInit(&memoryUpdateMutex, "CPU memory sync");
 	ram = (uint8_t*)calloc(1, 64 * 1024);
+	received = (uint8_t*)calloc(1, 64 * 1024);
+	memset(pageState, Page_Fresh, sizeof(pageState));
+	memset(pageViewed, 0, sizeof(pageViewed));
+	memset(receivedPage, 0, sizeof(receivedPage));
 }
 
+// connection thread, called with the MemSync lock held
 void CPU6510::MemoryFromVICE(uint16_t start, uint16_t end, uint8_t *bytes)
 {
 	if (end < start) { return; }
 	IBMutexLock(&memoryUpdateMutex);
-	memcpy(ram + start, bytes, (size_t)end - (size_t)start + 1);
-	memoryChanged = true;
+	memcpy(received + start, bytes, (size_t)end - (size_t)start + 1);
+	for (uint32_t page = start >> 8; page <= (uint32_t)(end >> 8); ++page) { receivedPage[page] = true; }
+	// only pages that were completely received are up to date
+	for (uint32_t page = (start + 0xffu) >> 8, last = ((uint32_t)end + 1) >> 8; page < last; ++page) {
+		if (pageState[page] == Page_Pending) { pageState[page] = Page_Received; }
+	}
+	++receivedGeneration;
+	IBMutexRelease(&memoryUpdateMutex);
+}
+
+CPU6510::Regs CPU6510::ReceivedRegs()
+{
+	IBMutexLock(&memoryUpdateMutex);
+	Regs copy = receivedRegs;
+	IBMutexRelease(&memoryUpdateMutex);
+	return copy;
+}
+
+static void MergeRegs(CPU6510::Regs& to, const CPU6510::Regs& from, uint32_t regMask)
+{
+	if (regMask & CPU6510::RM_A) { to.A = from.A; }
+	if (regMask & CPU6510::RM_X) { to.X = from.X; }
+	if (regMask & CPU6510::RM_Y) { to.Y = from.Y; }
+	if (regMask & CPU6510::RM_SP) { to.SP = from.SP; }
+	if (regMask & CPU6510::RM_FL) { to.FL = from.FL; }
+	if (regMask & CPU6510::RM_ZP00) { to.ZP00 = from.ZP00; }
+	if (regMask & CPU6510::RM_ZP01) { to.ZP01 = from.ZP01; }
+	if (regMask & CPU6510::RM_PC) { to.PC = from.PC; }
+	if (regMask & CPU6510::RM_LIN) { to.LIN = from.LIN; }
+	if (regMask & CPU6510::RM_CYC) { to.CYC = from.CYC; }
+}
+
+void CPU6510::RegistersFromVICE(const Regs& values, uint32_t regMask)
+{
+	IBMutexLock(&memoryUpdateMutex);
+	MergeRegs(receivedRegs, values, regMask);
+	receivedRegsNew = true;
+	++receivedGeneration;
+	IBMutexRelease(&memoryUpdateMutex);
+}
+
+// keep the received copy in step so a partial register update doesn't bring back old values
+void CPU6510::RegistersWritten(uint32_t regMask)
+{
+	IBMutexLock(&memoryUpdateMutex);
+	MergeRegs(receivedRegs, regs, regMask);
+	IBMutexRelease(&memoryUpdateMutex);
+}
+
+// UI thread, called with the MemSync lock held. Views only read ram and regs
+// so everything received during a frame shows up together on the next one.
+bool CPU6510::Publish()
+{
+	IBMutexLock(&memoryUpdateMutex);
+	bool changed = receivedGeneration != publishedGeneration;
+	if (changed) {
+		publishedGeneration = receivedGeneration;
+		for (int page = 0; page < 256; ++page) {
+			if (receivedPage[page]) {
+				memcpy(ram + (page << 8), received + (page << 8), 0x100);
+				receivedPage[page] = false;
+			}
+			if (pageState[page] == Page_Received) { pageState[page] = Page_Fresh; }
+		}
+		if (receivedRegsNew) {
+			regs = receivedRegs;
+			receivedRegsNew = false;
+		}
+		memoryChanged = true;
+	}
 	IBMutexRelease(&memoryUpdateMutex);
+	// a bank is a different view of the main CPU memory, published after it
+	if (space == VICEMemSpaces::MainMemory && bank) {
+		if (CPU6510* main = saCPUs[0]) { regs = main->regs; }
+	}
+	return changed;
 }
+
 uint8_t CPU6510::GetByte(uint16_t addr)
 {
+	pageViewed[addr >> 8] = viewFrame;
 	return ram[addr];
 }
 
+bool CPU6510::RangeFresh(uint16_t start, uint32_t bytes) const
+{
+	if (!bytes) { return true; }
+	uint32_t pages = (((start & 0xff) + bytes - 1) >> 8) + 1;
+	for (uint32_t p = 0; p < pages && p < 256; ++p) {
+		if (pageState[(uint8_t)((start >> 8) + p)] != Page_Fresh) { return false; }
+	}
+	return true;
+}
+
+int CPU6510::PagesPending() const
+{
+	int pending = 0;
+	for (int p = 0; p < 256; ++p) {
+		if (pageState[p] != Page_Fresh) { ++pending; }
+	}
+	return pending;
+}
+
 void CPU6510::SetByte(uint16_t addr, uint8_t byte)
 {
 	ram[addr] = byte;
+	IBMutexLock(&memoryUpdateMutex);
+	received[addr] = byte;
+	IBMutexRelease(&memoryUpdateMutex);
 	memoryChanged = true;
-	ViceSetMemory(addr, 1, ram + addr, space);
+	ViceSetMemory(addr, 1, ram + addr, space, bank);
+	MemSyncWritten(this, addr, addr);
 }
 
 void CPU6510::CopyToRAM(uint16_t address, uint8_t* data, size_t size)
@@ -40,8 +152,12 @@ void CPU6510::CopyToRAM(uint16_t address, uint8_t* data, size_t size)
 	uint32_t bytes = 0x10000 - address;
 	if (size_t(bytes) > size) { bytes = (uint32_t)size; }
 	memcpy(ram + address, data, bytes);
+	IBMutexLock(&memoryUpdateMutex);
+	memcpy(received + address, data, bytes);
+	IBMutexRelease(&memoryUpdateMutex);
 	memoryChanged = true;
-	ViceSetMemory(address, bytes, ram + address, space);
+	ViceSetMemory(address, bytes, ram + address, space, bank);
+	MemSyncWritten(this, address, (uint16_t)(address + bytes - 1));
 }
 
 void CPU6510::ReadPRGToRAM(const char *filename)
@@ -65,31 +181,67 @@ void CPU6510::SetPC(uint16_t pc)
 
 void CreateMainCPU()
 {
-	if (sp6510 == nullptr) {
-		sp6510 = new CPU6510;
+	if (saCPUs[0] == nullptr) {
+		saCPUs[0] = new CPU6510;
 	}
 }
 
 void ShutdownMainCPU()
 {
-	if (sp6510 != nullptr) {
-		delete sp6510;
-		sp6510 = nullptr;
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		if (CPU6510* cpu = saCPUs[slot].exchange(nullptr)) { delete cpu; }
 	}
 }
 
 CPU6510* GetMainCPU()
 {
-	return sp6510;
+	return saCPUs[0];
 }
 
 CPU6510* GetCurrCPU()
 {
-	return sp6510;
+	return saCPUs[0];
+}
+
+static int CPUSlot(VICEMemSpaces space, uint16_t bank)
+{
+	if (space == VICEMemSpaces::MainMemory || (int)space >= kNumMemSpaces) {
+		return (bank && bank < kMaxCPUBanks) ? (kFirstBankSlot + bank) : 0;
+	}
+	return (int)space;	// drives only have the default bank here
+}
+
+// a drive or bank CPU starts out with nothing fetched, MemSync requests the pages views read
+CPU6510* GetCPU(VICEMemSpaces space, uint16_t bank)
+{
+	int slot = CPUSlot(space, bank);
+	CPU6510* cpu = saCPUs[slot];
+	if (!cpu && slot) {
+		cpu = new CPU6510;
+		cpu->space = slot < kFirstBankSlot ? space : VICEMemSpaces::MainMemory;
+		cpu->bank = slot < kFirstBankSlot ? 0 : bank;
+		cpu->regsFresh = slot >= kFirstBankSlot;
+		memset(cpu->pageState, CPU6510::Page_Stale, sizeof(cpu->pageState));
+		if (slot >= kFirstBankSlot && saCPUs[0]) { cpu->regs = saCPUs[0].load()->regs; }
+		saCPUs[slot] = cpu;
+	}
+	return cpu;
+}
+
+// nullptr for a drive or bank CPU no view has asked for
+CPU6510* GetCPUIfCreated(VICEMemSpaces space, uint16_t bank)
+{
+	return saCPUs[CPUSlot(space, bank)];
+}
+
+CPU6510* GetCPUSlot(int slot)
+{
+	return (slot >= 0 && slot < kNumCPUSlots) ? saCPUs[slot].load() : nullptr;
 }
 
-CPU6510* GetCPU(VICEMemSpaces space)
+const char* MemSpaceName(VICEMemSpaces space)
 {
-	return sp6510;
+	static const char* names[kNumMemSpaces] = { "C64", "Drive 8", "Drive 9", "Drive 10", "Drive 11" };
+	return (int)space < kNumMemSpaces ? names[(int)space] : "?";
 }
 
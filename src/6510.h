@@ -23,16 +23,43 @@ struct CPU6510 {
 		RM_FL = 0x0010,
 		RM_ZP00 = 0x0020,
 		RM_ZP01 = 0x0040,
-		RM_PC = 0x0080
+		RM_PC = 0x0080,
+		RM_LIN = 0x0100,	// only received from VICE
+		RM_CYC = 0x0200
 	};
 
-	Regs	regs;
+	// sync state of each 256 byte page of ram relative to VICE
+	enum PageState : uint8_t {
+		Page_Fresh,		// matches VICE since the last stop
+		Page_Stale,		// not requested since the last stop
+		Page_Pending,	// requested, waiting for VICE
+		Page_Received	// arrived from VICE, fresh when published
+	};
+
+	Regs	regs;		// published state, read and written by the UI thread only
 	uint8_t *ram;
 	VICEMemSpaces space;
+	uint16_t bank;		// VICE bank id, 0 is what the CPU currently sees
+
+	uint8_t pageState[256];
+	uint32_t pageViewed[256];	// view frame when a page was last read, 0 = never
+	uint32_t viewFrame;
+	uint32_t syncGeneration;	// bumped when VICE stops or resumes, older responses are dropped
+	int syncInFlight;
+	bool regsFresh;		// drive CPUs fetch registers when viewed after a stop
+
+	// drives and banks other than the default only fetch the pages views read
+	bool OnDemand() const { return space != VICEMemSpaces::MainMemory || bank != 0; }
 
 	CPU6510();
 
+	// the connection thread writes what VICE sends to a second copy of memory
+	// and registers that the UI thread publishes between frames
 	void MemoryFromVICE(uint16_t start, uint16_t end, uint8_t* bytes);
+	Regs ReceivedRegs();
+	void RegistersFromVICE(const Regs& values, uint32_t regMask);
+	void RegistersWritten(uint32_t regMask);	// regs were changed by the UI and sent to VICE
+	bool Publish();		// UI thread, true if anything was received since the last publish
 
 	uint8_t GetByte(uint16_t addr);
 	void SetByte(uint16_t addr, uint8_t byte);
@@ -42,8 +69,18 @@ struct CPU6510 {
 	void ReadPRGToRAM(const char *filename);
 	void SetPC(uint16_t pc);
 
+	bool PageFresh(uint16_t addr) const { return pageState[addr >> 8] == Page_Fresh; }
+	bool RangeFresh(uint16_t start, uint32_t bytes) const;
+	int PagesPending() const;
+
 protected:
-	IBMutex memoryUpdateMutex;
+	IBMutex memoryUpdateMutex;	// protects the received state below
+	uint8_t* received;
+	Regs receivedRegs;
+	uint32_t receivedGeneration;	// bumped by each response
+	uint32_t publishedGeneration;
+	bool receivedRegsNew;
+	bool receivedPage[256];		// bytes arrived, copied to ram when published
 	bool memoryChanged;
 };
 
@@ -64,5 +101,10 @@ void ShutdownMainCPU();
 
 CPU6510* GetMainCPU();
 CPU6510* GetCurrCPU();
-CPU6510* GetCPU(VICEMemSpaces space);
+enum { kMaxCPUBanks = 16, kNumCPUSlots = 4 + kMaxCPUBanks };
+
+CPU6510* GetCPU(VICEMemSpaces space, uint16_t bank = 0);	// UI thread, creates a drive or bank CPU on first use
+CPU6510* GetCPUIfCreated(VICEMemSpaces space, uint16_t bank = 0);	// any thread
+CPU6510* GetCPUSlot(int slot);	// every created CPU for slot 0..kNumCPUSlots-1, otherwise nullptr
+const char* MemSpaceName(VICEMemSpaces space);
 
@@ -1,10 +1,13 @@
-// breakpoints are added in bulk when VICE stops
-// breakpoints can be added by the debugger
+// breakpoints are listed in bulk when VICE first stops after connecting
+// after that they are added, removed and toggled one by one as VICE confirms
+// changes made by the debugger
+// views look up breakpoints by address in a 64K map that the UI thread
+// rebuilds from the list when it has changed since the last frame
 
 #include <malloc.h>
+#include <string.h>
 #include "platform.h"
 #include "Breakpoints.h"
-#include "HashTable.h"
 #include "struse/struse.h"
 #include "ViceInterface.h"
 
@@ -16,17 +19,30 @@
 static IBMutex sBreakpointMutex;
 static std::vector<Breakpoint> sBreakpoints;
 static std::vector<uint32_t> sCurrentBreakpoints;
-static HashTable<uint16_t, uint32_t> sBreakpointLookup;	// address, VICE breakpoint index
+static uint32_t sBreakpointRevision = 0;	// bumped by every change to sBreakpoints
+
+// only touched by the UI thread
+static uint8_t* sAddressFlags = nullptr;	// 64K of BreakpointMapFlags
+static uint16_t* sAddressIndex = nullptr;	// 64K, 1 + index in sMapBreakpoints, 0 = none
+static std::vector<Breakpoint> sMapBreakpoints;	// sBreakpoints when the map was built, without conditions
+static uint32_t sMapRevision = 0;
 
 void InitBreakpoints()
 {
 	IBMutexInit(&sBreakpointMutex, "Breakpoints");
+	sAddressFlags = (uint8_t*)calloc(1, 0x10000);
+	sAddressIndex = (uint16_t*)calloc(0x10000, sizeof(uint16_t));
 }
 
 void ShutdownBreakpoints()
 {
 	sBreakpoints.clear();
+	sMapBreakpoints.clear();
 	ClearBreapointsHit();
+	free(sAddressFlags);
+	free(sAddressIndex);
+	sAddressFlags = nullptr;
+	sAddressIndex = nullptr;
 	IBMutexDestroy(&sBreakpointMutex);
 }
 
@@ -34,7 +50,7 @@ void ClearBreakpoints()
 {
 	IBMutexLock(&sBreakpointMutex);
 	sBreakpoints.clear();
-	sBreakpointLookup.Clear();
+	++sBreakpointRevision;
 	IBMutexRelease(&sBreakpointMutex);
 }
 
@@ -72,6 +88,7 @@ void AddBreakpoint(uint32_t number, uint32_t flags, uint16_t start, uint16_t end
 				sBreakpoints[i].condition = nullptr;
 			}
 			if (condition) { sBreakpoints[i].condition = _strdup(condition);	}
+			++sBreakpointRevision;
 			IBMutexRelease(&sBreakpointMutex);
 			return;
 		}
@@ -79,9 +96,7 @@ void AddBreakpoint(uint32_t number, uint32_t flags, uint16_t start, uint16_t end
 	Breakpoint bp = { number, flags, start, end, nullptr };
 	if (condition) { bp.condition = _strdup(condition); }
 	sBreakpoints.push_back(bp);
-	if ((flags & Breakpoint::Exec) && sBreakpointLookup.Value(start) == nullptr) {
-		sBreakpointLookup.Insert(start, number);
-	}
+	++sBreakpointRevision;
 	IBMutexRelease(&sBreakpointMutex);
 }
 
@@ -90,12 +105,23 @@ void RemoveBreakpoint(uint32_t number)
 	IBMutexLock(&sBreakpointMutex);
 	for (size_t i = 0; i < sBreakpoints.size(); ++i) {
 		if (sBreakpoints[i].number == number) {
-			if (uint32_t* num = sBreakpointLookup.Value(sBreakpoints[i].start)) {
-				if (*num == number) {
-					// TODO: Add remove hash table slot!
-				}
-			}
+			if (sBreakpoints[i].condition) { free((void*)sBreakpoints[i].condition); }
 			sBreakpoints.erase(sBreakpoints.begin() + i);
+			++sBreakpointRevision;
+			break;
+		}
+	}
+	IBMutexRelease(&sBreakpointMutex);
+}
+
+void EnableBreakpoint(uint32_t number, bool enable)
+{
+	IBMutexLock(&sBreakpointMutex);
+	for (size_t i = 0; i < sBreakpoints.size(); ++i) {
+		if (sBreakpoints[i].number == number) {
+			if (enable) { sBreakpoints[i].flags |= Breakpoint::Enabled; }
+			else { sBreakpoints[i].flags &= ~Breakpoint::Enabled; }
+			++sBreakpointRevision;
 			break;
 		}
 	}
@@ -110,7 +136,7 @@ void RemoveAllBreakpoints()
 		if (sBreakpoints[i].condition) { free((void*)sBreakpoints[i].condition); }
 	}
 	sBreakpoints.clear();
-	sBreakpointLookup.Clear();
+	++sBreakpointRevision;
 	IBMutexRelease(&sBreakpointMutex);
 }
 
@@ -130,19 +156,58 @@ Breakpoint GetBreakpoint(size_t index)
 	return r;
 }
 
-bool BreakpointAt(uint16_t address, Breakpoint& bp)
+bool HasExecBreakpoint(uint16_t address)
 {
 	IBMutexLock(&sBreakpointMutex);
-	if (uint32_t* number = sBreakpointLookup.Value(address)) {
-		uint32_t num = *number;
-		for (size_t index = 0, n = sBreakpoints.size(); index < n; ++index) {
-			if (sBreakpoints[index].number == num) {
-				bp = sBreakpoints[index];
-				IBMutexRelease(&sBreakpointMutex);
-				return true;
+	bool found = false;
+	for (size_t i = 0, n = sBreakpoints.size(); i < n && !found; ++i) {
+		const Breakpoint& bp = sBreakpoints[i];
+		found = (bp.flags & Breakpoint::Exec) && address >= bp.start && address <= bp.end;
+	}
+	IBMutexRelease(&sBreakpointMutex);
+	return found;
+}
+
+void UpdateBreakpointMap()
+{
+	if (!sAddressFlags) { return; }
+	IBMutexLock(&sBreakpointMutex);
+	if (sMapRevision == sBreakpointRevision) {
+		IBMutexRelease(&sBreakpointMutex);
+		return;
+	}
+	sMapRevision = sBreakpointRevision;
+	sMapBreakpoints = sBreakpoints;
+	IBMutexRelease(&sBreakpointMutex);
+
+	memset(sAddressFlags, 0, 0x10000);
+	memset(sAddressIndex, 0, 0x10000 * sizeof(uint16_t));
+	for (size_t i = 0, n = sMapBreakpoints.size(); i < n && i < 0xffff; ++i) {
+		Breakpoint& bp = sMapBreakpoints[i];
+		bp.condition = nullptr;	// owned by the list
+		uint8_t flags = ((bp.flags & Breakpoint::Exec) ? BPMap_Exec : 0) | ((bp.flags & Breakpoint::Load) ? BPMap_Load : 0) |
+			((bp.flags & Breakpoint::Store) ? BPMap_Store : 0) | ((bp.flags & Breakpoint::Enabled) ? BPMap_Enabled : 0) |
+			((bp.flags & Breakpoint::Stop) ? BPMap_Stop : 0);
+		uint32_t end = bp.end >= bp.start ? bp.end : bp.start;
+		for (uint32_t a = bp.start; a <= end; ++a) {
+			sAddressFlags[a] |= flags;
+			// an exec breakpoint is what the code view shows for the address
+			uint16_t prev = sAddressIndex[a];
+			if (!prev || ((bp.flags & Breakpoint::Exec) && !(sMapBreakpoints[prev - 1].flags & Breakpoint::Exec))) {
+				sAddressIndex[a] = (uint16_t)(i + 1);
 			}
 		}
 	}
-	IBMutexRelease(&sBreakpointMutex);
-	return false;
-}
\ No newline at end of file
+}
+
+uint8_t BreakpointFlagsAt(uint16_t address)
+{
+	return sAddressFlags ? sAddressFlags[address] : 0;
+}
+
+bool BreakpointAt(uint16_t address, Breakpoint& bp)
+{
+	if (!sAddressFlags || !(sAddressFlags[address] & BPMap_Exec)) { return false; }
+	bp = sMapBreakpoints[sAddressIndex[address] - 1];
+	return true;
+}
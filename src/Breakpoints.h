@@ -26,10 +26,25 @@ void ShutdownBreakpoints();
 void ClearBreakpoints();
 void AddBreakpoint(uint32_t number, uint32_t flags, uint16_t start, uint16_t end, const char* condition = nullptr);
 void RemoveBreakpoint(uint32_t number);
+void EnableBreakpoint(uint32_t number, bool enable);
 void RemoveAllBreakpoints();
 bool BreakpointCurrent(uint32_t number);
 void SetBreakpointHit(uint32_t number);
 void ClearBreapointsHit();
 size_t NumBreakpoints();
 Breakpoint GetBreakpoint(size_t index);
-bool BreakpointAt(uint16_t address, Breakpoint& bp);
+bool HasExecBreakpoint(uint16_t address);	// any thread, searches the list
+
+// per address summary of the breakpoints covering it, for the views
+enum BreakpointMapFlags : uint8_t {
+	BPMap_Exec = 0x01,
+	BPMap_Load = 0x02,
+	BPMap_Store = 0x04,
+	BPMap_Enabled = 0x08,	// at least one of them is enabled
+	BPMap_Stop = 0x10		// at least one of them stops, otherwise trace only
+};
+
+// the address map is only read and rebuilt on the UI thread, without locking
+void UpdateBreakpointMap();	// once per frame before the views draw
+uint8_t BreakpointFlagsAt(uint16_t address);
+bool BreakpointAt(uint16_t address, Breakpoint& bp);	// exec breakpoint covering address
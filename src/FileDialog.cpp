@@ -41,6 +41,7 @@ static bool sSetViceEXEPathReady = false;
 static bool sReadPrgReady = false;
 static bool sLoadThemeReady = false;
 static bool sSaveThemeReady = false;
+static bool sSaveStatsReady = false;
 
 static char sLoadPrgFileName[PATH_MAX_LEN] = {};
 static char sLoadLstFileName[PATH_MAX_LEN] = {};
@@ -50,6 +51,7 @@ static char sLoadViceFileName[PATH_MAX_LEN] = {};
 static char sViceEXEPath[PATH_MAX_LEN] = {};
 static char sReadPrgFileName[PATH_MAX_LEN] = {};
 static char sThemeFileName[PATH_MAX_LEN] = {};
+static char sStatsFileName[PATH_MAX_LEN] = {};
 
 static char sFileDialogFolder[PATH_MAX_LEN];
 
@@ -71,6 +73,7 @@ static const char sLoadViceCmdParams[] = "Vice Commands:*.vs";
 static const char sViceEXEParams[] = "Vice EXE path:x*.exe";
 static const char sReadPrgParams[] = "Prg files:*.prg";
 static const char sThemeParams[] = "Theme:*.theme.txt";
+static const char sStatsParams[] = "JSON:*.json";
 #endif
 
 void FileDialogPathEntry(const char* name, char* path) {
@@ -157,6 +160,14 @@ const char* SaveThemeReady() {
 	return nullptr;
 }
 
+const char* SaveStatsReady() {
+	if (sSaveStatsReady) {
+		sSaveStatsReady = false;
+		return sStatsFileName;
+	}
+	return nullptr;
+}
+
 const char* LoadThemeReady() {
 	if (sLoadThemeReady) {
 		sLoadThemeReady = false;
@@ -372,6 +383,23 @@ void SaveThemeDialog()
 #endif
 }
 
+void SaveStatsDialog()
+{
+	sSaveStatsReady = false;
+	sFileDialogOpen = true;
+
+#if defined(_WIN32) && !defined(CUSTOM_FILEVIEWER)
+	hThreadFileDialog = CreateThread(NULL, FILE_LOAD_THREAD_STACK, (LPTHREAD_START_ROUTINE)FileLoadDialogThreadRun, &aLoadTemplateInfo,
+		0, NULL);
+#else
+	FVFileView* filesView = GetFileView();
+	if (filesView && !filesView->IsOpen()) {
+		filesView->Show(strown<PATH_MAX_LEN>(StartFolder(sStatsFileName)).c_str(), &sSaveStatsReady, sStatsFileName, sizeof(sStatsFileName), sStatsParams);
+		filesView->SetSave();
+	}
+#endif
+}
+
 void LoadKickDbgDialog()
 {
 	sLoadKickDbgReady = false;
@@ -19,6 +19,7 @@ const char* GetViceCMDFilename();
 const char* ReadPRGToRAMReady();
 const char* LoadThemeReady();
 const char* SaveThemeReady();
+const char* SaveStatsReady();
 bool LoadViceEXEPathReady();
 void LoadProgramDialog();
 void LoadListingDialog();
@@ -27,6 +28,7 @@ void LoadSymbolsDialog();
 void LoadViceCmdDialog();
 void LoadThemeDialog();
 void SaveThemeDialog();
+void SaveStatsDialog();
 void SetViceEXEPathDialog();
 void ReadPRGDialog();
 
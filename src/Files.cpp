@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <malloc.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "Files.h"
 
 bool SaveFile(const char *filename, void* data, size_t size)
@@ -39,6 +41,39 @@ uint8_t* LoadBinary(const char* name, size_t& size)
 	return nullptr;
 }
 
+bool FileExists(const char* name)
+{
+	FILE* f;
+#ifdef _WIN32
+	if (fopen_s(&f, name, "rb") == 0 && f != nullptr) {
+#else
+	f = fopen(name, "rb");
+	if (f) {
+#endif
+		fclose(f);
+		return true;
+	}
+	return false;
+}
+
+bool FileStamp(const char* name, uint64_t& modified, uint64_t& size)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(name, &st) != 0) { return false; }
+#else
+	struct stat st;
+	if (stat(name, &st) != 0) { return false; }
+#endif
+#ifdef __linux__
+	modified = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+#else
+	modified = (uint64_t)st.st_mtime;
+#endif
+	size = (uint64_t)st.st_size;
+	return true;
+}
+
 #ifndef _MSC_VER
 int fopen_s(FILE **f, const char* filename, const char* options)
 {
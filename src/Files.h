@@ -3,6 +3,8 @@
 #include <stdint.h>
 bool SaveFile(const char* filename, void* data, size_t size);
 uint8_t* LoadBinary(const char* name, size_t& size);
+bool FileExists(const char* name);
+bool FileStamp(const char* name, uint64_t& modified, uint64_t& size);	// false if the file is missing
 
 #ifndef _MSC_VER
 int fopen_s(FILE **f, const char* filename, const char *options);
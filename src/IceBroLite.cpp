@@ -41,7 +41,14 @@
 #include "FileDialog.h"
 #include "Breakpoints.h"
 #include "Traces.h"
+#include "TraceQuery.h"
+#include "MemSync.h"
+#include "MemHistory.h"
+#include "StepBack.h"
+#include "ViceRecord.h"
+#include "ViceStats.h"
 #include "Sym.h"
+#include "SymbolLoad.h"
 #include "StartVice.h"
 #include "SaveState.h"
 #include "views/FilesView.h"
@@ -196,8 +203,15 @@ int main(int argc, char* argv[])
 	InitStartFolder();
 	CreateMainCPU();
 	InitSymbols();
+	InitSymbolLoad();
 	InitBreakpoints();
 	InitTraces();
+	InitTraceQuery();
+	InitMemSync();
+	InitMemHistory();
+	InitStepBack();
+	InitViceRecord();
+	InitViceStats();
 
 	// Setup Dear ImGui context
 	IMGUI_CHECKVERSION();
@@ -355,14 +369,15 @@ int main(int argc, char* argv[])
 		}
 
 		if (const char* kickDbgFile = LoadKickDbgReady()) {
-			ReadC64DbgSrc(kickDbgFile);
+			LoadSymbolFile(kickDbgFile, SymbolFile_KickDbg);
 		}
 		if (const char* viceMonCmdFile = LoadViceCMDReady()) {
-			ReadViceCommandFile(viceMonCmdFile);
+			LoadSymbolFile(viceMonCmdFile, SymbolFile_ViceCmd);
 		}
 		if (const char* symFile = LoadSymbolsReady()) {
-			ReadSymbols(symFile);
+			LoadSymbolFile(symFile, SymbolFile_Sym);
 		}
+		SymbolLoadUpdate();
 		if (const char* listFile = LoadListingReady()) {
 			if (ReadListingFile(listFile)) {
 				ReviewListing();
@@ -374,6 +389,9 @@ int main(int argc, char* argv[])
 		if (const char* themeFile = SaveThemeReady()) {
 			SaveCustomTheme(themeFile);
 		}
+		if (const char* statsFile = SaveStatsReady()) {
+			ViceStatsSaveJSON(statsFile);
+		}
 		WaitForViceEXEPath();
 
 
@@ -385,8 +403,15 @@ int main(int argc, char* argv[])
 		SaveState();
 	}
 
+	ShutdownViceStats();
+	ShutdownViceRecord();
+	ShutdownStepBack();
+	ShutdownMemHistory();
+	ShutdownMemSync();
+	ShutdownTraceQuery();
 	ShutdownTraces();
 	ShutdownBreakpoints();
+	ShutdownSymbolLoad();
 	ShutdownSourceDebug();
 	ShutdownSymbols();
 	ShutdownMainCPU();
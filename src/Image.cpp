@@ -1,8 +1,23 @@
 #include <stdint.h>
+#include <stddef.h>
 #include "imgui/imgui.h"
 #include "GLFW/glfw3.h"
 #include "Image.h"
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PALETTE_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSSE3_TARGET
+#else
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PALETTE_NEON
+#include <arm_neon.h>
+#endif
+
 extern const int sIcons_Width;
 extern const int sIcons_Height;
 extern const unsigned char sIcons_Pixels[];
@@ -27,6 +42,73 @@ uint32_t c64pal[16] = {
 	ColRGBA(159,159,159,255)
 };
 
+// each byte plane of the palette is a 16 entry table for a byte shuffle,
+// 16 indices become 16 pixels with one shuffle per plane and an interleave
+#ifdef PALETTE_SSSE3
+static bool HasSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+SSSE3_TARGET static size_t ExpandPaletteSSSE3(const uint8_t* src, uint32_t* dst, size_t count, const uint32_t* pal)
+{
+	uint8_t planes[4][16];
+	for (int c = 0; c < 16; ++c) {
+		for (int p = 0; p < 4; ++p) { planes[p][c] = (uint8_t)(pal[c] >> (8 * p)); }
+	}
+	const __m128i r = _mm_loadu_si128((const __m128i*)planes[0]);
+	const __m128i g = _mm_loadu_si128((const __m128i*)planes[1]);
+	const __m128i b = _mm_loadu_si128((const __m128i*)planes[2]);
+	const __m128i a = _mm_loadu_si128((const __m128i*)planes[3]);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t n = 0;
+	for (; (n + 16) <= count; n += 16) {
+		__m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + n)), mask);
+		__m128i pr = _mm_shuffle_epi8(r, idx), pg = _mm_shuffle_epi8(g, idx);
+		__m128i pb = _mm_shuffle_epi8(b, idx), pa = _mm_shuffle_epi8(a, idx);
+		__m128i rgLo = _mm_unpacklo_epi8(pr, pg), rgHi = _mm_unpackhi_epi8(pr, pg);
+		__m128i baLo = _mm_unpacklo_epi8(pb, pa), baHi = _mm_unpackhi_epi8(pb, pa);
+		__m128i* out = (__m128i*)(dst + n);
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+	}
+	return n;
+}
+#endif
+
+// indexed image to RGBA, only the low 4 bits of each index are used
+void ExpandPalette(const uint8_t* src, uint32_t* dst, size_t count, const uint32_t* pal)
+{
+	size_t n = 0;
+#if defined(PALETTE_SSSE3)
+	static const bool ssse3 = HasSSSE3();
+	if (ssse3) { n = ExpandPaletteSSSE3(src, dst, count, pal); }
+#elif defined(PALETTE_NEON)
+	uint8x16x4_t planes;
+	uint8_t table[4][16];
+	for (int c = 0; c < 16; ++c) {
+		for (int p = 0; p < 4; ++p) { table[p][c] = (uint8_t)(pal[c] >> (8 * p)); }
+	}
+	for (int p = 0; p < 4; ++p) { planes.val[p] = vld1q_u8(table[p]); }
+	const uint8x16_t mask = vdupq_n_u8(0x0f);
+	for (; (n + 16) <= count; n += 16) {
+		uint8x16_t idx = vandq_u8(vld1q_u8(src + n), mask);
+		uint8x16x4_t pixels;
+		for (int p = 0; p < 4; ++p) { pixels.val[p] = vqtbl1q_u8(planes.val[p], idx); }
+		vst4q_u8((uint8_t*)(dst + n), pixels);
+	}
+#endif
+	for (; n < count; ++n) { dst[n] = pal[src[n] & 0xf]; }
+}
+
 ImTextureID CreateTexture()
 {
 	// Turn the RGBA pixel data into an OpenGL texture:
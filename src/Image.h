@@ -36,6 +36,7 @@ int GetViceMonIconWidth(ViceMonIcons icon);
 ImTextureID CreateTexture();
 void SelectTexture(ImTextureID img);
 void UpdateTextureData(int width, int height, const void* data);
+void ExpandPalette(const uint8_t* src, uint32_t* dst, size_t count, const uint32_t* pal);
 //ImTextureID LoadTexture( const char* filename, int* width, int* height );
 
 extern uint32_t c64pal[16];
@@ -0,0 +1,258 @@
+// Copy-on-write snapshots of C64 memory, one per stop
+//	Pages are 256 bytes, reference counted and kept in a hash table by their
+//	contents. A snapshot is a table of 256 page indices copied from the previous
+//	snapshot when VICE stops, a page is only replaced when VICE sends different
+//	bytes for it. Stepping through a loop touches a few pages per stop so
+//	hundreds of stops fit in the space of a handful of 64K copies.
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "platform.h"
+#include "MemHistory.h"
+
+enum {
+	kMaxSnapshots = 512,	// oldest snapshots are dropped beyond this
+	kPageBytes = 256,
+	kPagesPerSnapshot = 256,
+	kMinBuckets = 1024
+};
+
+static const uint32_t kNoPage = 0xffffffff;
+
+struct HistoryPage {
+	uint64_t hash;
+	uint32_t refs;	// 0 = on the free list
+	uint32_t next;	// next page in the same bucket or on the free list
+	uint8_t data[kPageBytes];
+};
+
+struct HistorySnapshot {
+	uint32_t pages[kPagesPerSnapshot];	// kNoPage before the first stop sent the page
+	uint8_t known[kPagesPerSnapshot / 8];	// pages received during this stop
+	uint32_t stop;
+	uint16_t pc;
+};
+
+static IBMutex sHistoryMutex;
+static std::vector<HistoryPage> sPages;
+static std::vector<uint32_t> sBuckets;	// power of 2, first page of each chain
+static uint32_t sFreePages = kNoPage;
+static uint32_t sNumPages = 0;
+static HistorySnapshot* sSnapshots = nullptr;	// ring of kMaxSnapshots
+static int sFirstSnapshot = 0;
+static int sNumSnapshots = 0;
+static uint32_t sStops = 0;
+
+static uint64_t HashPage(const uint8_t* data)
+{
+	uint64_t hash = 0x9e3779b97f4a7c15ull;
+	for (int i = 0; i < kPageBytes; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+static HistorySnapshot* Snapshot(int back)
+{
+	if (back < 0 || back >= sNumSnapshots) { return nullptr; }
+	return sSnapshots + ((sFirstSnapshot + sNumSnapshots - 1 - back) % kMaxSnapshots);
+}
+
+static void Rehash(size_t buckets)
+{
+	sBuckets.assign(buckets, kNoPage);
+	for (uint32_t p = 0, n = (uint32_t)sPages.size(); p < n; ++p) {
+		if (sPages[p].refs) {
+			uint32_t& head = sBuckets[sPages[p].hash & (buckets - 1)];
+			sPages[p].next = head;
+			head = p;
+		}
+	}
+}
+
+// call with sHistoryMutex locked
+static void ReleasePage(uint32_t page)
+{
+	if (page == kNoPage || --sPages[page].refs) { return; }
+	uint32_t* link = &sBuckets[sPages[page].hash & (sBuckets.size() - 1)];
+	while (*link != page) { link = &sPages[*link].next; }
+	*link = sPages[page].next;
+	sPages[page].next = sFreePages;
+	sFreePages = page;
+	--sNumPages;
+}
+
+// call with sHistoryMutex locked, returns a referenced page with these contents
+static uint32_t AddPage(const uint8_t* data, uint64_t hash)
+{
+	for (uint32_t p = sBuckets[hash & (sBuckets.size() - 1)]; p != kNoPage; p = sPages[p].next) {
+		if (sPages[p].hash == hash && memcmp(sPages[p].data, data, kPageBytes) == 0) {
+			sPages[p].refs++;
+			return p;
+		}
+	}
+	uint32_t page = sFreePages;
+	if (page != kNoPage) {
+		sFreePages = sPages[page].next;
+	} else {
+		page = (uint32_t)sPages.size();
+		sPages.push_back(HistoryPage());
+	}
+	HistoryPage& stored = sPages[page];
+	stored.hash = hash;
+	stored.refs = 1;
+	memcpy(stored.data, data, kPageBytes);
+	++sNumPages;
+	if (sNumPages > sBuckets.size()) {
+		Rehash(sBuckets.size() * 2);
+	} else {
+		uint32_t& head = sBuckets[hash & (sBuckets.size() - 1)];
+		stored.next = head;
+		head = page;
+	}
+	return page;
+}
+
+void InitMemHistory()
+{
+	IBMutexInit(&sHistoryMutex, "Memory history");
+	sSnapshots = (HistorySnapshot*)calloc(kMaxSnapshots, sizeof(HistorySnapshot));
+	sBuckets.assign(kMinBuckets, kNoPage);
+}
+
+void ShutdownMemHistory()
+{
+	IBMutexLock(&sHistoryMutex);
+	free(sSnapshots);
+	sSnapshots = nullptr;
+	sNumSnapshots = 0;
+	sPages.clear();
+	sBuckets.clear();
+	sFreePages = kNoPage;
+	sNumPages = 0;
+	IBMutexRelease(&sHistoryMutex);
+	IBMutexDestroy(&sHistoryMutex);
+}
+
+void MemHistoryStop(uint16_t pc)
+{
+	IBMutexLock(&sHistoryMutex);
+	if (!sSnapshots) {
+		IBMutexRelease(&sHistoryMutex);
+		return;
+	}
+	HistorySnapshot* prev = Snapshot(0);
+	if (sNumSnapshots == kMaxSnapshots) {
+		HistorySnapshot* oldest = sSnapshots + sFirstSnapshot;
+		for (int p = 0; p < kPagesPerSnapshot; ++p) { ReleasePage(oldest->pages[p]); }
+		sFirstSnapshot = (sFirstSnapshot + 1) % kMaxSnapshots;
+		--sNumSnapshots;
+	}
+	HistorySnapshot* snap = sSnapshots + ((sFirstSnapshot + sNumSnapshots) % kMaxSnapshots);
+	++sNumSnapshots;
+	for (int p = 0; p < kPagesPerSnapshot; ++p) {
+		uint32_t page = prev ? prev->pages[p] : kNoPage;
+		if (page != kNoPage) { sPages[page].refs++; }
+		snap->pages[p] = page;
+	}
+	memset(snap->known, 0, sizeof(snap->known));
+	snap->stop = ++sStops;
+	snap->pc = pc;
+	IBMutexRelease(&sHistoryMutex);
+}
+
+void MemHistoryReceived(uint16_t start, uint16_t end, const uint8_t* data)
+{
+	if (end < start) { return; }
+	IBMutexLock(&sHistoryMutex);
+	if (HistorySnapshot* snap = Snapshot(0)) {
+		for (uint32_t page = (start + 0xffu) >> 8, last = ((uint32_t)end + 1) >> 8; page < last; ++page) {
+			const uint8_t* bytes = data + (page << 8) - start;
+			uint64_t hash = HashPage(bytes);
+			uint32_t prev = snap->pages[page];
+			// unchanged since the last stop is the common case
+			if (prev == kNoPage || sPages[prev].hash != hash || memcmp(sPages[prev].data, bytes, kPageBytes) != 0) {
+				snap->pages[page] = AddPage(bytes, hash);
+				ReleasePage(prev);
+			}
+			snap->known[page >> 3] |= 1 << (page & 7);
+		}
+	}
+	IBMutexRelease(&sHistoryMutex);
+}
+
+int MemHistoryCount()
+{
+	IBMutexLock(&sHistoryMutex);
+	int count = sNumSnapshots;
+	IBMutexRelease(&sHistoryMutex);
+	return count;
+}
+
+bool MemHistoryInfo(int back, uint32_t* stop, uint16_t* pc)
+{
+	IBMutexLock(&sHistoryMutex);
+	HistorySnapshot* snap = Snapshot(back);
+	if (snap) {
+		if (stop) { *stop = snap->stop; }
+		if (pc) { *pc = snap->pc; }
+	}
+	IBMutexRelease(&sHistoryMutex);
+	return snap != nullptr;
+}
+
+bool MemHistoryRead(int back, uint16_t addr, uint32_t bytes, uint8_t* out, uint8_t* changed, bool* known)
+{
+	IBMutexLock(&sHistoryMutex);
+	HistorySnapshot* snap = Snapshot(back);
+	HistorySnapshot* prev = Snapshot(back + 1);
+	if (!snap) {
+		IBMutexRelease(&sHistoryMutex);
+		return false;
+	}
+	bool allKnown = true;
+	for (uint32_t offs = 0; offs < bytes;) {
+		uint16_t a = (uint16_t)(addr + offs);
+		uint32_t page = a >> 8, inPage = a & 0xff;
+		uint32_t count = kPageBytes - inPage;
+		if (count > (bytes - offs)) { count = bytes - offs; }
+		uint32_t curr = snap->pages[page];
+		if (!(snap->known[page >> 3] & (1 << (page & 7)))) { allKnown = false; }
+		if (out) {
+			if (curr != kNoPage) { memcpy(out + offs, sPages[curr].data + inPage, count); }
+			else { memset(out + offs, 0, count); }
+		}
+		if (changed) {
+			uint32_t before = prev ? prev->pages[page] : kNoPage;
+			if (!prev || before == curr) {
+				memset(changed + offs, 0, count);	// same page, nothing changed
+			} else {
+				for (uint32_t b = 0; b < count; ++b) {
+					uint8_t now = curr != kNoPage ? sPages[curr].data[inPage + b] : 0;
+					uint8_t was = before != kNoPage ? sPages[before].data[inPage + b] : 0;
+					changed[offs + b] = now != was;
+				}
+			}
+		}
+		offs += count;
+	}
+	IBMutexRelease(&sHistoryMutex);
+	if (known) { *known = allKnown; }
+	return true;
+}
+
+MemHistoryStats MemHistoryGetStats()
+{
+	IBMutexLock(&sHistoryMutex);
+	MemHistoryStats stats;
+	stats.snapshots = (uint32_t)sNumSnapshots;
+	stats.pages = sNumPages;
+	stats.bytes = (uint64_t)kMaxSnapshots * sizeof(HistorySnapshot) + sPages.capacity() * sizeof(HistoryPage) +
+		sBuckets.capacity() * sizeof(uint32_t);
+	IBMutexRelease(&sHistoryMutex);
+	return stats;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Memory history of the C64 across stops
+//	Each stop is a snapshot of 256 page references. A new snapshot starts out
+//	sharing the pages of the one before and only pages that arrive from VICE
+//	with different contents are stored again, looked up by hash so a page that
+//	returns to an earlier state is shared as well.
+
+void InitMemHistory();
+void ShutdownMemHistory();
+
+// VICE stopped, start a snapshot on top of the previous one
+void MemHistoryStop(uint16_t pc);
+
+// main memory arrived from VICE for the current stop, only whole pages are kept
+void MemHistoryReceived(uint16_t start, uint16_t end, const uint8_t* data);
+
+// number of snapshots, the newest is 0 stops back
+int MemHistoryCount();
+
+// stop number and PC of a snapshot, false if it is gone
+bool MemHistoryInfo(int back, uint32_t* stop, uint16_t* pc);
+
+// bytes as they were in the snapshot back stops before the newest. changed is
+// set to nonzero where a byte differs from the stop before that. known is
+// cleared if part of the range was not received during that stop. out and
+// changed may be nullptr.
+bool MemHistoryRead(int back, uint16_t addr, uint32_t bytes, uint8_t* out, uint8_t* changed, bool* known);
+
+struct MemHistoryStats {
+	uint32_t snapshots;
+	uint32_t pages;		// unique pages stored
+	uint64_t bytes;		// snapshots + pages + hash table
+};
+MemHistoryStats MemHistoryGetStats();
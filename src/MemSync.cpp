@@ -0,0 +1,201 @@
+// Prioritized memory refresh from VICE
+//	Views read memory through CPU6510::GetByte which stamps the page with the
+//	current view frame. When VICE stops the stamped pages are requested first
+//	and the rest of memory is streamed in the background with a limited number
+//	of requests in flight so that scrolling or stepping again is not stuck
+//	behind a large transfer.
+//	Drive CPUs only request the pages views read, and their registers, so a
+//	drive costs nothing until a view is pointed at it. Other banks of main
+//	memory (RAM under ROM, I/O, cartridge) work the same way without registers.
+
+#include "platform.h"
+#include "struse/struse.h"
+#include "6510.h"
+#include "ViceInterface.h"
+#include "MemSync.h"
+#include "MemHistory.h"
+
+enum {
+	kViewedFrames = 30,		// pages read by a view within this many frames get priority
+	kMaxViewedPages = 16,	// max pages in a single prioritized request
+	kBackgroundPages = 16,	// pages in a single background request
+	kMaxInFlight = 2		// background requests are only sent below this many in flight
+};
+
+static IBMutex sMemSyncMutex;
+
+void InitMemSync()
+{
+	IBMutexInit(&sMemSyncMutex, "Memory sync mutex");
+}
+
+void ShutdownMemSync()
+{
+	IBMutexDestroy(&sMemSyncMutex);
+}
+
+static bool PageViewed(CPU6510* cpu, int page)
+{
+	uint32_t viewed = cpu->pageViewed[page];
+	return viewed && (cpu->viewFrame - viewed) < kViewedFrames;
+}
+
+static void RequestPages(CPU6510* cpu, int first, int count)
+{
+	uint16_t start = (uint16_t)(first << 8);
+	uint16_t end = (uint16_t)(((first + count) << 8) - 1);
+	if (ViceGetMemory(start, end, cpu->space, cpu->bank)) {
+		for (int p = first; p < (first + count); ++p) {
+			cpu->pageState[p] = CPU6510::Page_Pending;
+		}
+		cpu->syncInFlight++;
+	}
+}
+
+// call with sMemSyncMutex locked
+static void IssueRequests(CPU6510* cpu)
+{
+	if (!ViceConnected() || ViceRunning()) { return; }
+
+	// pages visible in a view go out immediately
+	bool viewed = false;
+	for (int page = 0; page < 256;) {
+		if (!PageViewed(cpu, page)) {
+			++page;
+			continue;
+		}
+		viewed = true;
+		if (cpu->pageState[page] != CPU6510::Page_Stale) {
+			++page;
+			continue;
+		}
+		int count = 1;
+		while ((page + count) < 256 && count < kMaxViewedPages &&
+			   cpu->pageState[page + count] == CPU6510::Page_Stale && PageViewed(cpu, page + count)) {
+			++count;
+		}
+		RequestPages(cpu, page, count);
+		page += count;
+	}
+
+	if (cpu->OnDemand()) {
+		if (viewed && !cpu->regsFresh && ViceGetRegisters(cpu->space)) { cpu->regsFresh = true; }
+		return;
+	}
+
+	// everything else streams in behind
+	for (int page = 0; page < 256 && cpu->syncInFlight < kMaxInFlight;) {
+		if (cpu->pageState[page] != CPU6510::Page_Stale) {
+			++page;
+			continue;
+		}
+		int count = 1;
+		while ((page + count) < 256 && count < kBackgroundPages &&
+			   cpu->pageState[page + count] == CPU6510::Page_Stale) {
+			++count;
+		}
+		RequestPages(cpu, page, count);
+		page += count;
+	}
+}
+
+void MemSyncInvalidate(CPU6510* cpu)
+{
+	if (!cpu) { return; }
+	IBMutexLock(&sMemSyncMutex);
+	cpu->syncGeneration++;
+	cpu->syncInFlight = 0;
+	memset(cpu->pageState, CPU6510::Page_Stale, sizeof(cpu->pageState));
+	if (cpu->space != VICEMemSpaces::MainMemory) { cpu->regsFresh = false; }
+	IssueRequests(cpu);
+	IBMutexRelease(&sMemSyncMutex);
+}
+
+void MemSyncInvalidateAll()
+{
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		MemSyncInvalidate(GetCPUSlot(slot));
+	}
+}
+
+// a write through one bank may show up in any other bank of the same memory
+void MemSyncWritten(CPU6510* cpu, uint16_t start, uint16_t end)
+{
+	if (end < start) { return; }
+	IBMutexLock(&sMemSyncMutex);
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		CPU6510* other = GetCPUSlot(slot);
+		if (other && other != cpu && other->space == cpu->space) {
+			for (int page = start >> 8; page <= (end >> 8); ++page) {
+				other->pageState[page] = CPU6510::Page_Stale;
+			}
+		}
+	}
+	IBMutexRelease(&sMemSyncMutex);
+}
+
+bool MemSyncReceived(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end, uint8_t* data)
+{
+	IBMutexLock(&sMemSyncMutex);
+	if (generation != cpu->syncGeneration) {
+		IBMutexRelease(&sMemSyncMutex);
+		return false;
+	}
+	cpu->MemoryFromVICE(start, end, data);
+	if (!cpu->OnDemand()) { MemHistoryReceived(start, end, data); }
+	if (cpu->syncInFlight) { cpu->syncInFlight--; }
+	IssueRequests(cpu);
+	IBMutexRelease(&sMemSyncMutex);
+	return true;
+}
+
+// VICE refused the request, f.e. a drive without true drive emulation, the
+// pages are left as they are until the next stop instead of asking again
+void MemSyncFailed(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end)
+{
+	IBMutexLock(&sMemSyncMutex);
+	if (generation == cpu->syncGeneration) {
+		for (int page = start >> 8; page <= (end >> 8); ++page) {
+			if (cpu->pageState[page] == CPU6510::Page_Pending) {
+				cpu->pageState[page] = CPU6510::Page_Fresh;
+			}
+		}
+		if (cpu->syncInFlight) { cpu->syncInFlight--; }
+	}
+	IBMutexRelease(&sMemSyncMutex);
+}
+
+void MemSyncTimedOut(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end)
+{
+	IBMutexLock(&sMemSyncMutex);
+	if (generation == cpu->syncGeneration) {
+		for (int page = start >> 8; page <= (end >> 8); ++page) {
+			if (cpu->pageState[page] == CPU6510::Page_Pending) {
+				cpu->pageState[page] = CPU6510::Page_Stale;
+			}
+		}
+		if (cpu->syncInFlight) { cpu->syncInFlight--; }
+	}
+	IBMutexRelease(&sMemSyncMutex);
+}
+
+void MemSyncPublish()
+{
+	IBMutexLock(&sMemSyncMutex);
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		if (CPU6510* cpu = GetCPUSlot(slot)) { cpu->Publish(); }
+	}
+	IBMutexRelease(&sMemSyncMutex);
+}
+
+void MemSyncTick()
+{
+	IBMutexLock(&sMemSyncMutex);
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		if (CPU6510* cpu = GetCPUSlot(slot)) {
+			cpu->viewFrame++;
+			IssueRequests(cpu);
+		}
+	}
+	IBMutexRelease(&sMemSyncMutex);
+}
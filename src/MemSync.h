@@ -0,0 +1,37 @@
+#pragma once
+
+#include <inttypes.h>
+
+struct CPU6510;
+
+// Memory sync scheduler
+//  When VICE stops the local copy of memory is out of date. Instead of
+//  requesting all 64K at once the pages that views have read recently are
+//  requested first and the remaining pages follow a few chunks at a time.
+//  Responses land in a second copy of memory and registers that is published
+//  to the views between frames, so a view never draws half a response.
+
+void InitMemSync();
+void ShutdownMemSync();
+
+// VICE stopped or resumed, all pages are stale and responses in flight are dropped
+void MemSyncInvalidate(CPU6510* cpu);
+void MemSyncInvalidateAll();	// main, drive and bank CPUs
+
+// memory was written through one bank, the same pages in other banks are requested again
+void MemSyncWritten(CPU6510* cpu, uint16_t start, uint16_t end);
+
+// memory response arrived, returns false if it belongs to an older stop
+bool MemSyncReceived(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end, uint8_t* data);
+
+// memory request answered with an error
+void MemSyncFailed(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end);
+
+// memory request got no response, the pages are requested again
+void MemSyncTimedOut(CPU6510* cpu, uint32_t generation, uint16_t start, uint16_t end);
+
+// once per UI frame before views draw, everything received becomes visible
+void MemSyncPublish();
+
+// once per UI frame, requests pages that views have scrolled to in each CPU
+void MemSyncTick();
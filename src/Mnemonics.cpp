@@ -620,6 +620,63 @@ InstrRefType GetRefType(CPU6510* cpu, uint16_t addr) {
 	return opcodes[cpu->GetByte(addr)].ref_type;
 }
 
+// address the instruction at pc operates on with the current registers, with
+// zero page wrapping like the 6502
+static uint16_t OperandAddress(CPU6510* cpu, uint16_t pc, uint8_t addrMode)
+{
+	uint8_t z = cpu->GetByte(pc + 1);
+	uint16_t abs = z + ((uint16_t)cpu->GetByte(pc + 2) << 8);
+	switch (addrMode) {
+		case AM_ZP: return z;
+		case AM_ZP_X: return (uint8_t)(z + cpu->regs.X);
+		case AM_ZP_Y: return (uint8_t)(z + cpu->regs.Y);
+		case AM_ABS: return abs;
+		case AM_ABS_X: return (uint16_t)(abs + cpu->regs.X);
+		case AM_ABS_Y: return (uint16_t)(abs + cpu->regs.Y);
+		case AM_ZP_REL_X: {
+			uint8_t ptr = z + cpu->regs.X;
+			return cpu->GetByte(ptr) + ((uint16_t)cpu->GetByte((uint8_t)(ptr + 1)) << 8);
+		}
+		case AM_ZP_Y_REL:
+			return (uint16_t)(cpu->GetByte(z) + ((uint16_t)cpu->GetByte((uint8_t)(z + 1)) << 8) + cpu->regs.Y);
+	}
+	return 0;
+}
+
+// memory the instruction at pc writes outside of the stack, returns the number of addresses
+int InstructionWrites(CPU6510* cpu, uint16_t pc, uint16_t* addrs)
+{
+	const dismnm& op = a6502_ops[cpu->GetByte(pc)];
+	switch (op.mnemonic) {
+		case mnm_sta: case mnm_stx: case mnm_sty: case mnm_sax:
+		case mnm_ahx: case mnm_shx: case mnm_shy: case mnm_tas:
+		case mnm_asl: case mnm_lsr: case mnm_rol: case mnm_ror: case mnm_inc: case mnm_dec:
+		case mnm_slo: case mnm_rla: case mnm_sre: case mnm_rra: case mnm_dcp: case mnm_isc:
+			if (op.addrMode == AM_NON || op.addrMode == AM_ACC || op.addrMode == AM_IMM) { return 0; }
+			addrs[0] = OperandAddress(cpu, pc, op.addrMode);
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// stack pointer after the instruction at pc unless an interrupt is taken
+uint8_t InstructionNextSP(CPU6510* cpu, uint16_t pc)
+{
+	uint8_t sp = cpu->regs.SP;
+	switch (a6502_ops[cpu->GetByte(pc)].mnemonic) {
+		case mnm_pha: case mnm_php: return sp - 1;
+		case mnm_pla: case mnm_plp: return sp + 1;
+		case mnm_jsr: return sp - 2;
+		case mnm_rts: return sp + 2;
+		case mnm_rti: return sp + 3;
+		case mnm_brk: return sp - 3;
+		case mnm_txs: return cpu->regs.X;
+		case mnm_tas: return cpu->regs.A & cpu->regs.X;
+		default: return sp;
+	}
+}
+
 // -
 // [$xxxx]
 // [$xx]
@@ -41,3 +41,5 @@ uint16_t InstrRefAddr(CPU6510* cpu, uint16_t addr);
 int InstrRef(CPU6510* cpu, uint16_t pc, char* buf, size_t bufSize);
 int InstructionBytes(CPU6510* cpu, uint16_t addr, bool illegals = true);
 int ValidInstructionBytes(CPU6510* cpu, uint16_t addr, bool illegals = true);
+int InstructionWrites(CPU6510* cpu, uint16_t pc, uint16_t* addrs);	// memory written outside of the stack
+uint8_t InstructionNextSP(CPU6510* cpu, uint16_t pc);	// without interrupts
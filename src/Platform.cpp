@@ -61,7 +61,7 @@ bool IBCreateThread(IBThread* thread, size_t stackSize, IBThreadFunc func, void
 
 //	int pthread_create(pthread_t * thread, const pthread_attr_t * attr,
 //					   void* (*start_routine) (void*), void* arg);
-	return pthread_create(thread, &attr, func, param);
+	return pthread_create(thread, &attr, func, param) == 0;
 #endif
 }
 
@@ -79,6 +79,134 @@ bool IBDestroyThread(IBThread* thread)
 #endif
 }
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <vector>
+
+struct IBMapFile {
+	struct Block {
+		void* data;
+		size_t bytes;
+#ifdef _WIN32
+		HANDLE mapping;
+#endif
+	};
+	std::vector<Block> blocks;
+	uint64_t size;
+#ifdef _WIN32
+	HANDLE file;
+#else
+	FILE* file;
+#endif
+};
+
+IBMapFile* IBMapFileCreate()
+{
+#ifdef _WIN32
+	char path[MAX_PATH], name[MAX_PATH];
+	if (!GetTempPathA(MAX_PATH, path) || !GetTempFileNameA(path, "ibl", 0, name)) { return nullptr; }
+	HANDLE file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+							  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (file == INVALID_HANDLE_VALUE) { return nullptr; }
+#else
+	FILE* file = tmpfile();
+	if (!file) { return nullptr; }
+#endif
+	IBMapFile* map = new IBMapFile;
+	map->file = file;
+	map->size = 0;
+	return map;
+}
+
+void* IBMapFileAdd(IBMapFile* map, size_t bytes)
+{
+	if (!map || !bytes || (bytes % IBMapFile_Granularity)) { return nullptr; }
+	IBMapFile::Block block = {};
+	block.bytes = bytes;
+	uint64_t offset = map->size, size = map->size + bytes;
+#ifdef _WIN32
+	block.mapping = CreateFileMappingA(map->file, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (!block.mapping) { return nullptr; }
+	block.data = MapViewOfFile(block.mapping, FILE_MAP_ALL_ACCESS, (DWORD)(offset >> 32), (DWORD)offset, bytes);
+	if (!block.data) {
+		CloseHandle(block.mapping);
+		return nullptr;
+	}
+#else
+	int fd = fileno(map->file);
+	if (ftruncate(fd, (off_t)size) != 0) { return nullptr; }
+	block.data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)offset);
+	if (block.data == MAP_FAILED) { return nullptr; }
+#endif
+	map->size = size;
+	map->blocks.push_back(block);
+	return block.data;
+}
+
+void IBMapFileClose(IBMapFile* map)
+{
+	if (!map) { return; }
+	for (size_t b = 0, n = map->blocks.size(); b < n; ++b) {
+#ifdef _WIN32
+		UnmapViewOfFile(map->blocks[b].data);
+		CloseHandle(map->blocks[b].mapping);
+#else
+		munmap(map->blocks[b].data, map->blocks[b].bytes);
+#endif
+	}
+#ifdef _WIN32
+	CloseHandle(map->file);
+#else
+	fclose(map->file);
+#endif
+	delete map;
+}
+
+const void* IBMapFileRead(const char* filename, size_t& size)
+{
+	const void* data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) { return nullptr; }
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+		if (HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);	// the view keeps the mapping open
+			CloseHandle(mapping);
+			if (data) { size = (size_t)fileSize.QuadPart; }
+		}
+	}
+	CloseHandle(file);
+#else
+	FILE* file = fopen(filename, "rb");
+	if (!file) { return nullptr; }
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	if (fileSize > 0) {
+		void* view = mmap(nullptr, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (view != MAP_FAILED) {
+			data = view;
+			size = (size_t)fileSize;
+		}
+	}
+	fclose(file);
+#endif
+	return data;
+}
+
+void IBMapFileUnmap(const void* data, size_t size)
+{
+	if (!data) { return; }
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
 #ifdef _WIN32
 HWND GetHWnd();
 #endif
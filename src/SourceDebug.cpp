@@ -8,6 +8,9 @@
 #include "ViceInterface.h"
 #include "Breakpoints.h"
 #include "SourceDebug.h"
+#include "SymbolLoad.h"
+#include "SymbolCache.h"
+#include "HashTable.h"
 #include "platform.h"
 
 // Format:
@@ -28,15 +31,36 @@ struct SourceDebugSegment {
 	uint16_t addrFirst, addrLast;
 	SourceDebugLine* lines;
 	strref* blockNames;	// indexed by lines->block
+	uint32_t numBlocks;
 	strref name;
 };
 
 struct SourceDebug {
 	std::vector<SourceDebugSegment> segments; // contains blocks which contains lines
 	std::vector<void*> files; // segments reference strings in these files directly
+	std::vector<char> sourceFiles;	// paths of the sources read, zero terminated one after another
+};
+
+// source debug in a cache, strings are offsets in one block of text
+enum { kNoCachedText = 0xffffffff };
+
+struct SourceCacheString {
+	uint32_t offset, len;
+};
+
+struct SourceCacheSegment {
+	SourceCacheString name;
+	uint32_t numBlocks;
+	uint16_t addrFirst, addrLast;
+};
+
+struct SourceCacheLine {
+	uint32_t text;
+	uint8_t len, spaces, block, pad;
 };
 
 SourceDebug* sSourceDebug = nullptr;
+static SourceDebug* sPendingSourceDebug = nullptr;	// read by the loader thread, not shown yet
 
 char* sListing = nullptr;
 size_t sListingSize = 0;
@@ -65,25 +89,30 @@ strref GetSourceAt(uint16_t addr, int &spaces)
 	return strref();
 }
 
+static void FreeSourceDebug(SourceDebug* dbg)
+{
+	while (!dbg->segments.empty()) {
+		SourceDebugSegment& seg = dbg->segments.back();
+		free(seg.lines);
+		free(seg.blockNames);
+		dbg->segments.pop_back();
+	}
+	while (!dbg->files.empty()) {
+		void* file = dbg->files.back();
+		if (file != sListing) {
+			free(file);
+		}
+		dbg->files.pop_back();
+	}
+	delete dbg;
+}
+
 // clean just the source debug references not the original files
 void ClearSourceDebugMap()
 {
 	if (SourceDebug* dbg = sSourceDebug) {
 		IBMutexLock(&sSrcDbgMutex);
-		while (!dbg->segments.empty()) {
-			SourceDebugSegment& seg = dbg->segments.back();
-			free(seg.lines);
-			free(seg.blockNames);
-			dbg->segments.pop_back();
-		}
-		while (!dbg->files.empty()) {
-			void* file = dbg->files.back();
-			if (file != sListing) {
-				free(file);
-			}
-			dbg->files.pop_back();
-		}
-		free(dbg);
+		FreeSourceDebug(dbg);
 		sSourceDebug = nullptr;
 		IBMutexRelease(&sSrcDbgMutex);
 	}
@@ -92,24 +121,10 @@ void ClearSourceDebugMap()
 void ClearSourceDebug()
 {
 	IBMutexLock(&sSrcDbgMutex);
-	if (SourceDebug* dbg = sSourceDebug) {
-		sSourceDebug = nullptr;
-		while (dbg->segments.size()) {
-			SourceDebugSegment& seg = dbg->segments[dbg->segments.size() - 1];
-			free(seg.lines);
-			free(seg.blockNames);
-			dbg->segments.pop_back();
-		}
-		while (dbg->files.size()) {
-			void* file = dbg->files[dbg->files.size() - 1];
-			if (file != sListing) {
-				free(dbg->files[dbg->files.size() - 1]);
-			}
-			dbg->files.pop_back();
-		}
-		free(dbg);
-	}
+	SourceDebug* dbg = sSourceDebug;
+	sSourceDebug = nullptr;
 	IBMutexRelease(&sSrcDbgMutex);
+	if (dbg) { FreeSourceDebug(dbg); }
 	if (sListing) {
 		free(sListing);
 		sListing = nullptr;
@@ -124,14 +139,165 @@ void InitSourceDebug()
 
 void ShutdownSourceDebug()
 {
+	ClearPendingSourceDebug();
 	ClearSourceDebug();
 
 	IBMutexDestroy(&sSrcDbgMutex);
 }
 
+void ClearPendingSourceDebug()
+{
+	if (SourceDebug* dbg = sPendingSourceDebug) {
+		sPendingSourceDebug = nullptr;
+		FreeSourceDebug(dbg);
+	}
+}
+
+// show the source debug info the loader read, replaces the listing as reading a new one did
+void CommitSourceDebug()
+{
+	if (SourceDebug* dbg = sPendingSourceDebug) {
+		sPendingSourceDebug = nullptr;
+		IBMutexLock(&sSrcDbgMutex);
+		SourceDebug* prev = sSourceDebug;
+		sSourceDebug = dbg;
+		IBMutexRelease(&sSrcDbgMutex);
+		if (prev) { FreeSourceDebug(prev); }
+		if (sListing) {
+			free(sListing);
+			sListing = nullptr;
+			sListingSize = 0;
+		}
+	}
+}
+
+const char* PendingSourceFiles(size_t& size)
+{
+	if (!sPendingSourceDebug || sPendingSourceDebug->sourceFiles.empty()) { return nullptr; }
+	size = sPendingSourceDebug->sourceFiles.size();
+	return sPendingSourceDebug->sourceFiles.data();
+}
+
+static SourceCacheString AddCachedText(std::vector<char>& text, const char* str, size_t len)
+{
+	SourceCacheString cached = { (uint32_t)text.size(), (uint32_t)len };
+	text.insert(text.end(), str, str + len);
+	return cached;
+}
+
+// the lines point into the sources, only the lines that are used are written
+void WritePendingSourceDebug(SymbolCacheWriter& cache)
+{
+	const SourceDebug* dbg = sPendingSourceDebug;
+	std::vector<SourceCacheSegment> segments;
+	std::vector<SourceCacheLine> lines;
+	std::vector<SourceCacheString> blockNames;
+	std::vector<char> text;
+	HashTable<uint64_t, uint32_t> lineText;	// line and length -> offset in text
+	for (size_t s = 0, n = dbg ? dbg->segments.size() : 0; s < n; ++s) {
+		const SourceDebugSegment& seg = dbg->segments[s];
+		SourceCacheSegment cachedSeg = { AddCachedText(text, seg.name.get(), seg.name.get_len()), seg.numBlocks, seg.addrFirst, seg.addrLast };
+		segments.push_back(cachedSeg);
+		for (uint32_t b = 0; b < seg.numBlocks; ++b) {
+			blockNames.push_back(AddCachedText(text, seg.blockNames[b].get(), seg.blockNames[b].get_len()));
+		}
+		for (size_t a = 0, numLines = (size_t)seg.addrLast + 1 - seg.addrFirst; a < numLines; ++a) {
+			const SourceDebugLine& ln = seg.lines[a];
+			SourceCacheLine cachedLine = { kNoCachedText, ln.len, ln.spaces, ln.block, 0 };
+			if (ln.line) {
+				uint64_t key = ((uint64_t)(uintptr_t)ln.line << 8) | ln.len;
+				if (uint32_t* offset = lineText.Value(key)) {
+					cachedLine.text = *offset;
+				} else {
+					cachedLine.text = AddCachedText(text, ln.line, ln.len).offset;
+					lineText.Insert(key, cachedLine.text);
+				}
+			}
+			lines.push_back(cachedLine);
+		}
+	}
+	cache.AddValue((uint32_t)(dbg ? 1 : 0));
+	cache.Add(segments);
+	cache.Add(lines);
+	cache.Add(blockNames);
+	cache.Add(text);
+	cache.Add(dbg ? dbg->sourceFiles : std::vector<char>());
+}
+
+// false leaves nothing pending
+bool ReadPendingSourceDebug(SymbolCacheReader& cache)
+{
+	ClearPendingSourceDebug();
+	uint32_t hasDebug = 0;
+	std::vector<SourceCacheSegment> segments;
+	std::vector<SourceCacheLine> lines;
+	std::vector<SourceCacheString> blockNames;
+	std::vector<char> text, sourceFiles;
+	cache.Value(hasDebug);
+	cache.Next(segments);
+	cache.Next(lines);
+	cache.Next(blockNames);
+	cache.Next(text);
+	cache.Next(sourceFiles);
+	if (cache.failed) { return false; }
+	if (!hasDebug) { return true; }
+
+	// check that it all adds up before using it
+	size_t numLines = 0, numBlocks = 0;
+	for (std::vector<SourceCacheSegment>::iterator seg = segments.begin(); seg != segments.end(); ++seg) {
+		if (seg->addrFirst > seg->addrLast || seg->name.offset > text.size() || seg->name.len > (text.size() - seg->name.offset)) { return false; }
+		numLines += (size_t)seg->addrLast + 1 - seg->addrFirst;
+		numBlocks += seg->numBlocks;
+	}
+	if (numLines != lines.size() || numBlocks != blockNames.size()) { return false; }
+	for (std::vector<SourceCacheString>::iterator name = blockNames.begin(); name != blockNames.end(); ++name) {
+		if (name->offset > text.size() || name->len > (text.size() - name->offset)) { return false; }
+	}
+	for (std::vector<SourceCacheLine>::iterator line = lines.begin(); line != lines.end(); ++line) {
+		if (line->text != kNoCachedText && (line->text > text.size() || line->len > (text.size() - line->text))) { return false; }
+	}
+
+	SourceDebug* dbg = new SourceDebug;
+	char* textCopy = (char*)malloc(text.size() + 1);
+	if (!textCopy) {
+		delete dbg;
+		return false;
+	}
+	if (text.size()) { memcpy(textCopy, text.data(), text.size()); }
+	dbg->files.push_back(textCopy);
+	dbg->sourceFiles.swap(sourceFiles);
+	const SourceCacheLine* line = lines.data();
+	const SourceCacheString* blockName = blockNames.data();
+	for (std::vector<SourceCacheSegment>::iterator seg = segments.begin(); seg != segments.end(); ++seg) {
+		dbg->segments.push_back(SourceDebugSegment());
+		SourceDebugSegment* segSrc = &dbg->segments[dbg->segments.size() - 1];
+		size_t segLines = (size_t)seg->addrLast + 1 - seg->addrFirst;
+		segSrc->addrFirst = seg->addrFirst;
+		segSrc->addrLast = seg->addrLast;
+		segSrc->lines = (SourceDebugLine*)calloc(segLines, sizeof(SourceDebugLine));
+		segSrc->blockNames = (strref*)calloc(seg->numBlocks ? seg->numBlocks : 1, sizeof(strref));
+		segSrc->numBlocks = seg->numBlocks;
+		segSrc->name = strref(textCopy + seg->name.offset, (strl_t)seg->name.len);
+		for (uint32_t b = 0; b < seg->numBlocks; ++b, ++blockName) {
+			if (segSrc->blockNames) { segSrc->blockNames[b] = strref(textCopy + blockName->offset, (strl_t)blockName->len); }
+		}
+		for (size_t l = 0; l < segLines; ++l, ++line) {
+			if (!segSrc->lines) { continue; }
+			SourceDebugLine* ln = segSrc->lines + l;
+			ln->line = line->text == kNoCachedText ? nullptr : (textCopy + line->text);
+			ln->len = line->len;
+			ln->spaces = line->spaces;
+			ln->block = line->block;
+		}
+	}
+	sPendingSourceDebug = dbg;
+	return true;
+}
+
 // These structs are for parsing the XML, gets converted to a SourceDebug when all is available
 
 struct ParseDebugSource {
+	strref name;
 	void* file;
 	size_t size;
 	// temp line index -> buffer offset
@@ -155,15 +321,46 @@ struct ParseDebugSegment {
 };
 
 struct ParseDebugText {
+	const char* xml;	// for progress
+	size_t xmlSize;
 	strref path; // the path from the filename with the trailing slash, or empty
 	strref segment;
 	std::vector<ParseDebugSource*> files;
 	std::vector<ParseDebugSegment*> segments;
 };
 
+static void DebugSourcePath(const ParseDebugText* parse, const ParseDebugSource* source, strown<PATH_MAX_LEN>& file)
+{
+	file.clear();
+	if (source->name.find(':') < 0) { file.append(parse->path); }
+	file.append(source->name);
+}
+
+// runs on the load workers, each source is read and line indexed independently
+static void LoadDebugSource(void* user, size_t index)
+{
+	ParseDebugText* parse = (ParseDebugText*)user;
+	ParseDebugSource* source = parse->files[index];
+	if (!source || source->file) { return; }
+	strown<PATH_MAX_LEN> file;
+	DebugSourcePath(parse, source, file);
+	source->file = LoadBinary(file.c_str(), source->size);
+	if (source->file) {
+		const char* start = (const char*)source->file;
+		strref read(start, (strl_t)source->size);
+		source->lineOffsets.reserve(read.count_lines());
+		while (read) {
+			strref num_line = read.next_line();
+			source->lineOffsets.push_back((uint32_t)(num_line.get() - start));
+		}
+	}
+}
+
 bool C64DbgXMLCB(void* user, strref tag_or_data, const strref* tag_stack, int size_stack, XML_TYPE type)
 {
 	ParseDebugText* parse = (ParseDebugText*)user;
+	if (SymbolLoadCancelled()) { return false; }
+	SymbolLoadStep((size_t)(tag_or_data.get() - parse->xml));
 
 	if (type == XML_TYPE::XML_TYPE_TEXT && size_stack) {
 		if (tag_stack->get_word().same_str("Sources")) {
@@ -171,23 +368,13 @@ bool C64DbgXMLCB(void* user, strref tag_or_data, const strref* tag_stack, int si
 			while (strref line = tag_or_data.line()) {
 				strref idstr = line.split_token_trim(',');
 				uint32_t id = (uint32_t)idstr.atoi();
-				strown<PATH_MAX_LEN> file;
-				if (line.find(':') < 0) { file.append(parse->path); }
-				file.append(line);
 				while (parse->files.size() <= id) { parse->files.push_back(nullptr); }
-				ParseDebugSource* source = new ParseDebugSource();
-				parse->files[id] = source;
-				source->file = LoadBinary(file.c_str(), source->size);
-				if (source->file) {
-					const char* start = (const char*)source->file;
-					strref read(start, (strl_t)source->size);
-					source->lineOffsets.reserve(read.count_lines());
-					while (read) {
-						strref num_line = read.next_line();
-						source->lineOffsets.push_back((uint32_t)(num_line.get() - start));
-					}
-				}
+				if (!parse->files[id]) { parse->files[id] = new ParseDebugSource(); }
+				parse->files[id]->name = line;
 			}
+			// the blocks that follow need the line offsets, read all sources before going on
+			SymbolLoadParallel("Reading sources", parse->files.size(), LoadDebugSource, parse);
+			SymbolLoadStage("Reading debug info", parse->xmlSize);
 		} else if (tag_stack->get_word().same_str("Block")) {
 			ParseDebugSegment* seg = nullptr;
 			for (size_t s = 0; s < parse->segments.size(); ++s) {
@@ -227,7 +414,7 @@ bool C64DbgXMLCB(void* user, strref tag_or_data, const strref* tag_stack, int si
 					if (file_num < parse->files.size()) {
 						ParseDebugSource* source = parse->files[file_num];
 						size_t row_num = (size_t)row.atoui();
-						if (row_num && source->file && row_num <= source->lineOffsets.size()) {
+						if (row_num && source && source->file && row_num <= source->lineOffsets.size()) {
 							strref srcTxt = strref((const char*)source->file, strl_t(source->size));
 							strl_t c1 = (strl_t)col1.atoui();
 							if (c1) { c1--; }
@@ -246,7 +433,7 @@ bool C64DbgXMLCB(void* user, strref tag_or_data, const strref* tag_stack, int si
 			tag_or_data.trim_whitespace();
 			if (tag_or_data) {
 				//ViceSetUpdateSymbols(false);
-				ClearSymbols();
+				BeginAddingSymbols();
 				while (strref label = tag_or_data.line()) {
 					strref seg = label.split_token_trim(',');
 					strref addr = label.split_token_trim(',');
@@ -258,20 +445,20 @@ bool C64DbgXMLCB(void* user, strref tag_or_data, const strref* tag_stack, int si
 								  seg.get(), seg.get_len());
 					}
 				}
-				FilterSectionSymbols();
 			}
 		} else if (tag_stack->get_word().same_str("Breakpoints")) {
 			//<Breakpoints values="SEGMENT,ADDRESS,ARGUMENT">
 			tag_or_data.trim_whitespace();
-			if (tag_or_data) { RemoveAllBreakpoints(); }
+			std::vector<uint16_t> addresses;
 			while (strref bkpt = tag_or_data.line()) {
 				/*strref seg =*/ bkpt.split_token_trim(',');
 				strref addr = bkpt.split_token_trim(',');
 				/*strref cond =*/ bkpt.split_token_trim(',');
 				if (addr.get_first() == '$') { ++addr; }
-				ViceAddBreakpoint((uint16_t)addr.ahextoui());
+				addresses.push_back((uint16_t)addr.ahextoui());
 				// TODO: Also send condition for breakpoint void ViceSetCondition(int checkPoint, strref condition)
 			}
+			if (!addresses.empty()) { SymbolLoadBreakpoints(addresses.data(), addresses.size(), true); }
 
 		}
 	} else if (type == XML_TYPE::XML_TYPE_TAG_OPEN) {
@@ -291,17 +478,30 @@ bool ReadC64DbgSrc(const char* filename)
 	size_t size;
 	bool success = false;
 	if (void* voidbuf = LoadBinary(filename, size)) {
-		ClearSourceDebug();
-		ClearSymbols();
-		IBMutexLock(&sSrcDbgMutex);
-		if (ParseXML(strref((const char*)voidbuf, (strl_t)size), C64DbgXMLCB, &parse)) {
+		// symbols are cleared by a debug file without labels
+		BeginAddingSymbols();
+		ClearPendingSourceDebug();
+		parse.xml = (const char*)voidbuf;
+		parse.xmlSize = size;
+		SymbolLoadStage("Reading debug info", size);
+		if (ParseXML(strref((const char*)voidbuf, (strl_t)size), C64DbgXMLCB, &parse) && !SymbolLoadCancelled()) {
 			SourceDebug* dbg = new SourceDebug;
-			sSourceDebug = dbg;
 
-			// remember the file pointers for later cleanup
-			dbg->files.reserve(parse.files.size());
+			// remember the file pointers for later cleanup, segment and block names are in the debug file
+			dbg->files.reserve(parse.files.size() + 1);
+			dbg->files.push_back(voidbuf);
+			for (size_t f = 0; f < parse.files.size(); ++f) {
+				if (parse.files[f] && parse.files[f]->file) { dbg->files.push_back(parse.files[f]->file); }
+			}
+
+			// the sources a cache of this depends on, including any that were missing
 			for (size_t f = 0; f < parse.files.size(); ++f) {
-				dbg->files.push_back(parse.files[f]->file);
+				if (parse.files[f]) {
+					strown<PATH_MAX_LEN> file;
+					DebugSourcePath(&parse, parse.files[f], file);
+					dbg->sourceFiles.insert(dbg->sourceFiles.end(), file.get(), file.get() + file.get_len());
+					dbg->sourceFiles.push_back(0);
+				}
 			}
 
 			// segments depend on if they have data or not, could be empty.
@@ -327,6 +527,7 @@ bool ReadC64DbgSrc(const char* filename)
 					segSrc->addrLast = addrLast;
 					segSrc->lines = (SourceDebugLine*)calloc((size_t)addrLast + 1 - (size_t)addrFirst, sizeof(SourceDebugLine));
 					segSrc->blockNames = (strref*)calloc(seg->blocks.size(), sizeof(strref));
+					segSrc->numBlocks = (uint32_t)seg->blocks.size();
 					segSrc->name = seg->name;
 					for (size_t b = 0; b < seg->blocks.size(); ++b) {
 						ParseDebugBlock* blk = seg->blocks[b];
@@ -357,7 +558,13 @@ bool ReadC64DbgSrc(const char* filename)
 					}
 				}
 			}
+			sPendingSourceDebug = dbg;
 			success = true;
+		} else {
+			for (size_t f = 0; f < parse.files.size(); ++f) {
+				if (parse.files[f] && parse.files[f]->file) { free(parse.files[f]->file); }
+			}
+			free(voidbuf);
 		}
 		// clear up ParseDebugText
 		while (parse.files.size()) {
@@ -370,9 +577,9 @@ bool ReadC64DbgSrc(const char* filename)
 				delete segment->blocks[segment->blocks.size() - 1];
 				segment->blocks.pop_back();
 			}
+			delete segment;
 			parse.segments.pop_back();
 		}
-		IBMutexRelease(&sSrcDbgMutex);
 	}
 	return success;
 }
@@ -453,6 +660,7 @@ void ListingToSrcDebug(int column)
 		segSrc->addrLast = addrLast;
 		segSrc->lines = (SourceDebugLine*)calloc(size_t(addrLast) + 1 - size_t(addrFirst), sizeof(SourceDebugLine));
 		segSrc->blockNames = (strref*)calloc(1, sizeof(strref));
+		segSrc->numBlocks = 1;
 		segSrc->name = "Listing";
 		if (segSrc->blockNames) { segSrc->blockNames[0] = "Listing"; }
 			// fill in addresses with line info
@@ -1,12 +1,21 @@
 #pragma once
 
-bool ReadC64DbgSrc(const char* filename);
+bool ReadC64DbgSrc(const char* filename);	// loader thread, kept aside until CommitSourceDebug
 bool ReadListingFile(const char* filename);
 strref GetSourceAt(uint16_t addr, int &spaces);
 strref GetListingFile();
 void ListingToSrcDebug(int column);
 void InitSourceDebug();
 void ShutdownSourceDebug();
+void CommitSourceDebug();	// UI thread
+void ClearPendingSourceDebug();
+
+// the cache of a debug file
+struct SymbolCacheWriter;
+struct SymbolCacheReader;
+const char* PendingSourceFiles(size_t& size);	// paths of the sources read, zero terminated one after another
+void WritePendingSourceDebug(SymbolCacheWriter& cache);
+bool ReadPendingSourceDebug(SymbolCacheReader& cache);	// instead of reading a debug file
 
 
 
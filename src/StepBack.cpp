@@ -0,0 +1,194 @@
+// Step back by undoing recorded single steps
+//	A step only changes the registers, the memory the instruction stores to and
+//	the stack. The stack bytes around SP are saved as a whole so a pull, a
+//	subroutine call or an interrupt taken during the step are all covered.
+//	VICE chip state such as timers or raster position is not restored.
+
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "struse/struse.h"
+#include "6510.h"
+#include "Mnemonics.h"
+#include "ViceInterface.h"
+#include "MemSync.h"
+#include "StepBack.h"
+
+enum {
+	kMaxStepBack = 4096,	// oldest steps are dropped beyond this
+	kMaxWrites = 1,			// stores and read-modify-write touch one address
+	kStackAbove = 3,		// saved stack bytes above SP, pulls read at most 3
+	kStackBytes = 9,		// SP+3 down to SP-5, a push of 3 then an interrupt of 3
+	kInterruptPush = 3		// return address and flags
+};
+
+struct StepRecord {
+	CPU6510::Regs regs;		// before the step
+	uint16_t writeAddr[kMaxWrites];
+	uint8_t writeOld[kMaxWrites];
+	uint8_t stackOld[kStackBytes];	// from $100+SP+kStackAbove down
+	uint8_t numWrites;
+	uint8_t nextSP;			// expected SP after the step without an interrupt
+	bool confirmed;			// VICE stopped with the expected SP
+};
+
+static IBMutex sStepBackMutex;
+static StepRecord* sSteps = nullptr;	// ring of kMaxStepBack
+static int sFirstStep = 0;
+static int sNumSteps = 0;
+
+static uint16_t StackAddr(uint8_t sp, int offset)
+{
+	return 0x100 | (uint8_t)(sp + offset);
+}
+
+static StepRecord* NewestStep()
+{
+	return sNumSteps ? (sSteps + ((sFirstStep + sNumSteps - 1) % kMaxStepBack)) : nullptr;
+}
+
+void InitStepBack()
+{
+	IBMutexInit(&sStepBackMutex, "Step back");
+	sSteps = (StepRecord*)calloc(kMaxStepBack, sizeof(StepRecord));
+}
+
+void ShutdownStepBack()
+{
+	IBMutexLock(&sStepBackMutex);
+	free(sSteps);
+	sSteps = nullptr;
+	sNumSteps = 0;
+	IBMutexRelease(&sStepBackMutex);
+	IBMutexDestroy(&sStepBackMutex);
+}
+
+void StepBackClear()
+{
+	IBMutexLock(&sStepBackMutex);
+	sNumSteps = 0;
+	IBMutexRelease(&sStepBackMutex);
+}
+
+void StepBackRecord(CPU6510* cpu)
+{
+	IBMutexLock(&sStepBackMutex);
+	if (!sSteps) {
+		IBMutexRelease(&sStepBackMutex);
+		return;
+	}
+	// stepping again before the last step stopped, the registers are not known
+	StepRecord* last = NewestStep();
+	uint16_t pc = cpu->regs.PC;
+	bool known = (!last || last->confirmed) && cpu->RangeFresh(pc, 3) &&
+		cpu->PageFresh(0x0000) && cpu->PageFresh(0x0100);
+	uint16_t writes[kMaxWrites];
+	int numWrites = known ? InstructionWrites(cpu, pc, writes) : 0;
+	for (int w = 0; w < numWrites; ++w) {
+		if (!cpu->PageFresh(writes[w])) { known = false; }
+	}
+	if (!known) {
+		// a step that can't be undone ends the history
+		sNumSteps = 0;
+		IBMutexRelease(&sStepBackMutex);
+		return;
+	}
+	if (sNumSteps == kMaxStepBack) {
+		sFirstStep = (sFirstStep + 1) % kMaxStepBack;
+		--sNumSteps;
+	}
+	StepRecord* step = sSteps + ((sFirstStep + sNumSteps) % kMaxStepBack);
+	++sNumSteps;
+	step->regs = cpu->regs;
+	step->numWrites = (uint8_t)numWrites;
+	for (int w = 0; w < numWrites; ++w) {
+		step->writeAddr[w] = writes[w];
+		step->writeOld[w] = cpu->ram[writes[w]];
+	}
+	for (int b = 0; b < kStackBytes; ++b) {
+		step->stackOld[b] = cpu->ram[StackAddr(cpu->regs.SP, kStackAbove - b)];
+	}
+	step->nextSP = InstructionNextSP(cpu, pc);
+	step->confirmed = false;
+	IBMutexRelease(&sStepBackMutex);
+}
+
+void StepBackStopped(CPU6510* cpu, const CPU6510::Regs& regs)
+{
+	// the next step is recorded from these pages, fetch them with the visible ones
+	cpu->pageViewed[0x00] = cpu->pageViewed[0x01] = cpu->viewFrame;
+	cpu->pageViewed[regs.PC >> 8] = cpu->pageViewed[(uint16_t)(regs.PC + 2) >> 8] = cpu->viewFrame;
+
+	IBMutexLock(&sStepBackMutex);
+	StepRecord* step = NewestStep();
+	if (step && !step->confirmed) {
+		// an interrupt pushes at the expected SP and below, that must be in the saved bytes
+		int delta = (int)(int8_t)(step->nextSP - step->regs.SP);
+		bool saved = delta <= kStackAbove && (delta - kInterruptPush + 1) >= (kStackAbove - kStackBytes + 1);
+		if (regs.SP == step->nextSP) {
+			step->confirmed = true;
+		} else if (saved && regs.SP == (uint8_t)(step->nextSP - kInterruptPush)) {
+			step->confirmed = true;
+		} else {
+			sNumSteps = 0;
+		}
+	}
+	IBMutexRelease(&sStepBackMutex);
+}
+
+bool StepBackAvailable()
+{
+	if (!ViceConnected() || ViceRunning()) { return false; }
+	IBMutexLock(&sStepBackMutex);
+	StepRecord* step = NewestStep();
+	bool available = step && step->confirmed;
+	IBMutexRelease(&sStepBackMutex);
+	return available;
+}
+
+bool CPUStepBack()
+{
+	CPU6510* cpu = GetMainCPU();
+	if (!cpu || !ViceConnected() || ViceRunning()) { return false; }
+
+	IBMutexLock(&sStepBackMutex);
+	StepRecord* newest = NewestStep();
+	if (!newest || !newest->confirmed) {
+		IBMutexRelease(&sStepBackMutex);
+		return false;
+	}
+	StepRecord step = *newest;
+	--sNumSteps;
+	IBMutexRelease(&sStepBackMutex);
+
+	// stack first, a store into the stack page saved the same byte
+	uint8_t stack[kStackBytes];
+	uint16_t top = StackAddr(step.regs.SP, kStackAbove);
+	for (int b = 0; b < kStackBytes; ++b) { stack[kStackBytes - 1 - b] = step.stackOld[b]; }
+	uint16_t bottom = StackAddr(step.regs.SP, kStackAbove - kStackBytes + 1);
+	if (bottom <= top) {
+		cpu->CopyToRAM(bottom, stack, kStackBytes);
+	} else {	// wraps around the stack page
+		int low = top - 0x100 + 1;
+		cpu->CopyToRAM(0x100, stack + kStackBytes - low, low);
+		cpu->CopyToRAM(bottom, stack, kStackBytes - low);
+	}
+	for (int w = step.numWrites - 1; w >= 0; --w) {
+		cpu->CopyToRAM(step.writeAddr[w], &step.writeOld[w], 1);
+	}
+
+	cpu->regs.A = step.regs.A;
+	cpu->regs.X = step.regs.X;
+	cpu->regs.Y = step.regs.Y;
+	cpu->regs.SP = step.regs.SP;
+	cpu->regs.FL = step.regs.FL;
+	cpu->regs.ZP00 = step.regs.ZP00;
+	cpu->regs.ZP01 = step.regs.ZP01;
+	cpu->regs.PC = step.regs.PC;
+	ViceSetRegisters(*cpu, CPU6510::RM_A | CPU6510::RM_X | CPU6510::RM_Y | CPU6510::RM_SP | CPU6510::RM_FL |
+		CPU6510::RM_ZP00 | CPU6510::RM_ZP01 | CPU6510::RM_PC);
+
+	// VICE answers in order, memory requested from here on is after the restore
+	MemSyncInvalidateAll();
+	return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Stepping back over single steps
+//	Before each single step the registers and the bytes the instruction will
+//	write are saved, decoded from the instruction in the local copy of memory.
+//	When VICE stops after the step the stack pointer confirms that the step
+//	went as decoded. Stepping back sends the saved registers and bytes to VICE.
+
+#include "6510.h"
+
+void InitStepBack();
+void ShutdownStepBack();
+
+void StepBackRecord(CPU6510* cpu);	// about to single step
+void StepBackStopped(CPU6510* cpu, const CPU6510::Regs& regs);	// VICE stopped with these registers
+void StepBackClear();	// running or changed in ways that are not recorded
+
+bool StepBackAvailable();
+bool CPUStepBack();
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <vector>
+#include <algorithm>
 #include "struse/struse.h"
 #include "6510.h"
 #include <string.h>
@@ -14,47 +15,67 @@
 #include "Breakpoints.h"
 #include "platform.h"
 #include "Config.h"
+#include "SymbolLoad.h"
+#include "SymbolCache.h"
 
-struct SymEntry {
-	int16_t count;
-};
-
-struct SymList {
-	enum {
-		MIN_LIST = 7,
-		GROW_LIST = 8
-	};
-	size_t capacity;
-	const char* names[ 1 ];
+struct SymbolInfo {
+	uint32_t address;
+	uint32_t section;
+	uint32_t label;	// offset in the strings of the load
 };
 
-union SymRef {
-	const char* unique;
-	SymList* multi;
+enum {
+	kNoSymbol = 0xffffffff,
+	kTrigramBuckets = 0x10000,
+	kMinTrigramSearch = 3	// shorter searches look at every symbol
 };
 
-struct SymbolInfo {
-	uint32_t address;
-	uint32_t section;
-	char* label;
+// Lookups built in one go from a symbol list
+//	Symbols are bucketed by address with a counting sort and each name hash
+//	starts a chain of the symbols with that name, both in load order. Neither
+//	depends on the hidden sections so they are built once per load. The per
+//	address tables are filled in from the buckets with the hidden sections
+//	masked out, which is all that happens when a section is hidden or shown.
+//	The search keeps a list of symbols per hashed lowercase trigram so a search
+//	only has to check the symbols that have every trigram of the search text.
+struct SymbolIndex {
+	uint32_t addrFirst[0x10001];			// symbols at a are addrSymbols[addrFirst[a]..addrFirst[a+1])
+	std::vector<uint32_t> addrSymbols;		// labelList indices
+	std::vector<uint32_t> sameName;			// next symbol with the same name hash
+	HashTable<uint64_t, uint32_t> names;	// name hash -> first symbol with it
+	std::vector<uint32_t> trigramFirst;		// symbols with trigram bucket t are trigramSymbols[trigramFirst[t]..trigramFirst[t+1])
+	std::vector<uint32_t> trigramSymbols;	// labelList indices, ascending
+	std::vector<uint8_t> hidden;			// per section
+	const char* label[0x10000];				// first visible label at each address
+	int32_t nearest[0x10000];				// closest address at or below with a visible label, -1 if none
+	size_t numAddresses;					// with a visible label
 };
 
-static SymEntry* sLabelCount = nullptr;
-static SymRef* sLabelEntries = nullptr;
-static std::vector<uint16_t> sortedSymAddrs;
-static HashTable<uint64_t, uint32_t> sReverseLookup;
+static SymbolIndex* sSymbolIndex = nullptr;	// for labelList
+static SymbolIndex* sPendingIndex = nullptr;	// for pendingLabelList
 static HashTable<uint64_t, uint32_t> sDuplicateCheck;	// look up from section + symbol + value
-static std::vector<char*> sectionNames;
+static std::vector<uint32_t> sectionNames;			// offsets in symbolStrings
 static std::vector<SymbolInfo> labelList;
-static std::vector<SymbolInfo> sortedLabelList;			// this is a copy of labelList without ownership of values
+static std::vector<char> symbolStrings;					// all the labels and section names, zero terminated
+static std::vector<uint32_t> sortedAllLabels;			// labelList indices in the sorted order
+static std::vector<uint32_t> sortedLabelList;			// the visible ones in sortedAllLabels
 static std::vector<uint64_t> hiddenSections;			// hashed value of section name
-static std::vector<uint32_t> matchedLabelList;			// search result
+static std::vector<uint32_t> matchedLabelList;			// search result, labelList indices in the sorted order
+static std::vector<uint8_t> searchCandidates;			// per labelList index, set while searching
+static strown<256> searchPattern;						// as typed, a leading * searches anywhere in the symbol
+static uint32_t searchStart = 0, searchEnd = 0xffffffff;	// address range
+static bool searchCaseSensitive = true;
+static bool searchActive = false;						// matchedLabelList is the result, otherwise all of sortedLabelList
+static std::vector<uint32_t> pendingSectionNames;		// being loaded, only the loader thread adds to these
+static std::vector<SymbolInfo> pendingLabelList;
+static std::vector<char> pendingStrings;
+static HashTable<uint64_t, uint32_t> sPendingSections;	// lowercase name hash -> pendingSectionNames index
 static bool lastSortedName = false;
 static bool lastSortedUp = true;
 static IBMutex symbolMutex;
 
 
-bool SymbolsLoaded() { return sortedSymAddrs.size() > 0; }
+bool SymbolsLoaded() { return sSymbolIndex && sSymbolIndex->numAddresses > 0; }
 
 void InitSymbols()
 {
@@ -66,116 +87,183 @@ void ShutdownSymbols()
 	IBMutexDestroy(&symbolMutex);
 }
 
-char* StringCopy(strref orig)
+// strings are appended to one block per load that is dropped in one go
+static uint32_t AddString(std::vector<char>& strings, strref str)
+{
+	uint32_t offset = (uint32_t)strings.size();
+	strings.insert(strings.end(), str.get(), str.get() + str.get_len());
+	strings.push_back(0);
+	return offset;
+}
+
+// section names are matched ignoring case
+static uint64_t SectionKey(strref name)
 {
-	char* copy = (char*)malloc((size_t)orig.get_len() + 1);
-	if (copy) {
-		if (orig.get_len()) { memcpy(copy, orig.get(), orig.get_len()); }
-		copy[orig.get_len()] = 0;
+	uint64_t hash = 14695981039346656037ULL;
+	for (strl_t i = 0; i < name.get_len(); ++i) {
+		uint8_t c = (uint8_t)name[i];
+		if (c >= 'A' && c <= 'Z') { c += 'a' - 'A'; }
+		hash = (hash ^ c) * 1099511628211ULL;
 	}
-	return copy;
+	return hash ? hash : 1;	// 0 is an empty slot
 }
 
-void StringFree(char* str)
+static uint32_t TrigramBucket(const char* str)
 {
-	if (str) { free(str); }
+	uint32_t key = 0;
+	for (int c = 0; c < 3; ++c) {
+		uint8_t chr = (uint8_t)str[c];
+		if (chr >= 'A' && chr <= 'Z') { chr += 'a' - 'A'; }
+		key = (key << 8) | chr;
+	}
+	return (key * 2654435761u) >> 16;
 }
 
-void ResetSymbols()
+static SymbolIndex* BuildSymbolIndex(const std::vector<SymbolInfo>& labels, const std::vector<char>& strings)
 {
-	IBMutexLock(&symbolMutex);
-	sReverseLookup.Clear();
-	sortedSymAddrs.clear();
-	sortedLabelList.clear();
-	if( sLabelCount ) {
-		for( size_t adr = 0; adr < 0x10000; ++adr ) {
-			if( sLabelCount[ adr ].count > 1 ) {
-				if (sLabelEntries && sLabelEntries[adr].multi) {
-					free(sLabelEntries[adr].multi);
-				}
+	SymbolIndex* index = new SymbolIndex;
+	uint32_t count = (uint32_t)labels.size();
+	memset(index->addrFirst, 0, sizeof(index->addrFirst));
+	for (uint32_t i = 0; i < count; ++i) {
+		if (labels[i].address < 0x10000) { ++index->addrFirst[labels[i].address + 1]; }
+	}
+	for (size_t a = 0; a < 0x10000; ++a) { index->addrFirst[a + 1] += index->addrFirst[a]; }
+	index->addrSymbols.resize(index->addrFirst[0x10000]);
+	std::vector<uint32_t> fill(index->addrFirst, index->addrFirst + 0x10000);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (labels[i].address < 0x10000) { index->addrSymbols[fill[labels[i].address]++] = i; }
+	}
+
+	// backwards so the chains start with the first symbol of each name
+	index->sameName.resize(count);
+	for (uint32_t i = count; i-- > 0;) {
+		index->sameName[i] = kNoSymbol;
+		uint64_t hash = strref(&strings[labels[i].label]).fnv1a_64();
+		if (uint32_t* first = index->names.Value(hash)) {
+			index->sameName[i] = *first;
+			*first = i;
+		} else {
+			index->names.Insert(hash, i);
+		}
+	}
+
+	// count then fill the trigram lists, a symbol is added once per bucket
+	index->trigramFirst.assign(kTrigramBuckets + 1, 0);
+	std::vector<uint32_t> lastInBucket(kTrigramBuckets, kNoSymbol);
+	for (uint32_t i = 0; i < count; ++i) {
+		const char* label = &strings[labels[i].label];
+		for (size_t c = 0; label[c] && label[c + 1] && label[c + 2]; ++c) {
+			uint32_t bucket = TrigramBucket(label + c);
+			if (lastInBucket[bucket] != i) {
+				lastInBucket[bucket] = i;
+				++index->trigramFirst[bucket + 1];
 			}
 		}
-		free( sLabelCount );
-		sLabelCount = nullptr;
-		free( sLabelEntries );
-		sLabelEntries = nullptr;
 	}
-	IBMutexRelease(&symbolMutex);
+	for (size_t t = 0; t < kTrigramBuckets; ++t) { index->trigramFirst[t + 1] += index->trigramFirst[t]; }
+	index->trigramSymbols.resize(index->trigramFirst[kTrigramBuckets]);
+	fill.assign(index->trigramFirst.begin(), index->trigramFirst.end() - 1);
+	lastInBucket.assign(kTrigramBuckets, kNoSymbol);
+	for (uint32_t i = 0; i < count; ++i) {
+		const char* label = &strings[labels[i].label];
+		for (size_t c = 0; label[c] && label[c + 1] && label[c + 2]; ++c) {
+			uint32_t bucket = TrigramBucket(label + c);
+			if (lastInBucket[bucket] != i) {
+				lastInBucket[bucket] = i;
+				index->trigramSymbols[fill[bucket]++] = i;
+			}
+		}
+	}
+
+	memset(index->label, 0, sizeof(index->label));
+	for (size_t a = 0; a < 0x10000; ++a) { index->nearest[a] = -1; }
+	index->numAddresses = 0;
+	return index;
 }
 
-size_t GetLabelSlot(uint16_t addr)
+static bool SymbolHidden(const SymbolIndex* index, const SymbolInfo& sym)
 {
-	size_t lb = 0, ub = sortedSymAddrs.size();
+	return sym.section < index->hidden.size() && index->hidden[sym.section];
+}
 
-	while ((ub-lb)>1) {
-		size_t cb = (ub + lb) >> 1;
-		uint16_t addr_cmp = sortedSymAddrs[cb];
-		if (addr == addr_cmp) {
-			return cb;
-		} else if (addr > addr_cmp) {
-			lb = cb;
-		} else {
-			ub = cb;
+static std::vector<uint8_t> HiddenSectionMask(const std::vector<uint32_t>& sections, const std::vector<char>& strings)
+{
+	std::vector<uint8_t> hidden(sections.size(), 0);
+	for (size_t j = 0, n = sections.size(); j < n && !hiddenSections.empty(); ++j) {
+		uint64_t hash = strref(&strings[sections[j]]).fnv1a_64();
+		for (std::vector<uint64_t>::iterator h = hiddenSections.begin(); h != hiddenSections.end(); ++h) {
+			if (*h == hash) {
+				hidden[j] = 1;
+				break;
+			}
 		}
 	}
-	return lb;
+	return hidden;
+}
+
+// fill in the per address tables from the first visible symbol at each address
+static void ApplySectionMask(SymbolIndex* index, const std::vector<SymbolInfo>& labels, const std::vector<char>& strings)
+{
+	int32_t nearest = -1;
+	size_t numAddresses = 0;
+	for (uint32_t a = 0; a < 0x10000; ++a) {
+		const char* label = nullptr;
+		for (uint32_t s = index->addrFirst[a], e = index->addrFirst[a + 1]; s < e; ++s) {
+			const SymbolInfo& sym = labels[index->addrSymbols[s]];
+			if (!SymbolHidden(index, sym)) {
+				label = &strings[sym.label];
+				break;
+			}
+		}
+		index->label[a] = label;
+		if (label) {
+			nearest = (int32_t)a;
+			++numAddresses;
+		}
+		index->nearest[a] = nearest;
+	}
+	index->numAddresses = numAddresses;
 }
 
 const char* NearestLabel(uint16_t addr, uint16_t& offs)
 {
 	IBMutexLock(&symbolMutex);
-	size_t i = GetLabelSlot(addr);
 	const char* ret = nullptr;
 	offs = addr;
-	if (i < sortedSymAddrs.size() && addr >= sortedSymAddrs[i]) {
-		uint16_t prevAddr = sortedSymAddrs[i];
-		offs = addr - prevAddr;
-		if (sLabelEntries[prevAddr].unique) {
-			ret = sLabelEntries[prevAddr].unique;
-		} else if (SymList* syms = sLabelEntries[prevAddr].multi) {
-			ret = sLabelCount[prevAddr].count ? syms->names[0] : nullptr;
-		}
+	int32_t nearest = sSymbolIndex ? sSymbolIndex->nearest[addr] : -1;
+	if (nearest >= 0) {
+		offs = addr - (uint16_t)nearest;
+		ret = sSymbolIndex->label[nearest];
 	}
 	IBMutexRelease(&symbolMutex);
 	return ret;
 }
 
-static int _compareSymAddrUp(const void* A, const void* B)
-{
-	return (int)((const SymbolInfo*)A)->address - (int)((const SymbolInfo*)B)->address;
-}
-
-static int _compareSymAddrDown(const void* A, const void* B)
-{
-	return (int)((const SymbolInfo*)B)->address - (int)((const SymbolInfo*)A)->address;
-}
-
-static int _compareSymNameUp(const void* A, const void* B)
+static int CompareSymNames(const char* sA, const char* sB)
 {
-	const char* sA = ((const SymbolInfo*)A)->label;
-	const char* sB = ((const SymbolInfo*)B)->label;
 	while (*sA && *sB) {
 		char cA = *sA++; if (cA >= 'a' && cA <= 'z') { cA -= 'a' - 'A'; }
 		char cB = *sB++; if (cB >= 'a' && cB <= 'z') { cB -= 'a' - 'A'; }
 		if (cA != cB) { return cA - cB; }
 	}
 	if (!*sA && !*sB) { return 0; }
-	if (*sB) { return 1; }
+	if (*sA) { return 1; }
 	return -1;
 }
 
-static int _compareSymNameDown(const void* A, const void* B)
+static void RunSymbolSearch(bool narrow);
+
+// the visible symbols in the sorted order, the search is redone on them
+static void FilterSortedLabels()
 {
-	const char* sA = ((const SymbolInfo*)A)->label;
-	const char* sB = ((const SymbolInfo*)B)->label;
-	while (*sA && *sB) {
-		char cA = *sA++; if (cA >= 'a' && cA <= 'z') { cA -= 'a' - 'A'; }
-		char cB = *sB++; if (cB >= 'a' && cB <= 'z') { cB -= 'a' - 'A'; }
-		if (cA != cB) { return cB - cA; }
+	sortedLabelList.clear();
+	for (std::vector<uint32_t>::iterator i = sortedAllLabels.begin(); i != sortedAllLabels.end(); ++i) {
+		const SymbolInfo& sym = labelList[*i];
+		if (!sSymbolIndex || !SymbolHidden(sSymbolIndex, sym)) {
+			sortedLabelList.push_back(*i);
+		}
 	}
-	if (!*sA && !*sB) { return 0; }
-	if (*sA) { return 1; }
-	return -1;
+	RunSymbolSearch(false);
 }
 
 void SortSymbols(bool up, bool name)
@@ -183,76 +271,175 @@ void SortSymbols(bool up, bool name)
 	IBMutexLock(&symbolMutex);
 	lastSortedName = name;
 	lastSortedUp = up;
-	size_t numSymbols = sortedLabelList.size();
-	if (numSymbols) {
-		SymbolInfo* symbols = &sortedLabelList[0];
-		if (name) {
-			if (up) {
-				qsort(symbols, numSymbols, sizeof(SymbolInfo), _compareSymNameUp);
-			} else {
-				qsort(symbols, numSymbols, sizeof(SymbolInfo), _compareSymNameDown);
-			}
+	const std::vector<SymbolInfo>& labels = labelList;
+	const char* strings = symbolStrings.data();
+	if (name) {
+		if (up) {
+			std::sort(sortedAllLabels.begin(), sortedAllLabels.end(), [&labels, strings](uint32_t a, uint32_t b) {
+				return CompareSymNames(strings + labels[a].label, strings + labels[b].label) < 0; });
 		} else {
-			if (up) {
-				qsort(symbols, numSymbols, sizeof(SymbolInfo), _compareSymAddrUp);
-			} else {
-				qsort(symbols, numSymbols, sizeof(SymbolInfo), _compareSymAddrDown);
-			}
+			std::sort(sortedAllLabels.begin(), sortedAllLabels.end(), [&labels, strings](uint32_t a, uint32_t b) {
+				return CompareSymNames(strings + labels[b].label, strings + labels[a].label) < 0; });
+		}
+	} else {
+		if (up) {
+			std::sort(sortedAllLabels.begin(), sortedAllLabels.end(), [&labels](uint32_t a, uint32_t b) {
+				return labels[a].address < labels[b].address; });
+		} else {
+			std::sort(sortedAllLabels.begin(), sortedAllLabels.end(), [&labels](uint32_t a, uint32_t b) {
+				return labels[b].address < labels[a].address; });
 		}
 	}
+	FilterSortedLabels();
 	IBMutexRelease(&symbolMutex);
 }
 
-size_t NumSymbolSearchMatches() { return matchedLabelList.size() ? matchedLabelList.size() : sortedLabelList.size(); }
-const char* GetSymbolSearchMatch(size_t i, uint32_t* address, const char** section)
+size_t NumSymbolSearchMatches() { return searchActive ? matchedLabelList.size() : sortedLabelList.size(); }
+
+// one lock for the rows on screen
+size_t GetSymbolSearchMatches(size_t first, size_t count, SymbolSearchMatch* matches)
 {
 	IBMutexLock(&symbolMutex);
-	if (!matchedLabelList.size()) {
-		if (i < sortedLabelList.size()) {
-			SymbolInfo sym = sortedLabelList[i];
-			if ((size_t)sym.section < sectionNames.size()) {
-				*section = sectionNames[sym.section];
-			} else { *section = ""; }
-			*address = sym.address;
-			IBMutexRelease(&symbolMutex);
-			return sym.label;
-		}
-	} else if (i < matchedLabelList.size()) {
-		uint32_t o = matchedLabelList[i];
-		if ((size_t)o < sortedLabelList.size()) {
-			SymbolInfo sym = sortedLabelList[o];
-			if ((size_t)sym.section < sectionNames.size()) {
-				*section = sectionNames[sym.section];
-			} else { *section = ""; }
-			*address = sym.address;
-			IBMutexRelease(&symbolMutex);
-			return sym.label;
-		}
+	const std::vector<uint32_t>& list = searchActive ? matchedLabelList : sortedLabelList;
+	size_t num = 0;
+	for (size_t i = first, n = list.size(); i < n && num < count; ++i) {
+		if (list[i] >= labelList.size()) { break; }
+		const SymbolInfo& sym = labelList[list[i]];
+		matches[num].address = sym.address;
+		matches[num].symbol = &symbolStrings[sym.label];
+		matches[num].section = (size_t)sym.section < sectionNames.size() ? &symbolStrings[sectionNames[sym.section]] : "";
+		++num;
 	}
 	IBMutexRelease(&symbolMutex);
-	return nullptr;
+	return num;
 }
 
-void SearchSymbols(const char* pattern, bool case_sensitive)
+const char* GetSymbolSearchMatch(size_t i, uint32_t* address, const char** section)
 {
-	matchedLabelList.clear();
-	if (!*pattern) { return; }	// clear search string -> show all
+	SymbolSearchMatch match;
+	if (!GetSymbolSearchMatches(i, 1, &match)) { return nullptr; }
+	*address = match.address;
+	*section = match.section;
+	return match.symbol;
+}
+
+// the search text up to the first wildcard is in every match
+static strref SearchLiteralRun(strref text)
+{
+	strl_t len = 0;
+	while (len < text.get_len() && !strchr("*?#[<>@^\\", text[len])) { ++len; }
+	return text.get_substr(0, len);
+}
+
+// search text without wildcards can narrow down a previous search
+static bool SearchLiteral(strref text)
+{
+	return SearchLiteralRun(text).get_len() == text.get_len();
+}
+
+static strref SearchText(strref pattern, bool& anywhere)
+{
+	anywhere = pattern.get_first() == '*';
+	if (anywhere) { ++pattern; }
+	return pattern;
+}
+
+// symbols with all the trigrams of the text, ascending labelList indices
+static void TrigramCandidates(const SymbolIndex* index, strref text, std::vector<uint32_t>& candidates)
+{
+	std::vector<uint32_t> buckets;
+	for (strl_t c = 0; c + 2 < text.get_len(); ++c) { buckets.push_back(TrigramBucket(text.get() + c)); }
+	std::sort(buckets.begin(), buckets.end(), [index](uint32_t a, uint32_t b) {
+		return (index->trigramFirst[a + 1] - index->trigramFirst[a]) < (index->trigramFirst[b + 1] - index->trigramFirst[b]); });
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+	// start from the shortest list
+	const uint32_t* list = index->trigramSymbols.data();
+	candidates.assign(list + index->trigramFirst[buckets[0]], list + index->trigramFirst[buckets[0] + 1]);
+	std::vector<uint32_t> both;
+	for (size_t b = 1; b < buckets.size() && !candidates.empty(); ++b) {
+		both.clear();
+		std::set_intersection(candidates.begin(), candidates.end(),
+			list + index->trigramFirst[buckets[b]], list + index->trigramFirst[buckets[b] + 1], std::back_inserter(both));
+		candidates.swap(both);
+	}
+}
+
+// search the visible symbols, or only the previous matches if the search can only match fewer
+static void RunSymbolSearch(bool narrow)
+{
+	bool anywhere;
+	strref text = SearchText(searchPattern.get_strref(), anywhere);
+	searchActive = !text.is_empty() || searchStart > 0 || searchEnd < 0xffffffff;
+	if (!searchActive) {
+		matchedLabelList.clear();
+		return;
+	}
 
 	strown<512> wildcard;
-	if (*pattern == '*') {
-		wildcard.copy(pattern + 1);	// substring
+	if (anywhere) {
+		wildcard.copy(text);	// substring
 	} else {
-		wildcard.append('@').append(pattern);
+		wildcard.append('@').append(text);
 	}
+	bool literal = SearchLiteral(text);
+	const char* strings = symbolStrings.data();
+	auto matches = [&wildcard, text, anywhere, literal, strings](const SymbolInfo& sym) {
+		const char* name = strings + sym.label;
+		if (!name[0] || sym.address < searchStart || sym.address > searchEnd) { return false; }
+		if (text.is_empty()) { return true; }
+		if (!literal) { return strref(name).find_wildcard(wildcard.get_strref(), 0, searchCaseSensitive).valid(); }
+		strref label(name);
+		if (anywhere) { return (searchCaseSensitive ? label.find_case(text) : label.find(text)) >= 0; }
+		strref head = label.get_substr(0, text.get_len());
+		return head.get_len() == text.get_len() && (searchCaseSensitive ? head.same_str_case(text) : head.same_str(text));
+	};
 
-	for (size_t i = 0, n = sortedLabelList.size(); i < n; ++i) {
-		const char* str = sortedLabelList[i].label;
-		if (str && str[0]) {
-			if (strref(str).find_wildcard(wildcard.get_strref(), 0, case_sensitive)) {
-				matchedLabelList.push_back((uint32_t)i);
-			}
+	// mark the symbols to check: the previous matches, the ones with all the
+	// trigrams of the text before any wildcard or all of them. They are checked in load order which is kind to
+	// the cache and then picked up in the sorted order.
+	searchCandidates.assign(labelList.size(), 0);
+	if (narrow) {
+		for (std::vector<uint32_t>::iterator m = matchedLabelList.begin(); m != matchedLabelList.end(); ++m) { searchCandidates[*m] = 1; }
+	} else if (sSymbolIndex && SearchLiteralRun(text).get_len() >= kMinTrigramSearch) {
+		std::vector<uint32_t> candidates;
+		TrigramCandidates(sSymbolIndex, SearchLiteralRun(text), candidates);
+		for (std::vector<uint32_t>::iterator c = candidates.begin(); c != candidates.end(); ++c) { searchCandidates[*c] = 1; }
+	} else {
+		std::fill(searchCandidates.begin(), searchCandidates.end(), 1);
+	}
+	for (size_t i = 0, n = labelList.size(); i < n; ++i) {
+		if (searchCandidates[i] && !matches(labelList[i])) { searchCandidates[i] = 0; }
+	}
+	matchedLabelList.clear();
+	for (std::vector<uint32_t>::iterator i = sortedLabelList.begin(); i != sortedLabelList.end(); ++i) {
+		if (searchCandidates[*i]) { matchedLabelList.push_back(*i); }
+	}
+}
+
+void SearchSymbols(const char* pattern, bool case_sensitive, uint32_t start, uint32_t end)
+{
+	IBMutexLock(&symbolMutex);
+	// typing more of a plain search only removes matches
+	bool prevAnywhere, anywhere;
+	strref prev = SearchText(searchPattern.get_strref(), prevAnywhere);
+	strref text = SearchText(strref(pattern), anywhere);
+	bool narrow = searchActive && case_sensitive == searchCaseSensitive && anywhere == prevAnywhere &&
+		start >= searchStart && end <= searchEnd && SearchLiteral(prev) && SearchLiteral(text) && prev.get_len() <= text.get_len();
+	if (narrow) {
+		if (anywhere) {
+			narrow = prev.is_empty() || (case_sensitive ? text.find_case(prev) : text.find(prev)) >= 0;
+		} else {
+			strref head = text.get_substr(0, prev.get_len());
+			narrow = case_sensitive ? head.same_str_case(prev) : head.same_str(prev);
 		}
 	}
+	searchPattern.copy(pattern);
+	searchCaseSensitive = case_sensitive;
+	searchStart = start;
+	searchEnd = end;
+	RunSymbolSearch(narrow);
+	IBMutexRelease(&symbolMutex);
 }
 
 size_t NumHiddenSections() { return hiddenSections.size(); }
@@ -272,19 +459,21 @@ void HideSection(uint64_t section, bool hide)
 	FilterSectionSymbols();
 }
 size_t NumSections() { return sectionNames.size(); }
-const char* GetSectionName(size_t index) { return sectionNames[index]; }
+const char* GetSectionName(size_t index) { return &symbolStrings[sectionNames[index]]; }
 
 void HideAllSections() {
 	hiddenSections.clear();
 	size_t numSects = sectionNames.size();
 	for (size_t j = 0; j < numSects; ++j) {
-		strref section(sectionNames[j]);
+		strref section(&symbolStrings[sectionNames[j]]);
 		hiddenSections.push_back(section.fnv1a_64());
 	}
+	FilterSectionSymbols();
 }
 
 void ShowAllSections() {
 	hiddenSections.clear();
+	FilterSectionSymbols();
 }
 
 bool IsSectionVisible(uint64_t section)
@@ -299,145 +488,148 @@ bool IsSectionVisible(uint64_t section)
 
 void BeginAddingSymbols()
 {
-	IBMutexLock(&symbolMutex);
 	sDuplicateCheck.Clear();
-	for (size_t i = 0, n = sectionNames.size(); i < n; ++i) {
-		if (char* sectName = sectionNames[i]) {
-			sectionNames[i] = nullptr;
-			StringFree(sectName);
-		}
-	}
-	sectionNames.clear();
-	for (size_t i = 0, n = labelList.size(); i < n; ++i) {
-		if (char* symName = labelList[i].label) {
-			labelList[i].label = nullptr;
-			StringFree(symName);
-		}
+	sPendingSections.Clear();
+	std::vector<uint32_t>().swap(pendingSectionNames);
+	std::vector<SymbolInfo>().swap(pendingLabelList);
+	std::vector<char>().swap(pendingStrings);
+	if (sPendingIndex) {
+		delete sPendingIndex;
+		sPendingIndex = nullptr;
 	}
-	labelList.clear();
-	IBMutexRelease(&symbolMutex);
 }
 
-bool LabelAssignedToAddress(uint16_t address, strref lbl)
+// index the added symbols, on the loader thread so the UI thread only has to swap them in
+void FinishAddingSymbols()
 {
-	if (const int16_t count = sLabelCount[address].count) {
-		if (count == 1) {
-			if (lbl.same_str_case(sLabelEntries[address].unique)) { return true; }
-		} else {
-			if (const char** ppStr = sLabelEntries[address].multi->names) {
-				for (size_t i = 0, n = count; i < n; ++i) {
-					if (lbl.same_str(*ppStr)) { return true; }
-					++ppStr;
-				}
-			}
-		}
-	}
-	return false;
+	if (!sPendingIndex) { sPendingIndex = BuildSymbolIndex(pendingLabelList, pendingStrings); }
 }
 
-// discard all symbol lookups and fill out with a filtered set of sections
-// call after loading symbols
-void FilterSectionSymbols()
+// the pending symbols and their index as they are in memory
+void WritePendingSymbols(SymbolCacheWriter& cache)
 {
-#if 1
-	size_t numSects = sectionNames.size();
-	uint8_t* hidden = (uint8_t*)calloc(1, numSects);
-	if (hidden == nullptr) { return; }
-	for (std::vector<uint64_t>::iterator i = hiddenSections.begin(); i != hiddenSections.end(); ++i) {
-		uint64_t hiddenName = *i;
-		for (size_t j = 0; j < numSects; ++j ) {
-			if (strref(sectionNames[j]).fnv1a_64() == hiddenName) {
-				hidden[j] = 1;
-				break;
-			}
-		}
-	}
-	ResetSymbols();
-
-	sortedLabelList.clear();
+	FinishAddingSymbols();
+	const SymbolIndex* index = sPendingIndex;
+	cache.Add(pendingLabelList);
+	cache.Add(pendingSectionNames);
+	cache.Add(pendingStrings);
+	cache.Add(index->addrFirst, sizeof(index->addrFirst));
+	cache.Add(index->addrSymbols);
+	cache.Add(index->sameName);
+	cache.Add(index->names.keys, index->names.size * sizeof(uint64_t));
+	cache.Add(index->names.values, index->names.size * sizeof(uint32_t));
+	cache.AddValue((uint64_t)index->names.maxSteps);
+	cache.Add(index->trigramFirst);
+	cache.Add(index->trigramSymbols);
+}
 
-	IBMutexLock(&symbolMutex);
-	// make sure label array exists
-	if (!sLabelCount) {
-		sLabelCount = (SymEntry*)malloc(sizeof(SymEntry) * 0x10000);
-		sLabelEntries = (SymRef*)malloc(sizeof(SymRef) * 0x10000);
+// a cache that doesn't add up is read as missing
+static bool PendingSymbolsValid(const SymbolIndex* index, const std::vector<uint32_t>& addrFirst)
+{
+	size_t numLabels = pendingLabelList.size(), numStrings = pendingStrings.size();
+	if (numStrings && pendingStrings.back() != 0) { return false; }
+	for (std::vector<SymbolInfo>::iterator sym = pendingLabelList.begin(); sym != pendingLabelList.end(); ++sym) {
+		if (sym->label >= numStrings || sym->section >= pendingSectionNames.size()) { return false; }
 	}
-	if (sLabelEntries == nullptr || sLabelCount == nullptr) { return; }
-
-	memset(sLabelCount, 0, sizeof(SymEntry) * 0x10000);
-	memset(sLabelEntries, 0, sizeof(SymRef) * 0x10000);
-
-	for (std::vector<SymbolInfo>::iterator sym = labelList.begin(); sym != labelList.end(); ++sym) {
-		if (hidden[sym->section]) { continue; }	// if this section is hidden don't add it!
-		if (sym->label == nullptr) { continue; }
-
-		strref lbl(sym->label);
-
-		sortedLabelList.push_back(*sym);
-
-		// 32 bit vymbol support
-		uint64_t hash = lbl.fnv1a_64();
-		if (!sReverseLookup.Exists(hash)) {
-			sReverseLookup.Insert(hash, sym->address);
-		}
-
-		// 16 bit symbol support
-		if (sym->address < 0x10000) {
-			const uint16_t address = (uint16_t)sym->address;
-			if (LabelAssignedToAddress(address, lbl)) { continue; }
-
-			if (!sLabelCount[address].count) {
-				sLabelCount[address].count = 1;
-				sLabelEntries[address].unique = sym->label;
-			} else if (sLabelCount[address].count == 1) {
-				const char* prev = sLabelEntries[address].unique;
-				sLabelEntries[address].multi = (SymList*)malloc(sizeof(SymList) +
-					sizeof(const char*) * (SymList::MIN_LIST - 1));
-				sLabelEntries[address].multi->capacity = SymList::MIN_LIST;
-				sLabelCount[address].count = 2;
-				sLabelEntries[address].multi->names[0] = prev;
-				sLabelEntries[address].multi->names[1] = sym->label;
-			} else {
-				SymList* entries = sLabelEntries[address].multi;
-				if (entries->capacity == (size_t)sLabelCount[address].count) {
-					size_t newCapacity = entries->capacity + SymList::GROW_LIST;
-					sLabelEntries[address].multi = (SymList*)malloc(
-						sizeof(SymList) + sizeof(const char*) * (newCapacity - 1));
-					if (sLabelEntries[address].multi) {
-						sLabelEntries[address].multi->capacity = newCapacity;
-						memcpy(sLabelEntries[address].multi->names, entries->names,
-							sizeof(const char*) * sLabelCount[address].count);
-						free(entries);
-						entries = sLabelEntries[address].multi;
-					}
-				}
-				assert(entries);
-				assert(entries->capacity > (size_t)sLabelCount[address].count);
-				entries->names[sLabelCount[address].count++] = sym->label;
-			}
+	for (std::vector<uint32_t>::iterator sect = pendingSectionNames.begin(); sect != pendingSectionNames.end(); ++sect) {
+		if (*sect >= numStrings) { return false; }
+	}
+	if (addrFirst.size() != 0x10001 || addrFirst[0x10000] != index->addrSymbols.size()) { return false; }
+	for (size_t a = 0; a < 0x10000; ++a) { if (addrFirst[a] > addrFirst[a + 1]) { return false; } }
+	for (std::vector<uint32_t>::const_iterator i = index->addrSymbols.begin(); i != index->addrSymbols.end(); ++i) {
+		if (*i >= numLabels) { return false; }
+	}
+	if (index->sameName.size() != numLabels) { return false; }
+	for (std::vector<uint32_t>::const_iterator i = index->sameName.begin(); i != index->sameName.end(); ++i) {
+		if (*i != kNoSymbol && *i >= numLabels) { return false; }
+	}
+	if (index->trigramFirst.size() != (kTrigramBuckets + 1) || index->trigramFirst[kTrigramBuckets] != index->trigramSymbols.size()) { return false; }
+	for (size_t t = 0; t < kTrigramBuckets; ++t) { if (index->trigramFirst[t] > index->trigramFirst[t + 1]) { return false; } }
+	for (std::vector<uint32_t>::const_iterator i = index->trigramSymbols.begin(); i != index->trigramSymbols.end(); ++i) {
+		if (*i >= numLabels) { return false; }
+	}
+	return true;
+}
 
-			// insert into range slot array
-			size_t slot = GetLabelSlot(address);
-			if (slot < sortedSymAddrs.size()) {
-				if (address < sortedSymAddrs[slot]) {
-					sortedSymAddrs.insert(sortedSymAddrs.begin() + slot, address);
-				} else if (address > sortedSymAddrs[slot]) {
-					sortedSymAddrs.insert(sortedSymAddrs.begin() + slot + 1, address);
-				}
-			} else {
-				sortedSymAddrs.push_back(address);
-			}
+// the pending symbols and their index from a cache, false leaves nothing pending
+bool ReadPendingSymbols(SymbolCacheReader& cache)
+{
+	BeginAddingSymbols();
+	SymbolIndex* index = new SymbolIndex;
+	std::vector<uint32_t> addrFirst, nameValues;
+	std::vector<uint64_t> nameKeys;
+	uint64_t nameSteps = 0;
+	cache.Next(pendingLabelList);
+	cache.Next(pendingSectionNames);
+	cache.Next(pendingStrings);
+	cache.Next(addrFirst);
+	cache.Next(index->addrSymbols);
+	cache.Next(index->sameName);
+	cache.Next(nameKeys);
+	cache.Next(nameValues);
+	cache.Value(nameSteps);
+	cache.Next(index->trigramFirst);
+	cache.Next(index->trigramSymbols);
+	size_t nameSlots = nameKeys.size();
+	bool valid = !cache.failed && nameValues.size() == nameSlots && !(nameSlots & (nameSlots - 1)) && PendingSymbolsValid(index, addrFirst);
+	for (size_t s = 0; valid && s < nameSlots; ++s) {
+		if (nameKeys[s] && nameValues[s] >= pendingLabelList.size()) { valid = false; }
+	}
+	if (!valid) {
+		delete index;
+		BeginAddingSymbols();
+		return false;
+	}
+	memcpy(index->addrFirst, addrFirst.data(), sizeof(index->addrFirst));
+	if (nameSlots) {
+		// the table is used as it was written, HashTable frees these with free()
+		index->names.keys = (uint64_t*)malloc(nameSlots * sizeof(uint64_t));
+		index->names.values = (uint32_t*)malloc(nameSlots * sizeof(uint32_t));
+		memcpy(index->names.keys, nameKeys.data(), nameSlots * sizeof(uint64_t));
+		memcpy(index->names.values, nameValues.data(), nameSlots * sizeof(uint32_t));
+		index->names.size = nameSlots;
+		index->names.maxSteps = (size_t)nameSteps;
+		index->names.used = 0;
+		for (size_t s = 0; s < nameSlots; ++s) {
+			if (nameKeys[s]) { ++index->names.used; }
 		}
 	}
-	free(hidden);
-	IBMutexRelease(&symbolMutex);
+	memset(index->label, 0, sizeof(index->label));
+	for (size_t a = 0; a < 0x10000; ++a) { index->nearest[a] = -1; }
+	index->numAddresses = 0;
+	sPendingIndex = index;
+	return true;
+}
 
+// the added symbols replace the current ones, the lookups change in one lock
+void CommitSymbols()
+{
+	FinishAddingSymbols();
+	sPendingIndex->hidden = HiddenSectionMask(pendingSectionNames, pendingStrings);
+	ApplySectionMask(sPendingIndex, pendingLabelList, pendingStrings);
+	IBMutexLock(&symbolMutex);
+	labelList.swap(pendingLabelList);
+	sectionNames.swap(pendingSectionNames);
+	symbolStrings.swap(pendingStrings);
+	std::swap(sSymbolIndex, sPendingIndex);
+	sortedAllLabels.resize(labelList.size());
+	for (size_t i = 0, n = labelList.size(); i < n; ++i) { sortedAllLabels[i] = (uint32_t)i; }
+	IBMutexRelease(&symbolMutex);
 	SortSymbols(lastSortedUp, lastSortedName);
-
-#endif
+	BeginAddingSymbols();	// frees the previous symbols
 }
 
-
+// apply the hidden sections to the symbol lookups
+void FilterSectionSymbols()
+{
+	if (!sSymbolIndex) { return; }
+	std::vector<uint8_t> hidden = HiddenSectionMask(sectionNames, symbolStrings);
+	IBMutexLock(&symbolMutex);
+	sSymbolIndex->hidden.swap(hidden);
+	ApplySectionMask(sSymbolIndex, labelList, symbolStrings);
+	FilterSortedLabels();
+	IBMutexRelease(&symbolMutex);
+}
 
 void AddSymbol(uint32_t address, const char *symbol, size_t symbolLen, const char *section, size_t sectionLen)
 {
@@ -449,43 +641,33 @@ void AddSymbol(uint32_t address, const char *symbol, size_t symbolLen, const cha
 	hash = sym.fnv1a_64(hash);
 
 	if (sDuplicateCheck.Exists(hash)) { return; }
-	IBMutexLock(&symbolMutex);
 	sDuplicateCheck.Insert(hash, address);
 
-	size_t sectIdx = 0, numSects = sectionNames.size();
-	for (; sectIdx < numSects; ++sectIdx) {
-		if (sect.same_str(sectionNames[sectIdx]) || (!sect.valid() && !sectionNames[sectIdx][0])) {
-			break;
-		}
-	}
-	if (sectIdx == numSects) {
-		if (char* sectionCopy = StringCopy(sect)) {
-			sectionNames.push_back(sectionCopy);
-		}
-	}
-	if (char* copy = StringCopy(sym)) {
-		SymbolInfo symInfo = { address, (uint32_t)sectIdx, copy };
-		labelList.push_back(symInfo);
+	uint32_t sectIdx;
+	uint64_t sectKey = SectionKey(sect);
+	if (uint32_t* known = sPendingSections.Value(sectKey)) {
+		sectIdx = *known;
+	} else {
+		sectIdx = (uint32_t)pendingSectionNames.size();
+		pendingSectionNames.push_back(AddString(pendingStrings, sect));
+		sPendingSections.Insert(sectKey, sectIdx);
 	}
-	IBMutexRelease(&symbolMutex);
+	SymbolInfo symInfo = { address, sectIdx, AddString(pendingStrings, sym) };
+	pendingLabelList.push_back(symInfo);
 }
 
 void ClearSymbols()
 {
-	ResetSymbols();
 	BeginAddingSymbols();
+	CommitSymbols();
 }
 
 const char* GetSymbol(uint16_t address)
 {
 	const char* sym = nullptr;
-	if( sLabelCount ) {
-		IBMutexLock(&symbolMutex);
-		if( !sLabelCount[ address ].count ) { sym = nullptr; }
-		else if( sLabelCount[ address ].count == 1 ) { sym = sLabelEntries[ address ].unique; }
-		else { sym = sLabelEntries[address].multi->names[0]; }
-		IBMutexRelease(&symbolMutex);
-	}
+	IBMutexLock(&symbolMutex);
+	if (sSymbolIndex) { sym = sSymbolIndex->label[address]; }
+	IBMutexRelease(&symbolMutex);
 	return sym;
 }
 
@@ -493,10 +675,16 @@ bool GetAddress( const char *name, size_t chars, uint16_t &addr )
 {
 	uint64_t key = strref(name, (strl_t)chars).fnv1a_64();
 	IBMutexLock(&symbolMutex);
-	if( uint32_t* value = sReverseLookup.Value( key ) ) {
-		addr = (uint16_t)*value;
-		IBMutexRelease(&symbolMutex);
-		return true;
+	if (sSymbolIndex) {
+		if (uint32_t* first = sSymbolIndex->names.Value(key)) {
+			for (uint32_t i = *first; i != kNoSymbol; i = sSymbolIndex->sameName[i]) {
+				if (!SymbolHidden(sSymbolIndex, labelList[i])) {
+					addr = (uint16_t)labelList[i].address;
+					IBMutexRelease(&symbolMutex);
+					return true;
+				}
+			}
+		}
 	}
 	IBMutexRelease(&symbolMutex);
 	return false;
@@ -504,13 +692,15 @@ bool GetAddress( const char *name, size_t chars, uint16_t &addr )
 
 bool ReadViceCommandFile(const char *symFile)
 {
-	ResetSymbols();
 	size_t size = 0;
 	if (uint8_t* buf = LoadBinary(symFile, size)) {
 		BeginAddingSymbols();
+		SymbolLoadStage("Reading symbols", size * 2);
+		std::vector<uint16_t> breakpoints;
 		for (int pass = 0; pass<2; pass++) {
 			strref file((const char*)buf, (strl_t)size);
 			while (strref line = file.line()) {
+				SymbolLoadStep(pass * size + (size_t)(line.get() - (const char*)buf));
 				if (strref command = line.get_word()) {
 					uint32_t addr;
 					line += command.get_len();
@@ -518,7 +708,7 @@ bool ReadViceCommandFile(const char *symFile)
 					if (command.same_str("break") || command.same_str("bk")) {
 						if (pass) {
 							if (line.get_first() == '$') { ++line; }
-							ViceAddBreakpoint((uint16_t)(line + 1).ahextoui());
+							breakpoints.push_back((uint16_t)(line + 1).ahextoui());
 						}
 					} else if (command.same_str("al") || command.same_str("add_label")) {
 						if (line.has_prefix("c:")) { line += 2; }
@@ -533,7 +723,7 @@ bool ReadViceCommandFile(const char *symFile)
 				}
 			}
 		}
-		FilterSectionSymbols();
+		SymbolLoadBreakpoints(breakpoints.data(), breakpoints.size(), false);
 		free(buf);
 		return true;
 	}
@@ -542,12 +732,14 @@ bool ReadViceCommandFile(const char *symFile)
 
 bool ReadSymbols(const char *filename)
 {
-	ResetSymbols();
 	size_t size = 0;
 	if (uint8_t* buf = LoadBinary(filename, size)) {
 		BeginAddingSymbols();
+		SymbolLoadStage("Reading symbols", size);
+		std::vector<uint16_t> breakpoints;
 		strref file((const char*)buf, (strl_t)size);
 		while (file) {
+			SymbolLoadStep((size_t)(file.get() - (const char*)buf));
 			if (strref line = file.line()) {
 				line.skip_whitespace();
 				if (line.grab_prefix(".label")) {
@@ -559,10 +751,7 @@ bool ReadSymbols(const char *filename)
 						if (line.grab_char('$')) {
 							size_t addr = line.ahextoui();
 							if (label.same_str("debugbreak")) {
-								Breakpoint bp;
-								if (!BreakpointAt((uint16_t)addr, bp)) {
-									ViceAddBreakpoint((uint16_t)addr);
-								}
+								breakpoints.push_back((uint16_t)addr);
 							} else {
 								AddSymbol((uint16_t)addr, label.get(), label.get_len(), nullptr, 0);
 							}
@@ -572,7 +761,7 @@ bool ReadSymbols(const char *filename)
 			}
 		}
 		free(buf);
-		FilterSectionSymbols();
+		SymbolLoadBreakpoints(breakpoints.data(), breakpoints.size(), false);
 		return true;
 	}
 	return false;
@@ -580,9 +769,9 @@ bool ReadSymbols(const char *filename)
 
 bool ReadSymbolsFile(const char* symbols) {
 	strref ext = strref(symbols).after_last('.');
-	if (ext.same_str("dbg")) return ReadC64DbgSrc(symbols);
-	if (ext.same_str("sym")) return ReadSymbols(symbols);
-	if (ext.same_str("vs")) return ReadViceCommandFile(symbols);
+	if (ext.same_str("dbg")) return LoadSymbolFile(symbols, SymbolFile_KickDbg);
+	if (ext.same_str("sym")) return LoadSymbolFile(symbols, SymbolFile_Sym);
+	if (ext.same_str("vs")) return LoadSymbolFile(symbols, SymbolFile_ViceCmd);
 	return false;
 }
 
@@ -594,15 +783,15 @@ void ReadSymbolsForBinary(const char *binname)
 	strown<PATH_MAX_LEN> symFile(origname);
 
 	symFile.append(".dbg");
-	if (ReadC64DbgSrc(symFile.c_str())) { return; }
+	if (LoadSymbolFile(symFile.c_str(), SymbolFile_KickDbg)) { return; }
 
 	symFile.copy(origname);
 	symFile.append(".sym");
-	if (ReadSymbols(symFile.c_str())) { return; }
+	if (LoadSymbolFile(symFile.c_str(), SymbolFile_Sym)) { return; }
 
 	symFile.copy(origname);
 	symFile.append(".vs");
-	ReadViceCommandFile(symFile.c_str());
+	LoadSymbolFile(symFile.c_str(), SymbolFile_ViceCmd);
 }
 
 void StateSaveHiddenSections(UserData &conf) {
@@ -610,9 +799,9 @@ void StateSaveHiddenSections(UserData &conf) {
 	for (std::vector<uint64_t>::iterator i = hiddenSections.begin(); i != hiddenSections.end(); ++i) {
 		uint64_t hiddenName = *i;
 		for (size_t j = 0; j < numSects; ++j) {
-			strref section(sectionNames[j]);
+			strref section(&symbolStrings[sectionNames[j]]);
 			if (section.get_len() && section.fnv1a_64() == hiddenName) {
-				conf.AddArrayValue(sectionNames[j]);
+				conf.AddArrayValue(section);
 				break;
 			}
 		}
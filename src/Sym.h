@@ -1,28 +1,41 @@
 #pragma once
 
 struct UserData;
+struct SymbolCacheWriter;
+struct SymbolCacheReader;
 class strref;
 
-bool ReadSymbols(const char *binname);
-bool ReadViceCommandFile(const char *symFile);
-void ReadSymbolsForBinary(const char *binname);
-bool ReadSymbolsFile(const char* symbols);
+bool ReadSymbols(const char *binname);	// loader thread
+bool ReadViceCommandFile(const char *symFile);	// loader thread
+void ReadSymbolsForBinary(const char *binname);	// loads in the background
+bool ReadSymbolsFile(const char* symbols);	// loads in the background
 void ClearSymbols();
+void BeginAddingSymbols();	// loader thread, AddSymbol adds to a pending set
+void FinishAddingSymbols();	// loader thread, indexes the pending set
+void CommitSymbols();	// UI thread, the pending set replaces the current symbols
+void WritePendingSymbols(SymbolCacheWriter& cache);	// loader thread
+bool ReadPendingSymbols(SymbolCacheReader& cache);	// loader thread, instead of adding symbols
 bool GetAddress(const char *name, size_t chars, uint16_t &addr);
 bool SymbolsLoaded();
 const char* GetSymbol(uint16_t address);
 void AddSymbol(uint32_t address, const char* symbol, size_t symbolLen, const char* section, size_t sectionLen);
-void FilterSectionSymbols();
+void FilterSectionSymbols();	// after changing the hidden sections
 const char* NearestLabel(uint16_t addr, uint16_t& offs);
 
 struct SymbolDragDrop {
 	uint32_t address;
 	char symbol[128];
 };
+struct SymbolSearchMatch {
+	uint32_t address;
+	const char* symbol;
+	const char* section;
+};
 void SortSymbols(bool up, bool name);
 size_t NumSymbolSearchMatches();
+size_t GetSymbolSearchMatches(size_t first, size_t count, SymbolSearchMatch* matches);	// returns count read
 const char* GetSymbolSearchMatch(size_t i, uint32_t* address, const char** section);
-void SearchSymbols(const char* pattern, bool case_sensitive);
+void SearchSymbols(const char* pattern, bool case_sensitive, uint32_t start = 0, uint32_t end = 0xffffffff);	// a leading * searches anywhere in the symbol
 
 size_t NumHiddenSections();
 uint64_t GetHiddenSection(size_t index);
@@ -0,0 +1,160 @@
+// Binary cache of a symbol load, see SymbolCache.h
+//	The file starts with a header, the files the load read and their stamps,
+//	then the blocks of the symbols, the source lines and the breakpoints.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "platform.h"
+#include "struse/struse.h"
+#include "Files.h"
+#include "Sym.h"
+#include "SourceDebug.h"
+#include "SymbolLoad.h"
+#include "SymbolCache.h"
+
+enum {
+	kSymbolCacheVersion = 1,
+	kSymbolCacheAlign = 8
+};
+
+static const char* kSymbolCacheExt = ".ibc";
+static const uint64_t kMissingFile = ~0ull;	// size of a source that wasn't there
+
+struct SymbolCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t type;
+};
+
+void SymbolCacheWriter::Add(const void* bytes, size_t size)
+{
+	uint64_t header = size;
+	size_t pos = data.size();
+	size_t padded = (size + kSymbolCacheAlign - 1) & ~(size_t)(kSymbolCacheAlign - 1);
+	data.resize(pos + sizeof(header) + padded, 0);
+	memcpy(&data[pos], &header, sizeof(header));
+	if (size) { memcpy(&data[pos + sizeof(header)], bytes, size); }
+}
+
+const void* SymbolCacheReader::Block(size_t& bytes)
+{
+	bytes = 0;
+	uint64_t header;
+	if (failed || (pos + sizeof(header)) > size) {
+		failed = true;
+		return nullptr;
+	}
+	memcpy(&header, data + pos, sizeof(header));
+	if (header > (size - pos - sizeof(header))) {
+		failed = true;
+		return nullptr;
+	}
+	const void* block = data + pos + sizeof(header);
+	bytes = (size_t)header;
+	pos += sizeof(header) + ((bytes + kSymbolCacheAlign - 1) & ~(size_t)(kSymbolCacheAlign - 1));
+	if (pos > size) { pos = size; }
+	return block;
+}
+
+static void SymbolCacheHeaderFor(SymbolCacheHeader& header, SymbolFileType type)
+{
+	memcpy(header.magic, "IBSC", sizeof(header.magic));
+	header.version = kSymbolCacheVersion;
+	header.type = (uint32_t)type;
+}
+
+// the symbol file followed by the sources it refers to, zero terminated one after another
+static void SymbolCacheFiles(const char* filename, std::vector<char>& files)
+{
+	files.assign(filename, filename + strlen(filename) + 1);
+	size_t sourcesSize = 0;
+	if (const char* sources = PendingSourceFiles(sourcesSize)) {
+		files.insert(files.end(), sources, sources + sourcesSize);
+	}
+}
+
+// modified time and size of each file
+static std::vector<uint64_t> SymbolCacheStamps(const std::vector<char>& files)
+{
+	std::vector<uint64_t> stamps;
+	for (size_t f = 0, n = files.size(); f < n; f += strlen(&files[f]) + 1) {
+		uint64_t modified = 0, size = kMissingFile;
+		if (!FileStamp(&files[f], modified, size)) {
+			modified = 0;
+			size = kMissingFile;
+		}
+		stamps.push_back(modified);
+		stamps.push_back(size);
+	}
+	return stamps;
+}
+
+static bool SymbolCacheCurrent(SymbolCacheReader& cache, const char* filename, SymbolFileType type)
+{
+	SymbolCacheHeader header, expected;
+	SymbolCacheHeaderFor(expected, type);
+	std::vector<char> files;
+	std::vector<uint64_t> stamps;
+	if (!cache.Value(header) || memcmp(&header, &expected, sizeof(header)) != 0) { return false; }
+	if (!cache.Next(files) || !cache.Next(stamps) || files.empty() || files.back() != 0) { return false; }
+	if (strcmp(&files[0], filename) != 0) { return false; }
+	return SymbolCacheStamps(files) == stamps;
+}
+
+bool ReadSymbolCache(const char* filename, SymbolFileType type)
+{
+	strown<PATH_MAX_LEN> cacheFile(filename);
+	cacheFile.append(kSymbolCacheExt);
+	size_t size = 0;
+	const void* view = IBMapFileRead(cacheFile.c_str(), size);
+	if (!view) { return false; }
+
+	SymbolLoadStage("Reading cache", 0);
+	SymbolCacheReader cache = { (const uint8_t*)view, size, 0, false };
+	bool success = SymbolCacheCurrent(cache, filename, type) && ReadPendingSymbols(cache) &&
+		ReadPendingSourceDebug(cache) && ReadLoadBreakpoints(cache);
+	if (!success) {
+		BeginAddingSymbols();
+		ClearPendingSourceDebug();
+	}
+	IBMapFileUnmap(view, size);
+	return success;
+}
+
+void WriteSymbolCache(const char* filename, SymbolFileType type)
+{
+	SymbolCacheHeader header;
+	SymbolCacheHeaderFor(header, type);
+	std::vector<char> files;
+	SymbolCacheFiles(filename, files);
+	std::vector<uint64_t> stamps = SymbolCacheStamps(files);
+	if (stamps[1] == kMissingFile) { return; }
+
+	SymbolCacheWriter cache;
+	cache.AddValue(header);
+	cache.Add(files);
+	cache.Add(stamps);
+	WritePendingSymbols(cache);
+	WritePendingSourceDebug(cache);
+	WriteLoadBreakpoints(cache);
+
+	// written aside and renamed so a cache is never read half written
+	strown<PATH_MAX_LEN> cacheFile(filename), writeFile(filename);
+	cacheFile.append(kSymbolCacheExt);
+	writeFile.append(kSymbolCacheExt).append(".tmp");
+	FILE* f = nullptr;
+#ifdef _WIN32
+	if (fopen_s(&f, writeFile.c_str(), "wb") != 0) { f = nullptr; }
+#else
+	f = fopen(writeFile.c_str(), "wb");
+#endif
+	if (!f) { return; }
+	bool written = fwrite(cache.data.data(), cache.data.size(), 1, f) == 1;
+	written = fclose(f) == 0 && written;
+	if (written) {
+		remove(cacheFile.c_str());
+		written = rename(writeFile.c_str(), cacheFile.c_str()) == 0;
+	}
+	if (!written) { remove(writeFile.c_str()); }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Cache of a symbol load, written next to the symbol file
+//	Holds the indexed symbols, the source lines of a debug file and the
+//	breakpoints of the load with the size and modified time of the symbol file
+//	and every source it read. While none of them change the cache is mapped and
+//	its tables copied in instead of parsing, reading sources and indexing again.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "SymbolLoad.h"
+
+// blocks are read back in the order they were written, each 8 byte aligned
+struct SymbolCacheWriter {
+	std::vector<uint8_t> data;
+
+	void Add(const void* bytes, size_t size);
+	template<class T> void Add(const std::vector<T>& items) { Add(items.data(), items.size() * sizeof(T)); }
+	template<class T> void AddValue(const T& value) { Add(&value, sizeof(T)); }
+};
+
+struct SymbolCacheReader {
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+	bool failed;
+
+	const void* Block(size_t& bytes);	// nullptr and failed if past the end
+	template<class T> bool Next(std::vector<T>& items) {
+		size_t bytes;
+		const T* first = (const T*)Block(bytes);
+		if (failed || (bytes % sizeof(T))) { failed = true; return false; }
+		items.assign(first, first + bytes / sizeof(T));
+		return true;
+	}
+	template<class T> bool Value(T& value) {
+		size_t bytes;
+		const void* item = Block(bytes);
+		if (failed || bytes != sizeof(T)) { failed = true; return false; }
+		value = *(const T*)item;
+		return true;
+	}
+};
+
+// loader thread
+bool ReadSymbolCache(const char* filename, SymbolFileType type);	// fills in the pending load if the cache is current
+void WriteSymbolCache(const char* filename, SymbolFileType type);	// after a load is read and indexed
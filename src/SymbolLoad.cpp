@@ -0,0 +1,215 @@
+// Symbol and debug info loading on a loader thread
+//	Only one load runs at a time, starting another cancels it. The readers in
+//	Sym.cpp and SourceDebug.cpp collect into pending tables that nothing else
+//	looks at, so the loader needs no locks until the UI thread swaps them in.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "platform.h"
+#include "struse/struse.h"
+#include "Files.h"
+#include "Sym.h"
+#include "SourceDebug.h"
+#include "Breakpoints.h"
+#include "ViceInterface.h"
+#include "SymbolLoad.h"
+#include "SymbolCache.h"
+
+#ifndef _WIN32
+#define WINAPI
+#endif
+
+enum {
+	kMaxLoadWorkers = 8,	// reading source files is mostly waiting on the disk
+	kLoadStackSize = 65536
+};
+
+struct SymbolLoadWork {
+	void (*work)(void* user, size_t index);
+	void* user;
+	size_t count;
+	std::atomic<size_t> next;
+	std::atomic<int> running;
+};
+
+static IBThread sLoadThread;
+static std::atomic<bool> sLoadCancel(false);
+static std::atomic<bool> sLoadRunning(false);
+static std::atomic<const char*> sLoadStage(nullptr);
+static std::atomic<size_t> sLoadStep(0);
+static std::atomic<size_t> sLoadSteps(0);
+static bool sLoadPending = false;	// started and not swapped in yet
+static bool sLoadSuccess = false;
+static SymbolFileType sLoadType = SymbolFile_Sym;
+static strown<PATH_MAX_LEN> sLoadFile;
+static std::vector<uint16_t> sLoadBreakpoints;
+static bool sLoadReplaceBreakpoints = false;
+
+void InitSymbolLoad()
+{
+	sLoadCancel = false;
+	sLoadRunning = false;
+}
+
+static void StopSymbolLoad()
+{
+	sLoadCancel = true;
+	while (sLoadRunning) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+	sLoadCancel = false;
+}
+
+static void DiscardSymbolLoad()
+{
+	BeginAddingSymbols();
+	ClearPendingSourceDebug();
+	sLoadBreakpoints.clear();
+	sLoadReplaceBreakpoints = false;
+	sLoadPending = false;
+}
+
+void ShutdownSymbolLoad()
+{
+	StopSymbolLoad();
+	DiscardSymbolLoad();
+}
+
+static IBThreadRet WINAPI SymbolLoadThread(void* data)
+{
+	// a cache is only read if nothing it was made from changed
+	bool success = ReadSymbolCache(sLoadFile.c_str(), sLoadType);
+	if (!success && !sLoadCancel) {
+		switch (sLoadType) {
+			case SymbolFile_KickDbg: success = ReadC64DbgSrc(sLoadFile.c_str()); break;
+			case SymbolFile_Sym: success = ReadSymbols(sLoadFile.c_str()); break;
+			case SymbolFile_ViceCmd: success = ReadViceCommandFile(sLoadFile.c_str()); break;
+		}
+		if (success && !sLoadCancel) {
+			SymbolLoadStage("Indexing symbols", 0);
+			FinishAddingSymbols();
+			SymbolLoadStage("Writing cache", 0);
+			WriteSymbolCache(sLoadFile.c_str(), sLoadType);
+		}
+	}
+	sLoadSuccess = success && !sLoadCancel;
+	sLoadRunning = false;
+	return 0;
+}
+
+bool LoadSymbolFile(const char* filename, SymbolFileType type)
+{
+	if (!FileExists(filename)) { return false; }
+	StopSymbolLoad();
+	DiscardSymbolLoad();
+	sLoadFile.copy(filename);
+	sLoadType = type;
+	sLoadSuccess = false;
+	sLoadStage = "Loading";
+	sLoadStep = 0;
+	sLoadSteps = 0;
+	sLoadPending = true;
+	sLoadRunning = true;
+	if (!IBCreateThread(&sLoadThread, kLoadStackSize, SymbolLoadThread, nullptr)) {
+		sLoadRunning = false;
+		sLoadPending = false;
+		return false;
+	}
+	return true;
+}
+
+bool SymbolLoadProgress(float& progress, const char*& stage)
+{
+	if (!sLoadPending) { return false; }
+	size_t steps = sLoadSteps;
+	progress = steps ? (float)std::min((size_t)sLoadStep, steps) / (float)steps : 0.0f;
+	stage = sLoadStage;
+	return true;
+}
+
+void SymbolLoadUpdate()
+{
+	if (!sLoadPending || sLoadRunning) { return; }
+	if (sLoadSuccess) {
+		CommitSymbols();
+		CommitSourceDebug();
+		if (sLoadReplaceBreakpoints) { RemoveAllBreakpoints(); }
+		ViceAddBreakpoints(sLoadBreakpoints.data(), sLoadBreakpoints.size());
+	}
+	DiscardSymbolLoad();
+}
+
+bool SymbolLoadCancelled()
+{
+	return sLoadCancel;
+}
+
+void SymbolLoadStage(const char* stage, size_t steps)
+{
+	sLoadStage = stage;
+	sLoadStep = 0;
+	sLoadSteps = steps;
+}
+
+void SymbolLoadStep(size_t step)
+{
+	sLoadStep = step;
+}
+
+static IBThreadRet WINAPI SymbolLoadWorker(void* data)
+{
+	SymbolLoadWork* job = (SymbolLoadWork*)data;
+	for (size_t index; !sLoadCancel && (index = job->next++) < job->count;) {
+		job->work(job->user, index);
+		++sLoadStep;
+	}
+	--job->running;
+	return 0;
+}
+
+void SymbolLoadParallel(const char* stage, size_t count, void (*work)(void* user, size_t index), void* user)
+{
+	SymbolLoadStage(stage, count);
+	SymbolLoadWork job;
+	job.work = work;
+	job.user = user;
+	job.count = count;
+	job.next = 0;
+	int workers = (int)std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), (size_t)kMaxLoadWorkers);
+	if ((size_t)workers > count) { workers = count ? (int)count : 1; }
+	job.running = workers;
+	for (int w = 1; w < workers; ++w) {	// this thread is the first worker
+		IBThread thread;
+		if (!IBCreateThread(&thread, kLoadStackSize, SymbolLoadWorker, &job)) { --job.running; }
+	}
+	SymbolLoadWorker(&job);
+	while (job.running) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+}
+
+void SymbolLoadBreakpoints(const uint16_t* addresses, size_t count, bool replace)
+{
+	if (replace) {
+		sLoadBreakpoints.clear();
+		sLoadReplaceBreakpoints = true;
+	}
+	sLoadBreakpoints.insert(sLoadBreakpoints.end(), addresses, addresses + count);
+}
+
+void WriteLoadBreakpoints(SymbolCacheWriter& cache)
+{
+	cache.AddValue((uint32_t)(sLoadReplaceBreakpoints ? 1 : 0));
+	cache.Add(sLoadBreakpoints);
+}
+
+bool ReadLoadBreakpoints(SymbolCacheReader& cache)
+{
+	uint32_t replace = 0;
+	std::vector<uint16_t> addresses;
+	if (!cache.Value(replace) || !cache.Next(addresses)) { return false; }
+	sLoadBreakpoints.swap(addresses);
+	sLoadReplaceBreakpoints = replace != 0;
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Loading symbols and debug info off the UI thread
+//	A symbol, Vice command or Kick Assembler debug file is read on a loader
+//	thread, the sources a debug file refers to are read and line indexed on a
+//	few more. The new symbols, source lines and breakpoints are kept aside and
+//	replace the current ones in one step on the UI thread when all is read.
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum SymbolFileType {
+	SymbolFile_KickDbg,
+	SymbolFile_Sym,
+	SymbolFile_ViceCmd
+};
+
+void InitSymbolLoad();
+void ShutdownSymbolLoad();
+
+bool LoadSymbolFile(const char* filename, SymbolFileType type);	// false if the file can't be opened, replaces a load in progress
+bool SymbolLoadProgress(float& progress, const char*& stage);	// true while loading
+void SymbolLoadUpdate();	// UI thread, swaps in a finished load
+
+// for the readers on the loader thread
+bool SymbolLoadCancelled();
+void SymbolLoadStage(const char* stage, size_t steps);
+void SymbolLoadStep(size_t step);
+void SymbolLoadParallel(const char* stage, size_t count, void (*work)(void* user, size_t index), void* user);	// returns when all are done
+void SymbolLoadBreakpoints(const uint16_t* addresses, size_t count, bool replace);	// set when the load is swapped in
+
+// the breakpoints of a load in its cache
+struct SymbolCacheWriter;
+struct SymbolCacheReader;
+void WriteLoadBreakpoints(SymbolCacheWriter& cache);
+bool ReadLoadBreakpoints(SymbolCacheReader& cache);
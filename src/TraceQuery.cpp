@@ -0,0 +1,577 @@
+// Filters and aggregates over trace hits
+//	The filter is compiled to a postfix list of column tests. Hits are scanned
+//	a block at a time from the trace columns: each test fills a byte per hit
+//	in a mask and && || ! combine masks, loops that the compiler vectorizes.
+//	Comparisons all become a range test, (value - lo) <= (hi - lo) unsigned.
+//	The scan runs on its own thread and publishes matches after each trace
+//	chunk and groups at most once a frame so the Trace view can show them as
+//	they come in.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "platform.h"
+#include "struse/struse.h"
+#include "Sym.h"
+#include "Traces.h"
+#include "TraceQuery.h"
+
+#ifndef _WIN32
+#define WINAPI
+#endif
+
+enum {
+	kQueryBlock = 4096,		// hits tested together, the masks stay in the L1 cache
+	kMaxQueryOps = 64,
+	kMaxQueryDepth = 16,	// masks on the stack while evaluating
+	kQueryPollMs = 10,		// how often a query that caught up looks for new hits
+	kQueryPublishMs = 16	// groups are published at most once per frame while scanning
+};
+
+enum TraceColumn {
+	TC_PC, TC_Addr, TC_A, TC_X, TC_Y, TC_SP, TC_FL, TC_Line, TC_Cycle, TC_Frame, TC_SW,
+	TC_Count
+};
+
+static const char* sColumnNames[TC_Count] = {
+	"pc", "addr", "a", "x", "y", "sp", "fl", "line", "cycle", "frame", "sw"
+};
+
+enum QueryOpType {
+	QO_Range,	// lo <= column <= hi
+	QO_Bits,	// column & lo != 0
+	QO_Const,	// lo is the result for every hit
+	QO_And,
+	QO_Or,
+	QO_Not
+};
+
+struct QueryOp {
+	uint8_t type;
+	uint8_t column;
+	uint32_t lo, hi;
+};
+
+struct QueryProgram {
+	QueryOp ops[kMaxQueryOps];
+	int numOps;
+	int groupColumn;
+	int valueColumn;
+	int tracePoint;
+};
+
+static IBMutex sQueryMutex;	// results
+static IBMutex sQueryThreadMutex;	// held by the scan thread while it runs
+static IBThread sQueryThread;
+static std::atomic<uint32_t> sQueryGeneration(0);	// a scan ends when this no longer matches its own
+static std::atomic<bool> sQueryScanning(false);	// there are hits the thread hasn't looked at yet
+static QueryProgram sQuery = {};	// owned by the scan while it runs
+static bool sQueryActive = false;
+
+static std::vector<uint32_t> sQueryMatches;
+static std::vector<TraceQueryGroup> sQueryGroups;
+static size_t sQueryScanned = 0;
+static size_t sQueryTotal = 0;
+static uint32_t sQueryRevision = 0;
+
+void InitTraceQuery()
+{
+	IBMutexInit(&sQueryMutex, "Trace query");
+	IBMutexInit(&sQueryThreadMutex, "Trace query thread");
+}
+
+void ShutdownTraceQuery()
+{
+	StopTraceQuery();
+	ClearTraceQuery();
+	IBMutexDestroy(&sQueryThreadMutex);
+	IBMutexDestroy(&sQueryMutex);
+}
+
+const char* TraceColumnName(int column)
+{
+	return column >= 0 && column < TC_Count ? sColumnNames[column] : "";
+}
+
+// parsing
+
+static int ParseColumn(strref& str)
+{
+	str.skip_whitespace();
+	strref name = str.get_label();
+	for (int c = 0; c < TC_Count; ++c) {
+		if (name.same_str(sColumnNames[c])) {
+			str.skip(name.get_len());
+			return c;
+		}
+	}
+	return -1;
+}
+
+static bool ParseValue(strref& str, uint32_t& value)
+{
+	str.skip_whitespace();
+	char c = str.get_first();
+	if (c == '$') {
+		++str;
+		if (!strref::is_hex(str.get_first())) { return false; }
+		value = (uint32_t)str.ahextoui_skip();
+		return true;
+	}
+	if (c == '%') {
+		++str;
+		value = (uint32_t)str.abinarytoui_skip();
+		return true;
+	}
+	if (c == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		str.skip(2);
+		value = (uint32_t)str.ahextoui_skip();
+		return true;
+	}
+	if (strref::is_number(c)) {
+		value = (uint32_t)str.atoi_skip();
+		return true;
+	}
+	// labels are looked up in the symbols
+	strl_t len = 0;
+	while (len < str.get_len() && (strref::is_valid_label(str[len]) || str[len] == '.')) { ++len; }
+	uint16_t addr;
+	if (len && GetAddress(str.get(), len, addr)) {
+		value = addr;
+		str.skip(len);
+		return true;
+	}
+	return false;
+}
+
+struct QueryParser {
+	QueryProgram& prog;
+	strref str;
+	const char* error;
+
+	QueryParser(QueryProgram& p, strref s) : prog(p), str(s), error(nullptr) {}
+
+	bool Emit(uint8_t type, uint8_t column = 0, uint32_t lo = 0, uint32_t hi = 0)
+	{
+		if (prog.numOps >= kMaxQueryOps) { error = "Query is too long"; return false; }
+		QueryOp& op = prog.ops[prog.numOps++];
+		op.type = type;
+		op.column = column;
+		op.lo = lo;
+		op.hi = hi;
+		return true;
+	}
+
+	// column op value
+	bool Compare()
+	{
+		int column = ParseColumn(str);
+		if (column < 0) { error = "Expected a column: pc addr a x y sp fl line cycle frame sw"; return false; }
+		str.skip_whitespace();
+		uint32_t value = 0, hi = 0;
+		if (str.grab_prefix("in")) {
+			if (!ParseValue(str, value)) { error = "Expected a value after in"; return false; }
+			str.skip_whitespace();
+			if (!str.grab_char('-') || !ParseValue(str, hi)) { error = "Expected a range, f.e. in $c000-$c0ff"; return false; }
+			return value <= hi ? Emit(QO_Range, (uint8_t)column, value, hi) : Emit(QO_Const, 0, 0);
+		}
+		// = is accepted for == like in breakpoint conditions
+		char c = str.get_first(), n = str[1];
+		int len = (c && n == '=') ? 2 : 1;
+		if (c == '&' && n != '&') {
+			str.skip(1);
+			if (!ParseValue(str, value)) { error = "Expected a value after &"; return false; }
+			return Emit(QO_Bits, (uint8_t)column, value);
+		}
+		if ((c != '=' && c != '!' && c != '<' && c != '>') || (c == '!' && len != 2)) {
+			error = "Expected == != < <= > >= in or &";
+			return false;
+		}
+		str.skip(len);
+		if (!ParseValue(str, value)) { error = "Expected a number or a label"; return false; }
+		switch (c) {
+			case '=': return Emit(QO_Range, (uint8_t)column, value, value);
+			case '!': return Emit(QO_Range, (uint8_t)column, value, value) && Emit(QO_Not);
+			case '<':
+				if (len == 1 && !value) { return Emit(QO_Const, 0, 0); }
+				return Emit(QO_Range, (uint8_t)column, 0, len == 2 ? value : value - 1);
+			case '>':
+				if (len == 1 && value == 0xffffffff) { return Emit(QO_Const, 0, 0); }
+				return Emit(QO_Range, (uint8_t)column, len == 2 ? value : value + 1, 0xffffffff);
+		}
+		return false;
+	}
+
+	bool Unary(int depth)
+	{
+		if (depth >= kMaxQueryDepth) { error = "Too many parentheses"; return false; }
+		str.skip_whitespace();
+		if (str.grab_char('!')) { return Unary(depth + 1) && Emit(QO_Not); }
+		if (str.grab_char('(')) {
+			if (!Or(depth + 1)) { return false; }
+			str.skip_whitespace();
+			if (!str.grab_char(')')) { error = "Expected )"; return false; }
+			return true;
+		}
+		return Compare();
+	}
+
+	bool And(int depth)
+	{
+		if (!Unary(depth)) { return false; }
+		for (;;) {
+			str.skip_whitespace();
+			if (!str.grab_prefix("&&")) { return true; }
+			if (!Unary(depth + 1) || !Emit(QO_And)) { return false; }
+		}
+	}
+
+	bool Or(int depth)
+	{
+		if (!And(depth)) { return false; }
+		for (;;) {
+			str.skip_whitespace();
+			if (str.get_first() != '|' || str[1] != '|') { return true; }
+			str.skip(2);
+			if (!And(depth + 1) || !Emit(QO_Or)) { return false; }
+		}
+	}
+
+	bool Parse()
+	{
+		prog.numOps = 0;
+		prog.groupColumn = prog.valueColumn = -1;
+		str.skip_whitespace();
+		if (str && str.get_first() != '|' && !Or(0)) { return false; }
+		str.skip_whitespace();
+		if (str.grab_char('|')) {
+			str.skip_whitespace();
+			if (!str.grab_prefix("group")) { error = "Expected group after |"; return false; }
+			prog.groupColumn = ParseColumn(str);
+			if (prog.groupColumn < 0) { error = "Expected a column to group by"; return false; }
+			str.skip_whitespace();
+			if (str) {
+				prog.valueColumn = ParseColumn(str);
+				if (prog.valueColumn < 0) { error = "Expected a column for min and max"; return false; }
+			}
+		}
+		str.skip_whitespace();
+		if (str) { error = "Unexpected text at the end"; return false; }
+		if (!prog.numOps && prog.groupColumn < 0) { error = "Nothing to filter or group"; return false; }
+		return true;
+	}
+};
+
+// scanning
+
+template<typename T> static void RangeMask(const T* column, size_t count, uint32_t lo, uint32_t span, uint8_t* mask)
+{
+	for (size_t i = 0; i < count; ++i) { mask[i] = ((uint32_t)column[i] - lo) <= span; }
+}
+
+template<typename T> static void BitsMask(const T* column, size_t count, uint32_t bits, uint8_t* mask)
+{
+	for (size_t i = 0; i < count; ++i) { mask[i] = ((uint32_t)column[i] & bits) != 0; }
+}
+
+static void TestColumn(const TraceColumns& cols, size_t first, size_t count, const QueryOp& op, uint8_t* mask)
+{
+	uint32_t span = op.hi - op.lo;
+	bool bits = op.type == QO_Bits;
+	switch (op.column) {
+#define QUERY_COLUMN(id, name) case id: if (bits) { BitsMask(cols.name + first, count, op.lo, mask); } \
+		else { RangeMask(cols.name + first, count, op.lo, span, mask); } break;
+		QUERY_COLUMN(TC_PC, pc)
+		QUERY_COLUMN(TC_Addr, addr)
+		QUERY_COLUMN(TC_A, a)
+		QUERY_COLUMN(TC_X, x)
+		QUERY_COLUMN(TC_Y, y)
+		QUERY_COLUMN(TC_SP, sp)
+		QUERY_COLUMN(TC_FL, fl)
+		QUERY_COLUMN(TC_Line, line)
+		QUERY_COLUMN(TC_Cycle, cycle)
+		QUERY_COLUMN(TC_Frame, frame)
+		QUERY_COLUMN(TC_SW, sw)
+#undef QUERY_COLUMN
+	}
+}
+
+static uint32_t ColumnValue(const TraceColumns& cols, int column, size_t i)
+{
+	switch (column) {
+		case TC_PC: return cols.pc[i];
+		case TC_Addr: return cols.addr[i];
+		case TC_A: return cols.a[i];
+		case TC_X: return cols.x[i];
+		case TC_Y: return cols.y[i];
+		case TC_SP: return cols.sp[i];
+		case TC_FL: return cols.fl[i];
+		case TC_Line: return cols.line[i];
+		case TC_Cycle: return cols.cycle[i];
+		case TC_Frame: return cols.frame[i];
+		case TC_SW: return cols.sw[i];
+	}
+	return 0;
+}
+
+// returns the mask of the hits that pass, nullptr if all do
+static const uint8_t* FilterBlock(const QueryProgram& prog, const TraceColumns& cols, size_t first, size_t count)
+{
+	static uint8_t masks[kMaxQueryDepth + 1][kQueryBlock];
+	if (!prog.numOps) { return nullptr; }
+	int top = 0;
+	for (int o = 0; o < prog.numOps; ++o) {
+		const QueryOp& op = prog.ops[o];
+		switch (op.type) {
+			case QO_Range:
+			case QO_Bits:
+				TestColumn(cols, first, count, op, masks[top++]);
+				break;
+			case QO_Const:
+				memset(masks[top++], op.lo ? 1 : 0, count);
+				break;
+			case QO_And: {
+				uint8_t* l = masks[top - 2], *r = masks[--top];
+				for (size_t i = 0; i < count; ++i) { l[i] &= r[i]; }
+				break;
+			}
+			case QO_Or: {
+				uint8_t* l = masks[top - 2], *r = masks[--top];
+				for (size_t i = 0; i < count; ++i) { l[i] |= r[i]; }
+				break;
+			}
+			case QO_Not: {
+				uint8_t* m = masks[top - 1];
+				for (size_t i = 0; i < count; ++i) { m[i] ^= 1; }
+				break;
+			}
+		}
+	}
+	return masks[0];
+}
+
+static int FindTrace(int tracePoint)
+{
+	for (size_t t = 0, n = NumTracePointIds(); t < n; ++t) {
+		if (GetTracePointId(t) == tracePoint) { return (int)t; }
+	}
+	return -1;
+}
+
+// groups are kept sorted by key, only new keys need a sort before publishing
+struct QueryGroups {
+	std::vector<TraceQueryGroup> sorted;
+	std::unordered_map<uint32_t, size_t> slots;	// key to index in sorted
+	bool added = false;
+	bool changed = false;	// since published
+};
+
+static void PublishGroups(QueryGroups& groups, size_t scanned, size_t total)
+{
+	if (groups.added) {
+		std::sort(groups.sorted.begin(), groups.sorted.end(), [](const TraceQueryGroup& a, const TraceQueryGroup& b) { return a.key < b.key; });
+		for (size_t g = 0, n = groups.sorted.size(); g < n; ++g) { groups.slots[groups.sorted[g].key] = g; }
+		groups.added = false;
+	}
+	IBMutexLock(&sQueryMutex);
+	sQueryGroups.assign(groups.sorted.begin(), groups.sorted.end());
+	sQueryScanned = scanned;
+	sQueryTotal = total;
+	++sQueryRevision;
+	IBMutexRelease(&sQueryMutex);
+	groups.changed = false;
+}
+
+static uint64_t QueryNowMs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the scan follows the trace, once it catches up it waits for more hits until stopped
+static void ScanTrace(uint32_t generation)
+{
+	const QueryProgram& prog = sQuery;
+	QueryGroups groups;
+	std::vector<uint32_t> matches;
+	size_t hit = 0, total = 0;
+	uint64_t published = QueryNowMs();
+	while (generation == sQueryGeneration) {
+		int trace = FindTrace(prog.tracePoint);
+		TraceColumns cols;
+		size_t count = trace >= 0 ? GetTraceColumns(trace, hit, cols) : 0;
+		if (!count) {
+			if (groups.changed) { PublishGroups(groups, hit, total); }
+			if (sQueryScanning) {
+				IBMutexLock(&sQueryMutex);
+				sQueryScanning = false;
+				++sQueryRevision;
+				IBMutexRelease(&sQueryMutex);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(kQueryPollMs));
+			continue;
+		}
+		sQueryScanning = true;
+		matches.clear();
+		for (size_t block = 0; block < count; block += kQueryBlock) {
+			size_t n = (count - block) < kQueryBlock ? (count - block) : kQueryBlock;
+			const uint8_t* mask = FilterBlock(prog, cols, block, n);
+			for (size_t i = 0; i < n; ++i) {
+				if (mask && !mask[i]) { continue; }
+				size_t row = block + i;
+				if (prog.groupColumn < 0) {
+					matches.push_back((uint32_t)(hit + row));
+					continue;
+				}
+				uint32_t key = ColumnValue(cols, prog.groupColumn, row);
+				uint32_t value = prog.valueColumn >= 0 ? ColumnValue(cols, prog.valueColumn, row) : 0;
+				std::unordered_map<uint32_t, size_t>::iterator slot = groups.slots.find(key);
+				if (slot == groups.slots.end()) {
+					TraceQueryGroup group = { key, 1, value, value, (uint32_t)(hit + row) };
+					groups.slots[key] = groups.sorted.size();
+					groups.sorted.push_back(group);
+					groups.added = true;
+					continue;
+				}
+				TraceQueryGroup& group = groups.sorted[slot->second];
+				if (value < group.min) { group.min = value; }
+				else if (value > group.max) { group.max = value; }
+				group.hits++;
+			}
+		}
+		hit += count;
+		total = NumTraceHits(trace);
+		if (prog.groupColumn >= 0) {
+			groups.changed = true;
+			uint64_t now = QueryNowMs();
+			if ((now - published) >= kQueryPublishMs) {
+				PublishGroups(groups, hit, total);
+				published = now;
+			}
+			continue;
+		}
+		IBMutexLock(&sQueryMutex);
+		sQueryMatches.insert(sQueryMatches.end(), matches.begin(), matches.end());
+		sQueryScanned = hit;
+		sQueryTotal = total;
+		++sQueryRevision;
+		IBMutexRelease(&sQueryMutex);
+	}
+	if (groups.changed) { PublishGroups(groups, hit, total); }	// stopped queries keep what was scanned
+}
+
+static IBThreadRet WINAPI TraceQueryThread(void* data)
+{
+	IBMutexLock(&sQueryThreadMutex);
+	ScanTrace((uint32_t)(uintptr_t)data);
+	IBMutexRelease(&sQueryThreadMutex);
+	return 0;
+}
+
+bool StartTraceQuery(int tracePoint, const char* query, char* error, size_t errorSize)
+{
+	StopTraceQuery();
+	QueryProgram prog = {};
+	QueryParser parser(prog, strref(query));
+	if (!parser.Parse()) {
+		if (error && errorSize) { snprintf(error, errorSize, "%s", parser.error ? parser.error : "Query error"); }
+		return false;
+	}
+	prog.tracePoint = tracePoint;
+	sQuery = prog;
+	IBMutexLock(&sQueryMutex);
+	sQueryMatches.clear();
+	sQueryGroups.clear();
+	sQueryScanned = 0;
+	sQueryTotal = 0;
+	++sQueryRevision;
+	IBMutexRelease(&sQueryMutex);
+	sQueryActive = true;
+	sQueryScanning = true;
+	if (!IBCreateThread(&sQueryThread, 65536, TraceQueryThread, (void*)(uintptr_t)sQueryGeneration.load())) {
+		sQueryScanning = false;
+		sQueryActive = false;
+		if (error && errorSize) { snprintf(error, errorSize, "Could not start the query"); }
+		return false;
+	}
+	return true;
+}
+
+// the scan thread holds its mutex until it ends, a thread that starts after
+// this sees the generation changed and ends right away
+void StopTraceQuery()
+{
+	++sQueryGeneration;
+	IBMutexLock(&sQueryThreadMutex);
+	IBMutexRelease(&sQueryThreadMutex);
+	IBMutexLock(&sQueryMutex);
+	sQueryScanning = false;
+	++sQueryRevision;
+	IBMutexRelease(&sQueryMutex);
+}
+
+void ClearTraceQuery()
+{
+	StopTraceQuery();
+	IBMutexLock(&sQueryMutex);
+	sQueryMatches.clear();
+	sQueryMatches.shrink_to_fit();
+	sQueryGroups.clear();
+	sQueryGroups.shrink_to_fit();
+	++sQueryRevision;
+	IBMutexRelease(&sQueryMutex);
+	sQueryActive = false;
+}
+
+bool TraceQueryActive()
+{
+	return sQueryActive;
+}
+
+int TraceQueryTracePoint()
+{
+	return sQuery.tracePoint;
+}
+
+TraceQueryStatus GetTraceQueryStatus()
+{
+	TraceQueryStatus status;
+	IBMutexLock(&sQueryMutex);
+	status.scanned = sQueryScanned;
+	status.total = sQueryTotal;
+	status.matches = sQueryMatches.size();
+	status.groups = sQueryGroups.size();
+	status.revision = sQueryRevision;
+	IBMutexRelease(&sQueryMutex);
+	status.groupColumn = sQuery.groupColumn;
+	status.valueColumn = sQuery.valueColumn;
+	status.running = sQueryScanning;
+	return status;
+}
+
+size_t GetTraceQueryMatches(size_t first, size_t count, uint32_t* hits)
+{
+	IBMutexLock(&sQueryMutex);
+	size_t num = sQueryMatches.size();
+	if (first >= num) { count = 0; }
+	else if (count > (num - first)) { count = num - first; }
+	if (count) { memcpy(hits, sQueryMatches.data() + first, count * sizeof(uint32_t)); }
+	IBMutexRelease(&sQueryMutex);
+	return count;
+}
+
+size_t GetTraceQueryGroups(size_t first, size_t count, TraceQueryGroup* groups)
+{
+	IBMutexLock(&sQueryMutex);
+	size_t num = sQueryGroups.size();
+	if (first >= num) { count = 0; }
+	else if (count > (num - first)) { count = num - first; }
+	if (count) { memcpy(groups, sQueryGroups.data() + first, count * sizeof(TraceQueryGroup)); }
+	IBMutexRelease(&sQueryMutex);
+	return count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// Queries over the hits of a trace
+//	<filter> [| group <column> [<column>]]
+//	The filter compares columns (pc, addr, a, x, y, sp, fl, line, cycle, frame,
+//	sw) to numbers or labels with == != < <= > >=, "in lo-hi" and "& bits",
+//	combined with && || ! and parentheses. Without group the query lists the
+//	matching hits, with group it counts the hits per value of the first column
+//	and keeps the min and max of the second.
+//	f.e. pc in $c000-$c0ff && a == $10
+//	     addr == $d418 | group frame
+//	     | group line a
+
+struct TraceQueryGroup {
+	uint32_t key;
+	uint32_t hits;
+	uint32_t min, max;	// of the value column, 0 without one
+	uint32_t firstHit;	// index of the first hit in the trace
+};
+
+struct TraceQueryStatus {
+	size_t scanned;		// hits looked at so far
+	size_t total;		// hits in the trace
+	size_t matches;		// matching hits so far
+	size_t groups;
+	uint32_t revision;	// changes when there are new results
+	int groupColumn;	// -1 if not grouping
+	int valueColumn;	// -1 if no min/max
+	bool running;		// scanning, false once caught up with the trace
+};
+
+void InitTraceQuery();
+void ShutdownTraceQuery();
+
+// parses the query and scans the trace on a background thread, results come
+// in as it goes and hits added later are scanned as they arrive until the
+// query is stopped. Returns false with a message if the query doesn't parse
+// or the thread can't be started.
+bool StartTraceQuery(int tracePoint, const char* query, char* error, size_t errorSize);
+void StopTraceQuery();	// waits for the scan to end, the results are kept
+void ClearTraceQuery();
+bool TraceQueryActive();	// a query was started and not cleared
+int TraceQueryTracePoint();
+
+TraceQueryStatus GetTraceQueryStatus();
+size_t GetTraceQueryMatches(size_t first, size_t count, uint32_t* hits);	// hit indices, returns count read
+size_t GetTraceQueryGroups(size_t first, size_t count, TraceQueryGroup* groups);	// sorted by key
+const char* TraceColumnName(int column);
@@ -1,189 +1,292 @@
-// Capture information from the VICE text monitor output
+// Trace hits from VICE checkpoints and step traces
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
 #include <vector>
-#include "struse/struse.h"
 #include "Traces.h"
+#include "TraceQuery.h"
 #include "platform.h"
 
-// TRACE Pattern:
-// ID: line starts with #, <bk num>, space, "(Trace store "<trg>")"
-// next line starts with .?:<addr>" "
-// contents line 0:
-//  * 23: line
-//	* 34, after spaces: cycle
-// contents line 1:
-//	* 3: pc
-//	* 40: A
-//	* 45: X
-//	* 50: Y
-//	* 55: SP
-//	* 59: FLAGS
-//	* 67: Stopwatch (after spaces)
-//#1 (Trace store d40b)  261/$105,   3/$003
-//.C:c617  9D 04 D4    STA $D404,X    - A:10 X:07 Y:00 SP:f6 ..-..I.C   26316174
+// Hits are stored by column in chunks that are only appended to. A chunk is
+// never moved or changed once its rows are counted, so the UI reads rows
+// below the published count without locking while VICE adds more. Chunks
+// beyond the memory budget are mapped from a temporary file instead.
+
+enum {
+	kTraceChunkRows = 0x10000,	// a chunk is 20 bytes per row, a multiple of IBMapFile_Granularity
+	kMaxTraceChunks = 4096,		// 256M hits in one trace
+	kMaxTraceArrays = 64
+};
+
+struct TraceChunk {
+	uint32_t sw[kTraceChunkRows];
+	uint32_t frame[kTraceChunkRows];
+	uint16_t pc[kTraceChunkRows];
+	uint16_t addr[kTraceChunkRows];
+	uint16_t line[kTraceChunkRows];
+	uint8_t cycle[kTraceChunkRows];
+	uint8_t a[kTraceChunkRows], x[kTraceChunkRows], y[kTraceChunkRows];
+	uint8_t sp[kTraceChunkRows], fl[kTraceChunkRows];
+};
 
 struct TraceArray {
 	int tpId;
 	uint32_t timeStart;
-	std::vector<TraceHit>* traceHits;
+	std::atomic<size_t> numHits;	// rows that readers can see
+	uint32_t rasterFrame;	// frames counted from the raster position of the hits
+	uint32_t lastRaster;
+	TraceChunk* chunks[kMaxTraceChunks];
+	bool mapped[kMaxTraceChunks];	// chunk is in the spill file
 };
 
 static const uint32_t cycles_per_frame_pal = 19656;
 static const uint32_t cycles_per_frame_ntsc = 17095;
 
-static bool sTraceStart = false;
-static int sTracePointIdx = 0;
-static TraceHit sTraceInfo = {};
-static IBMutex sTraceMutex;
+static IBMutex sTraceMutex;	// adding, removing and appending to traces, not reading
 
-static std::vector<TraceArray> sTraceArrays;
+static TraceArray* sTraceArrays[kMaxTraceArrays];
+static std::atomic<size_t> sNumTraceArrays(0);
+static TraceArray* sLastTrace = nullptr;	// most hits go to the same trace as the one before
+
+static size_t sTraceMemoryBudget = 256 * 1024 * 1024;
+static size_t sHeapChunks = 0;
+static IBMapFile* sSpillFile = nullptr;
+static std::vector<TraceChunk*> sFreeMappedChunks;	// the spill file doesn't shrink, its chunks are reused
 
 void InitTraces()
 {
 	IBMutexInit(&sTraceMutex, "Traces mutex");
 }
 
-void ShutdownTraces()
+// call with sTraceMutex locked
+static TraceChunk* AllocChunk(bool* mapped)
 {
-	IBMutexLock(&sTraceMutex);
-	for (size_t t = 0, n = sTraceArrays.size(); t < n; ++t) {
-		if (sTraceArrays[t].traceHits) {
-			delete sTraceArrays[t].traceHits;
-			sTraceArrays[t].traceHits = nullptr;
+	if (((sHeapChunks + 1) * sizeof(TraceChunk)) <= sTraceMemoryBudget) {
+		if (TraceChunk* chunk = (TraceChunk*)malloc(sizeof(TraceChunk))) {
+			++sHeapChunks;
+			*mapped = false;
+			return chunk;
+		}
+	}
+	*mapped = true;
+	if (sFreeMappedChunks.size()) {
+		TraceChunk* chunk = sFreeMappedChunks.back();
+		sFreeMappedChunks.pop_back();
+		return chunk;
+	}
+	if (!sSpillFile) { sSpillFile = IBMapFileCreate(); }
+	return (TraceChunk*)IBMapFileAdd(sSpillFile, sizeof(TraceChunk));
+}
+
+// call with sTraceMutex locked
+static void FreeTraceArray(TraceArray* trace)
+{
+	for (size_t c = 0; c < kMaxTraceChunks && trace->chunks[c]; ++c) {
+		if (trace->mapped[c]) { sFreeMappedChunks.push_back(trace->chunks[c]); }
+		else {
+			free(trace->chunks[c]);
+			--sHeapChunks;
 		}
 	}
-	sTraceArrays.clear();
+	if (sLastTrace == trace) { sLastTrace = nullptr; }
+	delete trace;
+}
+
+// call with sTraceMutex locked, only from the UI thread that reads the traces
+static void RemoveTraceArray(size_t index)
+{
+	size_t count = sNumTraceArrays;
+	if (index >= count) { return; }
+	FreeTraceArray(sTraceArrays[index]);
+	for (size_t t = index + 1; t < count; ++t) { sTraceArrays[t - 1] = sTraceArrays[t]; }
+	sNumTraceArrays = count - 1;
+}
+
+void ShutdownTraces()
+{
+	IBMutexLock(&sTraceMutex);
+	while (sNumTraceArrays) { RemoveTraceArray(sNumTraceArrays - 1); }
+	sFreeMappedChunks.clear();
+	IBMapFileClose(sSpillFile);
+	sSpillFile = nullptr;
 	IBMutexRelease(&sTraceMutex);
 	IBMutexDestroy(&sTraceMutex);
 }
 
+void SetTraceMemoryBudget(size_t bytes)
+{
+	IBMutexLock(&sTraceMutex);
+	sTraceMemoryBudget = bytes;
+	IBMutexRelease(&sTraceMutex);
+}
+
+size_t GetTraceMemoryBudget()
+{
+	return sTraceMemoryBudget;
+}
+
 size_t NumTracePointIds()
 {
-	return sTraceArrays.size();
+	return sNumTraceArrays;
 }
 
 int GetTracePointId(size_t id)
 {
-	if (id < sTraceArrays.size()) {
-		return sTraceArrays[id].tpId;
+	if (id < sNumTraceArrays) {
+		return sTraceArrays[id]->tpId;
 	}
 	return 0;
 }
 
 size_t NumTraceHits(size_t id)
 {
-	if (id < sTraceArrays.size()) {
-		return sTraceArrays[id].traceHits->size();
+	if (id < sNumTraceArrays) {
+		return sTraceArrays[id]->numHits.load(std::memory_order_acquire);
 	}
 	return 0;
 }
 
 void ClearTrace(size_t id)
 {
+	StopTraceQuery();
 	IBMutexLock(&sTraceMutex);
-	if (id < (int)sTraceArrays.size()) {
-		sTraceArrays[id].traceHits->clear();
-		sTraceArrays.erase(sTraceArrays.begin() + id);
-
-	}
+	RemoveTraceArray(id);
 	IBMutexRelease(&sTraceMutex);
 }
 
+static void ReadHit(const TraceChunk* chunk, size_t row, TraceHit& hit)
+{
+	hit.sw = chunk->sw[row];
+	hit.frame = chunk->frame[row];
+	hit.pc = chunk->pc[row];
+	hit.addr = chunk->addr[row];
+	hit.line = chunk->line[row];
+	hit.cycle = chunk->cycle[row];
+	hit.a = chunk->a[row];
+	hit.x = chunk->x[row];
+	hit.y = chunk->y[row];
+	hit.sp = chunk->sp[row];
+	hit.fl = chunk->fl[row];
+}
+
+size_t GetTraceColumns(int id, size_t first, TraceColumns& columns)
+{
+	if (id < 0 || (size_t)id >= sNumTraceArrays) { return 0; }
+	const TraceArray* trace = sTraceArrays[id];
+	size_t numHits = trace->numHits.load(std::memory_order_acquire);
+	if (first >= numHits) { return 0; }
+	const TraceChunk* chunk = trace->chunks[first / kTraceChunkRows];
+	size_t row = first % kTraceChunkRows;
+	columns.sw = chunk->sw + row;
+	columns.frame = chunk->frame + row;
+	columns.pc = chunk->pc + row;
+	columns.addr = chunk->addr + row;
+	columns.line = chunk->line + row;
+	columns.cycle = chunk->cycle + row;
+	columns.a = chunk->a + row;
+	columns.x = chunk->x + row;
+	columns.y = chunk->y + row;
+	columns.sp = chunk->sp + row;
+	columns.fl = chunk->fl + row;
+	size_t count = kTraceChunkRows - row;
+	return count < (numHits - first) ? count : (numHits - first);
+}
+
 TraceHit GetTraceHit(int id, size_t index)
 {
 	TraceHit ret = {};
-	IBMutexLock(&sTraceMutex);
-	if (id < (int)sTraceArrays.size()) {
-		if (index < sTraceArrays[id].traceHits->size()) {
-			ret = sTraceArrays[id].traceHits->at(index);
-		}
-	}
-	IBMutexRelease(&sTraceMutex);
+	GetTraceHits(id, index, 1, &ret);
 	return ret;
 }
 
-void AddTraceHit(int tracePoint, TraceHit& hit)
+size_t GetTraceHits(int id, size_t first, size_t count, TraceHit* hits)
 {
-	IBMutexLock(&sTraceMutex);
-	uint32_t startTime = 0;
-	std::vector<TraceHit>* pArray = nullptr;
-	for (size_t t = 0, n = sTraceArrays.size(); t < n; ++t) {
-		if (sTraceArrays[t].tpId == tracePoint) {
-			pArray = sTraceArrays[t].traceHits;
-			startTime = sTraceArrays[t].timeStart;
-			break;
-		}
-	}
-	if (!pArray) {
-		// TODO: Determine whether PAL or NTSC timing here.
-		startTime = hit.sw - (hit.line * cycles_per_frame_pal / 263 + hit.cycle);
-		TraceArray tArr;
-		tArr.tpId = tracePoint;
-		tArr.timeStart = startTime;
-		tArr.traceHits = new std::vector<TraceHit>();
-		pArray = tArr.traceHits;
-		sTraceArrays.push_back(tArr);
+	if (id < 0 || (size_t)id >= sNumTraceArrays) { return 0; }
+	const TraceArray* trace = sTraceArrays[id];
+	size_t numHits = trace->numHits.load(std::memory_order_acquire);
+	if (first >= numHits) { return 0; }
+	if (count > (numHits - first)) { count = numHits - first; }
+	for (size_t i = 0; i < count; ++i) {
+		size_t index = first + i;
+		ReadHit(trace->chunks[index / kTraceChunkRows], index % kTraceChunkRows, hits[i]);
 	}
+	return count;
+}
 
-	if (pArray) {
-		hit.frame = (hit.sw - startTime) / cycles_per_frame_pal;
-		pArray->push_back(hit);
+// call with sTraceMutex locked
+static TraceArray* FindTrace(int tracePoint, uint32_t timeStart)
+{
+	TraceArray* trace = sLastTrace && sLastTrace->tpId == tracePoint ? sLastTrace : nullptr;
+	for (size_t t = 0, n = sNumTraceArrays; !trace && t < n; ++t) {
+		if (sTraceArrays[t]->tpId == tracePoint) { trace = sTraceArrays[t]; }
 	}
-	IBMutexRelease(&sTraceMutex);
+	if (!trace && sNumTraceArrays < kMaxTraceArrays) {
+		trace = new TraceArray;
+		trace->tpId = tracePoint;
+		trace->timeStart = timeStart;
+		trace->numHits = 0;
+		trace->rasterFrame = 0;
+		trace->lastRaster = 0;
+		memset(trace->chunks, 0, sizeof(trace->chunks));
+		memset(trace->mapped, 0, sizeof(trace->mapped));
+		sTraceArrays[sNumTraceArrays] = trace;
+		sNumTraceArrays++;
+	}
+	if (trace) { sLastTrace = trace; }
+	return trace;
 }
 
+// call with sTraceMutex locked
+static void AppendHit(TraceArray* trace, const TraceHit& hit)
+{
+	size_t index = trace->numHits.load(std::memory_order_relaxed);
+	size_t c = index / kTraceChunkRows, row = index % kTraceChunkRows;
+	if (c < kMaxTraceChunks && !trace->chunks[c]) { trace->chunks[c] = AllocChunk(&trace->mapped[c]); }
+	if (c < kMaxTraceChunks && trace->chunks[c]) {
+		TraceChunk* chunk = trace->chunks[c];
+		chunk->sw[row] = hit.sw;
+		chunk->frame[row] = hit.frame;
+		chunk->pc[row] = hit.pc;
+		chunk->addr[row] = hit.addr;
+		chunk->line[row] = hit.line;
+		chunk->cycle[row] = hit.cycle;
+		chunk->a[row] = hit.a;
+		chunk->x[row] = hit.x;
+		chunk->y[row] = hit.y;
+		chunk->sp[row] = hit.sp;
+		chunk->fl[row] = hit.fl;
+		// the row is complete before readers can see it
+		trace->numHits.store(index + 1, std::memory_order_release);
+	}
+}
 
+// the binary monitor has no stopwatch, a hit more than jitter cycles before
+// the raster position of the previous hit starts a new frame. Hits later in
+// the frame are the same frame, so gaps of a frame or more are not seen.
+void AddRasterTraceHit(int tracePoint, TraceHit& hit, uint32_t jitter)
+{
+	IBMutexLock(&sTraceMutex);
+	if (TraceArray* trace = FindTrace(tracePoint, 0)) {
+		uint32_t raster = hit.line * (cycles_per_frame_pal / 312) + hit.cycle;
+		if (trace->numHits.load(std::memory_order_relaxed) && (raster + jitter) < trace->lastRaster) { ++trace->rasterFrame; }
+		trace->lastRaster = raster;
+		hit.frame = trace->rasterFrame;
+		hit.sw = trace->rasterFrame * cycles_per_frame_pal + raster;
+		AppendHit(trace, hit);
+	}
+	IBMutexRelease(&sTraceMutex);
+}
 
-strref CaptureVICELine(strref line)
-{
-	strref orig = line;
-	if (sTraceStart) {
-		sTraceStart = false;
-
-		if (line.get_len() >= 68 && line[0] == '.' && line[2] == ':' && line[7]==' ') {
-			sTraceInfo.pc = (uint16_t)line.get_substr(3, 4).ahextoui();
-			sTraceInfo.a = (uint8_t)line.get_substr(40, 2).ahextoui();
-			sTraceInfo.x = (uint8_t)line.get_substr(45, 2).ahextoui();
-			sTraceInfo.y = (uint8_t)line.get_substr(50, 2).ahextoui();
-			sTraceInfo.sp = (uint8_t)line.get_substr(55, 2).ahextoui();
-			uint8_t f = 0;
-			if (line[59] != '.') { f |= 0x80; }
-			if (line[60] != '.') { f |= 0x40; }
-			//if (line[61] != '.') { f |= 0x20; }
-			if (line[62] != '.') { f |= 0x10; }
-			if (line[63] != '.') { f |= 0x08; }
-			if (line[64] != '.') { f |= 0x04; }
-			if (line[65] != '.') { f |= 0x02; }
-			if (line[66] != '.') { f |= 0x01; }
-			sTraceInfo.fl = f;
-			line.skip(67);
-			line.trim_whitespace();
-			sTraceInfo.sw = (uint32_t)line.atoui();
-			AddTraceHit(sTracePointIdx, sTraceInfo);
-			return strref();
-		}
-	} else if (line.get_len() >= 40 && line[0] == '#' && strref::is_number(line[1])) {
-		++line;
-		sTracePointIdx = line.atoi_skip();
-		line.skip_whitespace();
-		if (line.grab_prefix("(Trace ")) {
-			// don't bother with store/load/exec yet
-			line.next_word_ws();
-			sTraceInfo.addr = (uint16_t)line.ahextoui_skip();
-			if (line.grab_char(')')) {
-				line.skip_whitespace();
-				if (strref::is_number(line.get_first())) {
-					sTraceInfo.line = (uint16_t)line.atoi_skip();
-					line.skip_to_whitespace();
-					line.skip_whitespace();
-					if (strref::is_number(line.get_first())) {
-						sTraceInfo.cycle = (uint8_t)line.atoi_skip();
-						sTraceStart = true;
-						return strref();
-					}
-				}
-			}
+void StartStepTrace()
+{
+	StopTraceQuery();
+	IBMutexLock(&sTraceMutex);
+	for (size_t t = 0, n = sNumTraceArrays; t < n; ++t) {
+		if (sTraceArrays[t]->tpId == kStepTraceId) {
+			RemoveTraceArray(t);
+			break;
 		}
 	}
-	return orig;
-}
\ No newline at end of file
+	IBMutexRelease(&sTraceMutex);
+}
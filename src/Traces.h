@@ -10,12 +10,32 @@ struct TraceHit {
 	uint8_t a, x, y, sp, fl;
 };
 
-strref CaptureVICELine(strref line);
+enum { kStepTraceId = -1 };	// trace point id of the instruction trace from stepping
+
+void StartStepTrace();	// clears the step trace
+void AddRasterTraceHit(int tracePoint, TraceHit& hit, uint32_t jitter = 0);	// frame and sw from the raster line and cycle
+
+// reading doesn't lock, hits can be added meanwhile. Traces are only removed
+// by the thread that reads them.
 size_t NumTracePointIds();
 int GetTracePointId(size_t id);
 size_t NumTraceHits(size_t id);
 TraceHit GetTraceHit(int traceId, size_t index);
-void ClearTrace(size_t id);
+size_t GetTraceHits(int traceId, size_t first, size_t count, TraceHit* hits);	// returns hits read
+void ClearTrace(size_t id);	// stops a running trace query
+
+// the columns of the hits from first up to the end of its chunk, for scanning
+// many hits at a time. Returns the number of hits the columns hold.
+struct TraceColumns {
+	const uint32_t *sw, *frame;
+	const uint16_t *pc, *addr, *line;
+	const uint8_t *cycle, *a, *x, *y, *sp, *fl;
+};
+size_t GetTraceColumns(int traceId, size_t first, TraceColumns& columns);
+
+// hits beyond this many bytes of RAM go to a memory mapped temporary file
+void SetTraceMemoryBudget(size_t bytes);
+size_t GetTraceMemoryBudget();
 
 void InitTraces();
 void ShutdownTraces();
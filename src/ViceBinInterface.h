@@ -177,6 +177,19 @@ struct VICEBinMemGetResponse : public VICEBinResponse {
 	uint8_t data[1];
 };
 
+struct VICEBinBanksAvailableResponse : public VICEBinResponse {
+	struct bankInfo {
+		uint8_t itemSize;	// excluding self
+		uint8_t bankID[2];
+		uint8_t bankNameLen;
+		uint8_t bankName[1];
+		uint16_t GetID() { return Get2Bytes(bankID); }
+	};
+	uint8_t numBanks[2];
+	bankInfo aBanks;
+	uint16_t GetCount() { return Get2Bytes(numBanks); }
+};
+
 struct VICEBinCheckpointList : public VICEBinResponse {
 	uint8_t count[4];
 	uint32_t GetCount() {
@@ -1,25 +1,25 @@
-#ifdef _WIN32
-#include "winsock2.h"
-#include <ws2tcpip.h>
-#else
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <sys/errno.h>
-#include <netdb.h>
-#endif
+#include "ViceSocket.h"
 #include <inttypes.h>
 #include <stdio.h>
 #include <malloc.h>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 #include <assert.h>
+#include <chrono>
+#include <thread>
 
 #include "Files.h"
 #include "struse/struse.h"
 #include "6510.h"
 #include "Breakpoints.h"
 #include "Traces.h"
+#include "MemSync.h"
+#include "MemHistory.h"
+#include "StepBack.h"
+#include "ViceRecord.h"
+#include "ViceStats.h"
 
 #include "ViceInterface.h"
 #include "ViceBinInterface.h"
@@ -30,26 +30,106 @@
 #define VICELOG
 #endif
 
-#define SEND_IMMEDIATE
-										 
-#ifdef _WIN32
-#define VI_SOCKET SOCKET
-#else
+#ifndef _WIN32
 #define WINAPI
-#define VI_SOCKET int
 #define strcpy_s strcpy
 #define OutputDebugStringA printf
-#define SOCKET_ERROR -1
-static void Sleep(int ms) {
-	timespec t = { 0, ms * 1000 };
-	nanosleep(&t, &t);
-}
 #endif
 
+// outstanding request sent to VICE, stored in a ring indexed by request id
+struct ViceRequest;
+typedef void (*ViceRequestHandler)(ViceRequest& req, VICEBinResponse* resp);	// resp is nullptr on timeout
+
+struct ViceRequest {
+	uint32_t requestID;
+	uint32_t issueTick;		// ViceConnection::Tick count when sent
+	uint32_t timeout;		// Ticks to wait for a response
+	uint64_t issueUs;		// ViceStatsNowUs when queued, for round trip stats
+	ViceRequestHandler handler;	// if set replaces the handling by command type
+	uint8_t command;
+	bool active;
+	bool pingOnTimeout;		// check if VICE is still there if this goes unanswered
+
+	// MemGet
+	uint16_t start, end, bank;
+	uint8_t space;
+	uint32_t generation;	// CPU6510::syncGeneration when requested
+
+	// CheckpointDelete, CheckpointToggle
+	uint32_t checkpoint;
+	bool enable;
+};
+
+// Responses are parsed in place from the receive buffer. Only the incomplete
+// response at the end is moved to the front, and only when there is not enough
+// room left to receive into. The buffer grows to fit the largest response seen
+// (display and 64K memory responses) and shrinks back when it empties out.
+struct ViceRecvBuffer {
+	enum {
+		INITIAL_SIZE = 64 * 1024,
+		MIN_RECV = 16 * 1024,	// least space to offer recv()
+		SHRINK_SIZE = 1024 * 1024
+	};
+	uint8_t* data;
+	size_t size, readPos, writePos;
+
+	ViceRecvBuffer() : data((uint8_t*)malloc(INITIAL_SIZE)), size(data ? INITIAL_SIZE : 0), readPos(0), writePos(0) {}
+	~ViceRecvBuffer() { free(data); }
+
+	uint8_t* ReadPtr() { return data + readPos; }
+	size_t Available() const { return writePos - readPos; }
+	uint8_t* WritePtr() { return data + writePos; }
+	size_t WriteSpace() const { return size - writePos; }
+
+	// make room to receive the rest of a response of needed bytes
+	bool Reserve(size_t needed)
+	{
+		if (needed < MIN_RECV) { needed = MIN_RECV; }
+		if ((size - readPos) >= needed && WriteSpace() >= MIN_RECV) { return true; }
+		if (readPos) {
+			memmove(data, data + readPos, Available());
+			writePos -= readPos;
+			readPos = 0;
+		}
+		if (size >= needed && WriteSpace() >= MIN_RECV) { return true; }
+		size_t grow = size ? size : INITIAL_SIZE;
+		while (grow < needed || (grow - writePos) < MIN_RECV) { grow *= 2; }
+		uint8_t* bigger = (uint8_t*)realloc(data, grow);
+		if (!bigger) { return false; }
+		data = bigger;
+		size = grow;
+		return true;
+	}
+
+	void Consume(size_t bytes)
+	{
+		readPos += bytes;
+		if (readPos == writePos) {
+			readPos = writePos = 0;
+			if (size > SHRINK_SIZE) {
+				if (uint8_t* smaller = (uint8_t*)realloc(data, INITIAL_SIZE)) {
+					data = smaller;
+					size = INITIAL_SIZE;
+				}
+			}
+		}
+	}
+};
+
+// outgoing command, data follows
+struct ViceMessage {
+	int size;
+	int pool;	// size class to return to, -1 if not pooled
+	uint8_t* Data() { return (uint8_t*)(this + 1); }
+};
+
 class ViceConnection {
-	enum { RECEIVE_SIZE = 10*1024*1024 };
-	struct ViceMessage {
-		int size;	// data follows after len..
+	enum {
+		POLL_TIMEOUT_MS = 500,
+		MAX_SEND_BUFS = 64,		// messages gathered into one send
+		POOL_CLASSES = 6,		// 64, 256, 1K, 4K, 16K, 64K
+		POOL_MIN_SIZE = 64,
+		POOL_MAX_FREE = 64		// free messages kept per size class
 	};
 
 	size_t waitCount;
@@ -58,67 +138,178 @@ class ViceConnection {
 	bool connected;
 	bool stopped;
 
-#ifndef SEND_IMMEDIATE
-	std::queue<ViceMessage*> toSend;
-#endif
+	// messages queued during a frame are held in pending until Flush, then
+	// the connection thread writes everything in toSend with gathered sends
+	std::vector<ViceMessage*> pending;
+	std::deque<ViceMessage*> toSend;
+	size_t toSendOffset;	// bytes of toSend.front() already sent
+	ViceSocketWake wakeup;
+	std::vector<ViceMessage*> freeMessages[POOL_CLASSES];
+	ViceSendStats frameStats;
+
+	// a message whose request slot is still taken by an older request waits
+	// here, in order with the ones after it, until that one is answered or expires
+	struct WaitingMessage {
+		ViceMessage* msg;
+		ViceRequest request;
+	};
+	std::deque<WaitingMessage> waiting;
+
+	// replaying a capture instead of connecting
+	ViceRecordFile replayFile;
+	bool replaying;
+	bool replayRealTime;
+
+	bool sendQueued();
+	bool flushPending();
+	void sendTracked(ViceMessage* msg, const ViceRequest& request);
+	void releaseWaiting();
+	void FreeMessage(ViceMessage* msg);
 public:
 	ViceConnection(const char* ip, uint32_t port);
 	~ViceConnection();
 
 	static IBThreadRet WINAPI ViceConnectThread(void *data);
 	void connectionThread();
+	static IBThreadRet WINAPI ViceReplayThread(void* data);
+	void replayThread();
+
+	void handleResponse(VICEBinResponse* resp);
 
-	void updateGetMemory(VICEBinMemGetResponse* resp);
+	void updateGetMemory(VICEBinMemGetResponse* resp, const ViceRequest& req);
 
 	void handleCheckpointList(VICEBinCheckpointList* cpList);
 
 	void handleCheckpointGet(VICEBinCheckpointResponse* cp);
 
-	void updateRegisters(VICEBinRegisterResponse* resp);
+	void updateRegisters(VICEBinRegisterResponse* resp, CPU6510* cpu = nullptr);	// nullptr for the main CPU
 
 	void handleDisplayGet(VICEBinDisplayResponse* resp);
 
 	void handleStopResume(VICEBinStopResponse* resp);
+	void recordTraceHits();
+	void refreshStopped();
+	void requestDisplay();
+
+	void queueStepTrace();
+	void queueStepTraceRegisters();
+	void stepTraceRegisters(VICEBinRegisterResponse* resp);
 
 	void updateRegisterNames(VICEBinRegisterAvailableResponse* resp);
+	void updateBanks(VICEBinBanksAvailableResponse* resp);
 
 	void close();
 
 	bool open();
+	bool openReplay(const char* filename, bool realTime);
 	void Tick();
+	void Wake() { ViceSocketWakeSignal(wakeup); }
+	void Flush() { if (flushPending()) { Wake(); } }
+	ViceSendStats TakeFrameStats();
+	ViceMessage* AllocMessage(int size);
+	void QueueMessage(ViceMessage* msg, const ViceRequest& request);
 	void AddMessage(uint8_t *message, int size, bool wantResponse = false);
+	void AddRequest(uint8_t* message, int size, const ViceRequest& request);
 
 	bool isConnected() { return connected; }
+	bool isReplaying() { return replaying; }
 	bool isStopped() { return stopped; }
+	void Resuming() { stopped = false; }
 	void ImWaiting() { waitCount++; }
 
 	IBMutex msgSendMutex;
 
 };
 
-struct GetMemoryRequest {
-	uint32_t requestID;
-	uint16_t start, end, bank;
-	uint8_t space;
-};
-
-struct MessageRequestTimeout {
-	uint32_t requestID;
-	uint32_t timeSincePing;
+enum {
+	kMaxRequests = 1024,	// power of 2, request ids are sequential so id & (kMaxRequests-1) is the slot, more in flight wait their turn
+	kRequestTimeout = 100,	// Ticks (UI frames) before a request is given up on
+	kMaxExpiredPerTick = 16,
+	kStepTraceInFlight = 32	// register fetches kept in flight while step tracing
 };
 
-static VI_SOCKET s;
+static VI_SOCKET s = VI_INVALID_SOCKET;
 static IBThread threadHandle;
 static ViceConnection* viceCon = nullptr;
-static uint32_t lastRequestID = 0x0fff;
-static std::vector<GetMemoryRequest> sMemRequests;
-static std::vector<MessageRequestTimeout> sMessageTimeouts;
-static IBMutex userRequestMutex;
+static std::atomic<uint32_t> lastRequestID(0x0fff);	// both the UI and the connection thread send requests
+static ViceRequest sRequests[kMaxRequests];	// guarded by msgSendMutex
+static uint32_t sOldestRequestID = 0x1000;	// all requests before this are completed or expired
+static uint32_t sRequestTick = 0;
 static ViceLogger logConsole = nullptr;
 static void* logUser = nullptr;
 static bool sCloseConnectRequest = false;
 
+static uint32_t NextRequestID() { return lastRequestID.fetch_add(1) + 1; }
+
 static bool sResumeMeansStopped = false;
+static ViceSendStats sLastFrameSendStats = {};
+static bool sDisplayStale = false;	// stopped while the Screen view was hidden
+
+// memory banks VICE has, written by the connection thread before sNumBanks
+struct ViceBank {
+	uint16_t id;
+	char name[16];
+};
+static ViceBank sBanks[kMaxCPUBanks];
+static volatile int sNumBanks = 0;
+static bool sBanksRequested = false;
+static bool sCheckpointsListed = false;	// VICE is asked for the full list once per connection
+
+// checkpoints set as traces stop VICE so the registers arrive with the hit and
+// VICE is resumed right away. Each hit costs a stop, the registers and an Exit
+// so traces record at round trip rate. Only used by the connection thread.
+enum {
+	kMaxTraceHitsPerStop = 8,
+	kTraceJitterCycles = 7	// an interrupt starts up to 7 cycles late, a hit that much before the previous one isn't a new frame
+};
+struct ViceTraceHit {
+	uint32_t checkpoint;
+	uint16_t addr;
+};
+// VICE only knows them as stopping checkpoints, so the set is kept across
+// connections and matched by number and kind against the list VICE sends
+struct ViceTraceCheckpoint {
+	uint32_t number;
+	uint16_t start, end;
+	uint8_t operation;
+	bool listed;	// seen since this connection started
+};
+static std::vector<ViceTraceCheckpoint> sTraceCheckpoints;
+static ViceTraceHit sTraceHits[kMaxTraceHitsPerStop];	// trace checkpoints hit ahead of the next stop
+static int sNumTraceHits = 0;
+static bool sBreakHit = false;	// a checkpoint that is not a trace was hit as well
+
+// instruction trace by stepping, guarded by msgSendMutex
+struct ViceStepTraceState {
+	uint32_t toStep;	// steps not requested yet
+	uint32_t inFlight;	// register fetches not answered yet
+	uint32_t captured;
+	uint64_t startUs;
+	uint16_t stride;	// instructions per step, the numSteps of each Step
+	bool active;
+};
+static ViceStepTraceState sStepTrace = {};
+
+// a stop the debugger asked for, VICE stays stopped even if it also hit a
+// trace there. guarded by msgSendMutex
+struct ViceStopRequest {
+	bool pending;	// Break, Step, step over or step out
+	bool runTo;
+	uint16_t runToAddr;
+};
+static ViceStopRequest sStopRequest = {};
+
+static void ExpectStop(IBMutex* mutex, bool runTo = false, uint16_t addr = 0)
+{
+	IBMutexLock(mutex);
+	if (runTo) {
+		sStopRequest.runTo = true;
+		sStopRequest.runToAddr = addr;
+	} else {
+		sStopRequest.pending = true;
+	}
+	IBMutexRelease(mutex);
+}
 
 struct { const char* name; uint8_t id; } aCommandNames[] = {
 	{ "MemGet",1 },
@@ -153,30 +344,158 @@ struct { const char* name; uint8_t id; } aCommandNames[] = {
 
 
 
-ViceConnection::ViceConnection(const char* ip, uint32_t port) : waitCount(0), ipPort(port), connected(false), stopped(false)
+// call with msgSendMutex locked
+static void TrackRequest(const ViceRequest& req)
+{
+	ViceRequest& slot = sRequests[req.requestID & (kMaxRequests - 1)];
+#ifdef VICELOG
+	if (slot.active) {
+		strown<64> msg("Request table full, dropped ReqID:");
+		msg.append_num(slot.requestID, 0, 16);
+		OutputDebugStringA(msg.c_str());
+	}
+#endif
+	slot = req;
+	slot.issueTick = sRequestTick;
+	slot.issueUs = ViceStatsNowUs();
+	slot.active = true;
+}
+
+// call with msgSendMutex locked
+static bool RequestSlotFree(uint32_t id)
+{
+	return !sRequests[id & (kMaxRequests - 1)].active;
+}
+
+// call with msgSendMutex locked
+static bool TakeRequest(uint32_t id, ViceRequest& req)
+{
+	ViceRequest& slot = sRequests[id & (kMaxRequests - 1)];
+	if (slot.active && slot.requestID == id) {
+		req = slot;
+		slot.active = false;
+		return true;
+	}
+	return false;
+}
+
+// call with msgSendMutex locked
+static void ClearRequests()
+{
+	for (size_t i = 0; i < kMaxRequests; ++i) { sRequests[i].active = false; }
+	sOldestRequestID = lastRequestID.load() + 1;
+	sStepTrace.active = false;
+	sStopRequest = ViceStopRequest();
+	ViceStatsConnectionClosed();
+}
+
+static void StepTraceHandler(ViceRequest& req, VICEBinResponse* resp)
+{
+	if (viceCon) { viceCon->stepTraceRegisters((VICEBinRegisterResponse*)resp); }
+}
+
+static void MemGetHandler(ViceRequest& req, VICEBinResponse* resp)
 {
+	if (resp && !resp->errorCode) {
+		if (viceCon) { viceCon->updateGetMemory((VICEBinMemGetResponse*)resp, req); }
+	} else if (CPU6510* cpu = GetCPUIfCreated((VICEMemSpaces)req.space, req.bank)) {
+		if (resp) { MemSyncFailed(cpu, req.generation, req.start, req.end); }
+		else { MemSyncTimedOut(cpu, req.generation, req.start, req.end); }
+	}
+}
+
+// registers of a drive CPU
+static void RegistersHandler(ViceRequest& req, VICEBinResponse* resp)
+{
+	CPU6510* cpu = GetCPUIfCreated((VICEMemSpaces)req.space);
+	if (!cpu) { return; }
+	if (!resp) { cpu->regsFresh = false; }	// ask again
+	else if (!resp->errorCode && viceCon) { viceCon->updateRegisters((VICEBinRegisterResponse*)resp, cpu); }
+}
+
+static bool IsTraceCheckpoint(VICEBinCheckpointResponse* cp)
+{
+	for (size_t t = 0, n = sTraceCheckpoints.size(); t < n; ++t) {
+		ViceTraceCheckpoint& trace = sTraceCheckpoints[t];
+		if (trace.number == cp->GetNumber() && trace.start == cp->GetStart() &&
+			trace.end == cp->GetEnd() && trace.operation == cp->operation) {
+			trace.listed = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void RemoveTraceCheckpoint(uint32_t number)
+{
+	for (size_t t = 0, n = sTraceCheckpoints.size(); t < n; ++t) {
+		if (sTraceCheckpoints[t].number == number) {
+			sTraceCheckpoints.erase(sTraceCheckpoints.begin() + t);
+			return;
+		}
+	}
+}
+
+// checkpoint changes are applied to the local list when VICE confirms them,
+// added ones arrive as CheckpointGet responses
+static void CheckpointDeleteHandler(ViceRequest& req, VICEBinResponse* resp)
+{
+	if (resp && !resp->errorCode) {
+		RemoveBreakpoint(req.checkpoint);
+		RemoveTraceCheckpoint(req.checkpoint);
+	}
+}
+
+// the number of a trace is only known from the answer
+static void TraceCheckpointSetHandler(ViceRequest& req, VICEBinResponse* resp)
+{
+	if (resp && !resp->errorCode && viceCon) {
+		VICEBinCheckpointResponse* cp = (VICEBinCheckpointResponse*)resp;
+		RemoveTraceCheckpoint(cp->GetNumber());
+		ViceTraceCheckpoint trace = { cp->GetNumber(), cp->GetStart(), cp->GetEnd(), cp->operation, true };
+		sTraceCheckpoints.push_back(trace);
+		viceCon->handleCheckpointGet(cp);
+	}
+}
+
+static void CheckpointToggleHandler(ViceRequest& req, VICEBinResponse* resp)
+{
+	if (resp && !resp->errorCode) { EnableBreakpoint(req.checkpoint, req.enable); }
+}
+
+ViceConnection::ViceConnection(const char* ip, uint32_t port) : waitCount(0), ipPort(port), connected(false),
+	stopped(false), toSendOffset(0), frameStats(), replaying(false), replayRealTime(false)
+{
+	replayFile.data = nullptr;
 	IBMutexInit(&msgSendMutex, "VICE Send Message Mutex");
 	strcpy_s(ipAddress, ip);
+	wakeup.recvSide = wakeup.sendSide = VI_INVALID_SOCKET;
 }
 
 
 ViceConnection::~ViceConnection()
 {
+	for (size_t m = 0; m < pending.size(); ++m) { free(pending[m]); }
+	for (size_t m = 0; m < waiting.size(); ++m) { free(waiting[m].msg); }
+	for (size_t m = 0; m < toSend.size(); ++m) { free(toSend[m]); }
+	for (int c = 0; c < POOL_CLASSES; ++c) {
+		for (size_t m = 0; m < freeMessages[c].size(); ++m) { free(freeMessages[c][m]); }
+	}
+	ViceSocketWakeClose(wakeup);
+	ViceRecordClose(replayFile);
 	IBMutexDestroy(&msgSendMutex);
 }
 
 void ViceLog(const char* str, size_t len)
 {
-	strref decap = CaptureVICELine(strref(str, (strl_t)len));
-	if (decap && logConsole && logUser) {
-		logConsole(logUser, decap.get(), decap.get_len());
+	if (logConsole && logUser) {
+		logConsole(logUser, str, len);
 	}
 }
 
 void ViceLog(strref str)
 {
-	strref decap = CaptureVICELine(str);
-	if (decap && logConsole && logUser) {
+	if (logConsole && logUser) {
 		logConsole(logUser, str.get(), str.get_len());
 	}
 }
@@ -185,7 +504,7 @@ void VicePing()
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinHeader pingMsg;
-		pingMsg.Setup(0, ++lastRequestID, VICE_Ping);
+		pingMsg.Setup(0, NextRequestID(), VICE_Ping);
 		viceCon->AddMessage((uint8_t*)&pingMsg, sizeof(VICEBinHeader));
 	}
 }
@@ -202,9 +521,9 @@ bool ViceRunning()
 
 void ViceDisconnect()
 {
-	if (viceCon && viceCon->isConnected()) {
+	if (viceCon && (viceCon->isConnected() || viceCon->isReplaying())) {
 		sCloseConnectRequest = true;
-		VicePing();
+		viceCon->Wake();
 	}
 }
 
@@ -212,27 +531,33 @@ void ViceQuit()
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinHeader viceQuit;
-		viceQuit.Setup(0, ++lastRequestID, VICE_Quit);
+		viceQuit.Setup(0, NextRequestID(), VICE_Quit);
 		viceCon->AddMessage((uint8_t*)&viceQuit, sizeof(viceQuit));
-		VicePing(); // this will fail but will cause the connection thread exit cleanly
+		viceCon->Flush();
 	}
 }
 
 void ViceBreak()
 {
 	if (viceCon && viceCon->isConnected() && !viceCon->isStopped()) {
-		VICEBinRegisters regMsg(++lastRequestID, false);
+		ExpectStop(&viceCon->msgSendMutex);
+		VICEBinRegisters regMsg(NextRequestID(), false);
 		viceCon->AddMessage((uint8_t*)&regMsg, sizeof(regMsg), true);
+		viceCon->Flush();
 	}
 }
 
 void ViceGo()
 {
+	StepBackClear();
+	ViceStepTraceStop();
 	ClearBreapointsHit();
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
 		VICEBinHeader resumeMsg;
-		resumeMsg.Setup(0, ++lastRequestID, VICE_Exit);
+		resumeMsg.Setup(0, NextRequestID(), VICE_Exit);
 		viceCon->AddMessage((uint8_t*)&resumeMsg, sizeof(VICEBinHeader), true);
+		viceCon->Flush();
+		viceCon->Resuming();	// no more memory requests, any command after Exit stops VICE again
 	}
 }
 
@@ -240,9 +565,12 @@ void ViceStep()
 {
 	ClearBreapointsHit();
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
+		StepBackRecord(GetMainCPU());
+		ExpectStop(&viceCon->msgSendMutex);
 		VICEBinStep stepMsg;
-		stepMsg.Setup(++lastRequestID, false);
+		stepMsg.Setup(NextRequestID(), false);
 		viceCon->AddMessage((uint8_t*)&stepMsg, sizeof(VICEBinStep), true);
+		viceCon->Flush();
 		//sResumeMeansStopped = true;
 	}
 }
@@ -251,20 +579,69 @@ void ViceStepOver()
 {
 	ClearBreapointsHit();
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
+		StepBackClear();	// many instructions
+		ExpectStop(&viceCon->msgSendMutex);
 		VICEBinStep stepMsg;
-		stepMsg.Setup(++lastRequestID, true);
+		stepMsg.Setup(NextRequestID(), true);
 		viceCon->AddMessage((uint8_t*)&stepMsg, sizeof(VICEBinStep), true);
+		viceCon->Flush();
 		//sResumeMeansStopped = true;
 	}
 }
 
+// records the registers, steps stride instructions and repeats until count
+// instructions are in the step trace
+bool ViceStepTrace(uint32_t count, uint16_t stride)
+{
+	if (!count || !stride) { return false; }
+	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
+		IBMutexLock(&viceCon->msgSendMutex);
+		bool busy = sStepTrace.active;
+		if (!busy) {
+			sStepTrace.toStep = count - 1;
+			sStepTrace.inFlight = 1;
+			sStepTrace.captured = 0;
+			sStepTrace.stride = stride;
+			sStepTrace.startUs = ViceStatsNowUs();
+			sStepTrace.active = true;
+		}
+		IBMutexRelease(&viceCon->msgSendMutex);
+		if (busy) { return false; }
+		StepBackClear();
+		ClearBreapointsHit();
+		StartStepTrace();
+		viceCon->queueStepTraceRegisters();
+		viceCon->queueStepTrace();
+		viceCon->Flush();
+		return true;
+	}
+	return false;
+}
+
+void ViceStepTraceStop()
+{
+	if (viceCon) {
+		IBMutexLock(&viceCon->msgSendMutex);
+		sStepTrace.toStep = 0;	// finishes when the steps in flight are answered
+		IBMutexRelease(&viceCon->msgSendMutex);
+	}
+}
+
+bool ViceStepTracing()
+{
+	return sStepTrace.active;
+}
+
 void ViceStepOut()
 {
 	ClearBreapointsHit();
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
+		StepBackClear();
+		ExpectStop(&viceCon->msgSendMutex);
 		VICEBinHeader stepOutMsg;
-		stepOutMsg.Setup(0, ++lastRequestID, VICE_StepOut);
+		stepOutMsg.Setup(0, NextRequestID(), VICE_StepOut);
 		viceCon->AddMessage((uint8_t*)&stepOutMsg, sizeof(VICEBinHeader), true);
+		viceCon->Flush();
 		//sResumeMeansStopped = true;
 	}
 }
@@ -274,7 +651,7 @@ void ViceRemoveBreakpointNoList(uint32_t number)
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinCheckpoint chkpt;
-		chkpt.Setup(4, ++lastRequestID, VICE_CheckpointDelete);
+		chkpt.Setup(4, NextRequestID(), VICE_CheckpointDelete);
 		chkpt.SetNumber(number);
 		viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
 	}
@@ -284,15 +661,16 @@ void ViceRemoveBreakpoint(uint32_t number)
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinCheckpoint chkpt;
-		chkpt.Setup(4, ++lastRequestID, VICE_CheckpointDelete);
+		uint32_t requestID = NextRequestID();
+		chkpt.Setup(4, requestID, VICE_CheckpointDelete);
 		chkpt.SetNumber(number);
-		viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
-		
-		// reset breakpoints
-		ClearBreakpoints();
-		VICEBinHeader breakList;
-		breakList.Setup(0, ++lastRequestID, VICE_CheckpointList);
-		viceCon->AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+		ViceRequest req = {};
+		req.requestID = requestID;
+		req.timeout = kRequestTimeout;
+		req.handler = CheckpointDeleteHandler;
+		req.command = VICE_CheckpointDelete;
+		req.checkpoint = number;
+		viceCon->AddRequest((uint8_t*)&chkpt, sizeof(chkpt), req);
 	}
 }
 
@@ -300,58 +678,63 @@ void ViceToggleBreakpoint(uint32_t number, bool enable)
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinCheckpointToggle chkpt;
-		chkpt.Setup(5, ++lastRequestID, VICE_CheckpointToggle);
+		uint32_t requestID = NextRequestID();
+		chkpt.Setup(5, requestID, VICE_CheckpointToggle);
 		chkpt.SetNumber(number);
 		chkpt.enabled = enable ? 1 : 0;
-		viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
-
-		// reset breakpoints
-		ClearBreakpoints();
-		VICEBinHeader breakList;
-		breakList.Setup(0, ++lastRequestID, VICE_CheckpointList);
-		viceCon->AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+		ViceRequest req = {};
+		req.requestID = requestID;
+		req.timeout = kRequestTimeout;
+		req.handler = CheckpointToggleHandler;
+		req.command = VICE_CheckpointToggle;
+		req.checkpoint = number;
+		req.enable = enable;
+		viceCon->AddRequest((uint8_t*)&chkpt, sizeof(chkpt), req);
 	}
 }
 
+// VICE answers with a CheckpointGet that adds it to the local list. A trace
+// (stop = false) stops VICE as well so the registers arrive with each hit.
 void ViceAddCheckpoint(uint16_t start, uint16_t end, bool stop, bool load, bool store, bool exec)
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinCheckpointSet chkpt;
-		chkpt.Setup(8, ++lastRequestID, VICE_CheckpointSet);
+		uint32_t requestID = NextRequestID();
+		chkpt.Setup(8, requestID, VICE_CheckpointSet);
 		chkpt.SetStart(start);
 		chkpt.SetEnd(end);
-		chkpt.stopWhenHit = stop ? 1 : 0;
+		chkpt.stopWhenHit = 1;
 		chkpt.enabled = 1;
 		chkpt.operation = (load ? VICE_LoadMem : 0) | (store ? VICE_StoreMem : 0) | (exec ? VICE_Exec : 0);
 		chkpt.temporary = 0;
-		viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
-
-		// reset breakpoints
-		ClearBreakpoints();
-		VICEBinHeader breakList;
-		breakList.Setup(0, ++lastRequestID, VICE_CheckpointList);
-		viceCon->AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+		if (stop) {
+			viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
+		} else {
+			ViceRequest req = {};
+			req.requestID = requestID;
+			req.timeout = kRequestTimeout;
+			req.handler = TraceCheckpointSetHandler;
+			req.command = VICE_CheckpointSet;
+			viceCon->AddRequest((uint8_t*)&chkpt, sizeof(chkpt), req);
+		}
 	}
 }
 
 void ViceAddBreakpoint(uint16_t address)
 {
-	if (viceCon && viceCon->isConnected()) {
-		VICEBinCheckpointSet chkpt;
-		chkpt.Setup(8, ++lastRequestID, VICE_CheckpointSet);
-		chkpt.SetStart(address);
-		chkpt.SetEnd(address);
-		chkpt.stopWhenHit = 1;
-		chkpt.enabled = 1;
-		chkpt.operation = VICE_Exec;
-		chkpt.temporary = 0;
-		viceCon->AddMessage((uint8_t*)&chkpt, sizeof(chkpt));
+	ViceAddCheckpoint(address, address, true, false, false, true);
+}
 
-		// reset breakpoints
-		ClearBreakpoints();
-		VICEBinHeader breakList;
-		breakList.Setup(0, ++lastRequestID, VICE_CheckpointList);
-		viceCon->AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+// imports send all of their breakpoints in one go
+void ViceAddBreakpoints(const uint16_t* addresses, size_t count)
+{
+	if (viceCon && viceCon->isConnected()) {
+		std::vector<uint16_t> sorted(addresses, addresses + count);
+		std::sort(sorted.begin(), sorted.end());
+		for (size_t i = 0, n = sorted.size(); i < n; ++i) {
+			if ((!i || sorted[i] != sorted[i - 1]) && !HasExecBreakpoint(sorted[i])) { ViceAddBreakpoint(sorted[i]); }
+		}
+		viceCon->Flush();
 	}
 }
 
@@ -359,7 +742,7 @@ void ViceSetCondition(int checkPoint, strref condition)
 {
 	if (viceCon && viceCon->isConnected()) {
 		VICEBinSetCondition cond;
-		cond.Setup(++lastRequestID, checkPoint, (uint8_t)condition.get_len(), condition.get());
+		cond.Setup(NextRequestID(), checkPoint, (uint8_t)condition.get_len(), condition.get());
 		viceCon->AddMessage((uint8_t*)&cond, sizeof(VICEBinCheckpoint) + 1 + condition.get_len());
 	}
 }
@@ -369,13 +752,14 @@ void ViceRunTo(uint16_t addr)
 	ClearBreapointsHit();
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
 		VICEBinCheckpointSet checkSet;
-		checkSet.Setup(8, ++lastRequestID, VICE_CheckpointSet);
+		checkSet.Setup(8, NextRequestID(), VICE_CheckpointSet);
 		checkSet.SetStart(addr);
 		checkSet.SetEnd(addr);
 		checkSet.stopWhenHit = true;
 		checkSet.enabled = true;
 		checkSet.operation = (uint8_t)VICE_Exec;
 		checkSet.temporary = true;
+		ExpectStop(&viceCon->msgSendMutex, true, addr);
 		viceCon->AddMessage((uint8_t*)&checkSet, sizeof(checkSet), true);
 		ViceGo();
 	}
@@ -384,9 +768,10 @@ void ViceRunTo(uint16_t addr)
 void ViceStartProgram(const char* loadPrg)
 {
 	if (viceCon && viceCon->isConnected()) {
+		StepBackClear();
 		size_t loadFileLen = strlen(loadPrg);
 		VICEBinAutoStart autoStart;
-		autoStart.Setup((uint32_t)loadFileLen + 4, ++lastRequestID, VICE_AutoStart);
+		autoStart.Setup((uint32_t)loadFileLen + 4, NextRequestID(), VICE_AutoStart);
 		autoStart.startImmediately = 1;
 		autoStart.fileIndex[0] = 0;
 		autoStart.fileIndex[1] = 0;
@@ -399,8 +784,9 @@ void ViceStartProgram(const char* loadPrg)
 void ViceReset(uint8_t resetType)
 {
 	if (viceCon && viceCon->isConnected()) {
+		StepBackClear();
 		VICEBinReset reset;
-		reset.Setup(1, ++lastRequestID, VICE_Reset);
+		reset.Setup(1, NextRequestID(), VICE_Reset);
 		reset.resetType = resetType;
 		viceCon->AddMessage((uint8_t*)&reset, sizeof(VICEBinReset), false);
 	}
@@ -414,12 +800,37 @@ void ViceWaiting()
 	}
 }
 
+// everything queued during the frame goes out together
 void ViceTickMessage()
 {
 	if (viceCon) { viceCon->Tick(); }
+	MemSyncTick();
+	if (sDisplayStale && viceCon && viceCon->isConnected() && viceCon->isStopped() && ScreenViewVisible()) {
+		sDisplayStale = false;
+		viceCon->requestDisplay();
+	}
+	if (viceCon) {
+		viceCon->Flush();
+		sLastFrameSendStats = viceCon->TakeFrameStats();
+	}
+}
+
+ViceSendStats ViceLastFrameSendStats()
+{
+	return sLastFrameSendStats;
 }
 
 static const int numNames = sizeof(aCommandNames) / sizeof(aCommandNames[0]);
+int ViceBinCmdCount()
+{
+	return numNames;
+}
+
+uint8_t ViceBinCmdID(int index)
+{
+	return aCommandNames[index].id;
+}
+
 const char* ViceBinCmdName(uint8_t cmd)
 {
 	for (int i = 0, n = numNames; i < n; ++i) {
@@ -430,9 +841,10 @@ const char* ViceBinCmdName(uint8_t cmd)
 
 #define MAX_REGS_BUF 64
 
-bool ViceSetRegisters(const CPU6510& cpu, uint32_t regMask)
+bool ViceSetRegisters(CPU6510& cpu, uint32_t regMask)
 {
 	if (viceCon) {
+		cpu.RegistersWritten(regMask);
 		const CPU6510::Regs& regs = cpu.regs;
 		VICEMemSpaces mem = cpu.space;
 
@@ -506,7 +918,7 @@ bool ViceSetRegisters(const CPU6510& cpu, uint32_t regMask)
 			++ri;// = (VICEBinRegisterSetSingle*)((uint8_t*)ri + 4);
 			++count;
 		}
-		rm->Setup(size, ++lastRequestID, VICE_RegistersSet);
+		rm->Setup(size, NextRequestID(), VICE_RegistersSet);
 		rm->memSpace = (uint8_t)mem;
 		rm->count[0] = (uint8_t)count;
 		rm->count[1] = (uint8_t)(count >> 8);
@@ -517,31 +929,60 @@ bool ViceSetRegisters(const CPU6510& cpu, uint32_t regMask)
 }
 
 
-bool ViceGetMemory(uint16_t start, uint16_t end, VICEMemSpaces mem)
+bool ViceGetRegisters(VICEMemSpaces mem)
 {
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
-		VICEBinMemGetSet getNem(++lastRequestID, false, true, start, end, 0, mem);
-		GetMemoryRequest reqInfo = { lastRequestID, start, end, 0, (uint8_t)mem };
-		IBMutexLock(&userRequestMutex);
-		sMemRequests.push_back(reqInfo);
-		IBMutexRelease(&userRequestMutex);
+		uint32_t requestID = NextRequestID();
+		VICEBinRegisters regMsg(requestID, false, mem);
+		ViceRequest req = {};
+		req.requestID = requestID;
+		req.timeout = kRequestTimeout;
+		req.handler = RegistersHandler;
+		req.command = VICE_RegistersGet;
+		req.space = (uint8_t)mem;
+		viceCon->AddRequest((uint8_t*)&regMsg, sizeof(regMsg), req);
+		return true;
+	}
+	return false;
+}
+
+bool ViceGetMemory(uint16_t start, uint16_t end, VICEMemSpaces mem, uint16_t bank)
+{
+	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
+		uint32_t requestID = NextRequestID();
+		VICEBinMemGetSet getNem(requestID, false, true, start, end, bank, mem);
+		CPU6510* cpu = GetCPUIfCreated(mem, bank);
+		ViceRequest req = {};
+		req.requestID = requestID;
+		req.timeout = kRequestTimeout;
+		req.handler = MemGetHandler;
+		req.command = VICE_MemGet;
+		req.pingOnTimeout = true;
+		req.start = start;
+		req.end = end;
+		req.bank = bank;
+		req.space = (uint8_t)mem;
+		req.generation = cpu ? cpu->syncGeneration : 0;
 #ifdef VICELOG
 		strown<128> msg("Requested VICE Memory $");
 		msg.append_num(start, 4, 16).append("-$").append_num(end, 4, 16).append("\n");
 		ViceLog(msg.get_strref());
 		OutputDebugStringA(msg.c_str());
 #endif
-		viceCon->AddMessage((uint8_t*)&getNem, sizeof(getNem), true);
+		viceCon->AddRequest((uint8_t*)&getNem, sizeof(getNem), req);
 		return true;
 	}
 	return false;
 }
 
-bool ViceSetMemory(uint16_t start, uint16_t len, uint8_t* bytes, VICEMemSpaces mem)
+bool ViceSetMemory(uint16_t start, uint16_t len, uint8_t* bytes, VICEMemSpaces mem, uint16_t bank)
 {
 	if (viceCon && viceCon->isConnected() && viceCon->isStopped()) {
-		VICEBinMemGetSet* setMem = (VICEBinMemGetSet*)calloc(1, sizeof(VICEBinMemGetSet) + len);
-		setMem->Setup(++lastRequestID, false, false, start, start + len - 1, 0, mem);
+		ViceMessage* setMsg = viceCon->AllocMessage(int(sizeof(VICEBinMemGetSet) + len));
+		if (!setMsg) { return false; }
+		VICEBinMemGetSet* setMem = (VICEBinMemGetSet*)setMsg->Data();
+		uint32_t requestID = NextRequestID();
+		setMem->Setup(requestID, false, false, start, start + len - 1, bank, mem);
 		memcpy(setMem + 1, bytes, len);
 #ifdef VICELOG
 		strown<128> msg("Setting VICE Memory $");
@@ -549,7 +990,13 @@ bool ViceSetMemory(uint16_t start, uint16_t len, uint8_t* bytes, VICEMemSpaces m
 		ViceLog(msg.get_strref());
 		OutputDebugStringA(msg.c_str());
 #endif
-		viceCon->AddMessage((uint8_t*)setMem, sizeof(VICEBinMemGetSet) + len, true);
+		ViceRequest req = {};
+		req.requestID = requestID;
+		req.timeout = kRequestTimeout;
+		req.command = VICE_MemSet;
+		req.active = true;
+		req.pingOnTimeout = true;
+		viceCon->QueueMessage(setMsg, req);	// built in place, no copy
 		return true;
 	}
 	return false;
@@ -561,28 +1008,78 @@ void ViceAddLogger(ViceLogger logger, void* user)
 	logUser = user;
 }
 
-void ViceConnection::connectionThread()
+// send as much of the queue as the socket takes, false if the connection failed
+bool ViceConnection::sendQueued()
 {
-	char* recvBuf = (char*)malloc(RECEIVE_SIZE);
-	if (!recvBuf) { return; }
+	for (;;) {
+		ViceSocketBuf bufs[MAX_SEND_BUFS];
+		int count = 0;
+		size_t total = 0;
+		IBMutexLock(&msgSendMutex);
+		for (size_t n = toSend.size(); count < MAX_SEND_BUFS && (size_t)count < n; ++count) {
+			ViceMessage* msg = toSend[count];
+			size_t skip = count ? 0 : toSendOffset;
+			bufs[count].data = msg->Data() + skip;
+			bufs[count].size = msg->size - skip;
+			total += bufs[count].size;
+		}
+		IBMutexRelease(&msgSendMutex);
+		if (!count) { return true; }
 
-	// Open the connection
-	if (!open()) { return; }
+		int sent = ViceSocketSendv(s, bufs, count);
+		if (sent == SOCKET_ERROR) { return ViceSocketWouldBlock(); }
 
-	int32_t timeout = 100000;// SOCKET_READ_TIMEOUT_SEC*1000;
-	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO | SO_DEBUG, (char*)&timeout, sizeof(timeout));
+		// return fully sent messages to the pool
+		IBMutexLock(&msgSendMutex);
+		++frameStats.writes;
+		frameStats.bytes += sent;
+		size_t done = toSendOffset + sent;
+		while (toSend.size() && done >= (size_t)toSend.front()->size) {
+			done -= toSend.front()->size;
+			ViceRecordMessage(ViceRecord_Sent, toSend.front()->Data(), toSend.front()->size);
+			FreeMessage(toSend.front());
+			toSend.pop_front();
+		}
+		toSendOffset = done;
+		IBMutexRelease(&msgSendMutex);
+		if ((size_t)sent < total) { return true; }	// socket is full, wait until writable
+	}
+}
 
+// move messages from pending to the send queue, true if there was anything
+bool ViceConnection::flushPending()
+{
+	IBMutexLock(&msgSendMutex);
+	releaseWaiting();
+	bool any = pending.size() > 0;
+	frameStats.packets += (uint32_t)pending.size();
+	toSend.insert(toSend.end(), pending.begin(), pending.end());
+	pending.clear();
+	IBMutexRelease(&msgSendMutex);
+	return any;
+}
 
-	bool activeConnection = true;
-	{
-//		VICEBinRegisters regAvailMsg(++lastRequestID, true);
-//		VICEBinRegisters regMsg(++lastRequestID, false);
-//		AddMessage((uint8_t*)&regMsg, sizeof(regMsg));
-//		AddMessage((uint8_t*)&regAvailMsg, sizeof(regAvailMsg));
-//		AddMessage((uint8_t*)&regMsg, sizeof(regMsg));
+ViceSendStats ViceConnection::TakeFrameStats()
+{
+	IBMutexLock(&msgSendMutex);
+	ViceSendStats stats = frameStats;
+	frameStats = ViceSendStats();
+	IBMutexRelease(&msgSendMutex);
+	return stats;
+}
+
+void ViceConnection::connectionThread()
+{
+	ViceRecvBuffer recvBuf;
+	if (!recvBuf.data) { return; }
+
+	// Open the connection
+	if (!ViceSocketWakeOpen(wakeup) || !open()) {
+		return;
 	}
 
-	size_t bufferRead = 0;
+	bool activeConnection = true;
+	size_t recvNeeded = 0;	// size of the incomplete response at the end of recvBuf
 	connected = true;
 
 	while (activeConnection) {
@@ -596,178 +1093,152 @@ void ViceConnection::connectionThread()
 			break;
 		}
 
-		// messages to receive
-		assert(bufferRead < (RECEIVE_SIZE * 3 / 4));
-		int bytesReceived = recv(s, recvBuf + bufferRead, int(RECEIVE_SIZE - bufferRead), 0);
-		if (bytesReceived == SOCKET_ERROR) {
-		#ifdef _WIN32
-			if (WSAGetLastError() == WSAETIMEDOUT) {
-//				if ((state == Vice_None || state == Vice_Running) && stopRequest) {
-//					offs = 0;
-//					send(s, "r\n", 2, NULL);
-//					stopRequest = false;
-//				} else if (syncRequest) {
-//					syncRequest = false;
-//					ClearAllPCBreakpoints();
-//					ResetViceBP();
-//					send(s, sBundle, (int)strlen(sBundle), NULL);
-//					state = Vice_Sync;
-//					syncing = true;
-//					monitorOn = true;
-//					offs = 0;
-//					viceRunning = false;
-//					viceReloadSymbols = true;
-//				}
-				Sleep(50);
-			} else {
-				activeConnection = false;
+		// messages to send
+		if (!sendQueued()) { break; }
+
+		IBMutexLock(&msgSendMutex);
+		bool sendPending = toSend.size() > 0;
+		IBMutexRelease(&msgSendMutex);
+
+		// wait for VICE, or for AddMessage / ViceDisconnect to wake this thread up
+		int events = ViceSocketWait(s, wakeup, sendPending, POLL_TIMEOUT_MS);
+		if (events & ViceSocket_Read) {
+			// messages to receive
+			if (!recvBuf.Reserve(recvNeeded)) { break; }
+			int bytesReceived = recv(s, (char*)recvBuf.WritePtr(), int(recvBuf.WriteSpace()), 0);
+			if (bytesReceived == 0) { break; }	// VICE closed the connection
+			if (bytesReceived == SOCKET_ERROR) {
+				if (ViceSocketWouldBlock()) { continue; }
 				break;
 			}
-		#else
-			Sleep(50);
-		#endif
-		} else {
-			bufferRead += bytesReceived;
+			recvBuf.writePos += bytesReceived;
 
-			while (bufferRead >= sizeof(VICEBinResponse) && recvBuf[0] == 2) {
-				VICEBinResponse* resp = (VICEBinResponse*)recvBuf;
+			recvNeeded = 0;
+			while (recvBuf.Available() >= sizeof(VICEBinResponse)) {
+				if (recvBuf.ReadPtr()[0] != 2) {
+					recvBuf.Consume(1);	// not a response start, skip to the next STX
+					continue;
+				}
+				VICEBinResponse* resp = (VICEBinResponse*)recvBuf.ReadPtr();
 				uint32_t bytes = resp->GetSize();
-				if (bufferRead >= bytes) {
-#ifdef VICELOG
-					strown<128> msg("Got resp: $");
-					msg.append_num(resp->commandType, 2, 16);
-					msg.append(" (").append(ViceBinCmdName(resp->commandType)).append(")");
-					msg.append(" ReqID:").append_num(resp->GetReqID(), 0, 16);
-					if (resp->errorCode) {
-						msg.append(" err: ").append_num(resp->errorCode, 2, 16);
-					}
-					msg.append("\n");
-					ViceLog(msg.get_strref());
-					OutputDebugStringA(msg.c_str());
-#endif
-					uint32_t id = resp->GetReqID();
-					if (id != 0xffffffff) {
-						IBMutexLock(&msgSendMutex);
-						for (size_t i = 0, n = sMessageTimeouts.size(); i < n; ++i) {
-							if (sMessageTimeouts[i].requestID == id) {
-								sMessageTimeouts.erase(sMessageTimeouts.begin() + i);
-								break;
-							}
-						}
-						IBMutexRelease(&msgSendMutex);
-					}
-
-					switch (resp->commandType) {
-						case VICE_RegistersGet:
-							updateRegisters((VICEBinRegisterResponse*)resp);
-							break;
-						case VICE_RegistersAvailable:
-							updateRegisterNames((VICEBinRegisterAvailableResponse*)resp);
-							break;
-						case VICE_Resumed:
-#ifdef _DEBUG
-							OutputDebugStringA("Vice resumed\n");
-#endif
-							handleStopResume((VICEBinStopResponse*)resp);
-							break;
-						case VICE_MemGet:
-							updateGetMemory((VICEBinMemGetResponse*)resp);
-							break;
-						case VICE_CheckpointList:
-							handleCheckpointList((VICEBinCheckpointList*)resp);
-							break;
-						case VICE_CheckpointGet:
-							handleCheckpointGet((VICEBinCheckpointResponse*)resp);
-							break;
-						case VICE_Step:
-#ifdef _DEBUG
-							OutputDebugStringA("Vice stepped!\n");
-#endif
-							break;
-						case VICE_Stopped:
-						case VICE_JAM:
-#ifdef _DEBUG
-							OutputDebugStringA("Vice stopped\n");
-#endif
-							handleStopResume((VICEBinStopResponse*)resp);
-							break;
-						case VICE_DisplayGet:
-							handleDisplayGet((VICEBinDisplayResponse*)resp);
-							break;
-						case VICE_AutoStart:
-#ifdef _DEBUG
-							OutputDebugStringA("Loaded!\n");
-#endif
-							break;
-					}
-					if (bufferRead > bytes) {
-						memmove(recvBuf, recvBuf + bytes, bufferRead - bytes);
-						bufferRead -= bytes;
-					} else {
-						bufferRead = 0;
-					}
-
+				if (recvBuf.Available() >= bytes) {
+					ViceRecordMessage(ViceRecord_Received, (const uint8_t*)resp, bytes);
+					handleResponse(resp);
+					recvBuf.Consume(bytes);
 				} else {
+					recvNeeded = bytes;
 					break;
 				}
 			}
+			// requests made by response handlers go out on the next send
+			flushPending();
+		} else if (events & ViceSocket_Error) {
+			break;
 		}
-
-#ifndef SEND_IMMEDIATE
-		// messages to send
-		{
-			ViceMessage* msg = nullptr;
-			IBMutexLock(&msgSendMutex);
-			if (toSend.size()) {
-				msg = toSend.front(); toSend.pop();
-			}
-			IBMutexRelease(&msgSendMutex);
-			if (msg) {
-				send(s, (const char*)(&msg->size + 1), msg->size, 0);
-				free(msg);
-			}
-		}
-#endif
 	}
 	// connection with VICE was terminated for some reason
-	free(recvBuf);
+	ViceSocketClose(s);
 	IBMutexLock(&msgSendMutex);
-	sMessageTimeouts.clear();
-	sMemRequests.clear();
+	ClearRequests();
+	for (size_t m = 0; m < waiting.size(); ++m) { FreeMessage(waiting[m].msg); }
+	waiting.clear();
 	connected = false;
+	sBanksRequested = false;
+	sCheckpointsListed = false;
 	IBMutexRelease(&msgSendMutex);
+	for (size_t t = 0, n = sTraceCheckpoints.size(); t < n; ++t) { sTraceCheckpoints[t].listed = false; }
+	sNumTraceHits = 0;
+	sBreakHit = false;
+	StepBackClear();
 }
 
-void ViceConnection::updateGetMemory(VICEBinMemGetResponse* resp)
+void ViceConnection::handleResponse(VICEBinResponse* resp)
 {
-	IBMutexLock(&userRequestMutex);
-	// TODO: Check memory range for end
+#ifdef VICELOG
+	strown<128> msg("Got resp: $");
+	msg.append_num(resp->commandType, 2, 16);
+	msg.append(" (").append(ViceBinCmdName(resp->commandType)).append(")");
+	msg.append(" ReqID:").append_num(resp->GetReqID(), 0, 16);
+	if (resp->errorCode) {
+		msg.append(" err: ").append_num(resp->errorCode, 2, 16);
+	}
+	msg.append("\n");
+	ViceLog(msg.get_strref());
+	OutputDebugStringA(msg.c_str());
+#endif
 	uint32_t id = resp->GetReqID();
-	uint16_t start = 0, bank = 0;
-	uint8_t space = 0;
-	bool found = false;
-	for (size_t i = 0; i < sMemRequests.size(); ++i) {
-		if (sMemRequests[i].requestID == id) {
-			start = sMemRequests[i].start;
-			//end = sMemRequests[i].end;
-			bank = sMemRequests[i].bank;
-			space = sMemRequests[i].space;
-			found = true;
-			sMemRequests.erase(sMemRequests.begin() + i);
+	ViceRequest req;
+	bool tracked = false;
+	if (id != 0xffffffff) {
+		IBMutexLock(&msgSendMutex);
+		tracked = TakeRequest(id, req);
+		IBMutexRelease(&msgSendMutex);
+	}
+	// responses are keyed by the command sent, f.e. CheckpointSet is answered with CheckpointGet
+	ViceStatsReceived(tracked ? req.command : resp->commandType, resp->GetSize(), tracked, tracked ? req.issueUs : 0);
+
+	if (tracked && req.handler) {
+		req.handler(req, resp);
+	} else switch (resp->commandType) {
+		case VICE_RegistersGet:
+			updateRegisters((VICEBinRegisterResponse*)resp);
+			break;
+		case VICE_RegistersAvailable:
+			updateRegisterNames((VICEBinRegisterAvailableResponse*)resp);
+			break;
+		case VICE_BanksAvailable:
+			if (!resp->errorCode) { updateBanks((VICEBinBanksAvailableResponse*)resp); }
+			break;
+		case VICE_Resumed:
+#ifdef _DEBUG
+			OutputDebugStringA("Vice resumed\n");
+#endif
+			handleStopResume((VICEBinStopResponse*)resp);
+			break;
+		case VICE_CheckpointList:
+			handleCheckpointList((VICEBinCheckpointList*)resp);
+			break;
+		case VICE_CheckpointGet:
+			handleCheckpointGet((VICEBinCheckpointResponse*)resp);
+			break;
+		case VICE_Step:
+#ifdef _DEBUG
+			OutputDebugStringA("Vice stepped!\n");
+#endif
+			break;
+		case VICE_Stopped:
+		case VICE_JAM:
+#ifdef _DEBUG
+			OutputDebugStringA("Vice stopped\n");
+#endif
+			handleStopResume((VICEBinStopResponse*)resp);
+			break;
+		case VICE_DisplayGet:
+			handleDisplayGet((VICEBinDisplayResponse*)resp);
+			break;
+		case VICE_AutoStart:
+#ifdef _DEBUG
+			OutputDebugStringA("Loaded!\n");
+#endif
 			break;
-		}
 	}
-	IBMutexRelease(&userRequestMutex);
+}
 
-	assert(found);
-	if (CPU6510* cpu = GetCPU((VICEMemSpaces)space)) {
+void ViceConnection::updateGetMemory(VICEBinMemGetResponse* resp, const ViceRequest& req)
+{
+	// TODO: Check memory range for end
+	uint16_t start = req.start;
+	uint16_t bank = req.bank;
+	uint8_t space = req.space;
+	if (CPU6510* cpu = GetCPUIfCreated((VICEMemSpaces)space, bank)) {
 #ifdef VICELOG
 		strown<128> msg("updating $");
 		msg.append_num(start, 4, 16).append("-$").append_num(start + resp->bytes[0] + (((uint16_t)resp->bytes[1]) << 8) - 1, 4, 16);
 		msg.append(" mem/bank:").append_num(space, 0, 10).append("/").append_num(bank, 0, 10);
 		ViceLog(msg.get_strref());
 #endif
-		cpu->MemoryFromVICE(start, start + resp->bytes[0] + (((uint16_t)resp->bytes[1]) << 8) - 1, resp->data);
+		// responses requested before the last stop or resume are out of date
+		MemSyncReceived(cpu, req.generation, start, start + resp->bytes[0] + (((uint16_t)resp->bytes[1]) << 8) - 1, resp->data);
 	}
 }
 
@@ -778,14 +1249,30 @@ void ViceConnection::handleCheckpointList(VICEBinCheckpointList* cpList)
 	msg.sprintf("%d checkpoints found", cpList->GetCount());
 	ViceLog(msg);
 #endif
+	// the list follows a CheckpointGet for each checkpoint, traces VICE no longer has are dropped
+	for (size_t t = 0; t < sTraceCheckpoints.size();) {
+		if (sTraceCheckpoints[t].listed) { ++t; }
+		else { sTraceCheckpoints.erase(sTraceCheckpoints.begin() + t); }
+	}
 }
 
-// this also gets called every tracepoint!
+// also sent by VICE for each checkpoint hit, ahead of the registers and the stop
 void ViceConnection::handleCheckpointGet(VICEBinCheckpointResponse* cp)
 {
+	bool trace = IsTraceCheckpoint(cp);
+	if (cp->wasHit && trace) {
+		// recorded with the registers when VICE stops
+		if (sNumTraceHits < kMaxTraceHitsPerStop) {
+			sTraceHits[sNumTraceHits].checkpoint = cp->GetNumber();
+			sTraceHits[sNumTraceHits].addr = cp->GetStart();
+			++sNumTraceHits;
+		}
+		return;
+	}
+	if (cp->wasHit && cp->stopWhenHit) { sBreakHit = true; }
 	uint32_t flags = 0;
 	if (cp->enabled) flags |= Breakpoint::Enabled;
-	if (cp->stopWhenHit) flags |= Breakpoint::Stop;
+	if (cp->stopWhenHit && !trace) flags |= Breakpoint::Stop;
 	if (cp->operation & VICE_Exec) flags |= Breakpoint::Exec;
 	if (cp->operation & VICE_LoadMem) flags |= Breakpoint::Load;
 	if (cp->operation & VICE_StoreMem) flags |= Breakpoint::Store;
@@ -794,6 +1281,11 @@ void ViceConnection::handleCheckpointGet(VICEBinCheckpointResponse* cp)
 		SetBreakpointHit(cp->GetNumber());
 	}
 	if (cp->temporary) flags |= Breakpoint::Temporary;
+	// VICE deletes a temporary checkpoint when it is hit
+	if (cp->wasHit && cp->temporary) {
+		RemoveBreakpoint(cp->GetNumber());
+		return;
+	}
 	AddBreakpoint(cp->GetNumber(), flags, cp->GetStart(), cp->GetEnd(),
 				  cp->hasCondition ? "yes" : nullptr);
 	if (cp->hasCondition) {
@@ -801,24 +1293,28 @@ void ViceConnection::handleCheckpointGet(VICEBinCheckpointResponse* cp)
 	}
 }
 
-void ViceConnection::updateRegisters(VICEBinRegisterResponse* resp)
+void ViceConnection::updateRegisters(VICEBinRegisterResponse* resp, CPU6510* cpu)
 {
-	if (CPU6510* cpu = GetMainCPU()) {
+	if (!cpu) { cpu = GetMainCPU(); }
+	if (cpu) {
+		CPU6510::Regs regs;
+		uint32_t mask = 0;
 		for (uint16_t r = 0, n = resp->GetCount(); r < n; ++r) {
 			VICEBinRegisterResponse::regInfo& info = resp->aRegs[r];
 			switch (info.registerID) {
-				case VICE_Acc: cpu->regs.A = info.GetValue8(); break;
-				case VICE_X: cpu->regs.X = info.GetValue8(); break;
-				case VICE_Y: cpu->regs.Y = info.GetValue8(); break;
-				case VICE_PC: cpu->regs.PC = info.GetValue16(); break;
-				case VICE_SP: cpu->regs.SP = info.GetValue8(); break;
-				case VICE_FL: cpu->regs.FL = info.GetValue8(); break;
-				case VICE_LIN: cpu->regs.LIN = info.GetValue16(); break;
-				case VICE_CYC: cpu->regs.CYC = info.GetValue16(); break;
-				case VICE_00: cpu->regs.ZP00 = info.GetValue8(); break;
-				case VICE_01: cpu->regs.ZP01 = info.GetValue8(); break;
+				case VICE_Acc: regs.A = info.GetValue8(); mask |= CPU6510::RM_A; break;
+				case VICE_X: regs.X = info.GetValue8(); mask |= CPU6510::RM_X; break;
+				case VICE_Y: regs.Y = info.GetValue8(); mask |= CPU6510::RM_Y; break;
+				case VICE_PC: regs.PC = info.GetValue16(); mask |= CPU6510::RM_PC; break;
+				case VICE_SP: regs.SP = info.GetValue8(); mask |= CPU6510::RM_SP; break;
+				case VICE_FL: regs.FL = info.GetValue8(); mask |= CPU6510::RM_FL; break;
+				case VICE_LIN: regs.LIN = info.GetValue16(); mask |= CPU6510::RM_LIN; break;
+				case VICE_CYC: regs.CYC = info.GetValue16(); mask |= CPU6510::RM_CYC; break;
+				case VICE_00: regs.ZP00 = info.GetValue8(); mask |= CPU6510::RM_ZP00; break;
+				case VICE_01: regs.ZP01 = info.GetValue8(); mask |= CPU6510::RM_ZP01; break;
 			}
 		}
+		cpu->RegistersFromVICE(regs, mask);
 	}
 }
 
@@ -837,33 +1333,176 @@ void ViceConnection::handleStopResume(VICEBinStopResponse* resp)
 	ViceLog(msg.get_strref());
 #endif
 	if (CPU6510* cpu = GetCurrCPU()) {
-		cpu->regs.PC = resp->GetPC();
+		CPU6510::Regs stopRegs;
+		stopRegs.PC = resp->GetPC();
+		cpu->RegistersFromVICE(stopRegs, CPU6510::RM_PC);
 	}
 	switch (resp->commandType) {
 		case VICE_Resumed:
 			stopped = false;
+			MemSyncInvalidateAll();
 			break;
 		case VICE_Stopped:
 		case VICE_JAM: {
+			IBMutexLock(&msgSendMutex);
+			bool tracing = sStepTrace.active;
+			bool requested = tracing || sStopRequest.pending ||
+				(sStopRequest.runTo && sStopRequest.runToAddr == resp->GetPC());
+			IBMutexRelease(&msgSendMutex);
+			if (sNumTraceHits) { recordTraceHits(); }
+			if (resp->commandType == VICE_Stopped && sNumTraceHits && !sBreakHit && !requested) {
+				// VICE only stopped for traces, it runs on once the registers are recorded
+				VICEBinHeader resumeMsg;
+				resumeMsg.Setup(0, NextRequestID(), VICE_Exit);
+				AddMessage((uint8_t*)&resumeMsg, sizeof(VICEBinHeader));
+				break;
+			}
+			IBMutexLock(&msgSendMutex);
+			sStopRequest = ViceStopRequest();
+			IBMutexRelease(&msgSendMutex);
 			stopped = true;
-			ViceGetMemory(0x0000, 0x7fff, VICEMemSpaces::MainMemory);
-			ViceGetMemory(0x8000, 0xffff, VICEMemSpaces::MainMemory);
+			// a step trace refreshes once it is done
+			if (!tracing) { refreshStopped(); }
+			break;
+		}
+	}
+	sResumeMeansStopped = false;
+	sNumTraceHits = 0;
+	sBreakHit = false;
+}
+
+void ViceConnection::recordTraceHits()
+{
+	CPU6510::Regs regs = GetMainCPU()->ReceivedRegs();
+	for (int h = 0; h < sNumTraceHits; ++h) {
+		TraceHit hit = {};
+		hit.pc = regs.PC;
+		hit.addr = sTraceHits[h].addr;
+		hit.a = regs.A;
+		hit.x = regs.X;
+		hit.y = regs.Y;
+		hit.sp = regs.SP;
+		hit.fl = regs.FL;
+		hit.line = regs.LIN;
+		hit.cycle = (uint8_t)regs.CYC;
+		AddRasterTraceHit((int)sTraceHits[h].checkpoint, hit, kTraceJitterCycles);
+	}
+}
 
-			// breakpoint list is just an empty message
-			ClearBreakpoints();
-			VICEBinHeader breakList;
-			breakList.Setup(0, ++lastRequestID, VICE_CheckpointList);
-			AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+void ViceConnection::refreshStopped()
+{
+	// visible pages are requested first, the rest streams in from MemSyncTick
+	if (CPU6510* cpu = GetMainCPU()) {
+		CPU6510::Regs regs = cpu->ReceivedRegs();
+		MemHistoryStop(regs.PC);
+		StepBackStopped(cpu, regs);
+	}
+	MemSyncInvalidateAll();
+
+	// banks don't change while connected, VICE is asked once
+	if (!sBanksRequested) {
+		sBanksRequested = true;
+		VICEBinHeader banks;
+		banks.Setup(0, NextRequestID(), VICE_BanksAvailable);
+		AddMessage((uint8_t*)&banks, sizeof(VICEBinHeader));
+	}
 
-			// update the vice display
-			// TODO: skip if ScreenView is hidden
-			VICEBinDisplay getDisplay(++lastRequestID, VICEDisplay_Indexed);
-			AddMessage((uint8_t*)&getDisplay, sizeof(VICEBinDisplay));
+	// checkpoints are listed on the first stop, after that the local list is
+	// kept up to date from the responses to changes and hit events
+	if (!sCheckpointsListed) {
+		sCheckpointsListed = true;
+		ClearBreakpoints();
+		VICEBinHeader breakList;
+		breakList.Setup(0, NextRequestID(), VICE_CheckpointList);
+		AddMessage((uint8_t*)&breakList, sizeof(VICEBinHeader));
+	}
 
-			break;
+	// update the vice display, a hidden Screen view gets it when shown
+	sDisplayStale = !ScreenViewVisible();
+	if (!sDisplayStale) { requestDisplay(); }
+}
+
+void ViceConnection::requestDisplay()
+{
+	VICEBinDisplay getDisplay(NextRequestID(), VICEDisplay_Indexed);
+	AddMessage((uint8_t*)&getDisplay, sizeof(VICEBinDisplay));
+}
+
+// Step + RegistersGet pairs are queued from the response handler so VICE
+// always has the next steps waiting instead of a UI round trip per step
+void ViceConnection::queueStepTrace()
+{
+	for (;;) {
+		IBMutexLock(&msgSendMutex);
+		bool more = sStepTrace.active && sStepTrace.toStep && sStepTrace.inFlight < kStepTraceInFlight;
+		uint16_t stride = sStepTrace.stride;
+		if (more) {
+			--sStepTrace.toStep;
+			++sStepTrace.inFlight;
 		}
+		IBMutexRelease(&msgSendMutex);
+		if (!more) { break; }
+
+		VICEBinStep stepMsg;
+		stepMsg.Setup(NextRequestID(), false, stride);
+		AddMessage((uint8_t*)&stepMsg, sizeof(VICEBinStep));
+		queueStepTraceRegisters();
+	}
+}
+
+void ViceConnection::queueStepTraceRegisters()
+{
+	uint32_t requestID = NextRequestID();
+	VICEBinRegisters regMsg(requestID, false);
+	ViceRequest req = {};
+	req.requestID = requestID;
+	req.timeout = kRequestTimeout;
+	req.handler = StepTraceHandler;
+	req.command = VICE_RegistersGet;
+	req.pingOnTimeout = true;
+	AddRequest((uint8_t*)&regMsg, sizeof(regMsg), req);
+}
+
+// resp is nullptr on timeout, which ends the trace
+void ViceConnection::stepTraceRegisters(VICEBinRegisterResponse* resp)
+{
+	if (resp) {
+		updateRegisters(resp);
+		CPU6510::Regs regs = GetMainCPU()->ReceivedRegs();
+		TraceHit hit = {};
+		hit.pc = hit.addr = regs.PC;
+		hit.a = regs.A;
+		hit.x = regs.X;
+		hit.y = regs.Y;
+		hit.sp = regs.SP;
+		hit.fl = regs.FL;
+		hit.line = regs.LIN;
+		hit.cycle = (uint8_t)regs.CYC;
+		AddRasterTraceHit(kStepTraceId, hit);
+	}
+
+	IBMutexLock(&msgSendMutex);
+	bool done = false;
+	if (sStepTrace.active) {
+		if (sStepTrace.inFlight) { --sStepTrace.inFlight; }
+		if (resp) { ++sStepTrace.captured; }
+		else { sStepTrace.toStep = 0; }
+		done = !sStepTrace.toStep && !sStepTrace.inFlight;
+		if (done) { sStepTrace.active = false; }
+	}
+	uint32_t captured = sStepTrace.captured;
+	uint64_t us = ViceStatsNowUs() - sStepTrace.startUs;
+	IBMutexRelease(&msgSendMutex);
+
+	if (done) {
+		strown<128> msg;
+		msg.sprintf("Step trace: %u instructions in %.1fms (%.0f per second)", captured, us / 1000.0,
+					us ? captured * 1000000.0 / us : 0.0);
+		ViceLog(msg.get_strref());
+		refreshStopped();
+	} else {
+		queueStepTrace();
 	}
-	sResumeMeansStopped = false;
 }
 
 void ViceConnection::updateRegisterNames(VICEBinRegisterAvailableResponse* resp)
@@ -886,87 +1525,118 @@ void ViceConnection::updateRegisterNames(VICEBinRegisterAvailableResponse* resp)
 
 }
 
-void ViceConnection::close()
+void ViceConnection::updateBanks(VICEBinBanksAvailableResponse* resp)
 {
-	IBDestroyThread(&threadHandle);
-#ifdef _WIN32
-	closesocket(s);
-	WSACleanup();
-#else
-	shutdown(s, SHUT_RDWR);
-#endif
-	sCloseConnectRequest = false;
+	uint8_t* end = (uint8_t*)resp + resp->GetSize();
+	VICEBinBanksAvailableResponse::bankInfo* info = &resp->aBanks;
+	int numBanks = 0;
+	for (uint16_t b = 0, n = resp->GetCount(); b < n && (uint8_t*)info < end; ++b) {
+		// banks past the cached ones can't be viewed
+		uint16_t id = info->GetID();
+		if (id < kMaxCPUBanks && numBanks < kMaxCPUBanks) {
+			ViceBank& bank = sBanks[numBanks++];
+			bank.id = id;
+			size_t len = info->bankNameLen < sizeof(bank.name) ? info->bankNameLen : (sizeof(bank.name) - 1);
+			memcpy(bank.name, info->bankName, len);
+			bank.name[len] = 0;
+		}
+		info = (VICEBinBanksAvailableResponse::bankInfo*)((uint8_t*)info + info->itemSize + 1);
+	}
+	sNumBanks = numBanks;
 }
 
-bool ViceConnection::open()
+int ViceNumBanks()
 {
-#ifdef _WIN32	
-	WSADATA ws;
-	long status = WSAStartup(0x0101, &ws);
-	if (status != 0) { return false; }
-#endif
+	return sNumBanks;
+}
 
-	s = socket(AF_INET, SOCK_STREAM, 0);
-
-	// Make sure the user has specified a port
-	if (ipPort < 0 || ipPort > 65535) { return false; }
-
-	int32_t iResult = 0;
-	int32_t dwRetval;
-	sockaddr_in saGNI;
-	char hostname[NI_MAXHOST];
-	char servInfo[NI_MAXSERV];
-	saGNI.sin_family = AF_INET;
-	inet_pton(AF_INET, ipAddress, &(saGNI.sin_addr.s_addr));
-	saGNI.sin_port = htons(ipPort);
-	dwRetval = getnameinfo((struct sockaddr*)&saGNI,
-						   sizeof(struct sockaddr),
-						   hostname,
-						   NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
-
-	if (dwRetval != 0) {
-		return false;
+uint16_t ViceBankID(int index)
+{
+	return index >= 0 && index < sNumBanks ? sBanks[index].id : 0;
+}
+
+const char* ViceBankName(int index)
+{
+	return index >= 0 && index < sNumBanks ? sBanks[index].name : "default";
+}
+
+const char* ViceBankNameByID(uint16_t id)
+{
+	for (int b = 0; b < sNumBanks; ++b) {
+		if (sBanks[b].id == id) { return sBanks[b].name; }
 	}
+	return id ? "?" : "default";
+}
 
-	iResult = ::connect(s, (struct sockaddr*)&saGNI, sizeof(saGNI));
+void ViceConnection::close()
+{
+	ViceSocketClose(s);
+	sCloseConnectRequest = false;
+}
+
+bool ViceConnection::open()
+{
 	sCloseConnectRequest = false;
-	return iResult == 0;
+	return ViceSocketOpen(s, ipAddress, ipPort);
 }
 
 void ViceConnection::Tick()
 {
+	// requests complete roughly in order so only the oldest ones need checking
+	ViceRequest expired[kMaxExpiredPerTick];
+	int numExpired = 0;
 	IBMutexLock(&msgSendMutex);
-	uint32_t maxTime = 0;
-	for (size_t i = 0, n = sMessageTimeouts.size(); i < n; ++i) {
-		sMessageTimeouts[i].timeSincePing++;
-		if (sMessageTimeouts[i].timeSincePing > maxTime) {
-			maxTime = sMessageTimeouts[i].timeSincePing;
+	++sRequestTick;
+	uint32_t lastID = lastRequestID;
+	while (sOldestRequestID != (lastID + 1) && numExpired < kMaxExpiredPerTick) {
+		ViceRequest& req = sRequests[sOldestRequestID & (kMaxRequests - 1)];
+		if (req.active && req.requestID == sOldestRequestID) {
+			if ((sRequestTick - req.issueTick) <= req.timeout) { break; }
+			expired[numExpired++] = req;
+			req.active = false;
 		}
+		++sOldestRequestID;
 	}
 	IBMutexRelease(&msgSendMutex);
-	if (maxTime > 100) {
+
+	if (numExpired) {
+		bool ping = false;
+		for (int i = 0; i < numExpired; ++i) {
+			ViceStatsTimeout(expired[i].command);
+			ping = ping || expired[i].pingOnTimeout;
+		}
 #ifdef VICELOG
 		strown<256> msg("No response for:");
-		IBMutexLock(&msgSendMutex);
-//		uint32_t maxTime = 0;
-		for (size_t i = 0, n = sMessageTimeouts.size(); i < n; ++i) {
+		for (int i = 0; i < numExpired; ++i) {
 			if (i) { msg.append(", "); }
-			msg.append_num(sMessageTimeouts[i].requestID, 0, 16);
+			msg.append_num(expired[i].requestID, 0, 16);
 		}
-		IBMutexRelease(&msgSendMutex);
-		msg.append(". Sending Ping to VICE");
+		if (ping) { msg.append(". Sending Ping to VICE"); }
 		ViceLog(msg.get_strref());
 #endif
-		VicePing();
-		IBMutexLock(&msgSendMutex);
-		for (size_t i = 0, n = sMessageTimeouts.size(); i < n; ++i) {
-			sMessageTimeouts[i].timeSincePing = 0;
+		for (int i = 0; i < numExpired; ++i) {
+			if (expired[i].handler) { expired[i].handler(expired[i], nullptr); }
 		}
-		IBMutexRelease(&msgSendMutex);
+		if (ping) { VicePing(); }
 	}
 }
 
 void ViceConnection::AddMessage(uint8_t* message, int size, bool wantResponse)
+{
+	// VICE answers every command, track all of them for the round trip stats
+	ViceRequest req = {};
+	req.requestID = ((VICEBinHeader*)message)->GetReqID();
+	req.timeout = kRequestTimeout;
+	req.command = ((VICEBinHeader*)message)->commandType;
+	req.active = true;
+	req.pingOnTimeout = wantResponse;
+	AddRequest(message, size, req);
+}
+
+// the request is tracked until VICE answers or it times out, then its handler
+// is called with the response or nullptr. AddMessage tracks the messages
+// without a handler the same way for the round trip stats and timeouts.
+void ViceConnection::AddRequest(uint8_t* message, int size, const ViceRequest& request)
 {
 #ifdef VICELOG
 	VICEBinHeader* hdr = (VICEBinHeader*)message;
@@ -978,36 +1648,88 @@ void ViceConnection::AddMessage(uint8_t* message, int size, bool wantResponse)
 	OutputDebugStringA(str.c_str());
 #endif
 
-#ifdef SEND_IMMEDIATE
-	if (wantResponse) {
-		MessageRequestTimeout to = { ((VICEBinHeader*)message)->GetReqID(), 0 };
-		IBMutexLock(&msgSendMutex);
-		sMessageTimeouts.push_back(to);
-		IBMutexRelease(&msgSendMutex);
+	if (ViceMessage* msg = AllocMessage(size)) {
+		memcpy(msg->Data(), message, size);
+		QueueMessage(msg, request);
 	}
-	send(s, (const char*)message, size, 0);
-#else
+}
 
-	ViceMessage* msg = (ViceMessage*)malloc(sizeof(ViceMessage) + size);
-	if (msg) {
-		if (wantResponse) {
-			MessageRequestTimeout to = { ((VICEBinHeader*)message)->GetReqID(), 0 };
-			sMessageTimeouts.push_back(to);
+// messages up to 64K come from size class pools, larger ones are allocated as is
+ViceMessage* ViceConnection::AllocMessage(int size)
+{
+	int pool = 0;
+	while (pool < POOL_CLASSES && (POOL_MIN_SIZE << (2 * pool)) < size) { ++pool; }
+	if (pool == POOL_CLASSES) {
+		ViceMessage* msg = (ViceMessage*)malloc(sizeof(ViceMessage) + size);
+		if (msg) {
+			msg->size = size;
+			msg->pool = -1;
 		}
+		return msg;
+	}
+
+	ViceMessage* msg = nullptr;
+	IBMutexLock(&msgSendMutex);
+	if (freeMessages[pool].size()) {
+		msg = freeMessages[pool].back();
+		freeMessages[pool].pop_back();
+	}
+	IBMutexRelease(&msgSendMutex);
+	if (!msg) { msg = (ViceMessage*)malloc(sizeof(ViceMessage) + (POOL_MIN_SIZE << (2 * pool))); }
+	if (msg) {
 		msg->size = size;
-		memcpy(&msg->size + 1, message, size);
-		IBMutexLock(&msgSendMutex);
-		toSend.push(msg);
-		IBMutexRelease(&msgSendMutex);
+		msg->pool = pool;
+	}
+	return msg;
+}
+
+// call with msgSendMutex locked
+void ViceConnection::FreeMessage(ViceMessage* msg)
+{
+	if (msg->pool >= 0 && freeMessages[msg->pool].size() < POOL_MAX_FREE) {
+		freeMessages[msg->pool].push_back(msg);
+	} else {
+		free(msg);
+	}
+}
+
+// takes ownership of msg, it is sent on the next Flush
+void ViceConnection::QueueMessage(ViceMessage* msg, const ViceRequest& request)
+{
+	IBMutexLock(&msgSendMutex);
+	if (!connected) {
+		FreeMessage(msg);	// nothing to send to, f.e. while replaying a capture
+	} else if (waiting.size() || ((request.active || request.handler) && !RequestSlotFree(request.requestID))) {
+		WaitingMessage wait = { msg, request };
+		waiting.push_back(wait);
+	} else {
+		sendTracked(msg, request);
+	}
+	IBMutexRelease(&msgSendMutex);
+}
+
+// call with msgSendMutex locked
+void ViceConnection::sendTracked(ViceMessage* msg, const ViceRequest& request)
+{
+	if (request.active || request.handler) { TrackRequest(request); }
+	pending.push_back(msg);
+	ViceStatsSent(((VICEBinHeader*)msg->Data())->commandType, (uint32_t)msg->size);
+}
+
+// call with msgSendMutex locked, more than kMaxRequests in flight hold back the rest
+void ViceConnection::releaseWaiting()
+{
+	while (waiting.size()) {
+		const WaitingMessage& wait = waiting.front();
+		if ((wait.request.active || wait.request.handler) && !RequestSlotFree(wait.request.requestID)) { break; }
+		sendTracked(wait.msg, wait.request);
+		waiting.pop_front();
 	}
-#endif
 }
 
 IBThreadRet WINAPI ViceConnection::ViceConnectThread(void* data)
 {
-	IBMutexInit(&userRequestMutex, "User request VICE operations");
 	((ViceConnection*)data)->connectionThread();
-	IBMutexDestroy(&userRequestMutex);
 	if ((void*)viceCon == data) {
 		viceCon = nullptr;
 		delete (ViceConnection*)data;
@@ -1016,6 +1738,116 @@ IBThreadRet WINAPI ViceConnection::ViceConnectThread(void* data)
 }
 
 
+// call with msgSendMutex locked
+static void TrackReplayedMessage(VICEBinHeader* hdr)
+{
+	ViceRequest req = {};
+	req.requestID = hdr->GetReqID();
+	req.timeout = kRequestTimeout;
+	req.command = hdr->commandType;
+	req.active = true;
+	if (hdr->commandType == VICE_MemGet) {
+		VICEBinMemGetSet* memGet = (VICEBinMemGetSet*)hdr;
+		CPU6510* cpu = GetCPUIfCreated((VICEMemSpaces)memGet->memSpace, memGet->GetBank());
+		req.handler = MemGetHandler;
+		req.start = memGet->GetStart();
+		req.end = memGet->GetEnd();
+		req.bank = memGet->GetBank();
+		req.space = memGet->memSpace;
+		req.generation = cpu ? cpu->syncGeneration : 0;
+	}
+	uint32_t last = lastRequestID;
+	while ((int32_t)(req.requestID - last) > 0 && !lastRequestID.compare_exchange_weak(last, req.requestID)) {}
+	TrackRequest(req);
+	ViceStatsSent(hdr->commandType, hdr->GetSize());
+}
+
+bool ViceConnection::openReplay(const char* filename, bool realTime)
+{
+	sCloseConnectRequest = false;
+	replayRealTime = realTime;
+	replaying = ViceRecordOpen(replayFile, filename);
+	return replaying;
+}
+
+// feed captured responses to the handlers, captured commands recreate their requests
+void ViceConnection::replayThread()
+{
+	IBMutexLock(&msgSendMutex);
+	ClearRequests();
+	IBMutexRelease(&msgSendMutex);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration handlerTime(0);
+	uint32_t responses = 0, commands = 0;
+	uint64_t bytes = 0;
+	ViceRecordEntry entry;
+	while (!sCloseConnectRequest && ViceRecordNext(replayFile, entry)) {
+		if (replayRealTime) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds(entry.timeUs));
+		}
+		if (entry.direction == ViceRecord_Sent) {
+			if (entry.size >= sizeof(VICEBinHeader)) {
+				IBMutexLock(&msgSendMutex);
+				TrackReplayedMessage((VICEBinHeader*)entry.data);
+				IBMutexRelease(&msgSendMutex);
+				++commands;
+			}
+		} else if (entry.size >= sizeof(VICEBinResponse)) {
+			std::chrono::steady_clock::time_point handlerStart = std::chrono::steady_clock::now();
+			handleResponse((VICEBinResponse*)entry.data);
+			handlerTime += std::chrono::steady_clock::now() - handlerStart;
+			++responses;
+			bytes += entry.size;
+		}
+	}
+
+	strown<256> msg("Replayed ");
+	msg.append_num(commands, 0, 10).append(" commands and ").append_num(responses, 0, 10).append(" responses (");
+	msg.append_num((uint32_t)(bytes / 1024), 0, 10).append("K) in ");
+	msg.append_num((uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 0, 10);
+	msg.append("ms, handlers ");
+	msg.append_num((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(handlerTime).count(), 0, 10).append("us");
+	ViceLog(msg.get_strref());
+
+	IBMutexLock(&msgSendMutex);
+	ClearRequests();
+	IBMutexRelease(&msgSendMutex);
+	ViceRecordClose(replayFile);
+	sCloseConnectRequest = false;
+	replaying = false;
+}
+
+IBThreadRet WINAPI ViceConnection::ViceReplayThread(void* data)
+{
+	((ViceConnection*)data)->replayThread();
+	if ((void*)viceCon == data) {
+		viceCon = nullptr;
+		delete (ViceConnection*)data;
+	}
+	return 0;
+}
+
+bool ViceReplay(const char* filename, bool realTime)
+{
+	if (viceCon != nullptr) {
+		return false;	// connected or already replaying
+	}
+	ViceConnection* replay = new ViceConnection("0.0.0.0", 0);
+	if (!replay->openReplay(filename, realTime)) {
+		delete replay;
+		return false;
+	}
+	viceCon = replay;
+	IBCreateThread(&threadHandle, 16384, ViceConnection::ViceReplayThread, replay);
+	return true;
+}
+
+bool ViceReplaying()
+{
+	return viceCon && viceCon->isReplaying();
+}
+
 void ViceConnect(const char* ip, uint32_t port)
 {
 	if (viceCon != nullptr) {
@@ -22,22 +22,56 @@ void ViceGo();
 void ViceStep();
 void ViceStepOver();
 void ViceStepOut();
+
+// instruction trace: records the registers, steps stride instructions and
+// repeats until count entries are in the Step trace (kStepTraceId)
+bool ViceStepTrace(uint32_t count, uint16_t stride);
+void ViceStepTraceStop();
+bool ViceStepTracing();
 void ViceRunTo(uint16_t addr);
-bool ViceGetMemory(uint16_t start, uint16_t end, VICEMemSpaces mem);
-bool ViceSetMemory(uint16_t start, uint16_t len, uint8_t* bytes, VICEMemSpaces mem);
-bool ViceSetRegisters(const CPU6510& cpu, uint32_t regMask);
+// memory banks of the main memory space, bank 0 is what the CPU currently
+// sees, others are f.e. ram under the roms, io and cartridge. listed with
+// the first stop after connecting, returns 0 banks until then.
+int ViceNumBanks();
+uint16_t ViceBankID(int index);
+const char* ViceBankName(int index);
+const char* ViceBankNameByID(uint16_t id);
+
+bool ViceGetMemory(uint16_t start, uint16_t end, VICEMemSpaces mem, uint16_t bank = 0);
+bool ViceGetRegisters(VICEMemSpaces mem);	// for the drive CPUs, main CPU registers arrive on stop
+bool ViceSetMemory(uint16_t start, uint16_t len, uint8_t* bytes, VICEMemSpaces mem, uint16_t bank = 0);
+bool ViceSetRegisters(CPU6510& cpu, uint32_t regMask);
 void ViceStartProgram(const char* loadPrg);
 void ViceReset(uint8_t resetType);
 void ViceRemoveBreakpoint(uint32_t number);
 void ViceToggleBreakpoint(uint32_t number, bool enable);
 void ViceAddCheckpoint(uint16_t start, uint16_t end, bool stop, bool load, bool store, bool exec);
 void ViceAddBreakpoint(uint16_t address);
+void ViceAddBreakpoints(const uint16_t* addresses, size_t count);	// skips addresses that have one
 void ViceSetCondition(int checkPoint, strref condition);
 void ViceRemoveBreakpointNoList(uint32_t number);
 
 void ViceWaiting();
 void ViceTickMessage();
 
+// feed a capture made with ViceRecordStart to the response handlers instead of
+// connecting, realTime keeps the captured timing, ViceDisconnect stops it
+bool ViceReplay(const char* filename, bool realTime);
+bool ViceReplaying();
+
+// outgoing traffic of the last UI frame
+struct ViceSendStats {
+	uint32_t packets;	// commands queued
+	uint32_t bytes;
+	uint32_t writes;	// socket send calls
+};
+ViceSendStats ViceLastFrameSendStats();
+
+// binary monitor command names, by index for listing or by command type
+int ViceBinCmdCount();
+uint8_t ViceBinCmdID(int index);
+const char* ViceBinCmdName(uint8_t cmd);
+
 void ViceLog(strref msg);
 typedef void (*ViceLogger)(void*, const char* text, size_t len);
 void ViceAddLogger(ViceLogger logger, void* user);
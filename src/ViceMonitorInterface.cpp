@@ -1,38 +1,21 @@
 // Testing if the text mode monitor can work alongside the binary connection
-#ifdef _WIN32
-#include "winsock2.h"
-#include <ws2tcpip.h>
-#else
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <sys/errno.h>
-#include <netdb.h>
-#endif
+#include "ViceSocket.h"
 #include <inttypes.h>
 #include <malloc.h>
 #include <assert.h>
+#include <vector>
 #include "platform.h"
 #include "struse/struse.h"
 #include "ViceInterface.h"
 
-#ifdef _WIN32
-#define VI_SOCKET SOCKET
-#else
+#ifndef _WIN32
 #define WINAPI
-#define VI_SOCKET int
 #define strcpy_s strcpy
 #define OutputDebugStringA printf
-#define SOCKET_ERROR -1
-static void Sleep(int ms)
-{
-	timespec t = { 0, ms * 1000 };
-	nanosleep(&t, &t);
-}
 #endif
 
 class ViceMonitorConnection {
-	enum { RECEIVE_SIZE = 1024 };
+	enum { RECEIVE_SIZE = 1024, POLL_TIMEOUT_MS = 500 };
 
 	char ipAddress[32];
 	uint32_t ipPort;
@@ -53,58 +36,32 @@ public:
 	bool isStopped() { return stopped; }
 
 	IBMutex msgSendMutex;
-
+	std::vector<char> toSend;	// lines waiting for the monitor thread to send, any length
+	ViceSocketWake wakeup;
 };
 
-static VI_SOCKET s;
+static VI_SOCKET s = VI_INVALID_SOCKET;
 static IBThread threadHandle;
 static ViceMonitorConnection* viceMon = nullptr;
-static strown<256> sInitialCommand;
+static std::vector<char> sInitialCommand;	// sent once the connection is open
 
 
 ViceMonitorConnection::ViceMonitorConnection(const char* ip, uint32_t port) : ipPort(port), connected(false), stopped(false)
 {
 	IBMutexInit(&msgSendMutex, "VICE Send Message Mutex");
 	strcpy_s(ipAddress, ip);
+	wakeup.recvSide = wakeup.sendSide = VI_INVALID_SOCKET;
 }
 
 ViceMonitorConnection::~ViceMonitorConnection()
 {
+	ViceSocketWakeClose(wakeup);
 	IBMutexDestroy(&msgSendMutex);
 }
 
 bool ViceMonitorConnection::open()
 {
-#ifdef _WIN32	
-	WSADATA ws;
-	long status = WSAStartup(0x0101, &ws);
-	if (status != 0) { return false; }
-#endif
-
-	s = socket(AF_INET, SOCK_STREAM, 0);
-
-	// Make sure the user has specified a port
-	if (ipPort < 0 || ipPort > 65535) { return false; }
-
-	int32_t iResult = 0;
-	int32_t dwRetval;
-	sockaddr_in saGNI;
-	char hostname[NI_MAXHOST];
-	char servInfo[NI_MAXSERV];
-	saGNI.sin_family = AF_INET;
-	inet_pton(AF_INET, ipAddress, &(saGNI.sin_addr.s_addr));
-	saGNI.sin_port = htons(ipPort);
-	dwRetval = getnameinfo((struct sockaddr*)&saGNI,
-						   sizeof(struct sockaddr),
-						   hostname,
-						   NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
-
-	if (dwRetval != 0) {
-		return false;
-	}
-
-	iResult = ::connect(s, (struct sockaddr*)&saGNI, sizeof(saGNI));
-	return iResult == 0;
+	return ViceSocketOpen(s, ipAddress, ipPort);
 }
 
 IBThreadRet WINAPI ViceMonitorConnection::ViceMonitorThread(void* data)
@@ -123,65 +80,39 @@ void ViceMonitorConnection::monitorThread()
 	if (!recvBuf) { return; }
 
 	// Open the connection
-	if (!open()) { return; }
-
-	int32_t timeout = 100000;// SOCKET_READ_TIMEOUT_SEC*1000;
-	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO | SO_DEBUG, (char*)&timeout, sizeof(timeout));
-
-
-	bool activeConnection = true;
-	{
-//		VICEBinRegisters regAvailMsg(++lastRequestID, true);
-//		VICEBinRegisters regMsg(++lastRequestID, false);
-//		AddMessage((uint8_t*)&regMsg, sizeof(regMsg));
-//		AddMessage((uint8_t*)&regAvailMsg, sizeof(regAvailMsg));
-//		AddMessage((uint8_t*)&regMsg, sizeof(regMsg));
+	if (!ViceSocketWakeOpen(wakeup) || !open()) {
+		free(recvBuf);
+		return;
 	}
 
+	bool activeConnection = true;
 	size_t bufferRead = 0;
 	connected = true;
 
 	while (activeConnection) {
-	// close after all commands have been sent?
-//		if (closeRequest && !commands.size()) {
-//			threadHandle = INVALID_HANDLE_VALUE;
-//			close();
-//			break;
-//		}
-		if (sInitialCommand) {
-			send(s, sInitialCommand.get(), sInitialCommand.get_len(), 0);
+		if (sInitialCommand.size()) {
+			SendMonitorLine(sInitialCommand.data(), (int)sInitialCommand.size());
 			sInitialCommand.clear();
 		}
-		assert(bufferRead < (RECEIVE_SIZE / 2));
-		int bytesReceived = recv(s, recvBuf + bufferRead, int(RECEIVE_SIZE - bufferRead), 0);
-		if (bytesReceived == SOCKET_ERROR) {
-#ifdef _WIN32
-			if (WSAGetLastError() == WSAETIMEDOUT) {
-//				if ((state == Vice_None || state == Vice_Running) && stopRequest) {
-//					offs = 0;
-//					send(s, "r\n", 2, NULL);
-//					stopRequest = false;
-//				} else if (syncRequest) {
-//					syncRequest = false;
-//					ClearAllPCBreakpoints();
-//					ResetViceBP();
-//					send(s, sBundle, (int)strlen(sBundle), NULL);
-//					state = Vice_Sync;
-//					syncing = true;
-//					monitorOn = true;
-//					offs = 0;
-//					viceRunning = false;
-//					viceReloadSymbols = true;
-//				}
-				Sleep(50);
-			} else {
-				activeConnection = false;
+
+		// send queued lines
+		IBMutexLock(&msgSendMutex);
+		if (toSend.size()) {
+			int sent = send(s, toSend.data(), (int)toSend.size(), 0);
+			if (sent > 0) { toSend.erase(toSend.begin(), toSend.begin() + sent); }
+		}
+		bool sendPending = toSend.size() > 0;
+		IBMutexRelease(&msgSendMutex);
+
+		int events = ViceSocketWait(s, wakeup, sendPending, POLL_TIMEOUT_MS);
+		if (events & ViceSocket_Read) {
+			assert(bufferRead < (RECEIVE_SIZE / 2));
+			int bytesReceived = recv(s, recvBuf + bufferRead, int(RECEIVE_SIZE - bufferRead), 0);
+			if (bytesReceived == 0) { break; }	// VICE closed the connection
+			if (bytesReceived == SOCKET_ERROR) {
+				if (ViceSocketWouldBlock()) { continue; }
 				break;
 			}
-#else
-			Sleep(50);
-#endif
-		} else {
 			bufferRead += bytesReceived;
 			size_t bk = 0;
 			while (bufferRead) {
@@ -200,12 +131,24 @@ void ViceMonitorConnection::monitorThread()
 					break;
 				}
 			}
+		} else if (events & ViceSocket_Error) {
+			break;
 		}
 	}
 	// connection with VICE was terminated for some reason
+	ViceSocketClose(s);
+	connected = false;
 	free(recvBuf);
 }
 
+void ViceMonitorConnection::SendMonitorLine(const char* message, int size)
+{
+	IBMutexLock(&msgSendMutex);
+	toSend.insert(toSend.end(), message, message + size);
+	IBMutexRelease(&msgSendMutex);
+	ViceSocketWakeSignal(wakeup);
+}
+
 void ViceMonitorConnect(const char* ip, uint32_t port)
 {
 	if (viceMon != nullptr) {
@@ -223,10 +166,10 @@ void ViceMonitorConnect(const char* ip, uint32_t port)
 void SendViceMonitorLine(const char* message, int size)
 {
 	if (viceMon == nullptr) {
-		sInitialCommand.copy(strref(message, strl_t(size)));
+		sInitialCommand.assign(message, message + size);
 		ViceMonitorConnect("127.0.0.1", 6510);
 	} else {
-		send(s, message, size, 0);
+		viceMon->SendMonitorLine(message, size);
 	}
 }
 
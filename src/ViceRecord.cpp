@@ -0,0 +1,138 @@
+// Capture of the VICE binary monitor traffic for offline replay
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <chrono>
+#include "platform.h"
+#include "Files.h"
+#include "ViceRecord.h"
+
+enum {
+	kRecordVersion = 1,
+	kRecordHeaderSize = 8,	// "IBVR" + version
+	kEntryHeaderSize = 9	// time delta, direction, size
+};
+
+static IBMutex sRecordMutex;
+static FILE* sRecordFile = nullptr;
+static uint64_t sRecordLastUs = 0;
+
+static uint64_t RecordNowUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Put32(uint8_t* out, uint32_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+	out[2] = (uint8_t)(value >> 16);
+	out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t Get32(const uint8_t* in)
+{
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+void InitViceRecord()
+{
+	IBMutexInit(&sRecordMutex, "VICE record mutex");
+}
+
+void ShutdownViceRecord()
+{
+	ViceRecordStop();
+	IBMutexDestroy(&sRecordMutex);
+}
+
+bool ViceRecordStart(const char* filename)
+{
+	FILE* f = nullptr;
+#ifdef _WIN32
+	if (fopen_s(&f, filename, "wb") != 0) { f = nullptr; }
+#else
+	f = fopen(filename, "wb");
+#endif
+	if (!f) { return false; }
+	uint8_t header[kRecordHeaderSize] = { 'I', 'B', 'V', 'R' };
+	Put32(header + 4, kRecordVersion);
+	fwrite(header, sizeof(header), 1, f);
+
+	IBMutexLock(&sRecordMutex);
+	if (sRecordFile) { fclose(sRecordFile); }
+	sRecordFile = f;
+	sRecordLastUs = RecordNowUs();
+	IBMutexRelease(&sRecordMutex);
+	return true;
+}
+
+void ViceRecordStop()
+{
+	IBMutexLock(&sRecordMutex);
+	if (sRecordFile) {
+		fclose(sRecordFile);
+		sRecordFile = nullptr;
+	}
+	IBMutexRelease(&sRecordMutex);
+}
+
+bool ViceRecording()
+{
+	return sRecordFile != nullptr;
+}
+
+void ViceRecordMessage(ViceRecordDirection direction, const uint8_t* data, uint32_t size)
+{
+	if (!sRecordFile) { return; }
+	IBMutexLock(&sRecordMutex);
+	if (sRecordFile) {
+		uint64_t now = RecordNowUs();
+		uint64_t delta = now - sRecordLastUs;
+		sRecordLastUs = now;
+		uint8_t header[kEntryHeaderSize];
+		Put32(header, delta > 0xffffffff ? 0xffffffff : (uint32_t)delta);
+		header[4] = (uint8_t)direction;
+		Put32(header + 5, size);
+		fwrite(header, sizeof(header), 1, sRecordFile);
+		fwrite(data, size, 1, sRecordFile);
+	}
+	IBMutexRelease(&sRecordMutex);
+}
+
+bool ViceRecordOpen(ViceRecordFile& file, const char* filename)
+{
+	file.data = LoadBinary(filename, file.size);
+	file.pos = kRecordHeaderSize;
+	file.timeUs = 0;
+	if (!file.data) { return false; }
+	if (file.size < kRecordHeaderSize || memcmp(file.data, "IBVR", 4) != 0 || Get32(file.data + 4) != kRecordVersion) {
+		ViceRecordClose(file);
+		return false;
+	}
+	return true;
+}
+
+bool ViceRecordNext(ViceRecordFile& file, ViceRecordEntry& entry)
+{
+	if (!file.data || (file.pos + kEntryHeaderSize) > file.size) { return false; }
+	const uint8_t* header = file.data + file.pos;
+	uint32_t size = Get32(header + 5);
+	if ((file.size - file.pos - kEntryHeaderSize) < size) { return false; }	// capture was cut short
+	file.timeUs += Get32(header);
+	entry.timeUs = file.timeUs;
+	entry.direction = header[4];
+	entry.size = size;
+	entry.data = file.data + file.pos + kEntryHeaderSize;
+	file.pos += kEntryHeaderSize + size;
+	return true;
+}
+
+void ViceRecordClose(ViceRecordFile& file)
+{
+	if (file.data) { free(file.data); }
+	file.data = nullptr;
+	file.size = 0;
+	file.pos = 0;
+}
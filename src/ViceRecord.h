@@ -0,0 +1,46 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// Binary monitor traffic capture
+//  Every command sent to VICE and every response received is appended to a
+//  file so a session can be replayed into the response handlers without VICE.
+//  File: "IBVR", uint32 version, then one record per message:
+//   uint32 microseconds since the previous record
+//   uint8 direction (ViceRecord_Sent / ViceRecord_Received)
+//   uint32 size, followed by the message bytes as on the socket
+
+enum ViceRecordDirection {
+	ViceRecord_Sent,
+	ViceRecord_Received
+};
+
+struct ViceRecordEntry {
+	uint64_t timeUs;	// since the start of the capture
+	uint8_t* data;
+	uint32_t size;
+	uint8_t direction;
+};
+
+struct ViceRecordFile {
+	uint8_t* data;
+	size_t size;
+	size_t pos;
+	uint64_t timeUs;
+};
+
+void InitViceRecord();
+void ShutdownViceRecord();
+
+bool ViceRecordStart(const char* filename);
+void ViceRecordStop();
+bool ViceRecording();
+
+// called from the connection thread for each complete message
+void ViceRecordMessage(ViceRecordDirection direction, const uint8_t* data, uint32_t size);
+
+// reading back a capture
+bool ViceRecordOpen(ViceRecordFile& file, const char* filename);
+bool ViceRecordNext(ViceRecordFile& file, ViceRecordEntry& entry);
+void ViceRecordClose(ViceRecordFile& file);
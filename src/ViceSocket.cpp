@@ -0,0 +1,216 @@
+// Non-blocking sockets with a wakeup for the VICE connection threads
+#include "ViceSocket.h"
+#ifdef _WIN32
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+static bool SetNonBlocking(VI_SOCKET s)
+{
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	return ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// each WSAStartup is matched by the WSACleanup in ViceSocketClose, or here if there is no socket to close
+bool ViceSocketOpen(VI_SOCKET& s, const char* ip, uint32_t port)
+{
+	// Make sure the user has specified a port
+	if (port > 65535) { return false; }
+
+#ifdef _WIN32
+	WSADATA ws;
+	long status = WSAStartup(0x0202, &ws);
+	if (status != 0) { return false; }
+#endif
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == VI_INVALID_SOCKET) {
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		return false;
+	}
+
+	int32_t iResult = 0;
+	int32_t dwRetval;
+	sockaddr_in saGNI;
+	char hostname[NI_MAXHOST];
+	char servInfo[NI_MAXSERV];
+	saGNI.sin_family = AF_INET;
+	inet_pton(AF_INET, ip, &(saGNI.sin_addr.s_addr));
+	saGNI.sin_port = htons((uint16_t)port);
+	dwRetval = getnameinfo((struct sockaddr*)&saGNI,
+						   sizeof(struct sockaddr),
+						   hostname,
+						   NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
+
+	if (dwRetval != 0) {
+		ViceSocketClose(s);
+		return false;
+	}
+
+	iResult = ::connect(s, (struct sockaddr*)&saGNI, sizeof(saGNI));
+	if (iResult != 0) {
+		ViceSocketClose(s);
+		return false;
+	}
+
+	// small commands like step should go out without waiting for more data
+	int noDelay = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	if (!SetNonBlocking(s)) {
+		ViceSocketClose(s);
+		return false;
+	}
+	return true;
+}
+
+void ViceSocketClose(VI_SOCKET& s)
+{
+	if (s == VI_INVALID_SOCKET) { return; }
+#ifdef _WIN32
+	closesocket(s);
+	WSACleanup();
+#else
+	shutdown(s, SHUT_RDWR);
+	close(s);
+#endif
+	s = VI_INVALID_SOCKET;
+}
+
+bool ViceSocketWouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+int ViceSocketSendv(VI_SOCKET s, const ViceSocketBuf* bufs, int count)
+{
+	enum { MAX_BUFS = 64 };
+	if (count > MAX_BUFS) { count = MAX_BUFS; }
+#ifdef _WIN32
+	WSABUF wsaBufs[MAX_BUFS];
+	for (int b = 0; b < count; ++b) {
+		wsaBufs[b].buf = (CHAR*)bufs[b].data;
+		wsaBufs[b].len = (ULONG)bufs[b].size;
+	}
+	DWORD sent = 0;
+	if (WSASend(s, wsaBufs, (DWORD)count, &sent, 0, NULL, NULL) != 0) { return SOCKET_ERROR; }
+	return (int)sent;
+#else
+	iovec iov[MAX_BUFS];
+	for (int b = 0; b < count; ++b) {
+		iov[b].iov_base = (void*)bufs[b].data;
+		iov[b].iov_len = bufs[b].size;
+	}
+	msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+	return (int)sendmsg(s, &msg, MSG_NOSIGNAL);
+#else
+	return (int)sendmsg(s, &msg, 0);
+#endif
+#endif
+}
+
+bool ViceSocketWakeOpen(ViceSocketWake& wake)
+{
+#ifdef _WIN32
+	// a loopback UDP socket connected to itself
+	wake.recvSide = wake.sendSide = socket(AF_INET, SOCK_DGRAM, 0);
+	if (wake.recvSide == INVALID_SOCKET) { return false; }
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	int len = sizeof(addr);
+	if (bind(wake.recvSide, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+		getsockname(wake.recvSide, (sockaddr*)&addr, &len) != 0 ||
+		connect(wake.recvSide, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		closesocket(wake.recvSide);
+		wake.recvSide = wake.sendSide = INVALID_SOCKET;
+		return false;
+	}
+	return SetNonBlocking(wake.recvSide);
+#else
+	int fds[2];
+	if (pipe(fds) != 0) { return false; }
+	wake.recvSide = fds[0];
+	wake.sendSide = fds[1];
+	return SetNonBlocking(wake.recvSide) && SetNonBlocking(wake.sendSide);
+#endif
+}
+
+void ViceSocketWakeClose(ViceSocketWake& wake)
+{
+#ifdef _WIN32
+	if (wake.recvSide != INVALID_SOCKET) { closesocket(wake.recvSide); }
+#else
+	if (wake.recvSide >= 0) { close(wake.recvSide); }
+	if (wake.sendSide >= 0) { close(wake.sendSide); }
+#endif
+	wake.recvSide = wake.sendSide = VI_INVALID_SOCKET;
+}
+
+void ViceSocketWakeSignal(ViceSocketWake& wake)
+{
+	char signal = 1;
+#ifdef _WIN32
+	send(wake.sendSide, &signal, 1, 0);
+#else
+	if (write(wake.sendSide, &signal, 1) < 0) {
+		// pipe is full so a wakeup is already pending
+	}
+#endif
+}
+
+int ViceSocketWait(VI_SOCKET s, ViceSocketWake& wake, bool wantWrite, int timeoutMs)
+{
+#ifdef _WIN32
+	WSAPOLLFD fds[2] = {};
+	fds[0].fd = s;
+	fds[0].events = POLLRDNORM | (wantWrite ? POLLWRNORM : 0);
+	fds[1].fd = wake.recvSide;
+	fds[1].events = POLLRDNORM;
+	int count = WSAPoll(fds, 2, timeoutMs);
+#else
+	pollfd fds[2] = {};
+	fds[0].fd = s;
+	fds[0].events = POLLIN | (wantWrite ? POLLOUT : 0);
+	fds[1].fd = wake.recvSide;
+	fds[1].events = POLLIN;
+	int count = poll(fds, 2, timeoutMs);
+#endif
+	if (count < 0) { return ViceSocketWouldBlock() ? 0 : ViceSocket_Error; }
+	if (count == 0) { return 0; }
+
+	int events = 0;
+	if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) { events |= ViceSocket_Error; }
+	if (fds[0].revents & POLLIN) { events |= ViceSocket_Read; }
+	if (fds[0].revents & POLLOUT) { events |= ViceSocket_Write; }
+	if (fds[1].revents & POLLIN) {
+		// drain all pending wakeups
+		char drain[64];
+#ifdef _WIN32
+		while (recv(wake.recvSide, drain, sizeof(drain), 0) > 0) {}
+#else
+		while (read(wake.recvSide, drain, sizeof(drain)) > 0) {}
+#endif
+		events |= ViceSocket_Wake;
+	}
+	return events;
+}
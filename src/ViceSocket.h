@@ -0,0 +1,54 @@
+#pragma once
+// TCP socket shared by the VICE binary monitor and text monitor connections.
+// Sockets are non-blocking and the connection threads wait in poll() on both
+// the socket and a wakeup socket, so queued sends and disconnect requests are
+// handled right away instead of after a receive timeout.
+
+#ifdef _WIN32
+#include "winsock2.h"
+#include <ws2tcpip.h>
+#define VI_SOCKET SOCKET
+#define VI_INVALID_SOCKET INVALID_SOCKET
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#define VI_SOCKET int
+#define VI_INVALID_SOCKET -1
+#define SOCKET_ERROR -1
+#endif
+#include <inttypes.h>
+
+enum ViceSocketEvents {
+	ViceSocket_Read = 0x01,
+	ViceSocket_Write = 0x02,
+	ViceSocket_Wake = 0x04,
+	ViceSocket_Error = 0x08
+};
+
+// self-signalling socket (Windows) or pipe to interrupt ViceSocketWait
+struct ViceSocketWake {
+	VI_SOCKET recvSide;
+	VI_SOCKET sendSide;
+};
+
+bool ViceSocketOpen(VI_SOCKET& s, const char* ip, uint32_t port);
+void ViceSocketClose(VI_SOCKET& s);
+bool ViceSocketWouldBlock();
+
+struct ViceSocketBuf {
+	const void* data;
+	size_t size;
+};
+
+// gathered send of several buffers in one call, returns bytes sent or SOCKET_ERROR
+int ViceSocketSendv(VI_SOCKET s, const ViceSocketBuf* bufs, int count);
+
+bool ViceSocketWakeOpen(ViceSocketWake& wake);
+void ViceSocketWakeClose(ViceSocketWake& wake);
+void ViceSocketWakeSignal(ViceSocketWake& wake);
+
+// returns ViceSocketEvents flags, 0 on timeout
+int ViceSocketWait(VI_SOCKET s, ViceSocketWake& wake, bool wantWrite, int timeoutMs);
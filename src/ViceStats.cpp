@@ -0,0 +1,154 @@
+// Round trip and bandwidth statistics of the VICE connection
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "platform.h"
+#include "struse/struse.h"
+#include "ViceInterface.h"
+#include "ViceStats.h"
+
+enum {
+	kNumCommandTypes = 256,
+	kFirstBucketUs = 250
+};
+
+static IBMutex sStatsMutex;
+static ViceStatsTotals sTotals;
+static ViceCommandStats sCommands[kNumCommandTypes];
+
+void InitViceStats()
+{
+	IBMutexInit(&sStatsMutex, "VICE stats mutex");
+	ViceStatsReset();
+}
+
+void ShutdownViceStats()
+{
+	IBMutexDestroy(&sStatsMutex);
+}
+
+void ViceStatsReset()
+{
+	IBMutexLock(&sStatsMutex);
+	uint32_t inFlight = sTotals.inFlight;
+	memset(&sTotals, 0, sizeof(sTotals));
+	memset(sCommands, 0, sizeof(sCommands));
+	sTotals.inFlight = sTotals.maxInFlight = inFlight;
+	IBMutexRelease(&sStatsMutex);
+}
+
+uint64_t ViceStatsNowUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int BucketOf(uint64_t us)
+{
+	int bucket = 0;
+	for (uint64_t limit = kFirstBucketUs; us >= limit && bucket < (ViceStats_Buckets - 1); limit <<= 1) { ++bucket; }
+	return bucket;
+}
+
+float ViceStatsBucketMs(int bucket)
+{
+	return (float)(kFirstBucketUs << bucket) / 1000.0f;
+}
+
+void ViceStatsSent(uint8_t command, uint32_t bytes)
+{
+	IBMutexLock(&sStatsMutex);
+	ViceCommandStats& cmd = sCommands[command];
+	cmd.sent++;
+	cmd.bytesOut += bytes;
+	sTotals.sent++;
+	sTotals.bytesOut += bytes;
+	if (++sTotals.inFlight > sTotals.maxInFlight) { sTotals.maxInFlight = sTotals.inFlight; }
+	IBMutexRelease(&sStatsMutex);
+}
+
+void ViceStatsReceived(uint8_t command, uint32_t bytes, bool tracked, uint64_t issueUs)
+{
+	uint64_t now = ViceStatsNowUs();
+	IBMutexLock(&sStatsMutex);
+	ViceCommandStats& cmd = sCommands[command];
+	cmd.received++;
+	cmd.bytesIn += bytes;
+	sTotals.received++;
+	sTotals.bytesIn += bytes;
+	if (tracked) {
+		uint64_t us = now > issueUs ? now - issueUs : 0;
+		if (!cmd.roundTrips || us < cmd.minUs) { cmd.minUs = (uint32_t)us; }
+		if (us > cmd.maxUs) { cmd.maxUs = (uint32_t)us; }
+		cmd.roundTrips++;
+		cmd.totalUs += us;
+		cmd.histogram[BucketOf(us)]++;
+		if (sTotals.inFlight) { sTotals.inFlight--; }
+	}
+	IBMutexRelease(&sStatsMutex);
+}
+
+void ViceStatsTimeout(uint8_t command)
+{
+	IBMutexLock(&sStatsMutex);
+	sCommands[command].timeouts++;
+	sTotals.timeouts++;
+	if (sTotals.inFlight) { sTotals.inFlight--; }
+	IBMutexRelease(&sStatsMutex);
+}
+
+void ViceStatsConnectionClosed()
+{
+	IBMutexLock(&sStatsMutex);
+	sTotals.inFlight = 0;
+	IBMutexRelease(&sStatsMutex);
+}
+
+void ViceStatsGet(ViceStatsTotals& totals, ViceCommandStats* commands)
+{
+	IBMutexLock(&sStatsMutex);
+	totals = sTotals;
+	if (commands) { memcpy(commands, sCommands, sizeof(sCommands)); }
+	IBMutexRelease(&sStatsMutex);
+}
+
+bool ViceStatsSaveJSON(const char* filename)
+{
+	FILE* f = nullptr;
+#ifdef _WIN32
+	if (fopen_s(&f, filename, "w") != 0) { f = nullptr; }
+#else
+	f = fopen(filename, "w");
+#endif
+	if (!f) { return false; }
+
+	ViceStatsTotals totals;
+	static ViceCommandStats commands[kNumCommandTypes];
+	ViceStatsGet(totals, commands);
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"bytesOut\": %llu,\n\t\"bytesIn\": %llu,\n", (unsigned long long)totals.bytesOut, (unsigned long long)totals.bytesIn);
+	fprintf(f, "\t\"sent\": %u,\n\t\"received\": %u,\n\t\"timeouts\": %u,\n", totals.sent, totals.received, totals.timeouts);
+	fprintf(f, "\t\"inFlight\": %u,\n\t\"maxInFlight\": %u,\n", totals.inFlight, totals.maxInFlight);
+	fprintf(f, "\t\"bucketLimitsMs\": [");
+	for (int b = 0; b < (ViceStats_Buckets - 1); ++b) { fprintf(f, "%s%g", b ? ", " : "", ViceStatsBucketMs(b)); }
+	fprintf(f, "],\n\t\"commands\": [");
+	bool first = true;
+	for (int c = 0, n = ViceBinCmdCount(); c < n; ++c) {
+		uint8_t id = ViceBinCmdID(c);
+		const ViceCommandStats& cmd = commands[id];
+		if (!cmd.sent && !cmd.received) { continue; }
+		fprintf(f, "%s\n\t\t{ \"name\": \"%s\", \"id\": %u, \"sent\": %u, \"received\": %u, \"timeouts\": %u,",
+				first ? "" : ",", ViceBinCmdName(id), id, cmd.sent, cmd.received, cmd.timeouts);
+		fprintf(f, " \"bytesOut\": %llu, \"bytesIn\": %llu,", (unsigned long long)cmd.bytesOut, (unsigned long long)cmd.bytesIn);
+		fprintf(f, " \"roundTrips\": %u, \"avgMs\": %.3f, \"minMs\": %.3f, \"maxMs\": %.3f, \"histogram\": [",
+				cmd.roundTrips, cmd.roundTrips ? cmd.totalUs / (1000.0 * cmd.roundTrips) : 0.0,
+				cmd.minUs / 1000.0, cmd.maxUs / 1000.0);
+		for (int b = 0; b < ViceStats_Buckets; ++b) { fprintf(f, "%s%u", b ? ", " : "", cmd.histogram[b]); }
+		fprintf(f, "] }");
+		first = false;
+	}
+	fprintf(f, "\n\t]\n}\n");
+	fclose(f);
+	return true;
+}
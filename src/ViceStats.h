@@ -0,0 +1,47 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Round trip and bandwidth statistics of the VICE binary monitor connection
+//  Round trips are measured per command type from queueing the command to
+//  handling its response. Events VICE sends on its own (stopped, resumed)
+//  only count bytes in.
+
+enum { ViceStats_Buckets = 12 };	// round trip histogram, < 0.25ms doubling up to >= 256ms
+
+struct ViceCommandStats {
+	uint32_t sent;
+	uint32_t received;
+	uint32_t timeouts;
+	uint32_t roundTrips;	// responses with a measured round trip
+	uint64_t bytesOut;
+	uint64_t bytesIn;
+	uint64_t totalUs;
+	uint32_t minUs, maxUs;
+	uint32_t histogram[ViceStats_Buckets];
+};
+
+struct ViceStatsTotals {
+	uint64_t bytesOut;
+	uint64_t bytesIn;
+	uint32_t sent;
+	uint32_t received;
+	uint32_t timeouts;
+	uint32_t inFlight;
+	uint32_t maxInFlight;
+};
+
+void InitViceStats();
+void ShutdownViceStats();
+void ViceStatsReset();
+
+uint64_t ViceStatsNowUs();
+void ViceStatsSent(uint8_t command, uint32_t bytes);
+void ViceStatsReceived(uint8_t command, uint32_t bytes, bool tracked, uint64_t issueUs);
+void ViceStatsTimeout(uint8_t command);
+void ViceStatsConnectionClosed();	// nothing in flight anymore
+
+// copy of the current numbers, commands is indexed by command type
+void ViceStatsGet(ViceStatsTotals& totals, ViceCommandStats* commands = nullptr);
+float ViceStatsBucketMs(int bucket);	// upper limit of a histogram bucket
+bool ViceStatsSaveJSON(const char* filename);
@@ -0,0 +1,769 @@
+// Stand-in VICE binary monitor server for benchmarks
+#include "../ViceSocket.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#include "../platform.h"
+#include "../Files.h"
+#include "../struse/struse.h"
+#include "../ViceInterface.h"
+#include "../ViceBinInterface.h"
+#include "StandInServer.h"
+
+#ifndef _WIN32
+#define WINAPI
+#endif
+
+static const uint32_t kEventID = 0xffffffff;	// request id of events VICE sends on its own
+
+enum {
+	kMaxCheckpoints = 4096,
+	kPollMs = 50,
+	kFrameMs = 20,	// exec checkpoints are hit once per frame while running
+	kHitLine = 100,	// raster line of the first checkpoint hit in a frame
+	kDisplayWidth = 384,
+	kDisplayHeight = 272,
+	kScreenLeft = 32,
+	kScreenTop = 35,
+	kScreenWidth = 320,
+	kScreenHeight = 200
+};
+
+struct StandInCheckpoint {
+	uint32_t number;
+	uint32_t hitCount;
+	uint16_t start, end;
+	uint8_t stopWhenHit, enabled, operation, temporary, hasCondition;
+	bool used;
+};
+
+// the synthetic machine behind the monitor
+struct StandInMachine {
+	uint8_t ram[0x10000];
+	uint8_t driveRam[4][0x10000];	// Drive8..Drive11 memspaces
+	uint16_t drivePC[4];
+	uint16_t PC;
+	uint8_t A, X, Y, SP, FL;
+	uint16_t LIN, CYC;
+	bool running;
+	uint32_t frame;
+	int frameHit;	// next checkpoint slot that runs this frame, -1 when the frame is done
+	uint32_t nextCheckpoint;
+	StandInCheckpoint checkpoints[kMaxCheckpoints];
+};
+
+struct StandInResponse {
+	uint64_t due;
+	std::vector<uint8_t> data;
+};
+
+static StandInConfig sConfig;
+static StandInMachine sMachine;
+static StandInStats sStats;
+static IBMutex sStatsMutex;
+static IBThread sServerThread;
+static volatile bool sServerStop = false;
+static volatile bool sServerRunning = false;
+static uint32_t sRandom = 1;
+static std::deque<StandInResponse> sResponses;
+static uint64_t sLastDue = 0;
+static uint64_t sCommandTime = 0;	// responses are timed from when the command arrived
+static uint64_t sCheckpointStopUs = 0;	// when the machine last stopped at a checkpoint, 0 if it didn't
+
+static uint64_t NowMs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t NowUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t Random()
+{
+	sRandom ^= sRandom << 13;
+	sRandom ^= sRandom >> 17;
+	sRandom ^= sRandom << 5;
+	return sRandom;
+}
+
+static void ResetMachine()
+{
+	for (uint32_t a = 0; a < 0x10000; ++a) { sMachine.ram[a] = (uint8_t)((a >> 8) ^ (a * 7)); }
+	sMachine.PC = 0xfce2;
+	sMachine.A = sMachine.X = sMachine.Y = 0;
+	sMachine.SP = 0xff;
+	sMachine.FL = 0x20;
+	sMachine.LIN = sMachine.CYC = 0;
+	sMachine.ram[0] = 0x2f;
+	sMachine.ram[1] = 0x37;
+	for (int d = 0; d < 4; ++d) {
+		for (uint32_t a = 0; a < 0x10000; ++a) { sMachine.driveRam[d][a] = (uint8_t)((a >> 8) + d * 0x40 + a); }
+		sMachine.drivePC[d] = 0xeb00;
+	}
+}
+
+// banks as listed by RespondBanks, rom reads a pattern under basic, chargen and kernal
+enum { StandInBank_Default, StandInBank_CPU, StandInBank_RAM, StandInBank_ROM, StandInBank_IO, StandInBank_Count };
+
+static uint8_t BankByte(const uint8_t* ram, uint16_t bank, uint16_t addr)
+{
+	if (bank == StandInBank_ROM && (addr >= 0xa000 && (addr < 0xc000 || addr >= 0xd000))) {
+		return (uint8_t)(0xea ^ (addr >> 8) ^ addr);
+	}
+	return ram[addr];
+}
+
+static uint8_t* MemSpaceRAM(uint8_t memSpace)
+{
+	if (memSpace == (uint8_t)VICEMemSpaces::MainMemory) { return sMachine.ram; }
+	if (memSpace <= (uint8_t)VICEMemSpaces::Drive11) { return sMachine.driveRam[memSpace - 1]; }
+	return nullptr;
+}
+
+// running between a resume and a stop, touch some memory so refreshes have something to do
+static void RunMachine()
+{
+	for (int p = 0; p < 8; ++p) {
+		uint16_t page = (uint16_t)((Random() % 0xa0) << 8);
+		for (int b = 0; b < 256; ++b) { sMachine.ram[page + b] += (uint8_t)(b + 1); }
+	}
+	sMachine.PC = (uint16_t)(0x0800 + Random() % 0x9800);
+	sMachine.LIN = (uint16_t)(Random() % 312);
+	sMachine.CYC = (uint16_t)(Random() % 63);
+}
+
+static uint16_t Get16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* p)
+{
+	return Get16(p) | ((uint32_t)Get16(p + 2) << 16);
+}
+
+static void Put16(std::vector<uint8_t>& d, uint32_t v)
+{
+	d.push_back((uint8_t)v);
+	d.push_back((uint8_t)(v >> 8));
+}
+
+static void Put32(std::vector<uint8_t>& d, uint32_t v)
+{
+	Put16(d, v);
+	Put16(d, v >> 16);
+}
+
+static void Respond(uint8_t cmd, uint8_t err, uint32_t reqID, const std::vector<uint8_t>& body)
+{
+	StandInResponse resp;
+	uint64_t due = sCommandTime + sConfig.latencyMs + (sConfig.jitterMs ? Random() % (sConfig.jitterMs + 1) : 0);
+	resp.due = due > sLastDue ? due : sLastDue;	// VICE answers in order
+	sLastDue = resp.due;
+	resp.data.reserve(sizeof(VICEBinResponse) + body.size());
+	resp.data.push_back(2);
+	resp.data.push_back(2);
+	Put32(resp.data, (uint32_t)body.size());
+	resp.data.push_back(cmd);
+	resp.data.push_back(err);
+	Put32(resp.data, reqID);
+	resp.data.insert(resp.data.end(), body.begin(), body.end());
+	sResponses.push_back(resp);
+}
+
+static void RespondEmpty(uint8_t cmd, uint8_t err, uint32_t reqID)
+{
+	std::vector<uint8_t> body;
+	Respond(cmd, err, reqID, body);
+}
+
+static void RespondRegisters(uint32_t reqID, uint8_t memSpace = 0);
+
+// VICE sends the registers ahead of a stop
+static void StopResumeEvent(uint8_t cmd)
+{
+	if (cmd != VICE_Resumed) { RespondRegisters(kEventID); }
+	std::vector<uint8_t> body;
+	Put16(body, sMachine.PC);
+	Respond(cmd, VICEResponse_OK, kEventID, body);
+}
+
+static void RespondRegisters(uint32_t reqID, uint8_t memSpace)
+{
+	static const uint8_t ids[] = { VICE_Acc, VICE_X, VICE_Y, VICE_PC, VICE_SP, VICE_FL, VICE_LIN, VICE_CYC, VICE_00, VICE_01 };
+	uint16_t values[] = { sMachine.A, sMachine.X, sMachine.Y, sMachine.PC, sMachine.SP, sMachine.FL,
+		sMachine.LIN, sMachine.CYC, sMachine.ram[0], sMachine.ram[1] };
+	if (uint8_t* driveRam = memSpace ? MemSpaceRAM(memSpace) : nullptr) {
+		uint16_t drive[] = { 0, 0, 0, sMachine.drivePC[memSpace - 1], 0xff, 0x20, 0, 0, driveRam[0], driveRam[1] };
+		memcpy(values, drive, sizeof(values));
+	}
+	std::vector<uint8_t> body;
+	Put16(body, sizeof(ids));
+	for (size_t r = 0; r < sizeof(ids); ++r) {
+		body.push_back(3);
+		body.push_back(ids[r]);
+		Put16(body, values[r]);
+	}
+	Respond(VICE_RegistersGet, VICEResponse_OK, reqID, body);
+}
+
+static void RespondRegisterNames(uint32_t reqID)
+{
+	static const struct { uint8_t id, bits; const char* name; } regs[] = {
+		{ VICE_Acc, 8, "A" }, { VICE_X, 8, "X" }, { VICE_Y, 8, "Y" }, { VICE_PC, 16, "PC" },
+		{ VICE_SP, 8, "SP" }, { VICE_FL, 8, "FL" }, { VICE_LIN, 16, "LIN" }, { VICE_CYC, 16, "CYC" },
+		{ VICE_00, 8, "00" }, { VICE_01, 8, "01" } };
+	std::vector<uint8_t> body;
+	Put16(body, sizeof(regs) / sizeof(regs[0]));
+	for (size_t r = 0; r < sizeof(regs) / sizeof(regs[0]); ++r) {
+		uint8_t len = (uint8_t)strlen(regs[r].name);
+		body.push_back(3 + len);
+		body.push_back(regs[r].id);
+		body.push_back(regs[r].bits);
+		body.push_back(len);
+		body.insert(body.end(), regs[r].name, regs[r].name + len);
+	}
+	Respond(VICE_RegistersAvailable, VICEResponse_OK, reqID, body);
+}
+
+static void RespondBanks(uint32_t reqID)
+{
+	static const char* banks[] = { "default", "cpu", "ram", "rom", "io" };
+	std::vector<uint8_t> body;
+	Put16(body, sizeof(banks) / sizeof(banks[0]));
+	for (size_t b = 0; b < sizeof(banks) / sizeof(banks[0]); ++b) {
+		uint8_t len = (uint8_t)strlen(banks[b]);
+		body.push_back(3 + len);
+		Put16(body, (uint32_t)b);
+		body.push_back(len);
+		body.insert(body.end(), banks[b], banks[b] + len);
+	}
+	Respond(VICE_BanksAvailable, VICEResponse_OK, reqID, body);
+}
+
+static void RespondCheckpoint(const StandInCheckpoint& cp, uint32_t reqID, bool hit = false)
+{
+	std::vector<uint8_t> body;
+	Put32(body, cp.number);
+	body.push_back(hit ? 1 : 0);
+	Put16(body, cp.start);
+	Put16(body, cp.end);
+	body.push_back(cp.stopWhenHit);
+	body.push_back(cp.enabled);
+	body.push_back(cp.operation);
+	body.push_back(cp.temporary);
+	Put32(body, cp.hitCount);
+	Put32(body, 0);
+	body.push_back(cp.hasCondition);
+	body.push_back(0);	// memspace
+	Respond(VICE_CheckpointGet, VICEResponse_OK, reqID, body);
+}
+
+static StandInCheckpoint* FindCheckpoint(uint32_t number)
+{
+	for (int c = 0; c < kMaxCheckpoints; ++c) {
+		if (sMachine.checkpoints[c].used && sMachine.checkpoints[c].number == number) { return sMachine.checkpoints + c; }
+	}
+	return nullptr;
+}
+
+// indexed image with the 40x25 text screen at $0400 as blocks of color
+static void RespondDisplay(uint32_t reqID)
+{
+	std::vector<uint8_t> body;
+	Put32(body, 13);
+	Put16(body, kDisplayWidth);
+	Put16(body, kDisplayHeight);
+	Put16(body, kScreenLeft);
+	Put16(body, kScreenTop);
+	Put16(body, kScreenWidth);
+	Put16(body, kScreenHeight);
+	body.push_back(8);
+	Put32(body, kDisplayWidth * kDisplayHeight);
+	size_t image = body.size();
+	body.resize(image + kDisplayWidth * kDisplayHeight, 14);
+	for (int y = 0; y < kScreenHeight; ++y) {
+		uint8_t* row = body.data() + image + (y + kScreenTop) * kDisplayWidth + kScreenLeft;
+		const uint8_t* chars = sMachine.ram + 0x0400 + (y >> 3) * 40;
+		for (int x = 0; x < kScreenWidth; ++x) {
+			row[x] = (uint8_t)((chars[x >> 3] >> ((x ^ y) & 7)) & 15);
+		}
+	}
+	Respond(VICE_DisplayGet, VICEResponse_OK, reqID, body);
+	IBMutexLock(&sStatsMutex);
+	sStats.displays++;
+	IBMutexRelease(&sStatsMutex);
+}
+
+static void Push(uint8_t value)
+{
+	sMachine.ram[0x100 + sMachine.SP--] = value;
+}
+
+static uint8_t Pull()
+{
+	return sMachine.ram[0x100 + ++sMachine.SP];
+}
+
+// a frame runs through each enabled exec checkpoint in slot order, like an
+// interrupt routine, and VICE stops at the ones that stop
+static void RunFrame()
+{
+	for (int c = sMachine.frameHit; c >= 0 && c < kMaxCheckpoints; ++c) {
+		StandInCheckpoint& cp = sMachine.checkpoints[c];
+		if (!cp.used || !cp.enabled || !(cp.operation & VICE_Exec)) { continue; }
+		cp.hitCount++;
+		sMachine.PC = cp.start;
+		sMachine.LIN = (uint16_t)(kHitLine + c);
+		sMachine.CYC = (uint16_t)(20 + Random() % 8);	// interrupt jitter
+		sMachine.A = (uint8_t)sMachine.frame;
+		sMachine.X = (uint8_t)c;
+		RespondCheckpoint(cp, kEventID, true);
+		if (cp.stopWhenHit) {
+			sMachine.frameHit = c + 1;
+			sMachine.running = false;
+			sCheckpointStopUs = NowUs();
+			StopResumeEvent(VICE_Stopped);
+			return;
+		}
+	}
+	sMachine.frameHit = -1;
+}
+
+// the stack and store instructions of a test program, the rest just moves the PC
+static bool StepInstruction()
+{
+	uint8_t* ram = sMachine.ram;
+	uint16_t pc = sMachine.PC;
+	uint8_t zp = ram[(uint16_t)(pc + 1)];
+	uint16_t abs = (uint16_t)(zp | (ram[(uint16_t)(pc + 2)] << 8));
+	switch (ram[pc]) {
+		case 0x08: Push(sMachine.FL | 0x30); sMachine.PC = pc + 1; return true;			// php
+		case 0x28: sMachine.FL = Pull() & 0xcf; sMachine.PC = pc + 1; return true;	// plp
+		case 0x48: Push(sMachine.A); sMachine.PC = pc + 1; return true;				// pha
+		case 0x68: sMachine.A = Pull(); sMachine.PC = pc + 1; return true;			// pla
+		case 0x20: Push((uint8_t)((pc + 2) >> 8)); Push((uint8_t)(pc + 2)); sMachine.PC = abs; return true;	// jsr
+		case 0x60: sMachine.PC = Pull(); sMachine.PC = (uint16_t)((sMachine.PC | (Pull() << 8)) + 1); return true;	// rts
+		case 0x4c: sMachine.PC = abs; return true;									// jmp abs
+		case 0xa9: sMachine.A = zp; sMachine.PC = pc + 2; return true;				// lda #
+		case 0x85: ram[zp] = sMachine.A; sMachine.PC = pc + 2; return true;			// sta zp
+		case 0x8d: ram[abs] = sMachine.A; sMachine.PC = pc + 3; return true;		// sta abs
+		case 0xe6: ram[zp]++; sMachine.PC = pc + 2; return true;					// inc zp
+		case 0xee: ram[abs]++; sMachine.PC = pc + 3; return true;					// inc abs
+	}
+	return false;
+}
+
+// roughly 2.5 bytes per instruction and 3 cycles
+// exec checkpoints at the PC report a hit, returns true if one stops the step
+static bool StepCheckpoints()
+{
+	bool stop = false;
+	for (int c = 0; c < kMaxCheckpoints; ++c) {
+		StandInCheckpoint& cp = sMachine.checkpoints[c];
+		if (!cp.used || !cp.enabled || !(cp.operation & VICE_Exec)) { continue; }
+		if (sMachine.PC < cp.start || sMachine.PC > cp.end) { continue; }
+		cp.hitCount++;
+		RespondCheckpoint(cp, kEventID, true);
+		stop = stop || cp.stopWhenHit;
+	}
+	return stop;
+}
+
+static void Step(uint32_t steps)
+{
+	for (uint32_t s = 0; s < steps; ++s) {
+		if (!StepInstruction()) { sMachine.PC += (uint16_t)(1 + (Random() % 3)); }
+		sMachine.CYC = (uint16_t)(sMachine.CYC + 3);
+		if (sMachine.CYC >= 63) {
+			sMachine.CYC -= 63;
+			sMachine.LIN = (uint16_t)((sMachine.LIN + 1) % 312);
+		}
+		if (StepCheckpoints()) { break; }
+	}
+	sMachine.A += (uint8_t)steps;
+}
+
+// returns false if the client asked to quit
+static bool HandleCommand(VICEBinHeader* cmd)
+{
+	uint32_t reqID = cmd->GetReqID();
+	uint32_t len = cmd->GetLength();
+	uint8_t* body = (uint8_t*)(cmd + 1);
+	uint8_t type = cmd->commandType;
+
+	IBMutexLock(&sStatsMutex);
+	sStats.commands++;
+	IBMutexRelease(&sStatsMutex);
+
+	// any command except resume and ping stops the machine
+	if (sMachine.running && type != VICE_Exit && type != VICE_Ping) {
+		sMachine.running = false;
+		RunMachine();
+		StopResumeEvent(VICE_Stopped);
+	}
+
+	switch (type) {
+		case VICE_MemGet:
+		case VICE_MemSet: {
+			if (len < 8) { RespondEmpty(type, VICEResponse_IncorrectLength, reqID); break; }
+			uint16_t start = Get16(body + 1);
+			uint16_t end = Get16(body + 3);
+			uint32_t bytes = (uint32_t)(uint16_t)(end - start) + 1;
+			uint16_t bank = Get16(body + 6);
+			uint8_t* ram = MemSpaceRAM(body[5]);
+			if (!ram) {
+				RespondEmpty(type, VICEResponse_InvalidMemSpace, reqID);
+				break;
+			}
+			if (bank >= StandInBank_Count) {
+				RespondEmpty(type, VICEResponse_InvalidParam, reqID);
+				break;
+			}
+			if (type == VICE_MemSet) {
+				if (len < (8 + bytes)) { RespondEmpty(type, VICEResponse_IncorrectLength, reqID); break; }
+				for (uint32_t b = 0; b < bytes; ++b) { ram[(uint16_t)(start + b)] = body[8 + b]; }
+				RespondEmpty(type, VICEResponse_OK, reqID);
+				break;
+			}
+			std::vector<uint8_t> resp;
+			resp.reserve(2 + bytes);
+			Put16(resp, bytes);
+			for (uint32_t b = 0; b < bytes; ++b) { resp.push_back(BankByte(ram, bank, (uint16_t)(start + b))); }
+			Respond(type, VICEResponse_OK, reqID, resp);
+			IBMutexLock(&sStatsMutex);
+			sStats.memGetBytes += bytes;
+			IBMutexRelease(&sStatsMutex);
+			break;
+		}
+
+		case VICE_RegistersGet:
+			RespondRegisters(reqID, len >= 1 ? body[0] : 0);
+			break;
+
+		case VICE_RegistersSet: {
+			uint32_t count = len >= 3 ? Get16(body + 1) : 0;
+			uint8_t* item = body + 3;
+			for (uint32_t r = 0; r < count && (item + 2) <= (body + len); ++r) {
+				uint16_t value = item[0] > 2 ? (uint16_t)Get16(item + 2) : item[2];
+				switch (item[1]) {
+					case VICE_Acc: sMachine.A = (uint8_t)value; break;
+					case VICE_X: sMachine.X = (uint8_t)value; break;
+					case VICE_Y: sMachine.Y = (uint8_t)value; break;
+					case VICE_PC: sMachine.PC = value; break;
+					case VICE_SP: sMachine.SP = (uint8_t)value; break;
+					case VICE_FL: sMachine.FL = (uint8_t)value; break;
+					case VICE_00: sMachine.ram[0] = (uint8_t)value; break;
+					case VICE_01: sMachine.ram[1] = (uint8_t)value; break;
+				}
+				item += item[0] + 1;
+			}
+			RespondRegisters(reqID);
+			break;
+		}
+
+		case VICE_RegistersAvailable:
+			RespondRegisterNames(reqID);
+			break;
+
+		case VICE_BanksAvailable:
+			RespondBanks(reqID);
+			break;
+
+		case VICE_CheckpointSet: {
+			if (len < 8) { RespondEmpty(type, VICEResponse_IncorrectLength, reqID); break; }
+			StandInCheckpoint* cp = nullptr;
+			for (int c = 0; c < kMaxCheckpoints && !cp; ++c) {
+				if (!sMachine.checkpoints[c].used) { cp = sMachine.checkpoints + c; }
+			}
+			if (!cp) { RespondEmpty(type, VICEResponse_General_Failure, reqID); break; }
+			memset(cp, 0, sizeof(StandInCheckpoint));
+			cp->used = true;
+			cp->number = ++sMachine.nextCheckpoint;
+			cp->start = Get16(body);
+			cp->end = Get16(body + 2);
+			cp->stopWhenHit = body[4];
+			cp->enabled = body[5];
+			cp->operation = body[6];
+			cp->temporary = body[7];
+			RespondCheckpoint(*cp, reqID);
+			break;
+		}
+
+		case VICE_CheckpointGet:
+		case VICE_CheckpointDelete:
+		case VICE_CheckpointToggle:
+		case VICE_ConditionSet: {
+			StandInCheckpoint* cp = len >= 4 ? FindCheckpoint(Get32(body)) : nullptr;
+			if (!cp) { RespondEmpty(type, VICEResponse_DoesntExist, reqID); break; }
+			if (type == VICE_CheckpointGet) {
+				RespondCheckpoint(*cp, reqID);
+				break;
+			}
+			if (type == VICE_CheckpointDelete) { cp->used = false; }
+			else if (type == VICE_CheckpointToggle) { cp->enabled = len > 4 ? body[4] : 1; }
+			else { cp->hasCondition = len > 4 && body[4] ? 1 : 0; }
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			break;
+		}
+
+		case VICE_CheckpointList: {
+			uint32_t count = 0;
+			for (int c = 0; c < kMaxCheckpoints; ++c) {
+				if (sMachine.checkpoints[c].used) {
+					RespondCheckpoint(sMachine.checkpoints[c], reqID);
+					++count;
+				}
+			}
+			std::vector<uint8_t> resp;
+			Put32(resp, count);
+			Respond(type, VICEResponse_OK, reqID, resp);
+			break;
+		}
+
+		case VICE_Step:
+		case VICE_StepOut: {
+			uint32_t steps = 1;
+			if (type == VICE_Step && len >= 3) { steps = Get16(body + 1); }
+			else if (type == VICE_StepOut) { steps = 1 + Random() % 32; }
+			Step(steps ? steps : 1);
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			StopResumeEvent(VICE_Stopped);
+			break;
+		}
+
+		case VICE_DisplayGet:
+			RespondDisplay(reqID);
+			break;
+
+		case VICE_Ping:
+		case VICE_AutoStart:
+		case VICE_KeyboardFeed:
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			break;
+
+		case VICE_Reset:
+			ResetMachine();
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			break;
+
+		case VICE_Exit:
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			if (!sMachine.running) {
+				if (sCheckpointStopUs) {
+					IBMutexLock(&sStatsMutex);
+					sStats.checkpointStops++;
+					sStats.checkpointStoppedUs += NowUs() - sCheckpointStopUs;
+					IBMutexRelease(&sStatsMutex);
+					sCheckpointStopUs = 0;
+				}
+				sMachine.running = true;
+				StopResumeEvent(VICE_Resumed);
+			}
+			break;
+
+		case VICE_Quit:
+			RespondEmpty(type, VICEResponse_OK, reqID);
+			return false;
+
+		default:
+			RespondEmpty(type, VICEResponse_Invalid_Cmd, reqID);
+			break;
+	}
+	return true;
+}
+
+static int WaitSocket(VI_SOCKET s, int timeoutMs)
+{
+#ifdef _WIN32
+	WSAPOLLFD fd = { s, POLLRDNORM, 0 };
+	return WSAPoll(&fd, 1, timeoutMs);
+#else
+	pollfd fd = { s, POLLIN, 0 };
+	return poll(&fd, 1, timeoutMs);
+#endif
+}
+
+static bool SendAll(VI_SOCKET s, const uint8_t* data, size_t size)
+{
+	while (size) {
+#ifdef MSG_NOSIGNAL
+		int sent = send(s, (const char*)data, (int)size, MSG_NOSIGNAL);
+#else
+		int sent = send(s, (const char*)data, (int)size, 0);
+#endif
+		if (sent <= 0) { return false; }
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static void CloseSocket(VI_SOCKET s)
+{
+#ifdef _WIN32
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
+static void ServeClient(VI_SOCKET client)
+{
+	std::vector<uint8_t> recvBuf;
+	size_t recvUsed = 0;
+	bool quit = false;
+	recvBuf.resize(64 * 1024);
+	sResponses.clear();
+	sLastDue = 0;
+	sMachine.running = true;	// VICE runs until the debugger stops it
+	sCheckpointStopUs = 0;
+	sMachine.frameHit = -1;
+	uint64_t nextFrame = NowMs() + kFrameMs;
+
+	while (!sServerStop && (!quit || sResponses.size())) {
+		// send whatever is due
+		uint64_t now = NowMs();
+		while (sResponses.size() && sResponses.front().due <= now) {
+			StandInResponse& resp = sResponses.front();
+			if (!SendAll(client, resp.data.data(), resp.data.size())) { return; }
+			IBMutexLock(&sStatsMutex);
+			sStats.bytesOut += resp.data.size();
+			sStats.responses++;
+			IBMutexRelease(&sStatsMutex);
+			sResponses.pop_front();
+		}
+		if (quit) { continue; }
+
+		if (sMachine.running) {
+			if (sMachine.frameHit < 0 && now >= nextFrame) {
+				sMachine.frameHit = 0;
+				sMachine.frame++;
+				nextFrame = now + kFrameMs;
+			}
+			sCommandTime = now;
+			RunFrame();
+		}
+
+		int timeout = kPollMs;
+		if (sResponses.size()) {
+			uint64_t wait = sResponses.front().due - now;
+			timeout = wait < (uint64_t)kPollMs ? (int)wait : kPollMs;
+		}
+		if (sMachine.running && (nextFrame - now) < (uint64_t)timeout) { timeout = (int)(nextFrame - now); }
+		int ready = WaitSocket(client, timeout);
+		if (ready < 0) { return; }
+		if (!ready) { continue; }
+
+		if ((recvBuf.size() - recvUsed) < 16 * 1024) { recvBuf.resize(recvBuf.size() * 2); }
+		int received = recv(client, (char*)recvBuf.data() + recvUsed, int(recvBuf.size() - recvUsed), 0);
+		if (received <= 0) { return; }
+		recvUsed += received;
+		sCommandTime = NowMs();
+		IBMutexLock(&sStatsMutex);
+		sStats.bytesIn += received;
+		IBMutexRelease(&sStatsMutex);
+
+		size_t read = 0;
+		while ((recvUsed - read) >= sizeof(VICEBinHeader) && !quit) {
+			VICEBinHeader* cmd = (VICEBinHeader*)(recvBuf.data() + read);
+			if (cmd->STX != 2) {
+				++read;
+				continue;
+			}
+			size_t size = cmd->GetSize();
+			if ((recvUsed - read) < size) { break; }
+			quit = !HandleCommand(cmd);
+			read += size;
+		}
+		memmove(recvBuf.data(), recvBuf.data() + read, recvUsed - read);
+		recvUsed -= read;
+	}
+}
+
+static IBThreadRet WINAPI StandInThread(void* data)
+{
+	VI_SOCKET listener = *(VI_SOCKET*)data;
+	while (!sServerStop) {
+		if (WaitSocket(listener, kPollMs) <= 0) { continue; }
+		VI_SOCKET client = accept(listener, nullptr, nullptr);
+		if (client == VI_INVALID_SOCKET) { continue; }
+		int noDelay = 1;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		ServeClient(client);
+		CloseSocket(client);
+	}
+	CloseSocket(listener);
+	delete (VI_SOCKET*)data;
+	sServerRunning = false;
+	return 0;
+}
+
+bool StandInStart(const StandInConfig& config)
+{
+	if (sServerRunning) { return false; }
+#ifdef _WIN32
+	WSADATA ws;
+	if (WSAStartup(0x0202, &ws) != 0) { return false; }
+#endif
+	sConfig = config;
+	sRandom = config.seed ? config.seed : 1;
+	memset(&sMachine, 0, sizeof(sMachine));
+	ResetMachine();
+
+	VI_SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == VI_INVALID_SOCKET) { return false; }
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((uint16_t)config.port);
+	if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0) {
+		CloseSocket(listener);
+		return false;
+	}
+
+	IBMutexInit(&sStatsMutex, "Stand-in stats mutex");
+	sServerStop = false;
+	sServerRunning = true;
+	IBCreateThread(&sServerThread, 65536, StandInThread, new VI_SOCKET(listener));
+	return true;
+}
+
+void StandInStop()
+{
+	sServerStop = true;
+	while (sServerRunning) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	IBMutexDestroy(&sStatsMutex);
+}
+
+StandInStats StandInGetStats()
+{
+	IBMutexLock(&sStatsMutex);
+	StandInStats stats = sStats;
+	IBMutexRelease(&sStatsMutex);
+	return stats;
+}
+
+void StandInResetStats()
+{
+	IBMutexLock(&sStatsMutex);
+	memset(&sStats, 0, sizeof(sStats));
+	IBMutexRelease(&sStatsMutex);
+}
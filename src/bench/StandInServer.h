@@ -0,0 +1,31 @@
+#pragma once
+// Stand-in for the VICE binary monitor
+//	Listens on a local port and answers the commands in ViceBinInterface.h
+//	against a synthetic 64K machine so the VICE connection can be measured
+//	without running VICE. Responses are delayed by a configurable latency
+//	plus random jitter, and stay in order like a real VICE.
+
+#include <inttypes.h>
+
+struct StandInConfig {
+	uint32_t port;
+	uint32_t latencyMs;		// added to every response
+	uint32_t jitterMs;		// random 0..jitterMs added on top of latency
+	uint32_t seed;
+};
+
+struct StandInStats {
+	uint64_t bytesIn;		// commands received
+	uint64_t bytesOut;		// responses and events sent
+	uint32_t commands;
+	uint32_t responses;
+	uint32_t memGetBytes;	// payload of MemGet responses
+	uint32_t displays;
+	uint32_t checkpointStops;	// stops at a checkpoint hit while running
+	uint64_t checkpointStoppedUs;	// from those stops until the next Exit arrived
+};
+
+bool StandInStart(const StandInConfig& config);
+void StandInStop();
+StandInStats StandInGetStats();
+void StandInResetStats();
@@ -0,0 +1,1010 @@
+// Benchmark driver for the VICE connection
+//	Runs the IceBroLite VICE interface (ViceInterface, MemSync, CPU6510) without
+//	the UI against the stand-in server, or an external VICE with -connect, and
+//	reports stop-to-refresh latency, step and step trace throughput and bytes
+//	transferred.
+//	Stepping also reports the size of the memory history of those stops.
+//	-drive and -bank stop with a view on drive 8 or the rom bank of main memory.
+//	-breakpoints imports that many breakpoints, toggles and deletes them.
+//	-tracepoints sets two trace checkpoints and runs until each was hit that
+//	many times, checking the registers recorded for every hit and reporting how
+//	long VICE stops for each, then reconnects and checks they are still traces.
+//	-tracehits adds that many hits to a trace from another thread while reading
+//	them back, with a small memory budget so most of them go to the spill file,
+//	then runs trace queries over them and checks the results.
+//	-symbols adds that many symbols spread over sections, indexes them, hides
+//	and shows sections and checks label lookups against the symbol list, then
+//	types searches into the symbol search a key at a time.
+//	-stepback steps a small program and steps back over it again, checking that
+//	memory and registers are as they were.
+//	-hidden runs as if the Screen view was closed. -record writes the session
+//	traffic to a capture, -replay feeds a capture to the response handlers and
+//	reports how long they took. Ends with the round trip stats per command
+//	type, -stats writes them as JSON. -offline only runs the trace store and
+//	symbol benchmarks, which don't need VICE, without connecting.
+//	A count of 0 skips a benchmark.
+//	ViceBench [-connect ip:port] [-port 6502] [-latency ms] [-jitter ms] [-stops n] [-steps n] [-trace n]
+//	          [-drive n] [-bank n] [-breakpoints n] [-stepback n] [-tracepoints n] [-tracehits n] [-symbols n] [-hidden]
+//	          [-record file] [-replay file [-realtime]] [-stats file] [-offline]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../struse/struse.h"
+#include "../6510.h"
+#include "../Breakpoints.h"
+#include "../Traces.h"
+#include "../TraceQuery.h"
+#include "../Sym.h"
+#include "../SymbolLoad.h"
+#include "../SourceDebug.h"
+#include "../MemHistory.h"
+#include "../MemSync.h"
+#include "../StepBack.h"
+#include "../ViceInterface.h"
+#include "../ViceRecord.h"
+#include "../ViceStats.h"
+#include "StandInServer.h"
+
+enum {
+	kFrameUs = 16667,		// UI frame rate the connection is ticked at
+	kWaitTimeoutMs = 5000,
+	kScreenStart = 0x0400,	// memory a view would show while stepping
+	kScreenBytes = 0x0400,
+	kDriveStart = 0x0300,	// drive buffers a fastloader view would show
+	kDriveBytes = 0x0500,
+	kBankStart = 0xe000,	// kernal a view on the rom bank would show
+	kBankBytes = 0x0500,
+	kStepBackStart = 0xc000	// program stepped over and back
+};
+
+// pushes, pulls, a subroutine and stores to the screen and zero page
+static uint8_t sStepBackProgram[] = {
+	0xa9, 0x01,				// lda #1
+	0x8d, 0x00, 0x04,		// sta $0400
+	0xee, 0x01, 0x04,		// inc $0401
+	0x48,					// pha
+	0x20, 0x10, 0xc0,		// jsr $c010
+	0x68,					// pla
+	0x4c, 0x00, 0xc0,		// jmp $c000
+	0x85, 0xfb,				// $c010: sta $fb
+	0xe6, 0xfc,				// inc $fc
+	0x08,					// php
+	0x28,					// plp
+	0x60					// rts
+};
+
+static StandInConfig sConfig = { 6502, 0, 0, 1 };
+static strown<64> sConnectIP("127.0.0.1");
+static bool sStandIn = true;	// false with -connect
+static uint64_t sLastFrame = 0;
+static ViceSendStats sSent = {};
+static uint32_t sDisplays = 0;
+static bool sScreenVisible = true;
+static bool sDriveView = false;
+static int sBankView = 0;	// VICE bank id, 0 = no bank view
+
+// the driver has no ScreenView, just count the updates
+void RefreshScreen(uint8_t* img, uint16_t w, uint16_t h, uint16_t sx, uint16_t sy, uint16_t sw, uint16_t sh)
+{
+	++sDisplays;
+}
+
+bool ScreenViewVisible()
+{
+	return sScreenVisible;
+}
+
+static void PrintLog(void* user, const char* text, size_t len)
+{
+	printf("%.*s\n", (int)len, text);
+}
+
+static uint64_t NowUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// what a UI frame does with the connection: views read memory, then the connection ticks
+static void Frame()
+{
+	uint64_t now = NowUs();
+	if ((now - sLastFrame) < kFrameUs) { return; }
+	sLastFrame = now;
+	CPU6510* cpu = GetMainCPU();
+	for (uint32_t a = kScreenStart; a < (kScreenStart + kScreenBytes); a += 0x100) { cpu->GetByte((uint16_t)a); }
+	cpu->GetByte(cpu->regs.PC);
+	if (sDriveView) {
+		CPU6510* drive = GetCPU(VICEMemSpaces::Drive8);
+		for (uint32_t a = kDriveStart; a < (kDriveStart + kDriveBytes); a += 0x100) { drive->GetByte((uint16_t)a); }
+	}
+	if (sBankView) {
+		CPU6510* bank = GetCPU(VICEMemSpaces::MainMemory, (uint16_t)sBankView);
+		for (uint32_t a = kBankStart; a < (kBankStart + kBankBytes); a += 0x100) { bank->GetByte((uint16_t)a); }
+	}
+	ViceTickMessage();
+	ViceSendStats frame = ViceLastFrameSendStats();
+	sSent.packets += frame.packets;
+	sSent.bytes += frame.bytes;
+	sSent.writes += frame.writes;
+}
+
+// tick right away so the send counters include everything up to now
+static void FlushFrame()
+{
+	sLastFrame = 0;
+	Frame();
+}
+
+static bool WaitFor(bool (*condition)())
+{
+	uint64_t start = NowUs();
+	// no views drawing here, publish whatever arrived right away
+	while (MemSyncPublish(), !condition()) {
+		if ((NowUs() - start) > (kWaitTimeoutMs * 1000ull)) { return false; }
+		Frame();
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	return true;
+}
+
+static bool IsConnected() { return ViceConnected(); }
+static bool IsRunning() { return ViceRunning(); }
+static bool ReplayDone() { return !ViceReplaying(); }
+static bool IsStopped() { return ViceConnected() && !ViceRunning(); }
+static bool ScreenFresh() { return IsStopped() && GetMainCPU()->RangeFresh(kScreenStart, kScreenBytes); }
+static bool AllFresh() { return IsStopped() && GetMainCPU()->RangeFresh(0, 0x10000); }
+
+static bool DriveFresh() { return ScreenFresh() && GetCPU(VICEMemSpaces::Drive8)->RangeFresh(kDriveStart, kDriveBytes); }
+static bool BankFresh() { return ScreenFresh() && GetCPU(VICEMemSpaces::MainMemory, (uint16_t)sBankView)->RangeFresh(kBankStart, kBankBytes); }
+
+static uint32_t sStepGeneration = 0;
+static bool StepTraceDone() { return !ViceStepTracing(); }
+static bool StepDone() { return ScreenFresh() && GetMainCPU()->syncGeneration != sStepGeneration; }
+enum { kBenchTraceId = 9999, kTraceBudgetMB = 16, kNumTracePoints = 2 };
+static const uint16_t sTracePointAddrs[kNumTracePoints] = { 0xea31, 0x1003 };
+
+// trace checkpoints are listed without Stop, their number is the trace point id
+static uint32_t sTracePoints[kNumTracePoints];
+static size_t sTracePointHitsWanted = 0;
+static bool TracePointsListed()
+{
+	int found = 0;
+	for (size_t b = 0, n = NumBreakpoints(); b < n; ++b) {
+		Breakpoint bp = GetBreakpoint(b);
+		for (int t = 0; t < kNumTracePoints; ++t) {
+			if (bp.start == sTracePointAddrs[t] && !(bp.flags & Breakpoint::Stop)) {
+				sTracePoints[t] = bp.number;
+				++found;
+			}
+		}
+	}
+	return found == kNumTracePoints;
+}
+
+static size_t TraceIndex(int tracePoint)
+{
+	for (size_t t = 0, n = NumTracePointIds(); t < n; ++t) {
+		if (GetTracePointId(t) == tracePoint) { return t; }
+	}
+	return ~(size_t)0;
+}
+
+static bool TracePointsHit()
+{
+	for (int t = 0; t < kNumTracePoints; ++t) {
+		if (NumTraceHits(TraceIndex((int)sTracePoints[t])) < sTracePointHitsWanted) { return false; }
+	}
+	return true;
+}
+
+// a loop of 5 cycles a pass, the raster position wraps to a new frame
+static TraceHit BenchTraceHit(uint32_t i)
+{
+	enum { kCyclesPerLine = 63, kCyclesPerFrame = 312 * kCyclesPerLine, kCyclesPerPass = 5 };
+	TraceHit hit = {};
+	uint32_t raster = (i * kCyclesPerPass) % kCyclesPerFrame;
+	hit.sw = i * kCyclesPerPass;
+	hit.frame = i * kCyclesPerPass / kCyclesPerFrame;
+	hit.line = (uint16_t)(raster / kCyclesPerLine);
+	hit.cycle = (uint8_t)(raster % kCyclesPerLine);
+	hit.pc = (uint16_t)i;
+	hit.addr = 0xd40b;
+	hit.a = (uint8_t)i;
+	hit.fl = (uint8_t)(i >> 8);
+	return hit;
+}
+
+static void AddBenchTraceHits(int count)
+{
+	for (int i = 0; i < count; ++i) {
+		TraceHit hit = BenchTraceHit((uint32_t)i);
+		AddRasterTraceHit(kBenchTraceId, hit, 7);	// the jitter VICE traces use, more than a pass
+	}
+}
+
+// queries over the bench trace with the same test done on each hit for the expected results
+struct BenchQuery {
+	const char* query;
+	bool (*match)(const TraceHit& hit);
+	uint32_t (*key)(const TraceHit& hit);	// nullptr when not grouping
+};
+
+static const BenchQuery sBenchQueries[] = {
+	{ "pc in $1000-$10ff && a == $10", [](const TraceHit& h) { return h.pc >= 0x1000 && h.pc <= 0x10ff && h.a == 0x10; }, nullptr },
+	{ "fl == $ff && a == $ff", [](const TraceHit& h) { return h.fl == 0xff && h.a == 0xff; }, nullptr },
+	{ "line < 10 || !(fl & $80)", [](const TraceHit& h) { return h.line < 10 || !(h.fl & 0x80); }, nullptr },
+	{ "| group pc", [](const TraceHit& h) { return true; }, [](const TraceHit& h) { return (uint32_t)h.pc; } },
+	{ "cycle >= 60 | group line a", [](const TraceHit& h) { return h.cycle >= 60; }, [](const TraceHit& h) { return (uint32_t)h.line; } },
+};
+
+static size_t BenchQueryExpected(int trace, const BenchQuery& query)
+{
+	static TraceHit hits[4096];
+	static bool keys[0x10000];
+	memset(keys, 0, sizeof(keys));
+	size_t expected = 0;
+	for (size_t first = 0, n; (n = GetTraceHits(trace, first, 4096, hits)) != 0; first += n) {
+		for (size_t h = 0; h < n; ++h) {
+			if (!query.match(hits[h])) { continue; }
+			if (!query.key) { ++expected; }
+			else if (!keys[query.key(hits[h])]) {
+				keys[query.key(hits[h])] = true;
+				++expected;
+			}
+		}
+	}
+	return expected;
+}
+
+static bool QueryDone() { return !GetTraceQueryStatus().running; }
+static size_t sQueryTrace = 0;
+static bool QueryCaughtUp() { return QueryDone() && GetTraceQueryStatus().scanned == NumTraceHits(sQueryTrace); }
+
+// symbols: a large project in sections, some names in more than one section
+enum { kBenchSections = 64, kBenchHiddenSections = 8, kBenchLookups = 1000000 };
+
+struct BenchSymbol {
+	uint32_t address;
+	uint32_t name;
+	uint32_t section;
+};
+
+static BenchSymbol BenchSymbolAt(uint32_t i, uint32_t count)
+{
+	BenchSymbol sym;
+	sym.address = (i * 2654435761u) >> 16;	// spread over 64K, a few per address
+	if ((i & 63) == 63) { sym.address += 0x10000; }	// 32 bit addresses are named but not labels
+	sym.name = i % (count - count / 8 + 1);
+	sym.section = (i * 7) % kBenchSections;
+	return sym;
+}
+
+static void BenchSymbolName(char* name, size_t size, uint32_t index)
+{
+	snprintf(name, size, "sym_%u", index);
+}
+
+static void BenchSectionName(char* name, size_t size, uint32_t index)
+{
+	snprintf(name, size, "section_%u", index);
+}
+
+static uint64_t BenchSectionHash(uint32_t index)
+{
+	char name[32];
+	BenchSectionName(name, sizeof(name), index);
+	return strref(name).fnv1a_64();
+}
+
+// the first visible symbol in load order at each address and for each name
+static int BenchCheckSymbols(uint32_t count, const bool* hidden)
+{
+	std::vector<int32_t> first(0x10000, -1);
+	std::vector<int32_t> named(count, -1);
+	for (uint32_t i = 0; i < count; ++i) {
+		BenchSymbol sym = BenchSymbolAt(i, count);
+		if (hidden[sym.section]) { continue; }
+		if (sym.address < 0x10000 && first[sym.address] < 0) { first[sym.address] = (int32_t)sym.name; }
+		if (named[sym.name] < 0) { named[sym.name] = (int32_t)sym.address; }
+	}
+	int wrong = 0, nearest = -1;
+	char name[32];
+	for (uint32_t a = 0; a < 0x10000; ++a) {
+		if (first[a] >= 0) { nearest = (int)a; }
+		uint16_t offs;
+		const char* label = NearestLabel((uint16_t)a, offs);
+		if (nearest < 0) {
+			if (label) { ++wrong; }
+			continue;
+		}
+		BenchSymbolName(name, sizeof(name), (uint32_t)first[nearest]);
+		if (!label || strcmp(label, name) != 0 || offs != (uint16_t)(a - nearest)) { ++wrong; }
+		const char* exact = GetSymbol((uint16_t)a);
+		if ((first[a] >= 0) != (exact != nullptr)) { ++wrong; }
+	}
+	for (uint32_t n = 0; n < count; n += 97) {
+		BenchSymbolName(name, sizeof(name), n);
+		uint16_t addr = 0;
+		bool found = GetAddress(name, strlen(name), addr);
+		if (found != (named[n] >= 0) || (found && addr != (uint16_t)named[n])) { ++wrong; }
+	}
+	return wrong;
+}
+
+// typed a key at a time, each one narrows the one before until the pattern changes kind
+struct BenchSearch {
+	const char* pattern;
+	bool caseSensitive;
+	uint32_t start, end;
+};
+
+static const BenchSearch sBenchSearches[] = {
+	{ "s", true, 0, 0xffffffff }, { "sy", true, 0, 0xffffffff }, { "sym", true, 0, 0xffffffff },
+	{ "sym_", true, 0, 0xffffffff }, { "sym_1", true, 0, 0xffffffff }, { "sym_12", true, 0, 0xffffffff },
+	{ "sym_123", true, 0, 0xffffffff }, { "*2", true, 0, 0xffffffff }, { "*23", true, 0, 0xffffffff },
+	{ "*234", true, 0, 0xffffffff }, { "*2345", true, 0, 0xffffffff }, { "SYM_4", false, 0, 0xffffffff },
+	{ "SYM_45", false, 0, 0xffffffff }, { "sym_1?3", true, 0, 0xffffffff }, { "*1", true, 0x1000, 0x1fff },
+	{ "*17", true, 0x1000, 0x1fff }, { "", true, 0, 0xffffffff }
+};
+
+// matches from a plain pass over all the listed symbols
+static size_t BenchSearchExpected(const std::vector<SymbolSearchMatch>& all, const BenchSearch& search)
+{
+	strown<64> wildcard;
+	if (search.pattern[0] == '*') { wildcard.copy(search.pattern + 1); }
+	else if (search.pattern[0]) { wildcard.append('@').append(search.pattern); }
+	size_t matches = 0;
+	for (std::vector<SymbolSearchMatch>::const_iterator m = all.begin(); m != all.end(); ++m) {
+		if (m->address < search.start || m->address > search.end) { continue; }
+		if (!wildcard.get_len() || strref(m->symbol).find_wildcard(wildcard.get_strref(), 0, search.caseSensitive)) { ++matches; }
+	}
+	return matches;
+}
+
+static size_t sBreakpointsWanted = 0;
+static bool BreakpointsListed() { return NumBreakpoints() == sBreakpointsWanted; }
+static bool BreakpointsDisabled()
+{
+	for (size_t b = 0, n = NumBreakpoints(); b < n; ++b) {
+		if (GetBreakpoint(b).flags & Breakpoint::Enabled) { return false; }
+	}
+	return true;
+}
+
+static bool StepRecordable()
+{
+	CPU6510* cpu = GetMainCPU();
+	return StepDone() && cpu->PageFresh(0x0000) && cpu->PageFresh(0x0100) && cpu->RangeFresh(cpu->regs.PC, 3);
+}
+
+static void Report(const char* name, std::vector<uint64_t>& us)
+{
+	if (!us.size()) {
+		printf("  %-24s no samples\n", name);
+		return;
+	}
+	std::sort(us.begin(), us.end());
+	uint64_t total = 0;
+	for (size_t i = 0; i < us.size(); ++i) { total += us[i]; }
+	printf("  %-24s avg %8.2fms  median %8.2fms  p95 %8.2fms  max %8.2fms\n", name,
+		   total / (1000.0 * us.size()), us[us.size() / 2] / 1000.0,
+		   us[(us.size() * 95) / 100] / 1000.0, us[us.size() - 1] / 1000.0);
+}
+
+static void ResetBytes()
+{
+	FlushFrame();
+	if (sStandIn) { StandInResetStats(); }
+	sSent = ViceSendStats();
+}
+
+static void ReportRoundTrips(const char* statsFile)
+{
+	static ViceCommandStats commands[256];
+	ViceStatsTotals totals;
+	ViceStatsGet(totals, commands);
+	printf("Round trips (%u sent, %u received, %u timeouts, max %u in flight)\n",
+		   totals.sent, totals.received, totals.timeouts, totals.maxInFlight);
+	for (int c = 0, n = ViceBinCmdCount(); c < n; ++c) {
+		const ViceCommandStats& cmd = commands[ViceBinCmdID(c)];
+		if (!cmd.roundTrips) { continue; }
+		printf("  %-24s %6u  avg %8.2fms  min %8.2fms  max %8.2fms\n", ViceBinCmdName(ViceBinCmdID(c)), cmd.roundTrips,
+			   cmd.totalUs / (1000.0 * cmd.roundTrips), cmd.minUs / 1000.0, cmd.maxUs / 1000.0);
+	}
+	if (statsFile && !ViceStatsSaveJSON(statsFile)) { printf("Could not write %s\n", statsFile); }
+}
+
+static void ReportBytes()
+{
+	FlushFrame();
+	printf("  sent: %u commands in %u writes, %u bytes\n", sSent.packets, sSent.writes, sSent.bytes);
+	if (sStandIn) {
+		StandInStats stats = StandInGetStats();
+		printf("  server: %u commands, %u responses, in %llu bytes, out %llu bytes (%u memory, %u displays)\n",
+			   stats.commands, stats.responses, (unsigned long long)stats.bytesIn,
+			   (unsigned long long)stats.bytesOut, stats.memGetBytes, stats.displays);
+	}
+}
+
+static void Disconnect()
+{
+	ViceDisconnect();
+	uint64_t disconnect = NowUs();
+	while (ViceConnected() && (NowUs() - disconnect) < (kWaitTimeoutMs * 1000ull)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));	// let the connection thread clean up
+}
+
+// stop to refresh: break a running machine and wait for the visible pages, then all of memory
+static void BenchStops(int stops)
+{
+	std::vector<uint64_t> toStopped, toScreen, toAll;
+	if (IsStopped()) {
+		ViceGo();
+		WaitFor(IsRunning);
+	}
+	ResetBytes();
+	for (int s = 0; s < stops; ++s) {
+		uint64_t start = NowUs();
+		ViceBreak();
+		if (!WaitFor(IsStopped)) { break; }
+		toStopped.push_back(NowUs() - start);
+		if (!WaitFor(ScreenFresh)) { break; }
+		toScreen.push_back(NowUs() - start);
+		if (!WaitFor(AllFresh)) { break; }
+		toAll.push_back(NowUs() - start);
+		ViceGo();
+		if (!WaitFor(IsRunning)) { break; }
+	}
+	printf("Stop to refresh (%d stops)\n", (int)toAll.size());
+	Report("stopped", toStopped);
+	Report("visible pages fresh", toScreen);
+	Report("all memory fresh", toAll);
+	ReportBytes();
+}
+
+// step throughput: each step waits for the stop and the visible pages
+static void BenchSteps(int steps)
+{
+	std::vector<uint64_t> stepTimes;
+	if (IsRunning()) {
+		ViceBreak();
+		WaitFor(AllFresh);
+	}
+	ResetBytes();
+	uint64_t stepStart = NowUs();
+	for (int s = 0; s < steps; ++s) {
+		uint64_t start = NowUs();
+		sStepGeneration = GetMainCPU()->syncGeneration;
+		ViceStep();
+		if (!WaitFor(StepDone)) { break; }
+		stepTimes.push_back(NowUs() - start);
+	}
+	uint64_t stepTotal = NowUs() - stepStart;
+	printf("Step (%d steps, %.1f steps/s)\n", (int)stepTimes.size(),
+		   stepTotal ? stepTimes.size() * 1000000.0 / stepTotal : 0.0);
+	Report("step to visible fresh", stepTimes);
+	ReportBytes();
+	MemHistoryStats history = MemHistoryGetStats();
+	printf("  memory history: %u stops in %u unique pages, %.1f KB (%.1f KB as full copies)\n", history.snapshots,
+		   history.pages, history.bytes / 1024.0, history.snapshots * 64.0);
+}
+
+// drive view: a view on drive 8 memory, only those pages are fetched from the drive
+static void BenchDriveView(int driveStops)
+{
+	std::vector<uint64_t> toDrive;
+	sDriveView = true;
+	ResetBytes();
+	for (int s = 0; s < driveStops; ++s) {
+		ViceGo();
+		if (!WaitFor(IsRunning)) { break; }
+		uint64_t start = NowUs();
+		ViceBreak();
+		if (!WaitFor(DriveFresh)) { break; }
+		toDrive.push_back(NowUs() - start);
+	}
+	WaitFor(AllFresh);
+	sDriveView = false;
+	CPU6510* drive = GetCPU(VICEMemSpaces::Drive8);
+	printf("Drive 8 view (%d stops, %d drive pages cached, main memory %s)\n", (int)toDrive.size(),
+		   256 - drive->PagesPending(), memcmp(drive->ram + kDriveStart, GetMainCPU()->ram + kDriveStart, kDriveBytes) ? "separate" : "SAME");
+	Report("drive pages fresh", toDrive);
+	ReportBytes();
+}
+
+// bank view: the kernal in the rom bank, fetched next to the default bank
+static void BenchBankView(int bankStops)
+{
+	for (int b = 0, n = ViceNumBanks(); b < n; ++b) {
+		if (strcmp(ViceBankName(b), "rom") != 0) { continue; }
+		std::vector<uint64_t> toBank;
+		sBankView = ViceBankID(b);
+		ResetBytes();
+		for (int s = 0; s < bankStops; ++s) {
+			ViceGo();
+			if (!WaitFor(IsRunning)) { break; }
+			uint64_t start = NowUs();
+			ViceBreak();
+			if (!WaitFor(BankFresh)) { break; }
+			toBank.push_back(NowUs() - start);
+		}
+		WaitFor(AllFresh);
+		CPU6510* bank = GetCPU(VICEMemSpaces::MainMemory, (uint16_t)sBankView);
+		sBankView = 0;
+		printf("Bank %s view (%d of %d banks, %d stops, %d bank pages cached, default bank %s)\n", ViceBankName(b), b, n,
+			   (int)toBank.size(), 256 - bank->PagesPending(),
+			   memcmp(bank->ram + kBankStart, GetMainCPU()->ram + kBankStart, kBankBytes) ? "separate" : "SAME");
+		Report("bank pages fresh", toBank);
+		ReportBytes();
+	}
+}
+
+// breakpoints: an import, then toggle and delete each, applied as VICE answers
+static void BenchBreakpoints(int numBreakpoints)
+{
+	WaitFor(AllFresh);
+	std::vector<uint16_t> addresses;
+	for (int b = 0; b < numBreakpoints; ++b) { addresses.push_back((uint16_t)(0x1000 + b * 3)); }
+	ResetBytes();
+	uint64_t start = NowUs();
+	sBreakpointsWanted = NumBreakpoints() + addresses.size();
+	ViceAddBreakpoints(addresses.data(), addresses.size());
+	bool added = WaitFor(BreakpointsListed);
+	uint64_t addUs = NowUs() - start;
+	// what the code views do for every line they draw
+	start = NowUs();
+	UpdateBreakpointMap();
+	uint64_t mapUs = NowUs() - start;
+	start = NowUs();
+	int found = 0;
+	for (uint32_t a = 0; a < 0x10000; ++a) {
+		Breakpoint bp;
+		if (BreakpointAt((uint16_t)a, bp)) { ++found; }
+	}
+	uint64_t lookupUs = NowUs() - start;
+	start = NowUs();
+	for (size_t b = 0, n = NumBreakpoints(); b < n; ++b) { ViceToggleBreakpoint(GetBreakpoint(b).number, false); }
+	bool toggled = WaitFor(BreakpointsDisabled);
+	uint64_t toggleUs = NowUs() - start;
+	start = NowUs();
+	std::vector<uint32_t> numbers;
+	for (size_t b = 0, n = NumBreakpoints(); b < n; ++b) { numbers.push_back(GetBreakpoint(b).number); }
+	for (size_t b = 0; b < numbers.size(); ++b) { ViceRemoveBreakpoint(numbers[b]); }
+	sBreakpointsWanted = 0;
+	bool removed = WaitFor(BreakpointsListed);
+	uint64_t removeUs = NowUs() - start;
+	printf("Breakpoints (%d: add %.2fms%s, disable %.2fms%s, delete %.2fms%s)\n", numBreakpoints,
+		   addUs / 1000.0, added ? "" : " FAILED", toggleUs / 1000.0, toggled ? "" : " FAILED",
+		   removeUs / 1000.0, removed ? "" : " FAILED");
+	printf("  address map built in %.3fms, 64K lookups in %.3fms, %d found\n", mapUs / 1000.0, lookupUs / 1000.0, found);
+	ReportBytes();
+}
+
+// step back: step a program forward then undo each step
+static void BenchStepBack(int backSteps)
+{
+	CPU6510* cpu = GetMainCPU();
+	WaitFor(AllFresh);
+	cpu->CopyToRAM(kStepBackStart, sStepBackProgram, sizeof(sStepBackProgram));
+	cpu->regs.PC = kStepBackStart;
+	ViceSetRegisters(*cpu, CPU6510::RM_PC);
+	std::vector<uint8_t> before(cpu->ram, cpu->ram + 0x10000);
+	CPU6510::Regs regs = cpu->regs;
+	int stepped = 0;
+	for (; stepped < backSteps; ++stepped) {
+		sStepGeneration = cpu->syncGeneration;
+		ViceStep();
+		if (!WaitFor(StepRecordable)) { break; }
+	}
+	WaitFor(AllFresh);
+	bool changed = memcmp(before.data(), cpu->ram, 0x10000) != 0;
+	std::vector<uint64_t> backTimes;
+	ResetBytes();
+	for (int s = 0; s < stepped && StepBackAvailable(); ++s) {
+		uint64_t start = NowUs();
+		if (!CPUStepBack() || !WaitFor(AllFresh)) { break; }
+		backTimes.push_back(NowUs() - start);
+	}
+	bool restored = memcmp(before.data(), cpu->ram, 0x10000) == 0 && regs.PC == cpu->regs.PC &&
+		regs.A == cpu->regs.A && regs.X == cpu->regs.X && regs.Y == cpu->regs.Y &&
+		regs.SP == cpu->regs.SP && regs.FL == cpu->regs.FL;
+	printf("Step back (%d of %d steps undone, memory %s, state %s)\n", (int)backTimes.size(), stepped,
+		   changed ? "changed" : "UNCHANGED", restored ? "restored" : "DIFFERENT");
+	Report("step back to all fresh", backTimes);
+	ReportBytes();
+}
+
+// step trace: Step + RegistersGet pairs pipelined without waiting on frames
+static void BenchStepTrace(int traceSteps)
+{
+	WaitFor(AllFresh);
+	ResetBytes();
+	uint64_t traceStart = NowUs();
+	if (ViceStepTrace((uint32_t)traceSteps, 1)) {
+		while (!StepTraceDone() && WaitFor(StepTraceDone)) {}
+		uint64_t traceTotal = NowUs() - traceStart;
+		size_t traced = 0;
+		for (size_t t = 0, n = NumTracePointIds(); t < n; ++t) {
+			if (GetTracePointId(t) == kStepTraceId) { traced = NumTraceHits(t); }
+		}
+		printf("Step trace (%d instructions traced, %.1f instructions/s)\n", (int)traced,
+			   traceTotal ? traced * 1000000.0 / traceTotal : 0.0);
+		ReportBytes();
+	}
+}
+
+// trace checkpoints: VICE stops at each hit and is resumed once the registers are recorded
+static void BenchTracePoints(int tracePointHits)
+{
+	WaitFor(AllFresh);
+	for (int t = 0; t < kNumTracePoints; ++t) {
+		ViceAddCheckpoint(sTracePointAddrs[t], sTracePointAddrs[t], false, false, false, true);
+	}
+	bool listed = WaitFor(TracePointsListed);
+	ResetBytes();
+	sTracePointHitsWanted = (size_t)tracePointHits;
+	uint64_t start = NowUs();
+	ViceGo();
+	bool hit = listed && WaitFor(IsRunning);
+	while (hit && !TracePointsHit()) { hit = WaitFor(TracePointsHit); }
+	uint64_t runUs = NowUs() - start;
+	ViceBreak();
+	WaitFor(AllFresh);
+	StandInStats stats = StandInGetStats();
+	int hits = 0, wrong = 0;
+	for (int t = 0; listed && t < kNumTracePoints; ++t) {
+		size_t trace = TraceIndex((int)sTracePoints[t]);
+		for (size_t h = 0, n = NumTraceHits(trace); h < n; ++h) {
+			TraceHit prev = GetTraceHit((int)trace, h ? h - 1 : 0), curr = GetTraceHit((int)trace, h);
+			// the stand-in hits each checkpoint once per frame with the frame number in A, at
+			// raster positions too close together to count frames from but never further back
+			if (curr.pc != sTracePointAddrs[t] || curr.addr != sTracePointAddrs[t] ||
+				(h && (curr.frame < prev.frame || curr.frame > prev.frame + 1 || curr.a != (uint8_t)(prev.a + 1)))) { ++wrong; }
+			++hits;
+		}
+	}
+	// VICE doesn't run while it waits for the Exit, that time per hit limits the hit rate
+	double stopUs = stats.checkpointStops ? stats.checkpointStoppedUs / (double)stats.checkpointStops : 0.0;
+	printf("Trace checkpoints (%d hits on %d traces%s, %.1f hits/s, %d wrong)\n", hits, kNumTracePoints,
+		   hit ? "" : " FAILED", runUs ? hits * 1000000.0 / runUs : 0.0, wrong);
+	printf("  stopped %.3fms per hit, at most %.0f hits/s, one trace per frame stops VICE %.1f%% of the time\n",
+		   stopUs / 1000.0, stopUs ? 1000000.0 / stopUs : 0.0, stopUs * 50.0 / 10000.0);
+	ReportBytes();
+
+	// stepping onto a trace is a stop the debugger asked for, VICE stays stopped
+	bool stayed = false;
+	if (listed) {
+		CPU6510* cpu = GetMainCPU();
+		uint16_t traced = sTracePointAddrs[0];
+		uint8_t jumpToTrace[] = { 0x4c, (uint8_t)traced, (uint8_t)(traced >> 8) };	// jmp traced
+		cpu->CopyToRAM(kStepBackStart, jumpToTrace, sizeof(jumpToTrace));
+		cpu->regs.PC = kStepBackStart;
+		ViceSetRegisters(*cpu, CPU6510::RM_PC);
+		size_t traceHits = NumTraceHits(TraceIndex((int)sTracePoints[0]));
+		sStepGeneration = cpu->syncGeneration;
+		ViceStep();
+		stayed = WaitFor(StepDone);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		stayed = stayed && IsStopped() && cpu->regs.PC == traced &&
+			NumTraceHits(TraceIndex((int)sTracePoints[0])) == traceHits + 1;
+		if (!IsStopped()) { ViceBreak(); }
+		WaitFor(AllFresh);
+	}
+	printf("  step onto a trace %s\n", stayed ? "stays stopped" : "RESUMED");
+
+	// reconnecting: VICE still has the checkpoints and they are still traces
+	ClearBreakpoints();
+	Disconnect();
+	ViceConnect(sConnectIP.c_str(), sConfig.port);
+	bool kept = WaitFor(IsConnected);
+	if (kept && IsRunning()) { ViceBreak(); }	// VICE is asked for its checkpoints on the first stop
+	kept = kept && WaitFor(TracePointsListed);
+	if (kept) {
+		ViceGo();
+		sTracePointHitsWanted = 0;
+		for (int t = 0; t < kNumTracePoints; ++t) {
+			sTracePointHitsWanted = std::max(sTracePointHitsWanted, NumTraceHits(TraceIndex((int)sTracePoints[t])) + 5);
+		}
+		kept = WaitFor(TracePointsHit);
+		ViceBreak();
+	}
+	WaitFor(AllFresh);
+	for (int t = 0; listed && t < kNumTracePoints; ++t) {
+		ViceRemoveBreakpoint(sTracePoints[t]);
+		ClearTrace(TraceIndex((int)sTracePoints[t]));
+	}
+	printf("  reconnected, traces %s\n", kept ? "kept" : "LOST");
+}
+
+// trace store: one thread adds hits while this one reads what is there so far
+static void BenchTraceStore(int traceHits)
+{
+	size_t budget = GetTraceMemoryBudget();
+	SetTraceMemoryBudget((size_t)kTraceBudgetMB << 20);
+	uint64_t start = NowUs();
+	std::thread writer(AddBenchTraceHits, traceHits);
+	size_t read = 0, wrong = 0, trace = ~(size_t)0;
+	static TraceHit hits[256];
+	while (read < (size_t)traceHits) {
+		for (size_t t = 0, n = NumTracePointIds(); trace == ~(size_t)0 && t < n; ++t) {
+			if (GetTracePointId(t) == kBenchTraceId) { trace = t; }
+		}
+		size_t got = trace != ~(size_t)0 ? GetTraceHits((int)trace, read, 256, hits) : 0;
+		for (size_t h = 0; h < got; ++h) {
+			TraceHit expect = BenchTraceHit((uint32_t)(read + h));
+			if (hits[h].pc != expect.pc || hits[h].a != expect.a || hits[h].sw != expect.sw || hits[h].frame != expect.frame ||
+				hits[h].fl != expect.fl || hits[h].line != expect.line) { ++wrong; }
+		}
+		read += got;
+		if (!got) { std::this_thread::yield(); }
+	}
+	writer.join();
+	uint64_t addUs = NowUs() - start;
+	// random rows, what scrolling through the trace view does
+	start = NowUs();
+	uint32_t random = 1;
+	for (int r = 0; r < 10000; ++r) {
+		random = random * 1103515245 + 12345;
+		GetTraceHits((int)trace, (random >> 4) % (size_t)traceHits, 64, hits);
+	}
+	uint64_t scrollUs = NowUs() - start;
+	printf("Trace store (%d hits, %.1fM hits/s while read back, %d wrong, %dMB in RAM, rest mapped)\n",
+		   traceHits, addUs ? traceHits / (double)addUs : 0.0, (int)wrong, kTraceBudgetMB);
+	printf("  10000 random 64 row reads in %.2fms\n", scrollUs / 1000.0);
+	for (size_t q = 0; q < sizeof(sBenchQueries) / sizeof(sBenchQueries[0]); ++q) {
+		char error[128];
+		start = NowUs();
+		if (!StartTraceQuery(kBenchTraceId, sBenchQueries[q].query, error, sizeof(error))) {
+			printf("  query %-32s %s\n", sBenchQueries[q].query, error);
+			continue;
+		}
+		WaitFor(QueryDone);
+		uint64_t queryUs = NowUs() - start;
+		TraceQueryStatus status = GetTraceQueryStatus();
+		size_t found = sBenchQueries[q].key ? status.groups : status.matches;
+		size_t expected = BenchQueryExpected((int)trace, sBenchQueries[q]);
+		printf("  query %-32s %8.2fms %8d %s%s\n", sBenchQueries[q].query, queryUs / 1000.0, (int)found,
+			   sBenchQueries[q].key ? "groups" : "matches", found == expected ? "" : " WRONG");
+	}
+	// a query keeps following the trace as hits are added
+	char error[128];
+	const BenchQuery& follow = sBenchQueries[0];
+	if (StartTraceQuery(kBenchTraceId, follow.query, error, sizeof(error))) {
+		sQueryTrace = trace;
+		WaitFor(QueryDone);
+		AddBenchTraceHits(traceHits / 4);
+		bool followed = WaitFor(QueryCaughtUp) && GetTraceQueryStatus().matches == BenchQueryExpected((int)trace, follow);
+		printf("  query %-32s followed %d more hits%s\n", follow.query, traceHits / 4, followed ? "" : " WRONG");
+	}
+	ClearTraceQuery();
+	ClearTrace(trace);
+	SetTraceMemoryBudget(budget);
+}
+
+// symbols: added and indexed as the loader does, swapped in, then sections hidden and shown one at a time
+static void BenchSymbols(int numSymbols)
+{
+	uint32_t count = (uint32_t)numSymbols;
+	char name[32], section[32];
+	uint64_t start = NowUs();
+	BeginAddingSymbols();
+	for (uint32_t i = 0; i < count; ++i) {
+		BenchSymbol sym = BenchSymbolAt(i, count);
+		BenchSymbolName(name, sizeof(name), sym.name);
+		BenchSectionName(section, sizeof(section), sym.section);
+		AddSymbol(sym.address, name, strlen(name), section, strlen(section));
+	}
+	uint64_t addUs = NowUs() - start;
+	start = NowUs();
+	FinishAddingSymbols();
+	uint64_t indexUs = NowUs() - start;
+	start = NowUs();
+	CommitSymbols();
+	uint64_t commitUs = NowUs() - start;
+	bool hidden[kBenchSections] = {};
+	int wrong = BenchCheckSymbols(count, hidden);
+	start = NowUs();
+	for (uint32_t s = 0; s < kBenchHiddenSections; ++s) {
+		HideSection(BenchSectionHash(s * 3), true);
+		hidden[s * 3] = true;
+	}
+	uint64_t hideUs = NowUs() - start;
+	wrong += BenchCheckSymbols(count, hidden);
+	uint32_t random = 1;
+	start = NowUs();
+	size_t labels = 0;
+	for (int l = 0; l < kBenchLookups; ++l) {
+		random = random * 1103515245 + 12345;
+		uint16_t offs;
+		if (NearestLabel((uint16_t)(random >> 8), offs)) { ++labels; }
+	}
+	uint64_t nearestUs = NowUs() - start;
+	start = NowUs();
+	for (int l = 0; l < kBenchLookups; ++l) {
+		random = random * 1103515245 + 12345;
+		BenchSymbolName(name, sizeof(name), (random >> 8) % count);
+		uint16_t addr;
+		if (GetAddress(name, strlen(name), addr)) { ++labels; }
+	}
+	uint64_t addressUs = NowUs() - start;
+	SearchSymbols("", true);
+	std::vector<SymbolSearchMatch> all(NumSymbolSearchMatches());
+	all.resize(GetSymbolSearchMatches(0, all.size(), all.data()));
+	uint64_t searchUs = 0, slowestSearchUs = 0;
+	for (size_t q = 0; q < sizeof(sBenchSearches) / sizeof(sBenchSearches[0]); ++q) {
+		const BenchSearch& search = sBenchSearches[q];
+		start = NowUs();
+		SearchSymbols(search.pattern, search.caseSensitive, search.start, search.end);
+		uint64_t us = NowUs() - start;
+		searchUs += us;
+		slowestSearchUs = std::max(slowestSearchUs, us);
+		if (NumSymbolSearchMatches() != BenchSearchExpected(all, search)) { ++wrong; }
+	}
+	start = NowUs();
+	for (uint32_t s = 0; s < kBenchHiddenSections; ++s) {
+		HideSection(BenchSectionHash(s * 3), false);
+		hidden[s * 3] = false;
+	}
+	uint64_t showUs = NowUs() - start;
+	wrong += BenchCheckSymbols(count, hidden);
+	printf("Symbols (%u in %d sections, %d wrong)\n", count, kBenchSections, wrong);
+	printf("  add %.2fms, index %.2fms, swap in %.2fms, hide %d sections %.2fms, show them %.2fms\n", addUs / 1000.0,
+		   indexUs / 1000.0, commitUs / 1000.0, kBenchHiddenSections, hideUs / 1000.0, showUs / 1000.0);
+	printf("  %d NearestLabel %.2fms, %d GetAddress %.2fms (%d found)\n", kBenchLookups, nearestUs / 1000.0,
+		   kBenchLookups, addressUs / 1000.0, (int)labels);
+	printf("  %d searches typed %.2fms, slowest %.2fms\n", (int)(sizeof(sBenchSearches) / sizeof(sBenchSearches[0])),
+		   searchUs / 1000.0, slowestSearchUs / 1000.0);
+	ClearSymbols();
+}
+
+// the counts of the benchmarks, 0 skips one
+struct BenchCounts {
+	int stops, steps, driveStops, bankStops, breakpoints, backSteps, traceSteps, tracePointHits, traceHits, symbols;
+};
+
+static bool ParseCount(const char* arg, const char* value, BenchCounts& counts)
+{
+	static const struct { const char* name; int BenchCounts::* count; } args[] = {
+		{ "-stops", &BenchCounts::stops }, { "-steps", &BenchCounts::steps }, { "-trace", &BenchCounts::traceSteps },
+		{ "-drive", &BenchCounts::driveStops }, { "-bank", &BenchCounts::bankStops },
+		{ "-breakpoints", &BenchCounts::breakpoints }, { "-stepback", &BenchCounts::backSteps },
+		{ "-tracepoints", &BenchCounts::tracePointHits }, { "-tracehits", &BenchCounts::traceHits },
+		{ "-symbols", &BenchCounts::symbols }
+	};
+	for (size_t a = 0; a < sizeof(args) / sizeof(args[0]); ++a) {
+		if (strcmp(arg, args[a].name) == 0) {
+			counts.*args[a].count = atoi(value);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void Init()
+{
+	CreateMainCPU();
+	InitSymbols();
+	InitSymbolLoad();
+	InitSourceDebug();
+	InitBreakpoints();
+	InitTraces();
+	InitTraceQuery();
+	InitMemSync();
+	InitMemHistory();
+	InitStepBack();
+	InitViceRecord();
+	InitViceStats();
+	ViceAddLogger(PrintLog, &sConfig);
+}
+
+static void Shutdown()
+{
+	ShutdownViceStats();
+	ShutdownViceRecord();
+	ShutdownStepBack();
+	ShutdownMemHistory();
+	ShutdownMemSync();
+	ShutdownTraceQuery();
+	ShutdownTraces();
+	ShutdownBreakpoints();
+	ShutdownSymbolLoad();
+	ShutdownSourceDebug();
+	ShutdownSymbols();
+	ShutdownMainCPU();
+}
+
+int main(int argc, char** argv)
+{
+	bool realTime = false, offline = false;
+	const char* recordFile = nullptr;
+	const char* replayFile = nullptr;
+	const char* statsFile = nullptr;
+	BenchCounts counts = { 50, 500, 10, 10, 200, 200, 5000, 50, 2000000, 200000 };
+	for (int a = 1; a < argc; ++a) {
+		bool more = (a + 1) < argc;
+		if (more && strcmp(argv[a], "-connect") == 0) {
+			strref addr(argv[++a]);
+			int colon = addr.find(':');
+			sConnectIP.copy(colon >= 0 ? addr.get_substr(0, colon) : addr);
+			if (colon >= 0) { sConfig.port = (uint32_t)addr.get_skipped(colon + 1).atoi(); }
+			sStandIn = false;
+		}
+		else if (more && strcmp(argv[a], "-port") == 0) { sConfig.port = (uint32_t)atoi(argv[++a]); }
+		else if (more && strcmp(argv[a], "-latency") == 0) { sConfig.latencyMs = (uint32_t)atoi(argv[++a]); }
+		else if (more && strcmp(argv[a], "-jitter") == 0) { sConfig.jitterMs = (uint32_t)atoi(argv[++a]); }
+		else if (more && ParseCount(argv[a], argv[a + 1], counts)) { ++a; }
+		else if (more && strcmp(argv[a], "-record") == 0) { recordFile = argv[++a]; }
+		else if (more && strcmp(argv[a], "-replay") == 0) { replayFile = argv[++a]; }
+		else if (more && strcmp(argv[a], "-stats") == 0) { statsFile = argv[++a]; }
+		else if (strcmp(argv[a], "-realtime") == 0) { realTime = true; }
+		else if (strcmp(argv[a], "-hidden") == 0) { sScreenVisible = false; }
+		else if (strcmp(argv[a], "-offline") == 0) { offline = true; }
+		else {
+			printf("Usage: ViceBench [-connect ip:port] [-port 6502] [-latency ms] [-jitter ms] [-stops n] [-steps n] [-trace n]\n");
+			printf("                 [-drive n] [-bank n] [-breakpoints n] [-stepback n] [-tracepoints n] [-tracehits n] [-symbols n] [-hidden]\n");
+			printf("                 [-record file] [-replay file [-realtime]] [-stats file] [-offline]\n");
+			return 1;
+		}
+	}
+
+	Init();
+
+	if (replayFile) {
+		if (!ViceReplay(replayFile, realTime)) {
+			printf("Could not replay %s\n", replayFile);
+			return 1;
+		}
+		while (!ReplayDone()) { WaitFor(ReplayDone); }
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));	// let the replay thread clean up
+		ReportRoundTrips(statsFile);
+		Shutdown();
+		return 0;
+	}
+
+	if (!offline) {
+		if (sStandIn && !StandInStart(sConfig)) {
+			printf("Could not start the stand-in server on port %u\n", sConfig.port);
+			return 1;
+		}
+		if (recordFile && !ViceRecordStart(recordFile)) {
+			printf("Could not create %s\n", recordFile);
+			return 1;
+		}
+		ViceConnect(sConnectIP.c_str(), sConfig.port);
+		if (!WaitFor(IsConnected)) {
+			printf("Could not connect to %s:%u\n", sConnectIP.c_str(), sConfig.port);
+			return 1;
+		}
+		printf("Connected to %s:%u", sConnectIP.c_str(), sConfig.port);
+		if (sStandIn) { printf(" (stand-in, latency %ums + 0..%ums)", sConfig.latencyMs, sConfig.jitterMs); }
+		printf("\n");
+
+		if (counts.stops > 0) { BenchStops(counts.stops); }
+		if (counts.steps > 0) { BenchSteps(counts.steps); }
+		if (counts.driveStops > 0) { BenchDriveView(counts.driveStops); }
+		if (counts.bankStops > 0) { BenchBankView(counts.bankStops); }
+		if (counts.breakpoints > 0) { BenchBreakpoints(counts.breakpoints); }
+		if (counts.backSteps > 0 && sStandIn) { BenchStepBack(counts.backSteps); }
+		if (counts.traceSteps > 0) { BenchStepTrace(counts.traceSteps); }
+		if (counts.tracePointHits > 0 && sStandIn) { BenchTracePoints(counts.tracePointHits); }
+	}
+
+	// these don't need VICE
+	if (counts.traceHits > 0) { BenchTraceStore(counts.traceHits); }
+	if (counts.symbols > 0) { BenchSymbols(counts.symbols); }
+
+	if (!offline) {
+		ReportRoundTrips(statsFile);
+		Disconnect();
+	}
+	Shutdown();
+	if (sStandIn && !offline) { StandInStop(); }
+	return 0;
+}
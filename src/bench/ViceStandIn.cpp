@@ -0,0 +1,43 @@
+// Stand-in VICE binary monitor, IceBroLite can connect to it like VICE
+//	ViceStandIn [-port 6502] [-latency ms] [-jitter ms]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "StandInServer.h"
+
+int main(int argc, char** argv)
+{
+	StandInConfig config = { 6502, 0, 0, 1 };
+	for (int a = 1; a < argc; ++a) {
+		bool more = (a + 1) < argc;
+		if (more && strcmp(argv[a], "-port") == 0) { config.port = (uint32_t)atoi(argv[++a]); }
+		else if (more && strcmp(argv[a], "-latency") == 0) { config.latencyMs = (uint32_t)atoi(argv[++a]); }
+		else if (more && strcmp(argv[a], "-jitter") == 0) { config.jitterMs = (uint32_t)atoi(argv[++a]); }
+		else if (more && strcmp(argv[a], "-seed") == 0) { config.seed = (uint32_t)atoi(argv[++a]); }
+		else {
+			printf("Usage: ViceStandIn [-port 6502] [-latency ms] [-jitter ms] [-seed n]\n");
+			return 1;
+		}
+	}
+
+	if (!StandInStart(config)) {
+		printf("Could not listen on port %u\n", config.port);
+		return 1;
+	}
+	printf("VICE stand-in listening on 127.0.0.1:%u, latency %ums + 0..%ums\n", config.port, config.latencyMs, config.jitterMs);
+
+	StandInStats last = StandInGetStats();
+	for (;;) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		StandInStats stats = StandInGetStats();
+		if (stats.commands != last.commands) {
+			printf("commands: %u responses: %u in: %llu bytes out: %llu bytes memory: %u bytes displays: %u\n",
+				stats.commands, stats.responses, (unsigned long long)stats.bytesIn, (unsigned long long)stats.bytesOut,
+				stats.memGetBytes, stats.displays);
+			last = stats;
+		}
+	}
+	return 0;
+}
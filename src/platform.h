@@ -36,6 +36,17 @@ bool IBMutexRelease(IBMutex* mutex);
 bool IBCreateThread(IBThread* thread, size_t stackSize, IBThreadFunc func, void* param);
 bool IBDestroyThread(IBThread* thread);
 
+// temporary file that is memory mapped in blocks as it grows, deleted when closed
+struct IBMapFile;
+enum { IBMapFile_Granularity = 0x10000 };	// block sizes are a multiple of this
+IBMapFile* IBMapFileCreate();
+void* IBMapFileAdd(IBMapFile* file, size_t bytes);	// grows the file and maps the new bytes
+void IBMapFileClose(IBMapFile* file);
+
+// read only view of a whole existing file
+const void* IBMapFileRead(const char* filename, size_t& size);
+void IBMapFileUnmap(const void* data, size_t size);
+
 void CopyBitmapToClipboard(void* bitmap, int width, int height);
 
 
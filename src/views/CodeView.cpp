@@ -19,7 +19,7 @@
 #include "../SourceDebug.h"
 #include "../CodeColoring.h"
 
-CodeView::CodeView() : open(false), evalAddress(false)
+CodeView::CodeView() : memSpace(0), bank(0), open(false), evalAddress(false)
 {
 	srcColDif = 0;
 	showAddress = true;
@@ -58,6 +58,8 @@ void CodeView::WriteConfig(UserData& config)
 	config.AddValue(strref("showLabels"), config.OnOff(showLabels));
 	config.AddValue(strref("showSrc"), config.OnOff(showSrc));
 	config.AddValue(strref("trackPC"), config.OnOff(trackPC));
+	config.AddValue(strref("memSpace"), memSpace);
+	config.AddValue(strref("bank"), bank);
 }
 
 void CodeView::ReadConfig(strref config)
@@ -85,6 +87,12 @@ void CodeView::ReadConfig(strref config)
 			showSrc = !value.same_str("Off");
 		} else if (name.same_str("trackPC") && type == ConfigParseType::CPT_Value) {
 			trackPC = !value.same_str("Off");
+		} else if (name.same_str("memSpace") && type == ConfigParseType::CPT_Value) {
+			memSpace = (int)value.atoi();
+			if (memSpace < 0 || memSpace > (int)VICEMemSpaces::Drive11) { memSpace = 0; }
+		} else if (name.same_str("bank") && type == ConfigParseType::CPT_Value) {
+			bank = (int)value.atoi();
+			if (bank < 0 || bank >= kMaxCPUBanks) { bank = 0; }
 		}
 	}
 }
@@ -101,7 +109,7 @@ bool CodeView::EditAssembly() {
 	strown<32> editID("Edit Asm##");
 	editID.append_num(editAsmAddr, 4, 16);
 	if (ImGui::InputText(editID.c_str(), editAsmStr, sizeof(editAsmStr), ImGuiInputTextFlags_EnterReturnsTrue)) {
-		int size = Assemble(GetCurrCPU(), editAsmStr, editAsmAddr);
+		int size = Assemble(GetCPU((VICEMemSpaces)memSpace, (uint16_t)bank), editAsmStr, editAsmAddr);
 		if (!size) {
 			editAsmAddr = -1;
 			ForceKeyboardCanvas("DisAsmView");
@@ -211,7 +219,7 @@ void CodeView::Draw(int index)
 
 
 //	uint16_t addrs[MaxDisAsmLines];	// address for each line
-	CPU6510* cpu = GetCurrCPU();
+	CPU6510* cpu = GetCPU((VICEMemSpaces)memSpace, (uint16_t)bank);
 	const CPU6510::Regs &regs = cpu->regs;	// current registers
 
 	// input text for address field
@@ -237,6 +245,12 @@ void CodeView::Draw(int index)
 	ImGui::Checkbox("source", &showSrc);
 	ImGui::SameLine();
 	ImGui::Checkbox("track PC", &trackPC);
+	ImGui::SameLine();
+	MemSpaceCombo(&memSpace);
+	if (memSpace == (int)VICEMemSpaces::MainMemory) {
+		ImGui::SameLine();
+		BankCombo(&bank);
+	}
 	{	// don't overlap rightmost area
 		ImVec2 content_avail = ImGui::GetContentRegionAvail();
 		content_avail.x -= 8;
@@ -25,6 +25,8 @@ struct CodeView
 
 	int editAsmAddr;
 	int cursor[ 2 ];
+	int memSpace;	// VICEMemSpaces
+	int bank;		// VICE bank id of main memory
 	int contextAddr;
 	int lastShownPCRow;
 	int srcColDif, srcColDif0;
@@ -10,6 +10,8 @@
 #include "../platform.h"
 #include "../Commands.h"
 #include "../FileDialog.h"
+#include "../Files.h"
+#include "../ViceRecord.h"
 
 static const strref command_separator(" $.");
 
@@ -453,6 +455,33 @@ void IceConsole::ExecCommand(const char* command_line)
 			addrchr.c_str();
 			ViceConnect(addrchr.charstr(), port);
 		}
+	} else if (cmd.same_str("capture")) {
+		if (!param) {
+			if (ViceRecording()) { AddLog("Capture stopped"); }
+			ViceRecordStop();
+		} else if (ViceRecordStart(strown<PATH_MAX_LEN>(param).c_str())) {
+			AddLog("Capturing VICE traffic to \"" STRREF_FMT "\"", STRREF_ARG(param));
+		} else {
+			AddLog("Could not create capture file \"" STRREF_FMT "\"", STRREF_ARG(param));
+		}
+	} else if (cmd.same_str("replay")) {
+		strref file = param.split_token_trim(' ');
+		if (!file) {
+			ViceDisconnect();
+		} else if (!ViceReplay(strown<PATH_MAX_LEN>(file).c_str(), !param.same_str("fast"))) {
+			AddLog("Could not replay \"" STRREF_FMT "\", disconnect from VICE first", STRREF_ARG(file));
+		}
+	} else if (cmd.same_str("steptrace")) {
+		if (!param) {
+			ViceStepTraceStop();
+		} else {
+			uint32_t count = (uint32_t)param.atoi_skip();
+			param.skip_whitespace();
+			uint16_t stride = param ? (uint16_t)param.atoi() : 1;
+			if (!ViceStepTrace(count, stride)) {
+				AddLog("Step trace needs VICE connected and stopped");
+			}
+		}
 	} else if (cmd.same_str("pause")) {
 		ViceBreak();
 	} else if (cmd.same_str("eval")) {
@@ -519,6 +548,22 @@ void IceConsole::ExecCommand(const char* command_line)
 			AddLog("  * F[ilter]: remove all non-matching results for another run");
 			AddLog("  * T[race]: add a Trace store for the matching results");
 			AddLog("  * W[atch]: add a Watch store for the matching results");
+		} else if (param.same_str("capture") || param.same_str("replay")) {
+			AddLog("capture / replay commands:");
+			AddLog("  capture <file>");
+			AddLog(" Writes all traffic with VICE to a file until capture");
+			AddLog(" is entered without a file name.");
+			AddLog("  replay <file> [fast]");
+			AddLog(" Sends the responses in a capture to IceBro as if");
+			AddLog(" VICE was connected, with the original timing unless");
+			AddLog(" fast is added. replay without a file stops it.");
+		} else if (param.same_str("steptrace")) {
+			AddLog("steptrace command:");
+			AddLog("  steptrace <count> [<stride>]");
+			AddLog(" Steps VICE and records the registers of count");
+			AddLog(" instructions in the Step trace of the Trace view.");
+			AddLog(" With a stride only every stride instruction is recorded.");
+			AddLog(" steptrace without a count stops it.");
 		} else if(param.same_str("poke")) {
 			AddLog("poke command:");
 			AddLog("  poke <addr>,<byte>");
@@ -530,7 +575,7 @@ void IceConsole::ExecCommand(const char* command_line)
 			AddLog("Vice Console IceBro Commands");
 			AddLog(" connect/cnct [<ip>:<port>] - connect to a remote host, default to 127.0.0.1:6510;");
 			AddLog(" pause; font <size:0-6>; eval <exp>; history/hist;");
-			AddLog(" clear, cwd, poke; remember; forget; match");
+			AddLog(" clear, cwd, poke; remember; forget; match; capture; replay; steptrace");
 			AddLog(" type cmd <command> for more information on some commands.");
 		}
 	}
@@ -205,6 +205,7 @@ void GfxView::WriteConfig(UserData& config)
 	config.AddValue(strref("columnsV20"), v20Columns);
 	config.AddValue(strref("rowsV20"), v20Rows);
 	config.AddValue(strref("doubleHeightV20"), vic20DoubleHeightChars ? 1 : 0);
+	config.AddValue(strref("bank"), bank);
 }
 
 void GfxView::ReadConfig(strref config)
@@ -297,6 +298,10 @@ void GfxView::ReadConfig(strref config)
 		} else if (name.same_str("doubleHeightV20") && type == ConfigParseType::CPT_Value) {
 			vic20DoubleHeightChars = !!value.atoi();
 			reeval = true;
+		} else if (name.same_str("bank") && type == ConfigParseType::CPT_Value) {
+			bank = (int)value.atoi();
+			if (bank < 0 || bank >= kMaxCPUBanks) { bank = 0; }
+			reeval = true;
 		} else if (name.same_str("color") && type == ConfigParseType::CPT_Value) {
 			color = !value.same_str("off");
 		} else if (name.same_str("multicolor") && type == ConfigParseType::CPT_Value) {
@@ -469,6 +474,7 @@ void GfxView::Draw(int index)
 		if (ImGui::Combo(name.c_str(), &displaySystem, "Generic\0C64\0Vic20\0\0")) {
 			SwapSystem();
 		}
+		if (BankCombo(&bank)) { redraw = true; }
 		ImGui::NextColumn();
 
 		int prevMode = displayMode;
@@ -672,7 +678,8 @@ void GfxView::Draw(int index)
 
 	if (HandleContextMenu()) { redraw = true; }
 
-	CPU6510* cpu = GetCurrCPU();
+	// graphics come from the chosen bank, VIC registers from what the CPU sees
+	CPU6510* cpu = GetCPU(VICEMemSpaces::MainMemory, (uint16_t)bank);
 	if (!bitmap || redraw || reeval || cpu->MemoryChange()) {
 		Create8bppBitmap(cpu);
 		reeval = false;
@@ -731,10 +738,10 @@ void GfxView::Draw(int index)
 }
 
 void GfxView::PrintCurrentInfo(CPU6510* cpu, int* hoverPos) {
-	uint16_t vic = (3 ^ (cpu->GetByte(0xdd00) & 3)) * 0x4000;
-	uint8_t d018 = cpu->GetByte(0xd018);
-	uint8_t d011 = cpu->GetByte(0xd011);
-	uint8_t d016 = cpu->GetByte(0xd016);
+	uint16_t vic = (3 ^ (GetMainCPU()->GetByte(0xdd00) & 3)) * 0x4000;
+	uint8_t d018 = GetMainCPU()->GetByte(0xd018);
+	uint8_t d011 = GetMainCPU()->GetByte(0xd011);
+	uint8_t d016 = GetMainCPU()->GetByte(0xd016);
 	uint16_t chars = (d018 & 0xe) * 0x400 + vic;
 	uint16_t screen = (d018 >> 4) * 0x400 + vic;
 	bool mc = (d016 & 0x10) ? true : false;
@@ -840,7 +847,7 @@ void GfxView::Create8bppBitmap(CPU6510* cpu)
 			if (ecbm) {
 				CreateC64ExtBkgTextBitmap(cpu, d, c64pal, addrGfxValue, addrScreenValue, addrColValue, cl, rw, vicColors);
 			} else if (color) {
-				CreateC64ColorTextBitmap(cpu, d, c64pal, addrGfxValue, addrScreenValue, addrColValue, cl, rw, cpu->GetByte(0xd021) & 0xf);
+				CreateC64ColorTextBitmap(cpu, d, c64pal, addrGfxValue, addrScreenValue, addrColValue, cl, rw, GetMainCPU()->GetByte(0xd021) & 0xf);
 			} else if (multicolor) {
 				CreateC64MulticolorTextBitmap(cpu, d, c64pal, addrGfxValue, addrScreenValue, addrColValue, cl, rw, vicColors);
 			} else {
@@ -921,10 +928,10 @@ void GfxView::CreateColumnsBitmap(CPU6510* cpu, uint32_t* d, int linesHigh, uint
 
 void GfxView::CreateC64CurrentBitmap(CPU6510* cpu, uint32_t* d, const uint32_t* pal)
 {
-	uint16_t vic = (3 ^ (cpu->GetByte(0xdd00) & 3)) * 0x4000;
-	uint8_t d018 = cpu->GetByte(0xd018);
-	uint8_t d011 = cpu->GetByte(0xd011);
-	uint8_t d016 = cpu->GetByte(0xd016);
+	uint16_t vic = (3 ^ (GetMainCPU()->GetByte(0xdd00) & 3)) * 0x4000;
+	uint8_t d018 = GetMainCPU()->GetByte(0xd018);
+	uint8_t d011 = GetMainCPU()->GetByte(0xd011);
+	uint8_t d016 = GetMainCPU()->GetByte(0xd016);
 	uint16_t chars = ( d018 & 0xe) * 0x400 + vic;
 	uint16_t screen = (d018 >> 4) * 0x400 + vic;
 	bool mc = (d016 & 0x10) ? true : false;
@@ -941,25 +948,25 @@ void GfxView::CreateC64CurrentBitmap(CPU6510* cpu, uint32_t* d, const uint32_t*
 		if (mc) {
 			CreateC64MulticolorTextBitmap(cpu, d, pal, chars, screen, 0xd800, 40, 25, true);
 		} else {
-			CreateC64ColorTextBitmap(cpu, d, pal, chars, screen, 0xd800, 40, 25, cpu->GetByte(0xd021)&0xf);
+			CreateC64ColorTextBitmap(cpu, d, pal, chars, screen, 0xd800, 40, 25, GetMainCPU()->GetByte(0xd021)&0xf);
 		}
 	}
 
-	uint8_t d015 = cpu->GetByte(0xd015); // enable
-	uint8_t d010 = cpu->GetByte(0xd010); // hi x
-	uint8_t d017 = cpu->GetByte(0xd017); // double width
-	uint8_t d01d = cpu->GetByte(0xd01d); // double height
-	uint8_t d01c = cpu->GetByte(0xd01c); // multicolor
-	uint8_t mcol [3] = { (uint8_t)(cpu->GetByte(0xd025)&0xf), (uint8_t)0, (uint8_t)(cpu->GetByte(0xd026)&0xf) };
+	uint8_t d015 = GetMainCPU()->GetByte(0xd015); // enable
+	uint8_t d010 = GetMainCPU()->GetByte(0xd010); // hi x
+	uint8_t d017 = GetMainCPU()->GetByte(0xd017); // double width
+	uint8_t d01d = GetMainCPU()->GetByte(0xd01d); // double height
+	uint8_t d01c = GetMainCPU()->GetByte(0xd01c); // multicolor
+	uint8_t mcol [3] = { (uint8_t)(GetMainCPU()->GetByte(0xd025)&0xf), (uint8_t)0, (uint8_t)(GetMainCPU()->GetByte(0xd026)&0xf) };
 	int sw = columns * 8;
 	int sh = rows * 8;
 	int w = 40 * 8;
 	for (int s = 7; s >= 0; --s) {
-		uint8_t col = cpu->GetByte(0xd027 + s)&0xf;
+		uint8_t col = GetMainCPU()->GetByte(0xd027 + s)&0xf;
 		mcol[1] = col;
 		if (d015 & (1 << s)) {
-			int x = cpu->GetByte(0xd000 + 2 * s) + (d010 & (1 << s) ? 256 : 0) - 24;
-			int y = cpu->GetByte(0xd001 + 2 * s) - 50;
+			int x = GetMainCPU()->GetByte(0xd000 + 2 * s) + (d010 & (1 << s) ? 256 : 0) - 24;
+			int y = GetMainCPU()->GetByte(0xd001 + 2 * s) - 50;
 			int /*l = 0, r = 0,*/ sy = 0, sx = 0;
 			if (d017 & (1 << s)) { sy = 1; }
 			if (d01d & (1 << s)) { sx = 1; }
@@ -1038,10 +1045,10 @@ void GfxView::CreateC64ExtBkgTextBitmap(CPU6510* cpu, uint32_t* d, const uint32_
 {
 	uint32_t k[4] = { bg, txt_col[1], txt_col[2], txt_col[3] };
 	if (useVicCol) {
-		k[0] = cpu->GetByte(0xd021)&0xf;
-		k[1] = cpu->GetByte(0xd022)&0xf;
-		k[2] = cpu->GetByte(0xd023)&0xf;
-		k[3] = cpu->GetByte(0xd024)&0xf;
+		k[0] = GetMainCPU()->GetByte(0xd021)&0xf;
+		k[1] = GetMainCPU()->GetByte(0xd022)&0xf;
+		k[2] = GetMainCPU()->GetByte(0xd023)&0xf;
+		k[3] = GetMainCPU()->GetByte(0xd024)&0xf;
 	}
 
 	for (size_t y = 0; y < rw; y++) {
@@ -1124,9 +1131,9 @@ void GfxView::CreateC64MulticolorTextBitmap(CPU6510* cpu, uint32_t* d, const uin
 {
 	uint8_t k[4] = { bg, txt_col[0], txt_col[1], 0 };
 	if (useVicCol) {
-		k[0] = cpu->GetByte(0xd021) & 0xf;
-		k[1] = cpu->GetByte(0xd022) & 0xf;
-		k[2] = cpu->GetByte(0xd023) & 0xf;
+		k[0] = GetMainCPU()->GetByte(0xd021) & 0xf;
+		k[1] = GetMainCPU()->GetByte(0xd022) & 0xf;
+		k[2] = GetMainCPU()->GetByte(0xd023) & 0xf;
 		k[3] = 0;
 	}
 
@@ -1202,7 +1209,7 @@ void GfxView::CreateV20TextBitmap(CPU6510* cpu, uint32_t* d, const uint32_t* pal
 
 void GfxView::CreateC64MulticolorBitmapBitmap(CPU6510* cpu, uint32_t* d, const uint32_t* pal, uint16_t a, uint16_t s, uint16_t cm, size_t cl, uint32_t rw)
 {
-	uint8_t k = cpu->GetByte(0xd021) & 15;
+	uint8_t k = GetMainCPU()->GetByte(0xd021) & 15;
 	for (size_t y = 0; y < rw; y++) {
 		for (size_t x = 0; x < cl; x++) {
 			uint8_t sc = cpu->GetByte(s++);
@@ -1260,9 +1267,9 @@ void GfxView::CreateC64SpritesMCBitmap(CPU6510* cpu, uint32_t* d, int linesHigh,
 	int sy = linesHigh / 21;
 	uint32_t cols[4] = { bg, spr_col[1], spr_col[0], spr_col[2] };
 	if (vicColors) {
-		cols[0] = cpu->GetByte(0xd020)&0xf;
-		cols[1] = cpu->GetByte(0xd025)&0xf;
-		cols[3] = cpu->GetByte(0xd026)&0xf;
+		cols[0] = GetMainCPU()->GetByte(0xd020)&0xf;
+		cols[1] = GetMainCPU()->GetByte(0xd025)&0xf;
+		cols[3] = GetMainCPU()->GetByte(0xd026)&0xf;
 	}
 	for (size_t y = 0; y < (size_t)sy; y++) {
 		for (size_t x = 0; x < (size_t)sx; x++) {
@@ -1284,7 +1291,7 @@ void GfxView::CreateC64SpritesMCBitmap(CPU6510* cpu, uint32_t* d, int linesHigh,
 
 void GfxView::CreateC64ColorTextColumns(CPU6510* cpu, uint32_t* d, const uint32_t* pal, uint16_t g, uint16_t a, uint16_t f, size_t cl, uint32_t rw)
 {
-	uint8_t k[4] = { uint8_t(cpu->GetByte(0xd021) & 0xf), uint8_t(cpu->GetByte(0xd022) & 0xf), uint8_t(cpu->GetByte(0xd023) & 0xf), 0 };
+	uint8_t k[4] = { uint8_t(GetMainCPU()->GetByte(0xd021) & 0xf), uint8_t(GetMainCPU()->GetByte(0xd022) & 0xf), uint8_t(GetMainCPU()->GetByte(0xd023) & 0xf), 0 };
 	for (size_t x = 0; x < cl; x++) {
 		uint32_t* o = d + x * 8;
 		for (size_t y = 0; y < rw; y++) {
@@ -1315,7 +1322,7 @@ void GfxView::CreateC64ColorTextColumns(CPU6510* cpu, uint32_t* d, const uint32_
 
 
 
-GfxView::GfxView() : open(false), reeval(false), color(false), multicolor(false), useRomFont(true), bitmapWidth(0)
+GfxView::GfxView() : bank(0), open(false), reeval(false), color(false), multicolor(false), useRomFont(true), bitmapWidth(0)
 {
 	addrScreenValue = 0x0400;
 	addrGfxValue = 0x1000;
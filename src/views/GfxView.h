@@ -71,6 +71,7 @@ struct GfxView {
 	int c64Mode;
 	int vic20Mode;
 	bool vic20DoubleHeightChars;
+	int bank;	// VICE bank id the graphics are read from
 
 	uint16_t hoverScreenAddr;
 	uint16_t hoverGfxAddr;
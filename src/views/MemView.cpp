@@ -10,9 +10,12 @@
 #include "../ImGui_Helper.h"
 #include "../imgui/imgui_internal.h"
 #include "../Sym.h"
+#include "../MemHistory.h"
+#include "../Breakpoints.h"
+#include "../C64Colors.h"
 #include "GLFW/glfw3.h"
 
-MemView::MemView() : fixedAddress(false), open(false), evalAddress(false)
+MemView::MemView() : memSpace(0), bank(0), historyBack(0), fixedAddress(false), open(false), evalAddress(false), showChanges(false)
 {
 	SetAddr(0x400);
 
@@ -56,8 +59,8 @@ void MemView::SetAddr(uint16_t addr)
 
 void MemView::Draw(int index)
 {
-	CPU6510* cpu = GetCurrCPU();
 	if (!open) { return; }
+	CPU6510* cpu = GetCPU((VICEMemSpaces)memSpace, (uint16_t)bank);	// creates a drive or bank CPU, only for views that are open
 	{
 		strown<64> title("Mem");
 		title.append_num(index+1, 1, 10);
@@ -136,6 +139,34 @@ void MemView::Draw(int index)
 		ImGui::Checkbox("text", &showText);
 		ImGui::SameLine();
 		ImGui::Checkbox("case", &textLowercase);
+		ImGui::SameLine();
+		MemSpaceCombo(&memSpace);
+		if (memSpace == (int)VICEMemSpaces::MainMemory) {
+			ImGui::SameLine();
+			BankCombo(&bank);
+		}
+		// earlier stops of the main memory from MemHistory
+		if (!cpu->OnDemand()) {
+			ImGui::Checkbox("changes", &showChanges);
+			int stops = MemHistoryCount();
+			if (historyBack >= stops) { historyBack = stops ? (stops - 1) : 0; }
+			if (stops > 1) {
+				uint32_t stop = 0;
+				uint16_t pc = 0;
+				MemHistoryInfo(historyBack, &stop, &pc);
+				strown<64> label;
+				if (historyBack) { label.sprintf("stop %u pc $%04x (-%d)", stop, pc, historyBack); }
+				else { label.copy("current"); }
+				ImGui::SameLine();
+				ImGui::SetNextItemWidth(-1.0f);
+				int scrub = -historyBack;
+				if (ImGui::SliderInt("##history", &scrub, 1 - stops, 0, label.c_str(), ImGuiSliderFlags_AlwaysClamp)) {
+					historyBack = -scrub;
+				}
+			}
+		} else {
+			historyBack = 0;
+		}
 	}
 	ImGui::BeginChild(ImGui::GetID("hexEdit"));
 
@@ -241,24 +272,81 @@ void MemView::Draw(int index)
 
 		strown<1024> line;
 		uint16_t read = addrValue;
+		bool connected = ViceConnected();
+		bool history = !cpu->OnDemand() && (historyBack || showChanges) && spanWin <= kMaxHistorySpan;
+		uint8_t lineBytes[kMaxHistorySpan], lineChanged[kMaxHistorySpan];
 		for(int lineNum = 0; lineNum < lines; ++lineNum) {
+			// lines that VICE has not sent since the last stop are dimmed
+			bool pending = connected && !cpu->RangeFresh(read, spanWin);
+			bool fromHistory = false;
+			if (history) {
+				bool known = true;
+				if (!MemHistoryRead(historyBack, read, spanWin, lineBytes, lineChanged, &known)) {
+					memset(lineChanged, 0, spanWin);
+				} else if (historyBack) {
+					fromHistory = true;
+					pending = !known;
+				}
+			}
 			line.clear();
 			if (showAddress) { line.append_num(read, 4, 16).append(' ');  }
 			if (showHex) {
 				uint16_t bytes = read;
 				for (uint32_t c = 0; c<spanWin; ++c) {
-					line.append_num(cpu->GetByte(bytes++), 2, 16).append(' ');
+					line.append_num(fromHistory ? lineBytes[c] : cpu->GetByte(bytes), 2, 16).append(' ');
+					++bytes;
 				}
 			}
 			if (showText && petsciiFont<0) {
 				uint16_t chars = read;
 				uint32_t base = textLowercase ? (uint32_t)0xee00 : (uint32_t)0xef00;
 				for (uint32_t c = 0; c<spanWin; ++c) {
-					uint32_t code = base + cpu->GetByte(chars++);
+					uint32_t code = base + (fromHistory ? lineBytes[c] : cpu->GetByte(chars));
 					line.push_utf8(code);
+					++chars;
+				}
+			}
+			if (history && showChanges) {
+				// mark bytes that changed since the previous stop behind the text
+				ImVec2 pos = ImGui::GetCursorScreenPos();
+				ImU32 mark = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
+				float hexX = showAddress ? 5.0f : 0.0f;
+				float textX = hexX + (showHex ? 3.0f * spanWin : 0.0f);
+				for (uint32_t c = 0; c < spanWin; ++c) {
+					if (!lineChanged[c]) { continue; }
+					if (showHex) {
+						float x = pos.x + (hexX + 3.0f * c) * fontWidth;
+						ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(x, pos.y), ImVec2(x + 2.0f * fontWidth, pos.y + fontHgt), mark);
+					}
+					if (showText && petsciiFont < 0) {
+						float x = pos.x + (textX + c) * fontWidth;
+						ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(x, pos.y), ImVec2(x + fontWidth, pos.y + fontHgt), mark);
+					}
+				}
+			}
+			if (cpu->space == VICEMemSpaces::MainMemory) {
+				// underline bytes that a watch (red) or trace (cyan) checkpoint covers
+				ImVec2 pos = ImGui::GetCursorScreenPos();
+				ImU32 watch = ImGui::GetColorU32(C64_RED), trace = ImGui::GetColorU32(C64_CYAN);
+				float hexX = showAddress ? 5.0f : 0.0f;
+				float textX = hexX + (showHex ? 3.0f * spanWin : 0.0f);
+				float y = pos.y + fontHgt - 2.0f;
+				for (uint32_t c = 0; c < spanWin; ++c) {
+					uint8_t flags = BreakpointFlagsAt((uint16_t)(read + c));
+					if (!(flags & (BPMap_Load | BPMap_Store))) { continue; }
+					ImU32 mark = (flags & BPMap_Stop) ? watch : trace;
+					if (showHex) {
+						float x = pos.x + (hexX + 3.0f * c) * fontWidth;
+						ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(x, y), ImVec2(x + 2.0f * fontWidth, y + 2.0f), mark);
+					}
+					if (showText && petsciiFont < 0) {
+						float x = pos.x + (textX + c) * fontWidth;
+						ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(x, y), ImVec2(x + fontWidth, y + 2.0f), mark);
+					}
 				}
 			}
-			ImGui::Text("%s", line.c_str());
+			if (pending) { ImGui::TextDisabled("%s", line.c_str()); }
+			else { ImGui::Text("%s", line.c_str()); }
 			if (showText && petsciiFont >= 0) {
 				float yPos = ImGui::GetCursorPosY();
 				ImGui::SameLine();
@@ -267,9 +355,11 @@ void MemView::Draw(int index)
 				line.clear();
 				uint16_t chars = read;
 				for (uint32_t c = 0; c < spanWin; ++c) {
-					line.push_utf8((textLowercase ? 0xee00 : 0xef00) + cpu->GetByte(chars++));
+					line.push_utf8((textLowercase ? 0xee00 : 0xef00) + (fromHistory ? lineBytes[c] : cpu->GetByte(chars)));
+					++chars;
 				}
-				ImGui::Text("%s", line.c_str());
+				if (pending) { ImGui::TextDisabled("%s", line.c_str()); }
+				else { ImGui::Text("%s", line.c_str()); }
 				ImGui::PopFont();
 				ImGui::SetCursorPosY(yPos);
 			}
@@ -278,8 +368,8 @@ void MemView::Draw(int index)
 			read += spanWin;
 		}
 
-		// keyboard
-		if (active && showHex) {
+		// keyboard, earlier stops can't be edited
+		if (active && showHex && !historyBack) {
 			int col0 = 0;
 			int colT = spanWin * 2;
 			if (showHex && cursor[0]<colT) {
@@ -342,6 +432,9 @@ void MemView::WriteConfig(UserData& config)
 	config.AddValue(strref("showAddress"), config.OnOff(showAddress));
 	config.AddValue(strref("showHex"), config.OnOff(showHex));
 	config.AddValue(strref("showText"), config.OnOff(showText));
+	config.AddValue(strref("memSpace"), memSpace);
+	config.AddValue(strref("bank"), bank);
+	config.AddValue(strref("showChanges"), config.OnOff(showChanges));
 }
 
 void MemView::ReadConfig(strref config)
@@ -355,6 +448,14 @@ void MemView::ReadConfig(strref config)
 		} else if (name.same_str("address")&&type== ConfigParseType::CPT_Value) {
 			strovl addr(address, sizeof(address));
 			addr.copy(value); addr.c_str(); evalAddress = true;
+		} else if (name.same_str("memSpace") && type == ConfigParseType::CPT_Value) {
+			memSpace = (int)value.atoi();
+			if (memSpace < 0 || memSpace > (int)VICEMemSpaces::Drive11) { memSpace = 0; }
+		} else if (name.same_str("showChanges") && type == ConfigParseType::CPT_Value) {
+			showChanges = !value.same_str("Off");
+		} else if (name.same_str("bank") && type == ConfigParseType::CPT_Value) {
+			bank = (int)value.atoi();
+			if (bank < 0 || bank >= kMaxCPUBanks) { bank = 0; }
 		} else if (name.same_str("span")&&type== ConfigParseType::CPT_Value) {
 			strovl spn(span, sizeof(span));
 			spn.copy(value); spn.c_str(); evalAddress = true;
@@ -4,6 +4,8 @@
 struct UserData;
 
 struct MemView {
+	enum { kMaxHistorySpan = 256 };
+
 	char address[128];
 	char span[16];
 
@@ -11,6 +13,9 @@ struct MemView {
 	uint32_t spanValue;
 
 	int cursor[2];
+	int memSpace;	// VICEMemSpaces
+	int bank;		// VICE bank id of main memory
+	int historyBack;	// stops back in MemHistory, 0 = current
 
 	MemView();
 
@@ -30,6 +35,7 @@ struct MemView {
 	bool open;
 	bool evalAddress;
 	bool textLowercase;
+	bool showChanges;	// mark bytes changed since the previous stop
 
 	bool dragging;
 
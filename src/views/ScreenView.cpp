@@ -1,5 +1,6 @@
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
 #include "../imgui/imgui.h"
 #include "../imgui/imgui_internal.h"
 #include "../Image.h"
@@ -39,6 +40,7 @@ void ScreenView::ReadConfig(strref config)
 
 void ScreenView::Draw()
 {
+	visible = false;
 	if (!open) { return; }
 
 	ImGui::SetNextWindowPos(ImVec2(400, 150), ImGuiCond_FirstUseEver);
@@ -47,6 +49,7 @@ void ScreenView::Draw()
 		ImGui::End();
 		return;
 	}
+	visible = true;
 
 	ImVec2 cursorTop = ImGui::GetCursorPos();
 
@@ -57,6 +60,7 @@ void ScreenView::Draw()
 		if (texture) {
 			SelectTexture(texture);
 			UpdateTextureData(width, height, bitmap);
+			refresh = false;
 		}
 	}
 
@@ -155,36 +159,45 @@ void ScreenView::Draw()
 ScreenView::~ScreenView()
 {
 	if (bitmap) { free(bitmap); }
+	if (indexed) { free(indexed); }
 	bitmap = nullptr;
+	indexed = nullptr;
 }
 
 void ScreenView::Refresh(uint8_t* img, uint16_t w, uint16_t h,
 	uint16_t sx, uint16_t sy, uint16_t sw, uint16_t sh)
 {
 	offs_x = sx; offs_y = sy; scrn_w = sw; scrn_h = sh;
+	size_t pixels = (size_t)w * (size_t)h;
 	if (bitmap && ((width != w) || (height != h))) {
 		free(bitmap);
+		free(indexed);
 		bitmap = nullptr;
+		indexed = nullptr;
 	}
 	if (!bitmap) {
-		bitmapSize = (size_t)w * (size_t)h * 4;
+		bitmapSize = pixels * 4;
 		bitmap = (uint8_t*)calloc(1, bitmapSize);
+		indexed = (uint8_t*)malloc(pixels);
+		if (!bitmap || !indexed) {
+			free(bitmap);
+			free(indexed);
+			bitmap = nullptr;
+			indexed = nullptr;
+		}
+	} else if (memcmp(indexed, img, pixels) == 0) {
+		return;	// same frame, f.e. stepping code that doesn't draw
 	}
 	if (bitmap) {
 		width = w;
 		height = h;
-//		memcpy(bitmap, img, bitmapSize);
-		uint32_t* bo = (uint32_t*)bitmap;
-		for (int y = 0; y < h; ++y) {
-			for (int x = 0; x < w; ++x) {
-				*bo++ = c64pal[(*img++)&0xf];
-			}
-		}
+		memcpy(indexed, img, pixels);
+		ExpandPalette(img, (uint32_t*)bitmap, pixels, c64pal);
 		refresh = true;
 	}
 }
 
-ScreenView::ScreenView() : bitmap(nullptr), bitmapSize(0), width(0), height(0), open(true), refresh(false), drawRasterTime(false)
+ScreenView::ScreenView() : bitmap(nullptr), bitmapSize(0), indexed(nullptr), width(0), height(0), open(true), visible(false), refresh(false), drawRasterTime(false)
 {
 	offs_x = 0;
 	offs_y = 0;
@@ -8,6 +8,7 @@ struct UserData;
 struct ScreenView {
 	uint8_t* bitmap;
 	size_t bitmapSize;
+	uint8_t* indexed;	// last image from VICE, an identical one is not uploaded again
 
 	enum class BorderMode {
 		Full,
@@ -21,6 +22,7 @@ struct ScreenView {
 
 	ImTextureID texture;
 	bool open;
+	bool visible;	// drawn last frame, VICE display is only fetched while visible
 	bool refresh;
 	bool drawRasterTime;
 
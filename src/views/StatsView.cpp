@@ -0,0 +1,123 @@
+#include <inttypes.h>
+#include "../imgui/imgui.h"
+#include "../struse/struse.h"
+#include "../Config.h"
+#include "../ViceInterface.h"
+#include "../ViceStats.h"
+#include "../FileDialog.h"
+#include "Views.h"
+#include "StatsView.h"
+
+StatsView::StatsView() : open(false)
+{
+}
+
+void StatsView::WriteConfig(UserData& config)
+{
+	config.AddValue(strref("open"), config.OnOff(open));
+}
+
+void StatsView::ReadConfig(strref config)
+{
+	ConfigParse conf(config);
+	while (!conf.Empty()) {
+		strref name, value;
+		ConfigParseType type = conf.Next(&name, &value);
+		if (name.same_str("open") && type == ConfigParseType::CPT_Value) {
+			open = !value.same_str("Off");
+		}
+	}
+}
+
+static void TextBytes(uint64_t bytes)
+{
+	if (bytes >= (1024 * 1024)) { ImGui::Text("%.1fM", bytes / (1024.0 * 1024.0)); }
+	else if (bytes >= 1024) { ImGui::Text("%.1fK", bytes / 1024.0); }
+	else { ImGui::Text("%u", (uint32_t)bytes); }
+}
+
+void StatsView::Draw()
+{
+	if (!open) { return; }
+	ImGui::SetNextWindowPos(ImVec2(400, 150), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(720, 400), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Connection Stats", &open)) {
+		ImGui::End();
+		return;
+	}
+
+	static ViceCommandStats commands[256];
+	ViceStatsTotals totals;
+	ViceStatsGet(totals, commands);
+
+	if (ImGui::Button("Reset")) { ViceStatsReset(); }
+	ImGui::SameLine();
+	if (ImGui::Button("Export JSON")) { SaveStatsDialog(); }
+	ImGui::SameLine();
+	ImGui::Text("Sent %u, received %u, timeouts %u, in flight %u (max %u), out %.1fK, in %.1fK",
+		totals.sent, totals.received, totals.timeouts, totals.inFlight, totals.maxInFlight,
+		totals.bytesOut / 1024.0, totals.bytesIn / 1024.0);
+
+	const ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_ScrollY;
+
+	float fontHgt = ImGui::GetFont()->FontSize;
+	if (ImGui::BeginTable("##statstable", 9, flags)) {
+		ImGui::TableSetupColumn("Command", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Sent", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Recv", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Timeouts", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Out", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("In", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Avg ms", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Max ms", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Round trips", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupScrollFreeze(0, 1); // Make row always visible
+		ImGui::TableHeadersRow();
+
+		for (int c = 0, n = ViceBinCmdCount(); c < n; ++c) {
+			uint8_t id = ViceBinCmdID(c);
+			const ViceCommandStats& cmd = commands[id];
+			if (!cmd.sent && !cmd.received) { continue; }
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::TextUnformatted(ViceBinCmdName(id));
+			ImGui::TableSetColumnIndex(1);
+			ImGui::Text("%u", cmd.sent);
+			ImGui::TableSetColumnIndex(2);
+			ImGui::Text("%u", cmd.received);
+			ImGui::TableSetColumnIndex(3);
+			ImGui::Text("%u", cmd.timeouts);
+			ImGui::TableSetColumnIndex(4);
+			TextBytes(cmd.bytesOut);
+			ImGui::TableSetColumnIndex(5);
+			TextBytes(cmd.bytesIn);
+			ImGui::TableSetColumnIndex(6);
+			if (cmd.roundTrips) { ImGui::Text("%.2f", cmd.totalUs / (1000.0 * cmd.roundTrips)); }
+			ImGui::TableSetColumnIndex(7);
+			if (cmd.roundTrips) { ImGui::Text("%.2f", cmd.maxUs / 1000.0); }
+			ImGui::TableSetColumnIndex(8);
+			if (cmd.roundTrips) {
+				float buckets[ViceStats_Buckets];
+				for (int b = 0; b < ViceStats_Buckets; ++b) { buckets[b] = (float)cmd.histogram[b]; }
+				ImGui::PushID(c);
+				ImGui::PlotHistogram("##rt", buckets, ViceStats_Buckets, 0, nullptr, 0.0f, FLT_MAX, ImVec2(-FLT_MIN, fontHgt));
+				if (ImGui::IsItemHovered()) {
+					ImGui::BeginTooltip();
+					for (int b = 0; b < ViceStats_Buckets; ++b) {
+						if (!cmd.histogram[b]) { continue; }
+						if (b < (ViceStats_Buckets - 1)) { ImGui::Text("< %gms: %u", ViceStatsBucketMs(b), cmd.histogram[b]); }
+						else { ImGui::Text(">= %gms: %u", ViceStatsBucketMs(b - 1), cmd.histogram[b]); }
+					}
+					ImGui::EndTooltip();
+				}
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,12 @@
+#pragma once
+struct UserData;
+
+// round trip times and traffic of the VICE connection per command type
+struct StatsView {
+	bool open;
+
+	StatsView();
+	void WriteConfig(UserData& config);
+	void ReadConfig(strref config);
+	void Draw();
+};
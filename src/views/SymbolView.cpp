@@ -62,28 +62,32 @@ void SymbolView::Draw()
         return;
     }
 
+    bool search = false;
     if (ImGui::InputText("Search", searchField, kSearchFieldSize)) {
-        SearchSymbols(searchField, case_sensitive);
+        search = true;
     }
     ImGui::SameLine();
     if (ImGui::RadioButton("case", case_sensitive)) {
         case_sensitive = !case_sensitive;
-        SearchSymbols(searchField, case_sensitive);
+        search = true;
     }
     ImGui::Columns(2);
     if (ImGui::InputText("start", startStr, sizeof(startStr))) {
         LimitHexStr(startStr, sizeof(startStr));
         if (*startStr == '$') { start = (uint32_t)strref(startStr + 1).ahextoui(); }
-        else { start = (uint32_t)strref(startStr + 1).atoui();  }
+        else { start = (uint32_t)strref(startStr).atoui();  }
+        search = true;
     }
     ImGui::NextColumn();
     if (ImGui::InputText("end", endStr, sizeof(endStr))) {
         LimitHexStr(endStr, sizeof(endStr));
         if (*endStr == '$') { end = (uint32_t)strref(endStr + 1).ahextoui(); }
         else if (*endStr == 0) { end = 0xffffffff; }
-        else{ end = (uint32_t)strref(startStr + 1).atoui(); }
+        else{ end = (uint32_t)strref(endStr).atoui(); }
+        search = true;
     }
     ImGui::Columns(1);
+    if (search) { SearchSymbols(searchField, case_sensitive, start, end); }
 
     const ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
         ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable | ImGuiTableFlags_Sortable |
@@ -102,40 +106,47 @@ void SymbolView::Draw()
             if (sorts_specs->SpecsDirty) {
                 sorts_specs->SpecsDirty = false;
                 SortSymbols(sorts_specs->Specs->SortDirection == ImGuiSortDirection_Ascending, sorts_specs->Specs->ColumnUserID == SymbolColumnID_Symbol);
-                SearchSymbols(searchField, case_sensitive);
             }
         }
 
-        for (size_t s = 0, n = NumSymbolSearchMatches(); s < n; ++s) {
-            const char* section;
-            uint32_t address;
-            const char* symbol = GetSymbolSearchMatch(s, &address, &section);
-            if (address < start || address > end) { continue; }
-            if (symbol) {
-                ImGui::TableNextRow(s==1 ? ImGuiTableBgTarget_RowBg1 : 0);
-                ImGui::TableSetColumnIndex(0);
-
-                strown<16> str;
-                str.append('$').append_num(address, address < 0x10000 ? 4 : 0, 16);
-                ImGui::Text("%s", str.c_str());
-
-                ImGui::TableSetColumnIndex(1);
-                ImGui::Text("%s", symbol);
-
-                if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_SourceAllowNullID)) {
-                    SymbolDragDrop drag;
-                    drag.address = address;
-                    strovl lblStr(drag.symbol, sizeof(drag.symbol));
-                    lblStr.copy(symbol); lblStr.c_str();
-                    ImGui::SetDragDropPayload("AddressDragDrop", &drag, sizeof(drag));
-                    ImGui::Text("%s: $%04x", symbol, address);
-                    ImGui::EndDragDropSource();
+        // only the rows in view are fetched
+        enum { kRowsPerFetch = 64 };
+        SymbolSearchMatch rows[kRowsPerFetch];
+        ImGuiListClipper clipper;
+        clipper.Begin((int)NumSymbolSearchMatches());
+        while (clipper.Step()) {
+            for (int first = clipper.DisplayStart; first < clipper.DisplayEnd; first += kRowsPerFetch) {
+                int want = clipper.DisplayEnd - first < kRowsPerFetch ? clipper.DisplayEnd - first : kRowsPerFetch;
+                size_t count = GetSymbolSearchMatches((size_t)first, (size_t)want, rows);
+                for (size_t r = 0; r < count; ++r) {
+                    const char* symbol = rows[r].symbol;
+                    uint32_t address = rows[r].address;
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+
+                    strown<16> str;
+                    str.append('$').append_num(address, address < 0x10000 ? 4 : 0, 16);
+                    ImGui::Text("%s", str.c_str());
+
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::Text("%s", symbol);
+
+                    if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_SourceAllowNullID)) {
+                        SymbolDragDrop drag;
+                        drag.address = address;
+                        strovl lblStr(drag.symbol, sizeof(drag.symbol));
+                        lblStr.copy(symbol); lblStr.c_str();
+                        ImGui::SetDragDropPayload("AddressDragDrop", &drag, sizeof(drag));
+                        ImGui::Text("%s: $%04x", symbol, address);
+                        ImGui::EndDragDropSource();
+                    }
+
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%s", rows[r].section);
                 }
-
-                ImGui::TableSetColumnIndex(2);
-                ImGui::Text("%s", section);
             }
         }
+        clipper.End();
 
         ImGui::EndTable();
     }
@@ -6,7 +6,9 @@
 #include "../Config.h"
 #include "../FileDialog.h"
 #include "../Sym.h"
+#include "../SymbolLoad.h"
 #include "../StartVice.h"
+#include "../StepBack.h"
 #include "ToolBar.h"
 
 ToolBar::ToolBar() : open(true) {}
@@ -57,7 +59,7 @@ void ToolBar::Draw()
 		return;
 	}
 
-	ImGui::Columns(10, 0, false);
+	ImGui::Columns(11, 0, false);
 
 	bool connected = ViceConnected();
 	bool playing = connected && ViceRunning();
@@ -87,6 +89,13 @@ void ToolBar::Draw()
 
 	ImGui::NextColumn();
 
+	bool canStepBack = StepBackAvailable();
+	bool stepBack = DrawTexturedIconCenter(ViceMonIcons::VMI_Step, true, -1.0f, canStepBack ? C64_WHITE : C64_LGRAY);
+	stepBack = CenterTextButtonInColumn("Step Back") || stepBack;
+	CenterTextonInColumn("Ctrl+F11");
+
+	ImGui::NextColumn();
+
 	bool load = DrawTexturedIconCenter(ViceMonIcons::VMI_Load);
 	load = CenterTextButtonInColumn("Load") || load;
 
@@ -97,7 +106,14 @@ void ToolBar::Draw()
 
 	ImGui::NextColumn();
 
-	bool reload_info = CenterTextButtonInColumn("Reload\nDebug\nInfo");
+	bool reload_info = false;
+	float loadProgress;
+	const char* loadStage;
+	if (SymbolLoadProgress(loadProgress, loadStage)) {
+		ImGui::ProgressBar(loadProgress, ImVec2(-1.0f, 0.0f), loadStage);
+	} else {
+		reload_info = CenterTextButtonInColumn("Reload\nDebug\nInfo");
+	}
 
 	ImGui::NextColumn();
 
@@ -126,7 +142,7 @@ void ToolBar::Draw()
 	if (stepOver) { ViceStepOver(); }
 	if (stepOut) { ViceStepOut(); }
 
-//	if (stepBack && !ViceRunning()) { CPUStepBack(); }
+	if (stepBack && canStepBack) { CPUStepBack(); }
 
 	if (connect) {
 		if (ViceConnected()) {
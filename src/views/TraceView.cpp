@@ -7,6 +7,7 @@
 #include "../6510.h"
 #include "../Mnemonics.h"
 #include "../Traces.h"
+#include "../TraceQuery.h"
 #include "../ViceInterface.h"
 #include "Views.h"
 #include "TraceView.h"
@@ -19,11 +20,19 @@
 TraceView::TraceView() : lastDrawnRows(1), row(0), open(false), mouseDrag(false), mouseWheelDiff(0)
 {
 	tracePointNum = ~(size_t)0;
+	query[0] = 0;
+	queryError[0] = 0;
 }
 
+enum {
+	kMaxTraceRows = 256,	// rows read for one frame
+	kMinScrollBar = 8
+};
+
 void TraceView::WriteConfig(UserData& config)
 {
 	config.AddValue(strref("open"), config.OnOff(open));
+	config.AddValue(strref("memoryMB"), (int)(GetTraceMemoryBudget() >> 20));
 }
 
 void TraceView::ReadConfig(strref config)
@@ -34,6 +43,8 @@ void TraceView::ReadConfig(strref config)
 		ConfigParseType type = conf.Next(&name, &value);
 		if (name.same_str("open") && type == ConfigParseType::CPT_Value) {
 			open = !value.same_str("Off");
+		} else if (name.same_str("memoryMB") && type == ConfigParseType::CPT_Value) {
+			if (int mb = (int)value.atoi()) { SetTraceMemoryBudget((size_t)mb << 20); }
 		}
 	}
 }
@@ -53,17 +64,19 @@ void TraceView::Draw()
 
 	size_t numTraceIds = NumTracePointIds();
 	if (numTraceIds == 0) {
-		ImGui::Text("Create a trace in the Console\nby entering tr <addr> [<addr2>]");
+		ImGui::Text("Create a trace in the Console\nby entering tr <addr> [<addr2>]\nor steptrace <count>");
 	} else {
 		strown<16> idStr;
 		if (tracePointNum >= 0 && tracePointNum < numTraceIds) {
-			idStr.append_num(GetTracePointId(tracePointNum), 0, 10);
+			if (GetTracePointId(tracePointNum) == kStepTraceId) { idStr.copy("Step"); }
+			else { idStr.append_num(GetTracePointId(tracePointNum), 0, 10); }
 		} else { idStr.copy("?"); }
 		if (ImGui::BeginCombo("Trace #", idStr.c_str())) {
 			for (size_t i = 0; i < numTraceIds; ++i) {
 				const bool is_selected = (tracePointNum == i);
 				idStr.clear();
-				idStr.append_num(GetTracePointId(i), 0, 10);
+				if (GetTracePointId(i) == kStepTraceId) { idStr.copy("Step"); }
+				else { idStr.append_num(GetTracePointId(i), 0, 10); }
 				if (ImGui::Selectable(idStr.c_str(), is_selected)) {
 					tracePointNum = i;
 				}
@@ -80,10 +93,45 @@ void TraceView::Draw()
 //		ImGui::SameLine();
 		if (ImGui::SmallButton("Clear")) {
 			ClearTrace(tracePointNum);
+			ClearTraceQuery();
 			if (tracePointNum) { --tracePointNum; }
 		}
 
-		size_t numHits = NumTraceHits(tracePointNum);
+		ImGui::SameLine();
+		if (ImGui::InputText("Query", query, sizeof(query), ImGuiInputTextFlags_EnterReturnsTrue)) {
+			queryError[0] = 0;
+			row = 0;
+			if (!query[0]) { ClearTraceQuery(); }
+			else if (tracePointNum < NumTracePointIds()) {
+				StartTraceQuery(GetTracePointId(tracePointNum), query, queryError, sizeof(queryError));
+			}
+		}
+		if (ImGui::IsItemHovered() && !ImGui::IsItemActive()) {
+			ImGui::SetTooltip("filter [| group column [column]]\n"
+							  "pc in $c000-$c0ff && a == $10\naddr == $d418 && !(a & $0f)\n"
+							  "| group frame\n| group line a\n"
+							  "columns: pc addr a x y sp fl line cycle frame sw");
+		}
+
+		// a query on this trace shows the matching hits or the groups instead of all hits
+		TraceQueryStatus status = GetTraceQueryStatus();
+		bool queried = TraceQueryActive() && TraceQueryTracePoint() == GetTracePointId(tracePointNum);
+		bool grouped = queried && status.groupColumn >= 0;
+		if (queryError[0]) {
+			ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", queryError);
+		} else if (queried) {
+			ImGui::Text("%s %d of %d hits: %d %s", status.running ? "Scanning" : "Scanned", (int)status.scanned,
+						(int)status.total, (int)(grouped ? status.groups : status.matches), grouped ? "groups" : "matches");
+			ImGui::SameLine();
+			if (status.running && ImGui::SmallButton("Stop")) { StopTraceQuery(); }
+			else if (!status.running && ImGui::SmallButton("All hits")) {
+				ClearTraceQuery();
+				queried = grouped = false;
+				row = 0;
+			}
+		}
+
+		size_t numHits = grouped ? status.groups : (queried ? status.matches : NumTraceHits(tracePointNum));
 
 		const ImGuiTableFlags flags = /*ImGuiTableFlags_Borders |*/ ImGuiTableFlags_RowBg |
 			ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable |
@@ -120,9 +168,62 @@ void TraceView::Draw()
 			row = (size_t)lastDrawnRows < numHits ? (int)(numHits - lastDrawnRows) : 0;
 		}
 
-		size_t r = row;
+		// the visible rows are read together, without locking
+		static TraceHit hits[kMaxTraceRows];
+		static uint32_t hitIndex[kMaxTraceRows];
+		static TraceQueryGroup groups[kMaxTraceRows];
+		size_t numRead = 0;
+		if (grouped) {
+			numRead = GetTraceQueryGroups((size_t)row, kMaxTraceRows, groups);
+		} else if (queried) {
+			numRead = GetTraceQueryMatches((size_t)row, kMaxTraceRows, hitIndex);
+			for (size_t m = 0; m < numRead; ++m) { hits[m] = GetTraceHit((int)tracePointNum, hitIndex[m]); }
+		} else {
+			numRead = GetTraceHits((int)tracePointNum, (size_t)row, kMaxTraceRows, hits);
+			for (size_t m = 0; m < numRead; ++m) { hitIndex[m] = (uint32_t)(row + m); }
+		}
+		size_t r = 0;
+
+		if (grouped && ImGui::BeginTable("##tracegroups", status.valueColumn >= 0 ? 5 : 3, flags)) {
+			strown<32> valueName(TraceColumnName(status.valueColumn));
+			ImGui::TableSetupColumn(TraceColumnName(status.groupColumn), ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("hits", ImGuiTableColumnFlags_WidthFixed);
+			if (status.valueColumn >= 0) {
+				ImGui::TableSetupColumn(strown<32>("min ").append(valueName.get_strref()).c_str(), ImGuiTableColumnFlags_WidthFixed);
+				ImGui::TableSetupColumn(strown<32>("max ").append(valueName.get_strref()).c_str(), ImGuiTableColumnFlags_WidthFixed);
+			}
+			ImGui::TableSetupColumn("first hit", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableHeadersRow();
 
-		if (ImGui::BeginTable("##tracetable", 4, flags)) {
+			while (r < numRead) {
+				if (ImGui::GetCursorPosY() > (winSize.y - 15.0f)) { break; }
+				ImGui::TableNextRow();
+				const TraceQueryGroup& group = groups[r++];
+				strown<64> str;
+				ImGui::TableSetColumnIndex(0);
+				str.append_num(group.key, 0, 16);
+				// selecting a group shows all hits from its first one
+				if (ImGui::Selectable(str.c_str(), false, ImGuiSelectableFlags_SpanAllColumns)) {
+					ClearTraceQuery();
+					row = (int)group.firstHit;
+				}
+				ImGui::TableSetColumnIndex(1);
+				ImGui::Text("%u", group.hits);
+				if (status.valueColumn >= 0) {
+					ImGui::TableSetColumnIndex(2);
+					ImGui::Text("%x", group.min);
+					ImGui::TableSetColumnIndex(3);
+					ImGui::Text("%x", group.max);
+				}
+				ImGui::TableSetColumnIndex(status.valueColumn >= 0 ? 4 : 2);
+				ImGui::Text("%u", group.firstHit);
+				++numRows;
+			}
+			lastDrawnRows = (int)(numRows + (size_t)(winSize.y - ImGui::GetCursorPosY()) / ImGui::GetFontSize());
+			ImGui::EndTable();
+		} else if (!grouped && ImGui::BeginTable("##tracetable", 5, flags)) {
+			ImGui::TableSetupColumn("hit", ImGuiTableColumnFlags_WidthFixed);
 			ImGui::TableSetupColumn("addr", ImGuiTableColumnFlags_WidthFixed);
 			ImGui::TableSetupColumn("pc", ImGuiTableColumnFlags_WidthFixed);
 			ImGui::TableSetupColumn("time", ImGuiTableColumnFlags_WidthStretch);
@@ -130,12 +231,12 @@ void TraceView::Draw()
 			ImGui::TableSetupScrollFreeze(0, 1); // Make top row always visible
 			ImGui::TableHeadersRow();
 
-			while (r < numHits)
+			while (r < numRead)
 			{
 				if (ImGui::GetCursorPosY() > (winSize.y - 15.0f)) { break; }
 				ImGui::TableNextRow();
 				ImVec2 curPos = ImGui::GetCursorScreenPos();
-				TraceHit hit = GetTraceHit((int)tracePointNum, r++);
+				const TraceHit& hit = hits[r++];
 				strown<64> str;
 				if( mousePos.x > winPos.x && mousePos.x < (winPos.x+winSize.x) &&
 					mousePos.y > curPos.y && mousePos.y < (curPos.y + ImGui::GetFontSize())) {
@@ -159,17 +260,19 @@ void TraceView::Draw()
 					str.clear();
 				}
 				ImGui::TableSetColumnIndex(0);
+				ImGui::Text("%u", hitIndex[r - 1]);
+				ImGui::TableSetColumnIndex(1);
 				str.append_num(hit.addr, 4, 16);
 				ImGui::Text("%s", str.c_str());
-				ImGui::TableSetColumnIndex(1);
+				ImGui::TableSetColumnIndex(2);
 				str.clear();
 				str.append_num(hit.pc, 4, 16);
 				ImGui::Text("%s", str.c_str());
-				ImGui::TableSetColumnIndex(2);
+				ImGui::TableSetColumnIndex(3);
 				str.clear();
 				str.append_num(hit.line, 0, 10).append('/').append_num(hit.cycle,0,10);
 				ImGui::Text("%s", str.c_str());
-				ImGui::TableSetColumnIndex(3);
+				ImGui::TableSetColumnIndex(4);
 				str.clear();
 				str.append_num(hit.frame, 0, 10);
 				ImGui::Text("%s", str.c_str());
@@ -180,8 +283,11 @@ void TraceView::Draw()
 		}
 
 		if (numHits > 0 && lastDrawnRows > 0 && numHits > (size_t)lastDrawnRows) {
+			// millions of rows would make the bar too thin to grab
 			size_t scrollBarHeight = (lastDrawnRows * size_t(winSize.y)) / numHits;
-			size_t scrollBarTop = (size_t(row) * size_t(winSize.y)) / numHits;
+			if (scrollBarHeight < kMinScrollBar) { scrollBarHeight = kMinScrollBar; }
+			if (scrollBarHeight >= size_t(winSize.y)) { scrollBarHeight = size_t(winSize.y) - 1; }
+			size_t scrollBarTop = (size_t(row) * (size_t(winSize.y) - scrollBarHeight)) / (numHits - lastDrawnRows);
 			ImDrawList* draw_list = ImGui::GetWindowDrawList();
 
 			float x = topLeft.x + winSize.x - 24.0f;
@@ -198,7 +304,7 @@ void TraceView::Draw()
 				float delta = mousePos.y - mouseYLast;
 				if (delta < -0.5f || delta > 0.5f) {
 					mouseYLast = mousePos.y;
-					row += (int)((delta * (numHits - lastDrawnRows)) / winSize.y);
+					row += (int)((delta * (numHits - lastDrawnRows)) / (winSize.y - h));
 					if (row < 0) { row = 0; } else if (((size_t)row + lastDrawnRows) > numHits) {
 						row = (size_t)lastDrawnRows < numHits ? (int)(numHits - lastDrawnRows) : 0;
 					}
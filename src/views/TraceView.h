@@ -3,6 +3,8 @@ struct UserData;
 
 struct TraceView {
 	size_t tracePointNum;
+	char query[256];
+	char queryError[128];
 	int lastDrawnRows;
 	int row;
 	float mouseWheelDiff;
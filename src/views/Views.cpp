@@ -13,6 +13,7 @@
 #include "WatchView.h"
 #include "SymbolView.h"
 #include "SectionView.h"
+#include "StatsView.h"
 #include "GfxView.h"
 #include "PreView.h"
 #include "TraceView.h"
@@ -22,6 +23,9 @@
 #include "../FileDialog.h"
 #include "../SourceDebug.h"
 #include "../StartVice.h"
+#include "../StepBack.h"
+#include "../MemSync.h"
+#include "../Breakpoints.h"
 #include "Views.h"
 #include "GLFW/glfw3.h"
 #include "../Image.h"
@@ -39,6 +43,7 @@ struct ViewContext {
 	BreakpointView breakView;
 	SymbolView symbolView;
 	SectionView sectionView;
+	StatsView statsView;
 	IceConsole console;
 	ScreenView screenView;
 	FVFileView fileView;
@@ -50,7 +55,7 @@ struct ViewContext {
 	int currFont, nextFont;
 	float currFontSize;
 	bool setupDocking;
-	bool memoryWasChanged;
+	bool memoryWasChanged[kNumCPUSlots];	// per CPU slot, the change is cleared after a full frame
 	bool saveSettingsOnExit;
 
 	ViewContext();
@@ -151,7 +156,7 @@ ViewContext::ViewContext() : currFont(3), setupDocking(true), saveSettingsOnExit
 	codeView[0].open = true;
 	watchView[0].open = true;
 	console.open = true;
-	memoryWasChanged = false;
+	memset(memoryWasChanged, 0, sizeof(memoryWasChanged));
 }
 
 void CheckCustomThemeAfterStateLoad() {
@@ -206,6 +211,8 @@ void ViewContext::SaveState(UserData& conf)
 	conf.BeginStruct("Symbols"); symbolView.WriteConfig(conf); conf.EndStruct();
 	// SectionView sectionView;
 	conf.BeginStruct("Sections"); sectionView.WriteConfig(conf); conf.EndStruct();
+	// StatsView statsView;
+	conf.BeginStruct("Stats"); statsView.WriteConfig(conf); conf.EndStruct();
 	// ImFont* aFonts[sNumFontSizes];
 	// IceConsole console;
 	conf.BeginStruct("Console"); console.WriteConfig(conf); conf.EndStruct();
@@ -262,6 +269,7 @@ void ViewContext::LoadState(strref config)
 			else if (name.same_str("Breakpoints")) { breakView.ReadConfig(value); }
 			else if (name.same_str("Symbols")) { symbolView.ReadConfig(value); }
 			else if (name.same_str("Sections")) { sectionView.ReadConfig(value); }
+			else if (name.same_str("Stats")) { statsView.ReadConfig(value); }
 			else if (name.same_str("Console")) { console.ReadConfig(value); }
 			else if (name.same_str("Screen")) { screenView.ReadConfig(value); }
 			else if (name.same_str("Trace")) { traceView.ReadConfig(value); }
@@ -298,7 +306,13 @@ static const char DetachCartridgeCommand[] = "detach 20\n";
 
 void ViewContext::Draw()
 {
-	memoryWasChanged = GetCurrCPU()->MemoryChange();
+	// memory, registers and breakpoints stay the same while the views draw
+	MemSyncPublish();
+	UpdateBreakpointMap();
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		CPU6510* cpu = GetCPUSlot(slot);
+		memoryWasChanged[slot] = cpu && cpu->MemoryChange();
+	}
 	{
 		if (ImGui::BeginMainMenuBar()) {
 			if (ImGui::BeginMenu("File")) {
@@ -362,6 +376,7 @@ void ViewContext::Draw()
 				if (ImGui::MenuItem("Trace", NULL, traceView.open)) { traceView.open = !traceView.open; }
 				if (ImGui::MenuItem("Symbols", NULL, symbolView.open)) { symbolView.open = !symbolView.open; }
 				if (ImGui::MenuItem("Sections", NULL, sectionView.open)) { sectionView.open = !sectionView.open; }
+				if (ImGui::MenuItem("Connection Stats", NULL, statsView.open)) { statsView.open = !statsView.open; }
 				if (ImGui::MenuItem("Toolbar", NULL, toolBar.open)) { toolBar.open = !toolBar.open; }
 				ImGui::EndMenu();
 			}
@@ -426,6 +441,7 @@ void ViewContext::Draw()
 		console.open = true;
 		screenView.open = true;
 		traceView.open = false;
+		statsView.open = false;
 	}
 
 	if (const char* prg = ReadPRGToRAMReady()) { GetCurrCPU()->ReadPRGToRAM(prg); }
@@ -443,13 +459,18 @@ void ViewContext::Draw()
 	sectionView.Draw();
 	preView.Draw();
 	traceView.Draw();
+	statsView.Draw();
 
 	fileView.Draw("Select File");
 	GlobalKeyCheck();
 	ViceTickMessage();
 
-	if (GetCurrCPU()->MemoryChange() && memoryWasChanged) {
-		GetCurrCPU()->WemoryChangeRefreshed();
+	// drive and bank CPUs also change while views draw them
+	for (int slot = 0; slot < kNumCPUSlots; ++slot) {
+		CPU6510* cpu = GetCPUSlot(slot);
+		if (cpu && cpu->MemoryChange() && memoryWasChanged[slot]) {
+			cpu->WemoryChangeRefreshed();
+		}
 	}
 
 	if (nextFont != currFont) {
@@ -481,7 +502,7 @@ void ViewContext::GlobalKeyCheck()
 //		if (ctrl) { StepOverVice(); } else if (shift) { StepOverBack(); } else { StepOver(); }
 	}
 	if (ImGui::IsKeyPressed((ImGuiKey)GLFW_KEY_F11, false)) {
-		if (ctrl) { /*StepInstructionVice();*/ } else if (shift) { ViceStepOut(); } else { ViceStep(); }
+		if (ctrl) { CPUStepBack(); } else if (shift) { ViceStepOut(); } else { ViceStep(); }
 	}
 }
 
@@ -659,6 +680,48 @@ void RefreshScreen(uint8_t* img, uint16_t w, uint16_t h,
 	}
 }
 
+// C64 or drive memory, a drive CPU is only fetched while a view shows it
+bool MemSpaceCombo(int* space)
+{
+	bool changed = false;
+	ImGui::SetNextItemWidth(ImGui::CalcTextSize("Drive 10").x + ImGui::GetFrameHeight() + ImGui::GetStyle().FramePadding.x * 2.0f);
+	if (ImGui::BeginCombo("##memspace", MemSpaceName((VICEMemSpaces)*space))) {
+		for (int s = (int)VICEMemSpaces::MainMemory; s <= (int)VICEMemSpaces::Drive11; ++s) {
+			if (ImGui::Selectable(MemSpaceName((VICEMemSpaces)s), *space == s)) {
+				changed = *space != s;
+				*space = s;
+			}
+		}
+		ImGui::EndCombo();
+	}
+	return changed;
+}
+
+// VICE memory bank of the C64, hidden until VICE has listed its banks
+bool BankCombo(int* bank)
+{
+	int numBanks = ViceNumBanks();
+	if (!numBanks && !*bank) { return false; }
+	bool changed = false;
+	ImGui::SetNextItemWidth(ImGui::CalcTextSize("default").x + ImGui::GetFrameHeight() + ImGui::GetStyle().FramePadding.x * 2.0f);
+	if (ImGui::BeginCombo("##bank", ViceBankNameByID((uint16_t)*bank))) {
+		for (int b = 0; b < numBanks; ++b) {
+			int id = ViceBankID(b);
+			if (ImGui::Selectable(ViceBankName(b), *bank == id)) {
+				changed = *bank != id;
+				*bank = id;
+			}
+		}
+		ImGui::EndCombo();
+	}
+	return changed;
+}
+
+bool ScreenViewVisible()
+{
+	return viewContext && viewContext->screenView.visible;
+}
+
 FVFileView* GetFileView()
 {
 	if (viewContext) {
@@ -22,6 +22,9 @@ uint8_t InputHex();
 void SelectFont(int size);
 void RefreshScreen(uint8_t* img, uint16_t w, uint16_t h,
 	uint16_t sx, uint16_t sy, uint16_t sw, uint16_t sh);
+bool ScreenViewVisible();
+bool MemSpaceCombo(int* space);
+bool BankCombo(int* bank);
 bool LoadUserFont(const char* file, int size);
 void CheckUserFont();
 bool UseCustomFont();